@@ -103,6 +103,9 @@ var (
 			"if true, TextColor and BackgroundColor of the document will be swapped"),
 		mkField("HideScrollbars", Bool, false,
 			"if true, hides the scrollbars but retains ability to scroll"),
+		mkField("TileCacheSize", Int, 0,
+			"maximum size (in MB) of the on-disk cache of rendered pages which allows showing "+
+				"re-opened documents without rendering them again; 0 disables the cache").setExpert().setVersion("3.6"),
 	}
 
 	comicBookUI = []*Field{
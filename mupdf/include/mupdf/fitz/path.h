@@ -100,6 +100,16 @@ typedef struct
 */
 void fz_walk_path(fz_context *ctx, const fz_path *path, const fz_path_walker *walker, void *arg);
 
+/**
+	SumatraPDF: Check whether a path, transformed by ctm, spans more
+	than size in either direction.
+
+	Stops at the first point that is far enough from the previous
+	ones, so (unlike fz_bound_path) this is cheap for all but small
+	paths.
+*/
+int fz_path_exceeds_size(fz_context *ctx, const fz_path *path, fz_matrix ctm, float size);
+
 /**
 	Create a new (empty) path structure.
 */
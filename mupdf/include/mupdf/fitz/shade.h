@@ -51,7 +51,8 @@ enum
 */
 typedef struct
 {
-	fz_storable storable;
+	/* SumatraPDF: key storable so that rasterized tiles can be cached in the store */
+	fz_key_storable key_storable;
 
 	fz_rect bbox;		/* can be fz_infinite_rect */
 	fz_colorspace *colorspace;
@@ -118,6 +119,10 @@ fz_shade *fz_keep_shade(fz_context *ctx, fz_shade *shade);
 */
 void fz_drop_shade(fz_context *ctx, fz_shade *shade);
 
+/* SumatraPDF: references held by store keys (see fz_keep_image_store_key) */
+fz_shade *fz_keep_shade_store_key(fz_context *ctx, fz_shade *shade);
+void fz_drop_shade_store_key(fz_context *ctx, fz_shade *shade);
+
 /**
 	Bound a given shading.
 
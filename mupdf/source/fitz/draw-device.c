@@ -669,6 +669,25 @@ push_group_for_separations(fz_context *ctx, fz_draw_device *dev, fz_color_params
 	return &dev->stack[1];
 }
 
+/* SumatraPDF: paths collapsed by fz_lod_path() are rasterized as their lod_rect.
+ * The shape of a group gets the coverage without alpha, so skipping
+ * has to be decided based on coverage alone in that case. */
+static int
+flatten_fill_lod(fz_context *ctx, fz_rasterizer *rast, const fz_path *path, fz_matrix ctm, float flatness, const fz_rect *lod_rect, fz_irect scissor, fz_irect *bbox)
+{
+	if (lod_rect)
+		return fz_flatten_lod_rect(ctx, rast, *lod_rect, scissor, bbox);
+	return fz_flatten_fill_path(ctx, rast, path, ctm, flatness, scissor, bbox);
+}
+
+static int
+flatten_stroke_lod(fz_context *ctx, fz_rasterizer *rast, const fz_path *path, const fz_stroke_state *stroke, fz_matrix ctm, float flatness, float linewidth, const fz_rect *lod_rect, fz_irect scissor, fz_irect *bbox)
+{
+	if (lod_rect)
+		return fz_flatten_lod_rect(ctx, rast, *lod_rect, scissor, bbox);
+	return fz_flatten_stroke_path(ctx, rast, path, stroke, ctm, flatness, linewidth, scissor, bbox);
+}
+
 static void
 fz_draw_fill_path(fz_context *ctx, fz_device *devp, const fz_path *path, int even_odd, fz_matrix in_ctm,
 	fz_colorspace *colorspace_in, const float *color, float alpha, fz_color_params color_params)
@@ -684,9 +703,8 @@ fz_draw_fill_path(fz_context *ctx, fz_device *devp, const fz_path *path, int eve
 	fz_draw_state *state = &dev->stack[dev->top];
 	fz_overprint op = { { 0 } };
 	fz_overprint *eop;
-
-	if (dev->top == 0 && dev->resolve_spots)
-		state = push_group_for_separations(ctx, dev, color_params, dev->default_cs);
+	fz_rect lod_buf;
+	fz_rect *lod_rect = NULL;
 
 	if (expansion < FLT_EPSILON)
 		expansion = 1;
@@ -694,8 +712,23 @@ fz_draw_fill_path(fz_context *ctx, fz_device *devp, const fz_path *path, int eve
 	if (flatness < 0.001f)
 		flatness = 0.001f;
 
+	if (!(dev->flags & FZ_DRAWDEV_FLAGS_TYPE3))
+	{
+		switch (fz_lod_path(ctx, rast, path, NULL, ctm, flatness, 0, state->shape ? 1 : alpha, &lod_buf))
+		{
+		case FZ_LOD_SKIP:
+			return;
+		case FZ_LOD_RECT:
+			lod_rect = &lod_buf;
+			break;
+		}
+	}
+
+	if (dev->top == 0 && dev->resolve_spots)
+		state = push_group_for_separations(ctx, dev, color_params, dev->default_cs);
+
 	bbox = fz_intersect_irect(fz_pixmap_bbox(ctx, state->dest), state->scissor);
-	if (fz_flatten_fill_path(ctx, rast, path, ctm, flatness, bbox, &bbox))
+	if (flatten_fill_lod(ctx, rast, path, ctm, flatness, lod_rect, bbox, &bbox))
 		return;
 
 	if (alpha == 0)
@@ -710,7 +743,7 @@ fz_draw_fill_path(fz_context *ctx, fz_device *devp, const fz_path *path, int eve
 	if (state->shape)
 	{
 		if (!rast->fns.reusable)
-			fz_flatten_fill_path(ctx, rast, path, ctm, flatness, bbox, NULL);
+			flatten_fill_lod(ctx, rast, path, ctm, flatness, lod_rect, bbox, NULL);
 
 		colorbv[0] = 255;
 		fz_convert_rasterizer(ctx, rast, even_odd, state->shape, colorbv, 0);
@@ -718,7 +751,7 @@ fz_draw_fill_path(fz_context *ctx, fz_device *devp, const fz_path *path, int eve
 	if (state->group_alpha)
 	{
 		if (!rast->fns.reusable)
-			fz_flatten_fill_path(ctx, rast, path, ctm, flatness, bbox, NULL);
+			flatten_fill_lod(ctx, rast, path, ctm, flatness, lod_rect, bbox, NULL);
 
 		colorbv[0] = alpha * 255;
 		fz_convert_rasterizer(ctx, rast, even_odd, state->group_alpha, colorbv, 0);
@@ -746,6 +779,8 @@ fz_draw_stroke_path(fz_context *ctx, fz_device *devp, const fz_path *path, const
 	float mlw = fz_rasterizer_graphics_min_line_width(rast);
 	fz_overprint op = { { 0 } };
 	fz_overprint *eop;
+	fz_rect lod_buf;
+	fz_rect *lod_rect = NULL;
 
 	if (dev->top == 0 && dev->resolve_spots)
 		state = push_group_for_separations(ctx, dev, color_params, dev->default_cs);
@@ -760,8 +795,20 @@ fz_draw_stroke_path(fz_context *ctx, fz_device *devp, const fz_path *path, const
 	if (flatness < 0.001f)
 		flatness = 0.001f;
 
+	if (!(dev->flags & FZ_DRAWDEV_FLAGS_TYPE3))
+	{
+		switch (fz_lod_path(ctx, rast, path, stroke, ctm, flatness, linewidth, state->shape ? 1 : alpha, &lod_buf))
+		{
+		case FZ_LOD_SKIP:
+			return;
+		case FZ_LOD_RECT:
+			lod_rect = &lod_buf;
+			break;
+		}
+	}
+
 	bbox = fz_intersect_irect(fz_pixmap_bbox_no_ctx(state->dest), state->scissor);
-	if (fz_flatten_stroke_path(ctx, rast, path, stroke, ctm, flatness, linewidth, bbox, &bbox))
+	if (flatten_stroke_lod(ctx, rast, path, stroke, ctm, flatness, linewidth, lod_rect, bbox, &bbox))
 		return;
 
 	if (alpha == 0)
@@ -785,7 +832,7 @@ fz_draw_stroke_path(fz_context *ctx, fz_device *devp, const fz_path *path, const
 	if (state->shape)
 	{
 		if (!rast->fns.reusable)
-			(void)fz_flatten_stroke_path(ctx, rast, path, stroke, ctm, flatness, linewidth, bbox, NULL);
+			(void)flatten_stroke_lod(ctx, rast, path, stroke, ctm, flatness, linewidth, lod_rect, bbox, NULL);
 
 		colorbv[0] = 255;
 		fz_convert_rasterizer(ctx, rast, 0, state->shape, colorbv, 0);
@@ -793,7 +840,7 @@ fz_draw_stroke_path(fz_context *ctx, fz_device *devp, const fz_path *path, const
 	if (state->group_alpha)
 	{
 		if (!rast->fns.reusable)
-			(void)fz_flatten_stroke_path(ctx, rast, path, stroke, ctm, flatness, linewidth, bbox, NULL);
+			(void)flatten_stroke_lod(ctx, rast, path, stroke, ctm, flatness, linewidth, lod_rect, bbox, NULL);
 
 		colorbv[0] = 255 * alpha;
 		fz_convert_rasterizer(ctx, rast, 0, state->group_alpha, colorbv, 0);
@@ -27,6 +27,7 @@
 #include "pixmap-imp.h"
 
 #include <assert.h>
+#include <float.h>
 #include <math.h>
 
 enum { MAXN = 2 + FZ_MAX_COLORS };
@@ -272,6 +273,413 @@ fz_drop_shade_color_cache(fz_context *ctx, fz_shade_color_cache *cache)
 	fz_free(ctx, cache);
 }
 
+/* SumatraPDF: rasterized mesh shadings are cached in the store as fixed size
+ * tiles in a canonical device space. The canonical transform keeps the
+ * orientation of the shading but rounds its scale up to the next quarter power
+ * of two, so that adjacent tiles of a page as well as nearby zoom levels sample
+ * the cached raster (downscaling it by at most 2^0.25) instead of decoding and
+ * tessellating the mesh again. Memory is bounded by the store. */
+
+enum { SHADE_TILE_SIZE = 256 };
+/* smaller areas are cheaper to paint than to cache */
+enum { SHADE_CACHE_MIN_AREA = SHADE_TILE_SIZE * SHADE_TILE_SIZE };
+/* larger areas would only churn the store */
+enum { SHADE_CACHE_MAX_TILES = 256, SHADE_CACHE_MAX_SIDE = 64 };
+/* number of tiles rendered ahead around a request */
+enum { SHADE_CACHE_PREFETCH_TILES = 64 };
+
+typedef struct
+{
+	int refs;
+	fz_shade *shade;
+	fz_matrix ctm;		/* shade space to canonical device space */
+	fz_colorspace *src;	/* NULL if the tile holds function indices */
+	fz_colorspace *dst;
+	fz_color_params params;
+	int tx, ty;
+} fz_shade_tile_key;
+
+static int
+fz_make_hash_shade_tile_key(fz_context *ctx, fz_store_hash *hash, void *key_)
+{
+	fz_shade_tile_key *key = (fz_shade_tile_key *)key_;
+	hash->u.im.ptr = key->shade;
+	hash->u.im.id = (key->ty << 16) ^ key->tx;
+	hash->u.im.m[0] = key->ctm.a;
+	hash->u.im.m[1] = key->ctm.b;
+	hash->u.im.m[2] = key->ctm.c;
+	hash->u.im.m[3] = key->ctm.d;
+	return 1;
+}
+
+static void *
+fz_keep_shade_tile_key(fz_context *ctx, void *key_)
+{
+	fz_shade_tile_key *key = (fz_shade_tile_key *)key_;
+	return fz_keep_imp(ctx, key, &key->refs);
+}
+
+static void
+fz_drop_shade_tile_key(fz_context *ctx, void *key_)
+{
+	fz_shade_tile_key *key = (fz_shade_tile_key *)key_;
+	if (fz_drop_imp(ctx, key, &key->refs))
+	{
+		fz_drop_shade_store_key(ctx, key->shade);
+		fz_drop_colorspace_store_key(ctx, key->src);
+		fz_drop_colorspace_store_key(ctx, key->dst);
+		fz_free(ctx, key);
+	}
+}
+
+static int
+fz_cmp_shade_tile_key(fz_context *ctx, void *k0_, void *k1_)
+{
+	fz_shade_tile_key *k0 = (fz_shade_tile_key *)k0_;
+	fz_shade_tile_key *k1 = (fz_shade_tile_key *)k1_;
+	return k0->shade == k1->shade &&
+		k0->ctm.a == k1->ctm.a && k0->ctm.b == k1->ctm.b &&
+		k0->ctm.c == k1->ctm.c && k0->ctm.d == k1->ctm.d &&
+		k0->ctm.e == k1->ctm.e && k0->ctm.f == k1->ctm.f &&
+		k0->src == k1->src && k0->dst == k1->dst &&
+		k0->params.ri == k1->params.ri && k0->params.bp == k1->params.bp &&
+		k0->params.op == k1->params.op && k0->params.opm == k1->params.opm &&
+		k0->tx == k1->tx && k0->ty == k1->ty;
+}
+
+static void
+fz_format_shade_tile_key(fz_context *ctx, char *s, size_t n, void *key_)
+{
+	fz_shade_tile_key *key = (fz_shade_tile_key *)key_;
+	fz_snprintf(s, n, "(shade type=%d tile=%d,%d scale=%g)", key->shade->type, key->tx, key->ty,
+		sqrtf(fabsf(key->ctm.a * key->ctm.d - key->ctm.b * key->ctm.c)));
+}
+
+static int
+fz_needs_reap_shade_tile_key(fz_context *ctx, void *key_)
+{
+	fz_shade_tile_key *key = (fz_shade_tile_key *)key_;
+	const fz_key_storable *ks = &key->shade->key_storable;
+	return ks->store_key_refs == ks->storable.refs;
+}
+
+static const fz_store_type fz_shade_tile_store_type =
+{
+	"fz_shade_tile",
+	fz_make_hash_shade_tile_key,
+	fz_keep_shade_tile_key,
+	fz_drop_shade_tile_key,
+	fz_cmp_shade_tile_key,
+	fz_format_shade_tile_key,
+	fz_needs_reap_shade_tile_key
+};
+
+static int
+floor_div_tile(int v)
+{
+	return v >= 0 ? v / SHADE_TILE_SIZE : -((SHADE_TILE_SIZE - 1 - v) / SHADE_TILE_SIZE);
+}
+
+/* Returns the canonical transform for ctm or 0 if the shading shouldn't be cached. */
+static int
+shade_cache_transform(fz_shade *shade, fz_matrix ctm, fz_irect bbox, fz_matrix *canon)
+{
+	float s, sc;
+
+	/* function based, axial and radial shadings are painted as a few
+	 * large quads, which is as fast as resampling a cached raster */
+	if (shade->type < FZ_MESH_TYPE4)
+		return 0;
+	if ((int64_t)(bbox.x1 - bbox.x0) * (bbox.y1 - bbox.y0) < SHADE_CACHE_MIN_AREA)
+		return 0;
+
+	s = sqrtf(fabsf(ctm.a * ctm.d - ctm.b * ctm.c));
+	if (!(s > FLT_EPSILON && s < 1e5f))
+		return 0;
+	sc = powf(2, ceilf(log2f(s) * 4 - 0.001f) / 4);
+
+	canon->a = roundf(ctm.a / s * 1024) / 1024 * sc;
+	canon->b = roundf(ctm.b / s * 1024) / 1024 * sc;
+	canon->c = roundf(ctm.c / s * 1024) / 1024 * sc;
+	canon->d = roundf(ctm.d / s * 1024) / 1024 * sc;
+	canon->e = 0;
+	canon->f = 0;
+	return fabsf(canon->a * canon->d - canon->b * canon->c) > FLT_EPSILON;
+}
+
+/* Resample src into dst; m maps dst device space to src device space. If
+ * unpremul is set, the first component is made independent of alpha again
+ * (function indices must not be premultiplied). */
+static void
+sample_shade_raster(fz_context *ctx, fz_pixmap *dst, fz_pixmap *src, fz_matrix m, int unpremul)
+{
+	unsigned char *d = dst->samples;
+	int n = dst->n;
+	int x, y, k;
+	int *cols;
+
+	/* pure integer translation: copy */
+	if (fabsf(m.a - 1) < 1e-5f && fabsf(m.b) < 1e-5f && fabsf(m.c) < 1e-5f && fabsf(m.d - 1) < 1e-5f &&
+		fabsf(m.e - roundf(m.e)) < 1e-3f && fabsf(m.f - roundf(m.f)) < 1e-3f)
+	{
+		int dx = (int)roundf(m.e);
+		int dy = (int)roundf(m.f);
+		for (y = 0; y < dst->h; y++)
+		{
+			int sy = fz_clampi(dst->y + y + dy - src->y, 0, src->h - 1);
+			int sx = dst->x + dx - src->x;
+			unsigned char *s = src->samples + sy * (size_t)src->stride;
+			for (x = 0; x < dst->w; x++)
+			{
+				unsigned char *sp = s + fz_clampi(sx + x, 0, src->w - 1) * (size_t)n;
+				for (k = 0; k < n; k++)
+					*d++ = sp[k];
+			}
+			d += dst->stride - dst->w * (size_t)n;
+		}
+		return;
+	}
+
+	/* axis aligned: the horizontal sample positions are the same for all rows */
+	if (m.b == 0 && m.c == 0)
+	{
+		cols = fz_malloc(ctx, dst->w * 3 * sizeof(int));
+		for (x = 0; x < dst->w; x++)
+		{
+			int u = (int)(((dst->x + x + 0.5f) * m.a + m.e - src->x - 0.5f) * 256);
+			cols[3 * x] = fz_clampi(u >> 8, 0, src->w - 1) * n;
+			cols[3 * x + 1] = fz_clampi((u >> 8) + 1, 0, src->w - 1) * n;
+			cols[3 * x + 2] = u & 255;
+		}
+		for (y = 0; y < dst->h; y++)
+		{
+			int v = (int)(((dst->y + y + 0.5f) * m.d + m.f - src->y - 0.5f) * 256);
+			int fy = v & 255;
+			unsigned char *r0 = src->samples + fz_clampi(v >> 8, 0, src->h - 1) * (size_t)src->stride;
+			unsigned char *r1 = src->samples + fz_clampi((v >> 8) + 1, 0, src->h - 1) * (size_t)src->stride;
+			for (x = 0; x < dst->w; x++)
+			{
+				int c0 = cols[3 * x];
+				int c1 = cols[3 * x + 1];
+				int fx = cols[3 * x + 2];
+				for (k = 0; k < n; k++)
+				{
+					int top = r0[c0 + k] * (256 - fx) + r0[c1 + k] * fx;
+					int bot = r1[c0 + k] * (256 - fx) + r1[c1 + k] * fx;
+					d[k] = (top * (256 - fy) + bot * fy + 32768) >> 16;
+				}
+				if (unpremul)
+				{
+					int a = d[n - 1];
+					d[0] = a ? fz_mini(255, (d[0] * 255 + a / 2) / a) : 0;
+				}
+				d += n;
+			}
+			d += dst->stride - dst->w * (size_t)n;
+		}
+		fz_free(ctx, cols);
+		return;
+	}
+
+	for (y = 0; y < dst->h; y++)
+	{
+		float px = dst->x + 0.5f;
+		float py = dst->y + y + 0.5f;
+		/* sample positions relative to src pixel centers */
+		float u0 = px * m.a + py * m.c + m.e - src->x - 0.5f;
+		float v0 = px * m.b + py * m.d + m.f - src->y - 0.5f;
+		for (x = 0; x < dst->w; x++)
+		{
+			/* in 16.16 fixed point, src is smaller than 32K pixels */
+			int u = (int)((u0 + x * m.a) * 65536);
+			int v = (int)((v0 + x * m.b) * 65536);
+			int x0 = u >> 16;
+			int y0 = v >> 16;
+			int fx = (u >> 8) & 255;
+			int fy = (v >> 8) & 255;
+			int x1 = fz_clampi(x0 + 1, 0, src->w - 1);
+			int y1 = fz_clampi(y0 + 1, 0, src->h - 1);
+			unsigned char *s00, *s01, *s10, *s11;
+			x0 = fz_clampi(x0, 0, src->w - 1);
+			y0 = fz_clampi(y0, 0, src->h - 1);
+			s00 = src->samples + y0 * (size_t)src->stride + x0 * (size_t)n;
+			s01 = src->samples + y0 * (size_t)src->stride + x1 * (size_t)n;
+			s10 = src->samples + y1 * (size_t)src->stride + x0 * (size_t)n;
+			s11 = src->samples + y1 * (size_t)src->stride + x1 * (size_t)n;
+			for (k = 0; k < n; k++)
+			{
+				int top = s00[k] * (256 - fx) + s01[k] * fx;
+				int bot = s10[k] * (256 - fx) + s11[k] * fx;
+				d[k] = (top * (256 - fy) + bot * fy + 32768) >> 16;
+			}
+			if (unpremul)
+			{
+				int a = d[n - 1];
+				d[0] = a ? fz_mini(255, (d[0] * 255 + a / 2) / a) : 0;
+			}
+			d += n;
+		}
+		d += dst->stride - dst->w * (size_t)n;
+	}
+}
+
+/* Fills ptd->dest (which must be cleared and have alpha) from cached tiles,
+ * rendering the missing ones. */
+static void
+paint_shade_from_cache(fz_context *ctx, fz_shade *shade, fz_colorspace *colorspace, fz_color_params color_params,
+	fz_matrix ctm, fz_matrix canon, struct paint_tri_data *ptd)
+{
+	fz_pixmap *dest = ptd->dest;
+	fz_irect bbox = ptd->bbox;
+	fz_shade_tile_key key = { 0 };
+	fz_shade_tile_key *keyp = NULL;
+	fz_pixmap **tiles = NULL;
+	fz_pixmap *area = NULL;
+	fz_pixmap *raster = NULL;
+	fz_matrix m;
+	fz_irect r, sb, missing = fz_empty_irect;
+	int tx0, ty0, tx1, ty1, wx0, wy0, wx1, wy1, ww, wh, grown, i, x, y;
+
+	fz_var(tiles);
+	fz_var(area);
+	fz_var(raster);
+	fz_var(keyp);
+
+	/* dest device space to canonical device space */
+	m = fz_concat(fz_invert_matrix(ctm), canon);
+	r = fz_irect_from_rect(fz_expand_rect(fz_transform_rect(fz_rect_from_irect(bbox), m), 1));
+	tx0 = floor_div_tile(r.x0);
+	ty0 = floor_div_tile(r.y0);
+	tx1 = floor_div_tile(r.x1 - 1) + 1;
+	ty1 = floor_div_tile(r.y1 - 1) + 1;
+	ww = tx1 - tx0;
+	wh = ty1 - ty0;
+	if (ww <= 0 || wh <= 0 || ww > SHADE_CACHE_MAX_SIDE || wh > SHADE_CACHE_MAX_SIDE || ww * wh > SHADE_CACHE_MAX_TILES)
+	{
+		fz_process_shade(ctx, shade, ctm, fz_rect_from_irect(bbox), prepare_mesh_vertex, &do_paint_tri, ptd);
+		return;
+	}
+
+	/* Processing a mesh costs about the same for one tile as for all of it,
+	 * so the tiles around the request (within the bounds of the shading)
+	 * are rendered in the same pass, for the adjacent tiles of the page. */
+	sb = fz_irect_from_rect(fz_bound_shade(ctx, shade, fz_concat(fz_invert_matrix(shade->matrix), canon)));
+	wx0 = tx0;
+	wy0 = ty0;
+	wx1 = tx1;
+	wy1 = ty1;
+	do
+	{
+		grown = 0;
+		if (wx0 * SHADE_TILE_SIZE > sb.x0 && (wx1 - wx0 + 1) * (wy1 - wy0) <= SHADE_CACHE_PREFETCH_TILES)
+			wx0--, grown = 1;
+		if (wx1 * SHADE_TILE_SIZE < sb.x1 && (wx1 - wx0 + 1) * (wy1 - wy0) <= SHADE_CACHE_PREFETCH_TILES)
+			wx1++, grown = 1;
+		if (wy0 * SHADE_TILE_SIZE > sb.y0 && (wx1 - wx0) * (wy1 - wy0 + 1) <= SHADE_CACHE_PREFETCH_TILES)
+			wy0--, grown = 1;
+		if (wy1 * SHADE_TILE_SIZE < sb.y1 && (wx1 - wx0) * (wy1 - wy0 + 1) <= SHADE_CACHE_PREFETCH_TILES)
+			wy1++, grown = 1;
+	}
+	while (grown);
+	ww = wx1 - wx0;
+	wh = wy1 - wy0;
+
+	key.shade = shade;
+	key.ctm = canon;
+	if (!shade->function_stride)
+	{
+		key.src = colorspace;
+		key.dst = dest->colorspace;
+		key.params = color_params;
+	}
+
+	fz_try(ctx)
+	{
+		tiles = fz_calloc(ctx, (size_t)ww * wh, sizeof(*tiles));
+		for (y = 0; y < wh; y++)
+		{
+			for (x = 0; x < ww; x++)
+			{
+				key.tx = wx0 + x;
+				key.ty = wy0 + y;
+				tiles[y * ww + x] = fz_find_item(ctx, fz_drop_pixmap_imp, &key, &fz_shade_tile_store_type);
+				if (!tiles[y * ww + x])
+				{
+					missing.x0 = fz_mini(missing.x0, key.tx * SHADE_TILE_SIZE);
+					missing.y0 = fz_mini(missing.y0, key.ty * SHADE_TILE_SIZE);
+					missing.x1 = fz_maxi(missing.x1, (key.tx + 1) * SHADE_TILE_SIZE);
+					missing.y1 = fz_maxi(missing.y1, (key.ty + 1) * SHADE_TILE_SIZE);
+				}
+			}
+		}
+
+		if (!fz_is_empty_irect(missing))
+		{
+			/* process the shading once for all the missing tiles */
+			area = fz_new_pixmap_with_bbox(ctx, dest->colorspace, missing, NULL, 1);
+			fz_clear_pixmap(ctx, area);
+			ptd->dest = area;
+			ptd->bbox = missing;
+			fz_process_shade(ctx, shade, canon, fz_rect_from_irect(missing), prepare_mesh_vertex, &do_paint_tri, ptd);
+
+			for (y = 0; y < wh; y++)
+			{
+				for (x = 0; x < ww; x++)
+				{
+					fz_pixmap *tile, *existing;
+					fz_irect tr;
+					if (tiles[y * ww + x])
+						continue;
+					key.tx = wx0 + x;
+					key.ty = wy0 + y;
+					tr = fz_make_irect(key.tx * SHADE_TILE_SIZE, key.ty * SHADE_TILE_SIZE,
+						(key.tx + 1) * SHADE_TILE_SIZE, (key.ty + 1) * SHADE_TILE_SIZE);
+					tile = tiles[y * ww + x] = fz_new_pixmap_with_bbox(ctx, dest->colorspace, tr, NULL, 1);
+					fz_copy_pixmap_rect(ctx, tile, area, tr, NULL);
+
+					keyp = fz_malloc_struct(ctx, fz_shade_tile_key);
+					*keyp = key;
+					keyp->refs = 1;
+					keyp->shade = fz_keep_shade_store_key(ctx, shade);
+					keyp->src = fz_keep_colorspace_store_key(ctx, key.src);
+					keyp->dst = fz_keep_colorspace_store_key(ctx, key.dst);
+					existing = fz_store_item(ctx, keyp, tile, fz_pixmap_size(ctx, tile), &fz_shade_tile_store_type);
+					if (existing)
+					{
+						/* rendered by a racing thread */
+						fz_drop_pixmap(ctx, tile);
+						tiles[y * ww + x] = existing;
+					}
+					fz_drop_shade_tile_key(ctx, keyp);
+					keyp = NULL;
+				}
+			}
+			fz_drop_pixmap(ctx, area);
+			area = NULL;
+		}
+
+		raster = fz_new_pixmap_with_bbox(ctx, dest->colorspace, r, NULL, 1);
+		for (i = 0; i < ww * wh; i++)
+			fz_copy_pixmap_rect(ctx, raster, tiles[i], fz_pixmap_bbox(ctx, tiles[i]), NULL);
+		sample_shade_raster(ctx, dest, raster, m, shade->function_stride != 0);
+	}
+	fz_always(ctx)
+	{
+		ptd->dest = dest;
+		ptd->bbox = bbox;
+		if (tiles)
+			for (i = 0; i < ww * wh; i++)
+				fz_drop_pixmap(ctx, tiles[i]);
+		fz_free(ctx, tiles);
+		fz_drop_pixmap(ctx, area);
+		fz_drop_pixmap(ctx, raster);
+		if (keyp)
+			fz_drop_shade_tile_key(ctx, keyp);
+	}
+	fz_catch(ctx)
+		fz_rethrow(ctx);
+}
+
 void
 fz_paint_shade(fz_context *ctx, fz_shade *shade, fz_colorspace *colorspace, fz_matrix ctm, fz_pixmap *dest, fz_color_params color_params, fz_irect bbox, const fz_overprint *eop, fz_shade_color_cache **color_cache)
 {
@@ -287,12 +695,15 @@ fz_paint_shade(fz_context *ctx, fz_shade *shade, fz_colorspace *colorspace, fz_m
 	int recache = 0;
 	int recache2 = 0;
 	int stride = shade->function_stride;
+	fz_matrix canon;
+	int cached = 0;
 
 	fz_var(temp);
 	fz_var(conv);
 	fz_var(recache);
 	fz_var(recache2);
 	fz_var(cc);
+	fz_var(cached);
 
 	if (colorspace == NULL)
 		colorspace = shade->colorspace;
@@ -308,12 +719,22 @@ fz_paint_shade(fz_context *ctx, fz_shade *shade, fz_colorspace *colorspace, fz_m
 	{
 		local_ctm = fz_concat(shade->matrix, ctm);
 
+		/* SumatraPDF: see paint_shade_from_cache */
+		cached = shade_cache_transform(shade, local_ctm, bbox, &canon);
+		if (!stride && (dest->seps || eop))
+			cached = 0;
+
 		if (stride)
 		{
 			/* We need to use alpha = 1 here, because the shade might not fill the bbox. */
 			temp = fz_new_pixmap_with_bbox(ctx, fz_device_gray(ctx), bbox, NULL, 1);
 			fz_clear_pixmap(ctx, temp);
 		}
+		else if (cached)
+		{
+			temp = fz_new_pixmap_with_bbox(ctx, dest->colorspace, bbox, NULL, 1);
+			fz_clear_pixmap(ctx, temp);
+		}
 		else
 		{
 			temp = dest;
@@ -352,7 +773,10 @@ fz_paint_shade(fz_context *ctx, fz_shade *shade, fz_colorspace *colorspace, fz_m
 			}
 		}
 
-		fz_process_shade(ctx, shade, local_ctm, fz_rect_from_irect(bbox), prepare_mesh_vertex, &do_paint_tri, &ptd);
+		if (cached)
+			paint_shade_from_cache(ctx, shade, colorspace, color_params, local_ctm, canon, &ptd);
+		else
+			fz_process_shade(ctx, shade, local_ctm, fz_rect_from_irect(bbox), prepare_mesh_vertex, &do_paint_tri, &ptd);
 
 		if (stride)
 		{
@@ -483,6 +907,10 @@ fz_paint_shade(fz_context *ctx, fz_shade *shade, fz_colorspace *colorspace, fz_m
 			}
 			fz_paint_pixmap_with_overprint(dest, conv, eop);
 		}
+		else if (cached)
+		{
+			fz_paint_pixmap(dest, temp, 255);
+		}
 	}
 	fz_always(ctx)
 	{
@@ -511,6 +939,10 @@ fz_paint_shade(fz_context *ctx, fz_shade *shade, fz_colorspace *colorspace, fz_m
 			fz_drop_pixmap(ctx, temp);
 			fz_drop_pixmap(ctx, conv);
 		}
+		else if (temp != dest)
+		{
+			fz_drop_pixmap(ctx, temp);
+		}
 	}
 	fz_catch(ctx)
 		fz_rethrow(ctx);
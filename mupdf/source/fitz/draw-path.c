@@ -170,6 +170,30 @@ quad(fz_context *ctx, fz_rasterizer *rast, fz_matrix ctm, float flatness,
 	quad(ctx, rast, ctm, flatness, xabc, yabc, xbc, ybc, xc, yc, depth + 1);
 }
 
+/*
+	SumatraPDF: polyline simplification.
+
+	Dense vector content (maps, CAD drawings) often has runs of line
+	segments that are much shorter than a pixel at the current zoom.
+	Every one of them costs an edge in the rasterizer. When simplify is
+	set, a lineto whose end point is within flatness (in both x and y)
+	of the last emitted point is not emitted; the run of such points is
+	replaced by a single segment when the next point is far enough away
+	(or the subpath ends). The emitted outline stays within flatness of
+	the original one, i.e. within the tolerance already used for
+	flattening curves (0.3 device pixels).
+
+	The edgebuffer rasterizers (aa levels 9 and 10) are used when it
+	matters exactly which pixels a path touches, so no simplification
+	is done for them.
+*/
+
+static int
+can_simplify(fz_rasterizer *rast)
+{
+	return fz_rasterizer_graphics_aa_level(rast) <= 8;
+}
+
 typedef struct
 {
 	fz_rasterizer *rast;
@@ -177,14 +201,30 @@ typedef struct
 	float flatness;
 	fz_point b;
 	fz_point c;
+	/* SumatraPDF: last emitted point, if c is not emitted yet */
+	fz_point e;
+	int pending;
+	int simplify;
 }
 flatten_arg;
 
+static void
+flatten_flush(fz_context *ctx, flatten_arg *arg)
+{
+	if (arg->pending)
+	{
+		line(ctx, arg->rast, arg->ctm, arg->e.x, arg->e.y, arg->c.x, arg->c.y);
+		arg->pending = 0;
+	}
+}
+
 static void
 flatten_moveto(fz_context *ctx, void *arg_, float x, float y)
 {
 	flatten_arg *arg = (flatten_arg *)arg_;
 
+	flatten_flush(ctx, arg);
+
 	/* implicit closepath before moveto */
 	if (arg->c.x != arg->b.x || arg->c.y != arg->b.y)
 		line(ctx, arg->rast, arg->ctm, arg->c.x, arg->c.y, arg->b.x, arg->b.y);
@@ -199,7 +239,22 @@ flatten_lineto(fz_context *ctx, void *arg_, float x, float y)
 {
 	flatten_arg *arg = (flatten_arg *)arg_;
 
-	line(ctx, arg->rast, arg->ctm, arg->c.x, arg->c.y, x, y);
+	if (arg->simplify)
+	{
+		if (!arg->pending)
+			arg->e = arg->c;
+		if (fz_abs(x - arg->e.x) < arg->flatness && fz_abs(y - arg->e.y) < arg->flatness)
+		{
+			arg->c.x = x;
+			arg->c.y = y;
+			arg->pending = 1;
+			return;
+		}
+		line(ctx, arg->rast, arg->ctm, arg->e.x, arg->e.y, x, y);
+		arg->pending = 0;
+	}
+	else
+		line(ctx, arg->rast, arg->ctm, arg->c.x, arg->c.y, x, y);
 	arg->c.x = x;
 	arg->c.y = y;
 }
@@ -209,6 +264,7 @@ flatten_curveto(fz_context *ctx, void *arg_, float x1, float y1, float x2, float
 {
 	flatten_arg *arg = (flatten_arg *)arg_;
 
+	flatten_flush(ctx, arg);
 	bezier(ctx, arg->rast, arg->ctm, arg->flatness, arg->c.x, arg->c.y, x1, y1, x2, y2, x3, y3, 0);
 	arg->c.x = x3;
 	arg->c.y = y3;
@@ -219,6 +275,7 @@ flatten_quadto(fz_context *ctx, void *arg_, float x1, float y1, float x2, float
 {
 	flatten_arg *arg = (flatten_arg *)arg_;
 
+	flatten_flush(ctx, arg);
 	quad(ctx, arg->rast, arg->ctm, arg->flatness, arg->c.x, arg->c.y, x1, y1, x2, y2, 0);
 	arg->c.x = x2;
 	arg->c.y = y2;
@@ -229,6 +286,7 @@ flatten_close(fz_context *ctx, void *arg_)
 {
 	flatten_arg *arg = (flatten_arg *)arg_;
 
+	flatten_flush(ctx, arg);
 	line(ctx, arg->rast, arg->ctm, arg->c.x, arg->c.y, arg->b.x, arg->b.y);
 	arg->c.x = arg->b.x;
 	arg->c.y = arg->b.y;
@@ -293,8 +351,12 @@ do_flatten_fill(fz_context *ctx, fz_rasterizer *rast, const fz_path *path, fz_ma
 	arg.ctm = ctm;
 	arg.flatness = flatness;
 	arg.b.x = arg.b.y = arg.c.x = arg.c.y = 0;
+	arg.e = arg.c;
+	arg.pending = 0;
+	arg.simplify = can_simplify(rast);
 
 	fz_walk_path(ctx, path, &flatten_proc, &arg);
+	flatten_flush(ctx, &arg);
 	if (arg.c.x != arg.b.x || arg.c.y != arg.b.y)
 		line(ctx, rast, ctm, arg.c.x, arg.c.y, arg.b.x, arg.b.y);
 
@@ -362,6 +424,12 @@ typedef struct sctx
 
 	float dirn_x;
 	float dirn_y;
+
+	/* SumatraPDF: polyline simplification, see flatten_arg */
+	fz_point e;
+	int pending;
+	int simplify;
+	float tolerance;
 } sctx;
 
 static void
@@ -1013,11 +1081,22 @@ fz_stroke_quad(fz_context *ctx, struct sctx *s,
 	fz_stroke_quad(ctx, s, xabc, yabc, xbc, ybc, xc, yc, depth + 1);
 }
 
+static void
+stroke_flush_pending(fz_context *ctx, sctx *s)
+{
+	if (s->pending)
+	{
+		fz_stroke_lineto(ctx, s, s->cur.x, s->cur.y, 0);
+		s->pending = 0;
+	}
+}
+
 static void
 stroke_moveto(fz_context *ctx, void *s_, float x, float y)
 {
 	sctx *s = (sctx *)s_;
 
+	stroke_flush_pending(ctx, s);
 	fz_stroke_flush(ctx, s, s->stroke->start_cap, s->stroke->end_cap);
 	fz_stroke_moveto(ctx, s, x, y);
 	s->cur.x = x;
@@ -1029,6 +1108,19 @@ stroke_lineto(fz_context *ctx, void *s_, float x, float y)
 {
 	sctx *s = (sctx *)s_;
 
+	if (s->simplify)
+	{
+		if (!s->pending)
+			s->e = s->cur;
+		s->cur.x = x;
+		s->cur.y = y;
+		if (fz_abs(x - s->e.x) < s->tolerance && fz_abs(y - s->e.y) < s->tolerance)
+		{
+			s->pending = 1;
+			return;
+		}
+		s->pending = 0;
+	}
 	fz_stroke_lineto(ctx, s, x, y, 0);
 	s->cur.x = x;
 	s->cur.y = y;
@@ -1039,6 +1131,7 @@ stroke_curveto(fz_context *ctx, void *s_, float x1, float y1, float x2, float y2
 {
 	sctx *s = (sctx *)s_;
 
+	stroke_flush_pending(ctx, s);
 	fz_stroke_bezier(ctx, s, s->cur.x, s->cur.y, x1, y1, x2, y2, x3, y3, 0);
 	s->cur.x = x3;
 	s->cur.y = y3;
@@ -1049,6 +1142,7 @@ stroke_quadto(fz_context *ctx, void *s_, float x1, float y1, float x2, float y2)
 {
 	sctx *s = (sctx *)s_;
 
+	stroke_flush_pending(ctx, s);
 	fz_stroke_quad(ctx, s, s->cur.x, s->cur.y, x1, y1, x2, y2, 0);
 	s->cur.x = x2;
 	s->cur.y = y2;
@@ -1059,6 +1153,7 @@ stroke_close(fz_context *ctx, void *s_)
 {
 	sctx *s = (sctx *)s_;
 
+	stroke_flush_pending(ctx, s);
 	fz_stroke_closepath(ctx, s);
 }
 
@@ -1551,6 +1646,17 @@ do_flatten_stroke(fz_context *ctx, fz_rasterizer *rast, const fz_path *path, con
 	s.phase = 0;
 	s.dirn_x = 0;
 	s.dirn_y = 0;
+	s.pending = 0;
+
+	/* SumatraPDF: the ink of a thin stroke is proportional to its length,
+	 * so simplifying wiggles away would make it lighter. Keeping within half
+	 * the line width of the original keeps the simplified stroke inside the
+	 * original one. Dropped vertices don't get a join, which is only within
+	 * tolerance if joins can't stick out far (miters of thick lines can). */
+	s.tolerance = fz_min(flatness, s.linewidth);
+	s.simplify = can_simplify(rast) &&
+		((stroke->linejoin != FZ_LINEJOIN_MITER && stroke->linejoin != FZ_LINEJOIN_MITER_XPS) ||
+		linewidth * fz_matrix_expansion(ctm) <= 1);
 
 	s.cap = stroke->start_cap;
 
@@ -1582,13 +1688,16 @@ do_flatten_stroke(fz_context *ctx, fz_rasterizer *rast, const fz_path *path, con
 		if (s.dash_total >= 0.01f && s.dash_total * max_expand >= 0.5f)
 		{
 			proc = &dash_proc;
+			s.simplify = 0;
 			s.dash_phase = fmodf(stroke->dash_phase, s.dash_total);
 			s.dash_list = list;
 		}
 	}
 
 	s.cur.x = s.cur.y = 0;
+	s.e = s.cur;
 	fz_walk_path(ctx, path, proc, &s);
+	stroke_flush_pending(ctx, &s);
 	fz_stroke_flush(ctx, &s, s.cap, stroke->end_cap);
 
 	return fz_is_empty_irect(fz_bound_rasterizer(ctx, rast));
@@ -1617,3 +1726,283 @@ fz_flatten_stroke_path(fz_context *ctx, fz_rasterizer *rast, const fz_path *path
 	*bbox = fz_intersect_irect(scissor, fz_bound_rasterizer(ctx, rast));
 	return fz_is_empty_irect(*bbox);
 }
+
+/*
+	SumatraPDF: level of detail for sub-pixel paths.
+
+	At low zoom levels dense vector pages consist mostly of paths that
+	cover a fraction of a pixel. Flattening and scan converting them
+	costs as much as for big paths, but all they contribute is a bit of
+	coverage to one or two pixels. fz_lod_path() measures the device
+	space bbox and the coverage of a path in a single walk (the exact
+	area enclosed for fills, length times line width for strokes) and
+	for paths whose bbox is at most 1x1 pixels decides to:
+
+	FZ_LOD_SKIP: drop the path if the ink it adds (coverage times alpha)
+	is below half of one 8-bit color step.
+
+	FZ_LOD_RECT: otherwise replace it with an axis-aligned rect with the
+	same center, aspect ratio and coverage, which is cheap to rasterize.
+
+	The total ink is preserved, so the visual difference is limited to
+	how that ink is distributed between at most 2x2 neighboring pixels
+	(and, for skipped paths, less than 0.5/255 per path). For even-odd
+	fills and self-intersecting outlines the coverage is an upper bound,
+	capped by the area of the bbox.
+*/
+
+typedef struct
+{
+	fz_matrix ctm;
+	fz_rect bbox;
+	float flatness;
+	fz_point b;
+	fz_point c;
+	float sub;
+	float area;
+	float len;
+}
+lod_arg;
+
+static inline float
+lod_cross(fz_point a, fz_point b)
+{
+	return a.x * b.y - a.y * b.x;
+}
+
+static inline float
+lod_dist(fz_point a, fz_point b)
+{
+	return sqrtf((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+}
+
+static fz_point
+lod_point(lod_arg *arg, float x, float y)
+{
+	fz_point p = fz_transform_point_xy(x, y, arg->ctm);
+	arg->bbox = fz_include_point_in_rect(arg->bbox, p);
+	return p;
+}
+
+static void
+lod_end_subpath(lod_arg *arg)
+{
+	/* shoelace formula, sub is twice the signed area of the open outline */
+	arg->area += fz_abs(arg->sub + lod_cross(arg->c, arg->b)) * 0.5f;
+	arg->sub = 0;
+}
+
+static void
+lod_moveto(fz_context *ctx, void *arg_, float x, float y)
+{
+	lod_arg *arg = (lod_arg *)arg_;
+
+	lod_end_subpath(arg);
+	arg->b = arg->c = lod_point(arg, x, y);
+}
+
+static void
+lod_lineto(fz_context *ctx, void *arg_, float x, float y)
+{
+	lod_arg *arg = (lod_arg *)arg_;
+	fz_point p = lod_point(arg, x, y);
+
+	arg->sub += lod_cross(arg->c, p);
+	arg->len += lod_dist(arg->c, p);
+	arg->c = p;
+}
+
+static void
+lod_cubic(lod_arg *arg, fz_point p1, fz_point p2, fz_point p3)
+{
+	fz_point p0 = arg->c;
+	float dmax, chord, poly;
+
+	/* measure what would be rasterized: bezier() replaces flat enough
+	 * curves with their chord, which is most curves at this size */
+	dmax = fz_abs(p0.x - p1.x);
+	dmax = fz_max(dmax, fz_abs(p0.y - p1.y));
+	dmax = fz_max(dmax, fz_abs(p3.x - p2.x));
+	dmax = fz_max(dmax, fz_abs(p3.y - p2.y));
+	if (dmax < arg->flatness)
+	{
+		arg->sub += lod_cross(p0, p3);
+		arg->len += lod_dist(p0, p3);
+		arg->c = p3;
+		return;
+	}
+
+	/* exact (twice the) signed area between the curve and the origin */
+	arg->sub += (6 * lod_cross(p0, p1) + 3 * lod_cross(p0, p2) + lod_cross(p0, p3) +
+		3 * lod_cross(p1, p2) + 3 * lod_cross(p1, p3) + 6 * lod_cross(p2, p3)) / 10;
+
+	/* the length of the curve is between the chord and the control polygon */
+	chord = lod_dist(p0, p3);
+	poly = lod_dist(p0, p1) + lod_dist(p1, p2) + lod_dist(p2, p3);
+	arg->len += (chord + poly) * 0.5f;
+	arg->c = p3;
+}
+
+static void
+lod_curveto(fz_context *ctx, void *arg_, float x1, float y1, float x2, float y2, float x3, float y3)
+{
+	lod_arg *arg = (lod_arg *)arg_;
+	fz_point p1 = lod_point(arg, x1, y1);
+	fz_point p2 = lod_point(arg, x2, y2);
+	fz_point p3 = lod_point(arg, x3, y3);
+
+	lod_cubic(arg, p1, p2, p3);
+}
+
+static void
+lod_quadto(fz_context *ctx, void *arg_, float x1, float y1, float x2, float y2)
+{
+	lod_arg *arg = (lod_arg *)arg_;
+	fz_point q1 = lod_point(arg, x1, y1);
+	fz_point p2 = lod_point(arg, x2, y2);
+	fz_point c1, c2;
+
+	/* elevate to a cubic */
+	c1.x = arg->c.x + (q1.x - arg->c.x) * (2.0f / 3);
+	c1.y = arg->c.y + (q1.y - arg->c.y) * (2.0f / 3);
+	c2.x = p2.x + (q1.x - p2.x) * (2.0f / 3);
+	c2.y = p2.y + (q1.y - p2.y) * (2.0f / 3);
+	lod_cubic(arg, c1, c2, p2);
+}
+
+static void
+lod_close(fz_context *ctx, void *arg_)
+{
+	lod_arg *arg = (lod_arg *)arg_;
+
+	arg->sub += lod_cross(arg->c, arg->b);
+	arg->len += lod_dist(arg->c, arg->b);
+	arg->c = arg->b;
+}
+
+static void
+lod_rectto(fz_context *ctx, void *arg_, float x0, float y0, float x1, float y1)
+{
+	lod_moveto(ctx, arg_, x0, y0);
+	lod_lineto(ctx, arg_, x1, y0);
+	lod_lineto(ctx, arg_, x1, y1);
+	lod_lineto(ctx, arg_, x0, y1);
+	lod_close(ctx, arg_);
+}
+
+static const fz_path_walker lod_proc =
+{
+	lod_moveto,
+	lod_lineto,
+	lod_curveto,
+	lod_close,
+	lod_quadto,
+	NULL,
+	NULL,
+	lod_rectto
+};
+
+int
+fz_lod_path(fz_context *ctx, fz_rasterizer *rast, const fz_path *path, const fz_stroke_state *stroke, fz_matrix ctm, float flatness, float linewidth, float alpha, fz_rect *rect)
+{
+	lod_arg arg;
+	float w, h, coverage, scale;
+	fz_point center;
+	float expansion = fz_matrix_expansion(ctm);
+
+	/* without anti-aliasing coverage is all or nothing */
+	if (!can_simplify(rast) || fz_rasterizer_graphics_aa_level(rast) == 0)
+		return FZ_LOD_NONE;
+
+	/* most paths are bigger than a pixel, which is usually clear after
+	 * a few points. that way they don't pay for a complete walk */
+	if (fz_path_exceeds_size(ctx, path, ctm, 1))
+		return FZ_LOD_NONE;
+
+	arg.ctm = ctm;
+	arg.flatness = flatness * expansion;
+	arg.bbox = fz_empty_rect;
+	arg.b.x = arg.b.y = arg.c.x = arg.c.y = 0;
+	arg.sub = arg.area = arg.len = 0;
+	fz_walk_path(ctx, path, &lod_proc, &arg);
+	lod_end_subpath(&arg);
+
+	if (fz_is_empty_rect(arg.bbox))
+		return FZ_LOD_NONE;
+
+	if (stroke)
+	{
+		float lw = linewidth * expansion;
+		arg.bbox = fz_expand_rect(arg.bbox, lw * 0.5f);
+		coverage = arg.len * lw;
+		if (stroke->dash_len > 0)
+		{
+			float on = 0, total = 0;
+			int i;
+			for (i = 0; i < stroke->dash_len; i++)
+			{
+				total += stroke->dash_list[i];
+				if ((i & 1) == 0)
+					on += stroke->dash_list[i];
+			}
+			if (stroke->dash_len & 1)
+				coverage *= 0.5f;
+			else if (total > 0)
+				coverage *= on / total;
+		}
+	}
+	else
+		coverage = arg.area;
+
+	w = arg.bbox.x1 - arg.bbox.x0;
+	h = arg.bbox.y1 - arg.bbox.y0;
+	if (w > 1 || h > 1)
+		return FZ_LOD_NONE;
+
+	if (coverage > w * h)
+		coverage = w * h;
+	if (coverage * alpha * 255 < 0.5f)
+		return FZ_LOD_SKIP;
+
+	scale = sqrtf(coverage / (w * h)) * 0.5f;
+	center.x = (arg.bbox.x0 + arg.bbox.x1) * 0.5f;
+	center.y = (arg.bbox.y0 + arg.bbox.y1) * 0.5f;
+	rect->x0 = center.x - w * scale;
+	rect->x1 = center.x + w * scale;
+	rect->y0 = center.y - h * scale;
+	rect->y1 = center.y + h * scale;
+	return FZ_LOD_RECT;
+}
+
+/* not fz_insert_rasterizer_rect() because anti-dropout rounds the rect out
+ * to whole sub-samples, which would add a lot of ink to tiny rects */
+static void
+insert_lod_rect(fz_context *ctx, fz_rasterizer *rast, fz_rect rect)
+{
+	fz_insert_rasterizer(ctx, rast, rect.x0, rect.y0, rect.x1, rect.y0, 0);
+	fz_insert_rasterizer(ctx, rast, rect.x1, rect.y0, rect.x1, rect.y1, 0);
+	fz_insert_rasterizer(ctx, rast, rect.x1, rect.y1, rect.x0, rect.y1, 0);
+	fz_insert_rasterizer(ctx, rast, rect.x0, rect.y1, rect.x0, rect.y0, 0);
+	fz_gap_rasterizer(ctx, rast);
+}
+
+int
+fz_flatten_lod_rect(fz_context *ctx, fz_rasterizer *rast, fz_rect rect, fz_irect scissor, fz_irect *bbox)
+{
+	fz_irect local_bbox;
+	if (!bbox)
+		bbox = &local_bbox;
+
+	if (fz_is_empty_irect(scissor))
+		scissor.x1 = scissor.x0, scissor.y1 = scissor.y0;
+
+	if (fz_reset_rasterizer(ctx, rast, scissor))
+	{
+		insert_lod_rect(ctx, rast, rect);
+		fz_postindex_rasterizer(ctx, rast);
+	}
+	insert_lod_rect(ctx, rast, rect);
+
+	*bbox = fz_intersect_irect(scissor, fz_bound_rasterizer(ctx, rast));
+	return fz_is_empty_irect(*bbox);
+}
@@ -806,7 +806,10 @@ typedef struct
 	int ivcount;
 	unsigned char bp[16];
 	unsigned char *rp, *wp;
-	unsigned char buffer[256];
+	/* SumatraPDF: bigger buffer for decrypting many blocks at once */
+	unsigned char buffer[4096];
+	/* SumatraPDF: input ended within a block, throw once the whole blocks before it have been returned */
+	int partial;
 } fz_aesd;
 
 static int
@@ -816,6 +819,9 @@ next_aesd(fz_context *ctx, fz_stream *stm, size_t max)
 	unsigned char *p = state->buffer;
 	unsigned char *ep;
 
+	if (state->partial)
+		fz_throw(ctx, FZ_ERROR_FORMAT, "partial block in aes filter");
+
 	if (max > sizeof(state->buffer))
 		max = sizeof(state->buffer);
 	ep = p + max;
@@ -831,13 +837,48 @@ next_aesd(fz_context *ctx, fz_stream *stm, size_t max)
 	while (state->rp < state->wp && p < ep)
 		*p++ = *state->rp++;
 
-	while (p < ep)
+	/* SumatraPDF: decrypt all the whole blocks that fit in one call, which
+	 * is much faster than one block at a time (see fz_aes_crypt_cbc) */
+	while (ep - p >= 16)
+	{
+		size_t n = fz_read(ctx, state->chain, p, (ep - p) & ~15);
+		if (n == 0)
+			break;
+		if (n & 15)
+		{
+			/* return the whole blocks first, like the block-at-a-time code did */
+			state->partial = 1;
+			n &= ~15;
+			if (n == 0)
+				break;
+		}
+
+		fz_aes_crypt_cbc(&state->aes, FZ_AES_DECRYPT, n, state->iv, p, p);
+		p += n;
+		if (state->partial)
+			break;
+
+		/* strip padding at end of file */
+		if (fz_is_eof(ctx, state->chain))
+		{
+			int pad = p[-1];
+			if (pad < 1 || pad > 16)
+				fz_throw(ctx, FZ_ERROR_FORMAT, "aes padding out of range: %d", pad);
+			p -= pad;
+			break;
+		}
+	}
+
+	while (p < ep && !state->partial)
 	{
 		size_t n = fz_read(ctx, state->chain, state->bp, 16);
 		if (n == 0)
 			break;
 		else if (n < 16)
-			fz_throw(ctx, FZ_ERROR_FORMAT, "partial block in aes filter");
+		{
+			state->partial = 1;
+			break;
+		}
 
 		fz_aes_crypt_cbc(&state->aes, FZ_AES_DECRYPT, 16, state->iv, state->bp, state->bp);
 		state->rp = state->bp;
@@ -856,6 +897,9 @@ next_aesd(fz_context *ctx, fz_stream *stm, size_t max)
 			*p++ = *state->rp++;
 	}
 
+	if (state->partial && p == state->buffer)
+		fz_throw(ctx, FZ_ERROR_FORMAT, "partial block in aes filter");
+
 	stm->rp = state->buffer;
 	stm->wp = p;
 	stm->pos += p - state->buffer;
@@ -884,6 +928,7 @@ fz_open_aesd(fz_context *ctx, fz_stream *chain, unsigned char *key, unsigned key
 		fz_throw(ctx, FZ_ERROR_ARGUMENT, "aes invalid key size (%d)", keylen * 8);
 	}
 	state->ivcount = 0;
+	state->partial = 0;
 	state->rp = state->bp;
 	state->wp = state->bp;
 	state->chain = fz_keep_stream(ctx, chain);
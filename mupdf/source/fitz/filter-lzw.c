@@ -23,6 +23,7 @@
 #include "mupdf/fitz.h"
 
 #include <assert.h>
+#include <string.h>
 
 /* TODO: error checking */
 
@@ -34,15 +35,21 @@ enum
 {
 	MAX_BITS = 12,
 	NUM_CODES = (1 << MAX_BITS),
-	MAX_LENGTH = 4097
+	MAX_LENGTH = 4097,
+	TAIL_LENGTH = 8
 };
 
+/* SumatraPDF: a string is stored as the code of its prefix and the last
+ * 1 to TAIL_LENGTH bytes, cut so that the prefix is a multiple of
+ * TAIL_LENGTH bytes long. Unpacking a string then copies TAIL_LENGTH bytes
+ * per table lookup instead of one. */
 typedef struct
 {
-	int prev;			/* prev code (in string) */
+	short prefix;			/* code of the string without tail (or -1) */
 	unsigned short length;		/* string len, including this token */
-	unsigned char value;		/* data value */
+	unsigned char tail_length;	/* number of bytes in tail */
 	unsigned char first_char;	/* first token of string */
+	unsigned char tail[TAIL_LENGTH];
 } lzw_code;
 
 typedef struct
@@ -60,6 +67,10 @@ typedef struct
 	int old_code;			/* previously recognized code */
 	int next_code;			/* next free entry */
 
+	/* SumatraPDF: read codes from the chain directly instead of with fz_read_bits */
+	unsigned int bits;
+	int avail;
+
 	lzw_code table[NUM_CODES];
 
 	unsigned char bp[MAX_LENGTH];
@@ -68,6 +79,55 @@ typedef struct
 	unsigned char buffer[4096];
 } fz_lzwd;
 
+/* bits and avail are kept in locals by the caller, as writes to the output
+ * through unsigned char pointers would otherwise force reloading them */
+static inline int
+lzw_read_code(fz_context *ctx, fz_lzwd *lzw, unsigned int *bits, int *avail, int code_bits)
+{
+	int c;
+
+	while (*avail < code_bits)
+	{
+		c = fz_read_byte(ctx, lzw->chain);
+		if (c == EOF)
+			return -1;
+		if (lzw->reverse_bits)
+			*bits |= c << *avail;
+		else
+			*bits = (*bits << 8) | c;
+		*avail += 8;
+	}
+
+	*avail -= code_bits;
+	if (lzw->reverse_bits)
+	{
+		c = *bits & ((1 << code_bits) - 1);
+		*bits >>= code_bits;
+	}
+	else
+		c = (*bits >> *avail) & ((1 << code_bits) - 1);
+	return c;
+}
+
+/* write the string for code to s, which has room for its length */
+static inline void
+lzw_unpack(lzw_code *table, int code, unsigned char *s)
+{
+	lzw_code *e = &table[code];
+	unsigned char *start = s;
+
+	s += e->length - e->tail_length;
+	memcpy(s, e->tail, e->tail_length);
+
+	/* the length check guards against codes redefined after a clear code */
+	while (e->prefix >= 0 && s - start >= TAIL_LENGTH)
+	{
+		e = &table[e->prefix];
+		s -= TAIL_LENGTH;
+		memcpy(s, e->tail, TAIL_LENGTH);
+	}
+}
+
 static int
 next_lzwd(fz_context *ctx, fz_stream *stm, size_t len)
 {
@@ -76,39 +136,41 @@ next_lzwd(fz_context *ctx, fz_stream *stm, size_t len)
 	unsigned char *buf = lzw->buffer;
 	unsigned char *p = buf;
 	unsigned char *ep;
-	unsigned char *s;
+	size_t n;
 	int codelen;
 
+	const int clear = LZW_CLEAR(lzw);
+	const int eod = LZW_EOD(lzw);
 	int code_bits = lzw->code_bits;
 	int code = lzw->code;
 	int old_code = lzw->old_code;
 	int next_code = lzw->next_code;
+	unsigned int bits = lzw->bits;
+	int avail = lzw->avail;
 
 	if (len > sizeof(lzw->buffer))
 		len = sizeof(lzw->buffer);
 	ep = buf + len;
 
-	while (lzw->rp < lzw->wp && p < ep)
-		*p++ = *lzw->rp++;
+	n = fz_minz(lzw->wp - lzw->rp, ep - p);
+	memcpy(p, lzw->rp, n);
+	lzw->rp += n;
+	p += n;
 
 	while (p < ep)
 	{
 		if (lzw->eod)
 			return EOF;
 
-		if (fz_is_eof_bits(ctx, lzw->chain))
+		code = lzw_read_code(ctx, lzw, &bits, &avail, code_bits);
+		if (code < 0)
 		{
 			fz_warn(ctx, "premature end in lzw decode");
 			lzw->eod = 1;
 			break;
 		}
 
-		if (lzw->reverse_bits)
-			code = fz_read_rbits(ctx, lzw->chain, code_bits);
-		else
-			code = fz_read_bits(ctx, lzw->chain, code_bits);
-
-		if (code == LZW_EOD(lzw))
+		if (code == eod)
 		{
 			lzw->eod = 1;
 			break;
@@ -116,13 +178,13 @@ next_lzwd(fz_context *ctx, fz_stream *stm, size_t len)
 
 		/* Old Tiffs are allowed to NOT send the clear code, and to
 		 * overrun at the end. */
-		if (!lzw->old_tiff && next_code > NUM_CODES && code != LZW_CLEAR(lzw))
+		if (!lzw->old_tiff && next_code > NUM_CODES && code != clear)
 		{
 			fz_warn(ctx, "missing clear code in lzw decode");
-			code = LZW_CLEAR(lzw);
+			code = clear;
 		}
 
-		if (code == LZW_CLEAR(lzw))
+		if (code == clear)
 		{
 			code_bits = lzw->min_bits;
 			next_code = LZW_FIRST(lzw);
@@ -147,17 +209,36 @@ next_lzwd(fz_context *ctx, fz_stream *stm, size_t len)
 		}
 		else if (next_code < NUM_CODES)
 		{
-			/* add new entry to the code table */
-			table[next_code].prev = old_code;
-			table[next_code].first_char = table[old_code].first_char;
-			table[next_code].length = table[old_code].length + 1;
+			/* add new entry to the code table: the string for old_code
+			 * followed by the first char of the string for code */
+			lzw_code *e = &table[next_code];
+			lzw_code *old = &table[old_code];
+			int tail_length = old->tail_length;
+			int c;
+
 			if (code < next_code)
-				table[next_code].value = table[code].first_char;
+				c = table[code].first_char;
 			else if (code == next_code)
-				table[next_code].value = table[next_code].first_char;
+				c = old->first_char;
 			else
 				fz_throw(ctx, FZ_ERROR_FORMAT, "out of range code encountered in lzw decode");
 
+			e->first_char = old->first_char;
+			e->length = old->length + 1;
+			if (tail_length < TAIL_LENGTH)
+			{
+				e->prefix = old->prefix;
+				memmove(e->tail, old->tail, tail_length);
+				e->tail[tail_length] = c;
+				e->tail_length = tail_length + 1;
+			}
+			else
+			{
+				e->prefix = old_code;
+				e->tail[0] = c;
+				e->tail_length = 1;
+			}
+
 			next_code ++;
 
 			if (next_code > (1 << code_bits) - lzw->early_change - 1)
@@ -170,39 +251,40 @@ next_lzwd(fz_context *ctx, fz_stream *stm, size_t len)
 			old_code = code;
 		}
 
-		/* code maps to a string, copy to output (in reverse...) */
-		if (code >= LZW_CLEAR(lzw))
+		/* a single character... */
+		if (code < clear)
 		{
-			codelen = table[code].length;
-			lzw->rp = lzw->bp;
-			lzw->wp = lzw->bp + codelen;
-
-			assert(codelen < MAX_LENGTH);
-
-			s = lzw->wp;
-			do {
-				*(--s) = table[code].value;
-				code = table[code].prev;
-			} while (code >= 0 && s > lzw->bp);
+			*p++ = code;
+			continue;
 		}
 
-		/* ... or just a single character */
+		/* ... or a string, unpacked straight into the output if it fits */
+		codelen = table[code].length;
+		assert(codelen < MAX_LENGTH);
+		if (codelen <= ep - p)
+		{
+			lzw_unpack(table, code, p);
+			p += codelen;
+		}
 		else
 		{
-			lzw->bp[0] = code;
+			lzw_unpack(table, code, lzw->bp);
 			lzw->rp = lzw->bp;
-			lzw->wp = lzw->bp + 1;
-		}
+			lzw->wp = lzw->bp + codelen;
 
-		/* copy to output */
-		while (lzw->rp < lzw->wp && p < ep)
-			*p++ = *lzw->rp++;
+			n = ep - p;
+			memcpy(p, lzw->rp, n);
+			lzw->rp += n;
+			p += n;
+		}
 	}
 
 	lzw->code_bits = code_bits;
 	lzw->code = code;
 	lzw->old_code = old_code;
 	lzw->next_code = next_code;
+	lzw->bits = bits;
+	lzw->avail = avail;
 
 	stm->rp = buf;
 	stm->wp = p;
@@ -217,7 +299,6 @@ static void
 close_lzwd(fz_context *ctx, void *state_)
 {
 	fz_lzwd *lzw = (fz_lzwd *)state_;
-	fz_sync_bits(ctx, lzw->chain);
 	fz_drop_stream(ctx, lzw->chain);
 	fz_free(ctx, lzw);
 }
@@ -249,18 +330,19 @@ fz_open_lzwd(fz_context *ctx, fz_stream *chain, int early_change, int min_bits,
 
 	for (i = 0; i < LZW_CLEAR(lzw); i++)
 	{
-		lzw->table[i].value = i;
+		lzw->table[i].tail[0] = i;
+		lzw->table[i].tail_length = 1;
 		lzw->table[i].first_char = i;
 		lzw->table[i].length = 1;
-		lzw->table[i].prev = -1;
+		lzw->table[i].prefix = -1;
 	}
 
 	for (i = LZW_CLEAR(lzw); i < NUM_CODES; i++)
 	{
-		lzw->table[i].value = 0;
+		lzw->table[i].tail_length = 0;
 		lzw->table[i].first_char = 0;
 		lzw->table[i].length = 0;
-		lzw->table[i].prev = -1;
+		lzw->table[i].prefix = -1;
 	}
 
 	lzw->chain = fz_keep_stream(ctx, chain);
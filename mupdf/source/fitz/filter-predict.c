@@ -25,6 +25,13 @@
 #include <string.h>
 #include <limits.h>
 
+#if ARCH_HAS_SSE
+#include <emmintrin.h>
+#endif
+#if ARCH_HAS_NEON
+#include <arm_neon.h>
+#endif
+
 /* TODO: check if this works with 16bpp images */
 
 typedef struct
@@ -81,6 +88,301 @@ static inline int paeth(int a, int b, int c)
 	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
 }
 
+/*
+ * SumatraPDF: vectorized predictors. Up handles 16 bytes at a time.
+ * Sub, Average and Paeth depend on the previous pixel: for 3 and 4 bytes
+ * per pixel all components of a pixel are decoded at once, and Sub with
+ * 1 or 4 bytes per pixel uses a prefix sum over 16 bytes. Each returns
+ * the number of bytes decoded (0 or at least bpp), the caller decodes
+ * the rest with the scalar code.
+ */
+#if ARCH_HAS_SSE
+
+static inline __m128i load_px(const unsigned char *p, int bpp)
+{
+	int v;
+	if (bpp == 4)
+		memcpy(&v, p, 4);
+	else
+		v = p[0] | (p[1] << 8) | (p[2] << 16);
+	return _mm_cvtsi32_si128(v);
+}
+
+static inline void store_px(unsigned char *p, __m128i x, int bpp)
+{
+	int v = _mm_cvtsi128_si32(x);
+	if (bpp == 4)
+		memcpy(p, &v, 4);
+	else
+	{
+		p[0] = v;
+		p[1] = v >> 8;
+		p[2] = v >> 16;
+	}
+}
+
+static inline __m128i abs_epi16(__m128i x)
+{
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static inline __m128i select_si128(__m128i mask, __m128i x, __m128i y)
+{
+	return _mm_or_si128(_mm_and_si128(mask, x), _mm_andnot_si128(mask, y));
+}
+
+static size_t
+predict_up_simd(unsigned char *out, const unsigned char *in, const unsigned char *ref, size_t len)
+{
+	size_t i;
+	for (i = 0; i + 16 <= len; i += 16)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(ref + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_add_epi8(d, b));
+	}
+	return i;
+}
+
+static size_t
+predict_sub_simd(unsigned char *out, const unsigned char *in, size_t len, int bpp)
+{
+	__m128i a = _mm_setzero_si128();
+	size_t i = 0;
+
+	if (bpp == 1)
+	{
+		for (; i + 16 <= len; i += 16)
+		{
+			__m128i d = _mm_loadu_si128((const __m128i *)(in + i));
+			d = _mm_add_epi8(d, _mm_slli_si128(d, 1));
+			d = _mm_add_epi8(d, _mm_slli_si128(d, 2));
+			d = _mm_add_epi8(d, _mm_slli_si128(d, 4));
+			d = _mm_add_epi8(d, _mm_slli_si128(d, 8));
+			a = _mm_add_epi8(d, a);
+			_mm_storeu_si128((__m128i *)(out + i), a);
+			/* broadcast the last byte */
+			a = _mm_srli_si128(a, 15);
+			a = _mm_unpacklo_epi8(a, a);
+			a = _mm_shuffle_epi32(_mm_shufflelo_epi16(a, 0), 0);
+		}
+	}
+	else if (bpp == 4)
+	{
+		for (; i + 16 <= len; i += 16)
+		{
+			__m128i d = _mm_loadu_si128((const __m128i *)(in + i));
+			d = _mm_add_epi8(d, _mm_slli_si128(d, 4));
+			d = _mm_add_epi8(d, _mm_slli_si128(d, 8));
+			a = _mm_add_epi8(d, a);
+			_mm_storeu_si128((__m128i *)(out + i), a);
+			/* broadcast the last pixel */
+			a = _mm_shuffle_epi32(a, 0xff);
+		}
+	}
+	else if (bpp == 3)
+	{
+		for (; i + 3 <= len; i += 3)
+		{
+			a = _mm_add_epi8(a, load_px(in + i, 3));
+			store_px(out + i, a, 3);
+		}
+	}
+	return i;
+}
+
+static size_t
+predict_avg_simd(unsigned char *out, const unsigned char *in, const unsigned char *ref, size_t len, int bpp)
+{
+	__m128i a = _mm_setzero_si128();
+	__m128i one = _mm_set1_epi8(1);
+	size_t i = 0;
+
+	if (bpp != 3 && bpp != 4)
+		return 0;
+	for (; i + bpp <= len; i += bpp)
+	{
+		__m128i b = load_px(ref + i, bpp);
+		/* _mm_avg_epu8 rounds up, PNG rounds down */
+		__m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+		a = _mm_add_epi8(load_px(in + i, bpp), avg);
+		store_px(out + i, a, bpp);
+	}
+	return i;
+}
+
+static size_t
+predict_paeth_simd(unsigned char *out, const unsigned char *in, const unsigned char *ref, size_t len, int bpp)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i a = zero, c = zero;
+	size_t i = 0;
+
+	if (bpp != 3 && bpp != 4)
+		return 0;
+	/* same as paeth(), on 16 bit lanes */
+	for (; i + bpp <= len; i += bpp)
+	{
+		__m128i b = _mm_unpacklo_epi8(load_px(ref + i, bpp), zero);
+		__m128i pa = _mm_sub_epi16(b, c);
+		__m128i pb = _mm_sub_epi16(a, c);
+		__m128i pc = _mm_add_epi16(pa, pb);
+		__m128i smallest, nearest;
+		pa = abs_epi16(pa);
+		pb = abs_epi16(pb);
+		pc = abs_epi16(pc);
+		smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		nearest = select_si128(_mm_cmpeq_epi16(pb, smallest), b, c);
+		nearest = select_si128(_mm_cmpeq_epi16(pa, smallest), a, nearest);
+		a = _mm_add_epi8(load_px(in + i, bpp), _mm_packus_epi16(nearest, nearest));
+		store_px(out + i, a, bpp);
+		a = _mm_unpacklo_epi8(a, zero);
+		c = b;
+	}
+	return i;
+}
+
+#elif ARCH_HAS_NEON
+
+static inline uint8x8_t load_px(const unsigned char *p, int bpp)
+{
+	uint32_t v;
+	if (bpp == 4)
+		memcpy(&v, p, 4);
+	else
+		v = p[0] | (p[1] << 8) | (p[2] << 16);
+	return vreinterpret_u8_u32(vdup_n_u32(v));
+}
+
+static inline void store_px(unsigned char *p, uint8x8_t x, int bpp)
+{
+	uint32_t v = vget_lane_u32(vreinterpret_u32_u8(x), 0);
+	if (bpp == 4)
+		memcpy(p, &v, 4);
+	else
+	{
+		p[0] = v;
+		p[1] = v >> 8;
+		p[2] = v >> 16;
+	}
+}
+
+static size_t
+predict_up_simd(unsigned char *out, const unsigned char *in, const unsigned char *ref, size_t len)
+{
+	size_t i;
+	for (i = 0; i + 16 <= len; i += 16)
+		vst1q_u8(out + i, vaddq_u8(vld1q_u8(in + i), vld1q_u8(ref + i)));
+	return i;
+}
+
+static size_t
+predict_sub_simd(unsigned char *out, const unsigned char *in, size_t len, int bpp)
+{
+	uint8x16_t zero = vdupq_n_u8(0);
+	size_t i = 0;
+
+	if (bpp == 1)
+	{
+		uint8x16_t a = zero;
+		for (; i + 16 <= len; i += 16)
+		{
+			uint8x16_t d = vld1q_u8(in + i);
+			d = vaddq_u8(d, vextq_u8(zero, d, 15));
+			d = vaddq_u8(d, vextq_u8(zero, d, 14));
+			d = vaddq_u8(d, vextq_u8(zero, d, 12));
+			d = vaddq_u8(d, vextq_u8(zero, d, 8));
+			a = vaddq_u8(d, a);
+			vst1q_u8(out + i, a);
+			/* broadcast the last byte */
+			a = vdupq_n_u8(vgetq_lane_u8(a, 15));
+		}
+	}
+	else if (bpp == 4)
+	{
+		uint8x16_t a = zero;
+		for (; i + 16 <= len; i += 16)
+		{
+			uint8x16_t d = vld1q_u8(in + i);
+			d = vaddq_u8(d, vextq_u8(zero, d, 12));
+			d = vaddq_u8(d, vextq_u8(zero, d, 8));
+			a = vaddq_u8(d, a);
+			vst1q_u8(out + i, a);
+			/* broadcast the last pixel */
+			a = vreinterpretq_u8_u32(vdupq_n_u32(vgetq_lane_u32(vreinterpretq_u32_u8(a), 3)));
+		}
+	}
+	else if (bpp == 3)
+	{
+		uint8x8_t a = vdup_n_u8(0);
+		for (; i + 3 <= len; i += 3)
+		{
+			a = vadd_u8(a, load_px(in + i, 3));
+			store_px(out + i, a, 3);
+		}
+	}
+	return i;
+}
+
+static size_t
+predict_avg_simd(unsigned char *out, const unsigned char *in, const unsigned char *ref, size_t len, int bpp)
+{
+	uint8x8_t a = vdup_n_u8(0);
+	size_t i = 0;
+
+	if (bpp != 3 && bpp != 4)
+		return 0;
+	for (; i + bpp <= len; i += bpp)
+	{
+		a = vadd_u8(load_px(in + i, bpp), vhadd_u8(a, load_px(ref + i, bpp)));
+		store_px(out + i, a, bpp);
+	}
+	return i;
+}
+
+static size_t
+predict_paeth_simd(unsigned char *out, const unsigned char *in, const unsigned char *ref, size_t len, int bpp)
+{
+	uint8x8_t a = vdup_n_u8(0), c = a;
+	size_t i = 0;
+
+	if (bpp != 3 && bpp != 4)
+		return 0;
+	/* same as paeth(); pc saturates at 255, which doesn't change the comparisons */
+	for (; i + bpp <= len; i += bpp)
+	{
+		uint8x8_t b = load_px(ref + i, bpp);
+		uint8x8_t pa = vabd_u8(b, c);
+		uint8x8_t pb = vabd_u8(a, c);
+		uint8x8_t pc = vqmovn_u16(vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c)));
+		uint8x8_t usea = vand_u8(vcle_u8(pa, pb), vcle_u8(pa, pc));
+		uint8x8_t nearest = vbsl_u8(usea, a, vbsl_u8(vcle_u8(pb, pc), b, c));
+		a = vadd_u8(load_px(in + i, bpp), nearest);
+		store_px(out + i, a, bpp);
+		c = b;
+	}
+	return i;
+}
+
+#else
+
+#define predict_up_simd(out, in, ref, len) 0
+#define predict_sub_simd(out, in, len, bpp) 0
+#define predict_avg_simd(out, in, ref, len, bpp) 0
+#define predict_paeth_simd(out, in, ref, len, bpp) 0
+
+#endif
+
+static void
+predict_sub(unsigned char *out, const unsigned char *in, size_t len, int bpp)
+{
+	size_t i = predict_sub_simd(out, in, len, bpp);
+	for (; i < (size_t)bpp && i < len; i++)
+		out[i] = in[i];
+	for (; i < len; i++)
+		out[i] = in[i] + out[i - bpp];
+}
+
 static void
 fz_predict_tiff(fz_predict *state, unsigned char *out, unsigned char *in)
 {
@@ -91,12 +393,10 @@ fz_predict_tiff(fz_predict *state, unsigned char *out, unsigned char *in)
 	for (k = 0; k < state->colors; k++)
 		left[k] = 0;
 
-	/* special fast case */
+	/* special fast case, same as png Sub */
 	if (state->bpc == 8)
 	{
-		for (i = 0; i < state->columns; i++)
-			for (k = 0; k < state->colors; k++)
-				*out++ = left[k] = (*in++ + left[k]) & 0xFF;
+		predict_sub(out, in, state->stride, state->colors);
 		return;
 	}
 
@@ -136,48 +436,26 @@ fz_predict_png(fz_context *ctx, fz_predict *state, unsigned char *out, unsigned
 		memcpy(out, in, len);
 		break;
 	case 1:
-		for (i = bpp; i > 0; i--)
-		{
-			*out++ = *in++;
-		}
-		for (i = len - bpp; i > 0; i--)
-		{
-			*out = *in++ + out[-bpp];
-			out++;
-		}
+		predict_sub(out, in, len, bpp);
 		break;
 	case 2:
-		for (i = bpp; i > 0; i--)
-		{
-			*out++ = *in++ + *ref++;
-		}
-		for (i = len - bpp; i > 0; i--)
-		{
-			*out++ = *in++ + *ref++;
-		}
+		i = predict_up_simd(out, in, ref, len);
+		for (; i < len; i++)
+			out[i] = in[i] + ref[i];
 		break;
 	case 3:
-		for (i = bpp; i > 0; i--)
-		{
-			*out++ = *in++ + (*ref++) / 2;
-		}
-		for (i = len - bpp; i > 0; i--)
-		{
-			*out = *in++ + (out[-bpp] + *ref++) / 2;
-			out++;
-		}
+		i = predict_avg_simd(out, in, ref, len, bpp);
+		for (; i < (size_t)bpp; i++)
+			out[i] = in[i] + ref[i] / 2;
+		for (; i < len; i++)
+			out[i] = in[i] + (out[i - bpp] + ref[i]) / 2;
 		break;
 	case 4:
-		for (i = bpp; i > 0; i--)
-		{
-			*out++ = *in++ + paeth(0, *ref++, 0);
-		}
-		for (i = len - bpp; i > 0; i --)
-		{
-			*out = *in++ + paeth(out[-bpp], *ref, ref[-bpp]);
-			ref++;
-			out++;
-		}
+		i = predict_paeth_simd(out, in, ref, len, bpp);
+		for (; i < (size_t)bpp; i++)
+			out[i] = in[i] + paeth(0, ref[i], 0);
+		for (; i < len; i++)
+			out[i] = in[i] + paeth(out[i - bpp], ref[i], ref[i - bpp]);
 		break;
 	}
 }
@@ -196,30 +474,38 @@ next_predict(fz_context *ctx, fz_stream *stm, size_t len)
 		len = sizeof(state->buffer);
 	ep = buf + len;
 
-	while (state->rp < state->wp && p < ep)
-		*p++ = *state->rp++;
+	n = fz_minz(state->wp - state->rp, ep - p);
+	memcpy(p, state->rp, n);
+	state->rp += n;
+	p += n;
 
 	while (p < ep)
 	{
+		unsigned char *row = state->out;
+
 		n = fz_read(ctx, state->chain, state->in, state->stride + ispng);
 		if (n == 0)
 			break;
 
 		if (state->predictor == 1)
-			memcpy(state->out, state->in, n);
+			memcpy(row, state->in, n);
 		else if (state->predictor == 2)
-			fz_predict_tiff(state, state->out, state->in);
+			fz_predict_tiff(state, row, state->in);
 		else
 		{
-			fz_predict_png(ctx, state, state->out, state->in + 1, n - 1, state->in[0]);
-			memcpy(state->ref, state->out, state->stride);
+			fz_predict_png(ctx, state, row, state->in + 1, n - 1, state->in[0]);
+			/* SumatraPDF: the decoded row is the reference for the next one, swap instead of copying */
+			state->out = state->ref;
+			state->ref = row;
 		}
 
-		state->rp = state->out;
-		state->wp = state->out + n - ispng;
+		state->rp = row;
+		state->wp = row + n - ispng;
 
-		while (state->rp < state->wp && p < ep)
-			*p++ = *state->rp++;
+		n = fz_minz(state->wp - state->rp, ep - p);
+		memcpy(p, state->rp, n);
+		state->rp += n;
+		p += n;
 	}
 
 	stm->rp = buf;
@@ -144,6 +144,52 @@ enum {
 	INDIRECT_NODE_THRESHOLD = (1<<9)-1
 };
 
+/* SumatraPDF: spatial index used by fz_run_display_list.
+ *
+ * The list is split into runs of consecutive nodes (chunks). For each
+ * chunk we record the union of the bounds of its nodes and the graphics
+ * state at its start (nodes only store changes to the state, so it can't
+ * be recovered from a node on its own). When the list is replayed for a
+ * scissor rect, a chunk that is completely outside of it is skipped in a
+ * single step instead of being walked node by node, so rendering a small
+ * tile of a huge page only visits the nodes near the tile. Chunks are
+ * visited in list order, so the painting order is preserved.
+ *
+ * Clips, masks and groups don't have to be balanced within a chunk. A
+ * chunk can only be skipped if the replay is at least 'need' levels deep
+ * inside culled clips (so that all pops in the chunk would be culled as
+ * well) and skipping it changes the depth by 'net'.
+ */
+#define INDEX_MIN_LEN 16384
+#define INDEX_CHUNK_CMDS 64
+
+enum
+{
+	/* tiles, render flags and default colorspaces are never culled */
+	CHUNK_ALWAYS_RUN = 1,
+	/* layers, structure and metatext are only culled if the device ignores them */
+	CHUNK_HAS_MARKUP = 2
+};
+
+typedef struct
+{
+	size_t pos;
+	fz_rect bounds;
+	int need;
+	int net;
+	int flags;
+
+	/* graphics state at the start of the chunk */
+	fz_rect rect;
+	fz_matrix ctm;
+	float alpha;
+	int cs; /* CS_GRAY_0, CS_RGB_0, CS_CMYK_0 or CS_OTHER_0 */
+	fz_colorspace *colorspace; /* for CS_OTHER_0, owned by the list */
+	float color[FZ_MAX_COLORS];
+	fz_stroke_state *stroke;
+	fz_path *path;
+} fz_list_chunk;
+
 struct fz_display_list
 {
 	fz_storable storable;
@@ -151,6 +197,8 @@ struct fz_display_list
 	fz_rect mediabox;
 	size_t max;
 	size_t len;
+	fz_list_chunk *chunks;
+	int nchunks;
 };
 
 typedef struct
@@ -1474,6 +1522,264 @@ fz_list_end_metatext(fz_context *ctx, fz_device *dev)
 		0); /* private_data_len */
 }
 
+/* SumatraPDF: like fz_union_rect but keeps zero area rects which
+ * fz_run_display_list doesn't cull for paths and text */
+static fz_rect
+union_valid_rect(fz_rect a, fz_rect b)
+{
+	if (!fz_is_valid_rect(b))
+		return a;
+	if (!fz_is_valid_rect(a))
+		return b;
+	if (b.x0 < a.x0)
+		a.x0 = b.x0;
+	if (b.y0 < a.y0)
+		a.y0 = b.y0;
+	if (b.x1 > a.x1)
+		a.x1 = b.x1;
+	if (b.y1 > a.y1)
+		a.y1 = b.y1;
+	return a;
+}
+
+/* SumatraPDF: build the chunk index (see fz_list_chunk). The graphics
+ * state is unpacked exactly like fz_run_display_list does it. */
+static void
+fz_index_display_list(fz_context *ctx, fz_display_list *list)
+{
+	fz_display_node *node = list->list;
+	fz_display_node *node_end = list->list + list->len;
+	fz_list_chunk *chunks;
+	fz_list_chunk *c = NULL;
+	size_t ncmds = 0;
+	int nchunks = 0;
+	int chunk_cmds = 0;
+	int depth = 0;
+
+	fz_rect rect = { 0 };
+	fz_matrix ctm = fz_identity;
+	float alpha = 1.0f;
+	int cs = CS_GRAY_0;
+	fz_colorspace *colorspace = NULL;
+	int cs_n = 1;
+	float color[FZ_MAX_COLORS] = { 0 };
+	fz_stroke_state *stroke = NULL;
+	fz_path *path = NULL;
+
+	if (list->len < INDEX_MIN_LEN || list->chunks)
+		return;
+
+	while (node != node_end)
+	{
+		size_t size = node->size;
+		if (size == INDIRECT_NODE_THRESHOLD)
+			memcpy(&size, &node[1], sizeof(size));
+		node += size;
+		ncmds++;
+	}
+
+	/* the index is optional so don't fail if there's not enough memory for it */
+	chunks = fz_malloc_no_throw(ctx, ((ncmds + INDEX_CHUNK_CMDS - 1) / INDEX_CHUNK_CMDS) * sizeof(fz_list_chunk));
+	if (!chunks)
+		return;
+
+	node = list->list;
+	while (node != node_end)
+	{
+		fz_display_node n = *node;
+		size_t size = n.size;
+		fz_display_node *next;
+
+		if (!c || chunk_cmds == INDEX_CHUNK_CMDS)
+		{
+			c = &chunks[nchunks++];
+			c->pos = node - list->list;
+			c->bounds = fz_empty_rect;
+			c->need = 0;
+			c->net = 0;
+			c->flags = 0;
+			c->rect = rect;
+			c->ctm = ctm;
+			c->alpha = alpha;
+			c->cs = cs;
+			c->colorspace = colorspace;
+			memcpy(c->color, color, sizeof(color));
+			c->stroke = stroke;
+			c->path = path;
+			chunk_cmds = 0;
+			depth = 0;
+		}
+		chunk_cmds++;
+
+		if (size == INDIRECT_NODE_THRESHOLD)
+		{
+			memcpy(&size, &node[1], sizeof(size_t));
+			node += SIZE_IN_NODES(sizeof(size_t));
+			size -= SIZE_IN_NODES(sizeof(size_t));
+		}
+		next = node + size;
+
+		node++;
+		if (n.rect)
+		{
+			rect = *(fz_rect *)node;
+			node += SIZE_IN_NODES(sizeof(fz_rect));
+		}
+		if (n.cs)
+		{
+			int i;
+			colorspace = NULL;
+			switch (n.cs)
+			{
+			default:
+			case CS_GRAY_0:
+				cs = CS_GRAY_0;
+				cs_n = 1;
+				color[0] = 0.0f;
+				break;
+			case CS_GRAY_1:
+				cs = CS_GRAY_0;
+				cs_n = 1;
+				color[0] = 1.0f;
+				break;
+			case CS_RGB_0:
+			case CS_RGB_1:
+				cs = CS_RGB_0;
+				cs_n = 3;
+				for (i = 0; i < 3; i++)
+					color[i] = n.cs == CS_RGB_1 ? 1.0f : 0.0f;
+				break;
+			case CS_CMYK_0:
+			case CS_CMYK_1:
+				cs = CS_CMYK_0;
+				cs_n = 4;
+				color[0] = color[1] = color[2] = 0.0f;
+				color[3] = n.cs == CS_CMYK_1 ? 1.0f : 0.0f;
+				break;
+			case CS_OTHER_0:
+				align_node_for_pointer(&node);
+				cs = CS_OTHER_0;
+				colorspace = *(fz_colorspace **)node;
+				cs_n = fz_colorspace_n(ctx, colorspace);
+				node += SIZE_IN_NODES(sizeof(fz_colorspace *));
+				for (i = 0; i < cs_n; i++)
+					color[i] = 0.0f;
+				break;
+			}
+		}
+		if (n.color)
+		{
+			memcpy(color, (float *)node, cs_n * sizeof(float));
+			node += SIZE_IN_NODES(cs_n * sizeof(float));
+		}
+		if (n.alpha)
+		{
+			switch (n.alpha)
+			{
+			default:
+			case ALPHA_0:
+				alpha = 0.0f;
+				break;
+			case ALPHA_1:
+				alpha = 1.0f;
+				break;
+			case ALPHA_PRESENT:
+				alpha = *(float *)node;
+				node += SIZE_IN_NODES(sizeof(float));
+				break;
+			}
+		}
+		if (n.ctm != 0)
+		{
+			float *packed_ctm = (float *)node;
+			if (n.ctm & CTM_CHANGE_AD)
+			{
+				ctm.a = *packed_ctm++;
+				ctm.d = *packed_ctm++;
+				node += SIZE_IN_NODES(2*sizeof(float));
+			}
+			if (n.ctm & CTM_CHANGE_BC)
+			{
+				ctm.b = *packed_ctm++;
+				ctm.c = *packed_ctm++;
+				node += SIZE_IN_NODES(2*sizeof(float));
+			}
+			if (n.ctm & CTM_CHANGE_EF)
+			{
+				ctm.e = *packed_ctm++;
+				ctm.f = *packed_ctm;
+				node += SIZE_IN_NODES(2*sizeof(float));
+			}
+		}
+		if (n.stroke)
+		{
+			align_node_for_pointer(&node);
+			stroke = *(fz_stroke_state **)node;
+			node += SIZE_IN_NODES(sizeof(fz_stroke_state *));
+		}
+		if (n.path)
+		{
+			align_node_for_pointer(&node);
+			path = (fz_path *)node;
+		}
+
+		switch (n.cmd)
+		{
+		case FZ_CMD_CLIP_PATH:
+		case FZ_CMD_CLIP_STROKE_PATH:
+		case FZ_CMD_CLIP_TEXT:
+		case FZ_CMD_CLIP_STROKE_TEXT:
+		case FZ_CMD_CLIP_IMAGE_MASK:
+		case FZ_CMD_BEGIN_MASK:
+		case FZ_CMD_BEGIN_GROUP:
+			depth++;
+			c->bounds = union_valid_rect(c->bounds, rect);
+			break;
+		case FZ_CMD_POP_CLIP:
+		case FZ_CMD_END_GROUP:
+			/* culled only when the replay is inside a culled clip */
+			depth--;
+			if (-depth > c->need)
+				c->need = -depth;
+			break;
+		case FZ_CMD_END_MASK:
+			if (1 - depth > c->need)
+				c->need = 1 - depth;
+			break;
+		case FZ_CMD_BEGIN_TILE:
+		case FZ_CMD_END_TILE:
+		case FZ_CMD_RENDER_FLAGS:
+		case FZ_CMD_DEFAULT_COLORSPACES:
+			c->flags |= CHUNK_ALWAYS_RUN;
+			break;
+		case FZ_CMD_BEGIN_LAYER:
+		case FZ_CMD_END_LAYER:
+		case FZ_CMD_BEGIN_STRUCTURE:
+		case FZ_CMD_END_STRUCTURE:
+		case FZ_CMD_BEGIN_METATEXT:
+		case FZ_CMD_END_METATEXT:
+			c->flags |= CHUNK_HAS_MARKUP;
+			break;
+		default:
+			c->bounds = union_valid_rect(c->bounds, rect);
+			break;
+		}
+		c->net = depth;
+		node = next;
+	}
+
+	list->chunks = chunks;
+	list->nchunks = nchunks;
+}
+
+static void
+fz_list_close_device(fz_context *ctx, fz_device *dev)
+{
+	fz_list_device *writer = (fz_list_device *)dev;
+
+	fz_index_display_list(ctx, writer->list);
+}
+
 static void
 fz_list_drop_device(fz_context *ctx, fz_device *dev)
 {
@@ -1530,6 +1836,7 @@ fz_new_list_device(fz_context *ctx, fz_display_list *list)
 	dev->super.begin_metatext = fz_list_begin_metatext;
 	dev->super.end_metatext = fz_list_end_metatext;
 
+	dev->super.close_device = fz_list_close_device;
 	dev->super.drop_device = fz_list_drop_device;
 
 	dev->list = fz_keep_display_list(ctx, list);
@@ -1658,6 +1965,7 @@ fz_drop_display_list_imp(fz_context *ctx, fz_storable *list_)
 		}
 		node = next;
 	}
+	fz_free(ctx, list->chunks);
 	fz_free(ctx, list->list);
 	fz_free(ctx, list);
 }
@@ -1671,6 +1979,8 @@ fz_new_display_list(fz_context *ctx, fz_rect mediabox)
 	list->mediabox = mediabox;
 	list->max = 0;
 	list->len = 0;
+	list->chunks = NULL;
+	list->nchunks = 0;
 	return list;
 }
 
@@ -1699,6 +2009,60 @@ int fz_display_list_is_empty(fz_context *ctx, const fz_display_list *list)
 	return !list || list->len == 0;
 }
 
+/* SumatraPDF: set the graphics state of fz_run_display_list to what it
+ * is at the start of chunk c */
+static void
+restore_chunk_state(fz_context *ctx, const fz_list_chunk *c, fz_rect *rect, fz_matrix *ctm, float *alpha,
+	fz_colorspace **colorspace, float *color, fz_stroke_state **stroke, fz_path **path)
+{
+	*rect = c->rect;
+	*ctm = c->ctm;
+	*alpha = c->alpha;
+	fz_drop_colorspace(ctx, *colorspace);
+	switch (c->cs)
+	{
+	default:
+	case CS_GRAY_0:
+		*colorspace = fz_keep_colorspace(ctx, fz_device_gray(ctx));
+		break;
+	case CS_RGB_0:
+		*colorspace = fz_keep_colorspace(ctx, fz_device_rgb(ctx));
+		break;
+	case CS_CMYK_0:
+		*colorspace = fz_keep_colorspace(ctx, fz_device_cmyk(ctx));
+		break;
+	case CS_OTHER_0:
+		*colorspace = fz_keep_colorspace(ctx, c->colorspace);
+		break;
+	}
+	memcpy(color, c->color, sizeof(c->color));
+	if (*stroke != c->stroke)
+	{
+		fz_drop_stroke_state(ctx, *stroke);
+		*stroke = fz_keep_stroke_state(ctx, c->stroke);
+	}
+	if (*path != c->path)
+	{
+		fz_drop_path(ctx, *path);
+		*path = fz_keep_path(ctx, c->path);
+	}
+}
+
+/* SumatraPDF: can chunk c be skipped without changing the output? */
+static int
+can_skip_chunk(const fz_list_chunk *c, fz_matrix top_ctm, fz_rect scissor, int clipped, int skip_markup)
+{
+	if (c->flags & CHUNK_ALWAYS_RUN)
+		return 0;
+	if ((c->flags & CHUNK_HAS_MARKUP) && !skip_markup)
+		return 0;
+	if (clipped < c->need)
+		return 0;
+	if (!fz_is_valid_rect(c->bounds))
+		return 1;
+	return !fz_is_valid_rect(fz_intersect_rect(fz_transform_rect(c->bounds, top_ctm), scissor));
+}
+
 void
 fz_run_display_list(fz_context *ctx, fz_display_list *list, fz_device *dev, fz_matrix top_ctm, fz_rect scissor, fz_cookie *cookie)
 {
@@ -1724,6 +2088,12 @@ fz_run_display_list(fz_context *ctx, fz_display_list *list, fz_device *dev, fz_m
 	fz_matrix trans_ctm;
 	int tile_skip_depth = 0;
 
+	/* SumatraPDF: index of the next chunk that could be skipped */
+	int chunk = 0;
+	int skip_markup = !dev->begin_layer && !dev->end_layer &&
+		!dev->begin_structure && !dev->end_structure &&
+		!dev->begin_metatext && !dev->end_metatext;
+
 	if (cookie)
 	{
 		cookie->progress_max = list->len;
@@ -1737,8 +2107,35 @@ fz_run_display_list(fz_context *ctx, fz_display_list *list, fz_device *dev, fz_m
 	for (; node != node_end ; node = next_node)
 	{
 		int empty;
-		fz_display_node n = *node;
-		size_t size = n.size;
+		fz_display_node n;
+		size_t size;
+
+		/* SumatraPDF: skip chunks outside of the scissor rect */
+		if (chunk < list->nchunks && node == list->list + list->chunks[chunk].pos)
+		{
+			int skipped = 0;
+			size_t pos;
+			while (chunk < list->nchunks && !tiled && !tile_skip_depth &&
+				can_skip_chunk(&list->chunks[chunk], top_ctm, scissor, clipped, skip_markup))
+			{
+				clipped += list->chunks[chunk].net;
+				chunk++;
+				skipped = 1;
+			}
+			if (skipped)
+			{
+				pos = chunk < list->nchunks ? list->chunks[chunk].pos : list->len;
+				progress += (int)(pos - (node - list->list));
+				node = list->list + pos;
+				if (node == node_end)
+					break;
+				restore_chunk_state(ctx, &list->chunks[chunk], &rect, &ctm, &alpha, &colorspace, color, &stroke, &path);
+			}
+			chunk++;
+		}
+
+		n = *node;
+		size = n.size;
 
 		if (size == INDIRECT_NODE_THRESHOLD)
 		{
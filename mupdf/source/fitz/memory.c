@@ -41,12 +41,36 @@
  * except the _no_throw family which instead silently returns NULL.
  */
 
+static void *fz_malloc_default(void *opaque, size_t size);
+
+/* SumatraPDF: the system allocator is thread-safe so FZ_LOCK_ALLOC is
+ * only needed for scavenging (which modifies the store). Taking it for
+ * every allocation serializes all threads that allocate (e.g. renderers
+ * using cloned contexts). Custom allocators may rely on the lock, so they
+ * are still called with it held. */
+static int
+fz_alloc_needs_lock(fz_context *ctx)
+{
+#ifdef MEMENTO
+	return 1;
+#else
+	return ctx->alloc.malloc != fz_malloc_default;
+#endif
+}
+
 static void *
 do_scavenging_malloc(fz_context *ctx, size_t size)
 {
 	void *p;
 	int phase = 0;
 
+	if (!fz_alloc_needs_lock(ctx))
+	{
+		p = ctx->alloc.malloc(ctx->alloc.user, size);
+		if (p != NULL)
+			return p;
+	}
+
 	fz_lock(ctx, FZ_LOCK_ALLOC);
 	do {
 		p = ctx->alloc.malloc(ctx->alloc.user, size);
@@ -67,6 +91,13 @@ do_scavenging_realloc(fz_context *ctx, void *p, size_t size)
 	void *q;
 	int phase = 0;
 
+	if (!fz_alloc_needs_lock(ctx))
+	{
+		q = ctx->alloc.realloc(ctx->alloc.user, p, size);
+		if (q != NULL)
+			return q;
+	}
+
 	fz_lock(ctx, FZ_LOCK_ALLOC);
 	do {
 		q = ctx->alloc.realloc(ctx->alloc.user, p, size);
@@ -169,6 +200,11 @@ fz_free(fz_context *ctx, void *p)
 {
 	if (p)
 	{
+		if (!fz_alloc_needs_lock(ctx))
+		{
+			ctx->alloc.free(ctx->alloc.user, p);
+			return;
+		}
 		fz_lock(ctx, FZ_LOCK_ALLOC);
 		ctx->alloc.free(ctx->alloc.user, p);
 		fz_unlock(ctx, FZ_LOCK_ALLOC);
@@ -897,6 +897,110 @@ void fz_walk_path(fz_context *ctx, const fz_path *path, const fz_path_walker *pr
 	}
 }
 
+/* SumatraPDF: only the end points of segments are looked at. they lie on
+ * the path, so the result never says a path exceeds size when it doesn't */
+int
+fz_path_exceeds_size(fz_context *ctx, const fz_path *path, fz_matrix ctm, float size)
+{
+	int i, k, n, cmd_len;
+	float x = 0, y = 0, sx = 0, sy = 0;
+	fz_point p;
+	fz_rect r = fz_empty_rect;
+	uint8_t *cmds;
+	float *coords;
+
+	switch (path->packed)
+	{
+	case FZ_PATH_UNPACKED:
+	case FZ_PATH_PACKED_OPEN:
+		cmd_len = path->cmd_len;
+		coords = path->coords;
+		cmds = path->cmds;
+		break;
+	case FZ_PATH_PACKED_FLAT:
+		cmd_len = ((fz_packed_path *)path)->cmd_len;
+		coords = (float *)&((fz_packed_path *)path)[1];
+		cmds = (uint8_t *)&coords[((fz_packed_path *)path)->coord_len];
+		break;
+	default:
+		assert("This never happens" == NULL);
+		return 1;
+	}
+
+	for (k = 0, i = 0; i < cmd_len; i++)
+	{
+		uint8_t cmd = cmds[i];
+
+		/* number of coordinates before the end point */
+		switch (cmd)
+		{
+		case FZ_CURVETO:
+		case FZ_CURVETOCLOSE:
+			n = 4;
+			break;
+		case FZ_CURVETOV:
+		case FZ_CURVETOVCLOSE:
+		case FZ_CURVETOY:
+		case FZ_CURVETOYCLOSE:
+		case FZ_QUADTO:
+		case FZ_QUADTOCLOSE:
+			n = 2;
+			break;
+		default:
+			n = 0;
+			break;
+		}
+		k += n;
+
+		switch (cmd)
+		{
+		case FZ_HORIZTO:
+		case FZ_HORIZTOCLOSE:
+			x = coords[k++];
+			break;
+		case FZ_VERTTO:
+		case FZ_VERTTOCLOSE:
+			y = coords[k++];
+			break;
+		case FZ_DEGENLINETO:
+		case FZ_DEGENLINETOCLOSE:
+			break;
+		case FZ_RECTTO:
+			/* the opposite corner */
+			p = fz_transform_point_xy(coords[k+2], coords[k+3], ctm);
+			r = fz_include_point_in_rect(r, p);
+			x = coords[k];
+			y = coords[k+1];
+			k += 4;
+			break;
+		default:
+			x = coords[k];
+			y = coords[k+1];
+			k += 2;
+			break;
+		}
+		if (cmd == FZ_MOVETO || cmd == FZ_MOVETOCLOSE || cmd == FZ_RECTTO)
+		{
+			sx = x;
+			sy = y;
+		}
+
+		p = fz_transform_point_xy(x, y, ctm);
+		r = fz_include_point_in_rect(r, p);
+		if (r.x1 - r.x0 > size || r.y1 - r.y0 > size)
+			return 1;
+
+		/* lower case commands close the subpath */
+		if (cmd >= 'a' && cmd <= 'z')
+		{
+			x = sx;
+			y = sy;
+		}
+	}
+
+	return 0;
+}
+
 typedef struct
 {
 	fz_matrix ctm;
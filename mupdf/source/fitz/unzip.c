@@ -55,6 +55,11 @@ typedef struct
 
 	int count;
 	zip_entry *entries;
+
+	/* SumatraPDF: case-insensitive hash index over entries (see
+	 * build_zip_index). open addressing, slots hold entry index + 1 */
+	int index_size;
+	int *index;
 } fz_zip_archive;
 
 static void drop_zip_archive(fz_context *ctx, fz_archive *arch)
@@ -64,6 +69,7 @@ static void drop_zip_archive(fz_context *ctx, fz_archive *arch)
 	for (i = 0; i < zip->count; ++i)
 		fz_free(ctx, zip->entries[i].name);
 	fz_free(ctx, zip->entries);
+	fz_free(ctx, zip->index);
 }
 
 static int ishex(char c)
@@ -492,14 +498,57 @@ static void ensure_zip_entries(fz_context *ctx, fz_zip_archive *zip)
 	fz_throw(ctx, FZ_ERROR_FORMAT, "cannot find end of central directory");
 }
 
+/* SumatraPDF: CBZ, EPUB and XPS documents look up entries by name many
+ * times per page (XPS even probes several names per part), so instead of
+ * comparing against every entry, names are looked up in a hash table that
+ * is built once when the archive is opened. Hashing lower-cased bytes
+ * matches fz_strcasecmp. */
+static unsigned int hash_zip_name(const char *name)
+{
+	unsigned int h = 2166136261u;
+	while (*name)
+	{
+		h ^= (unsigned char) fz_tolower(*name++);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void build_zip_index(fz_context *ctx, fz_zip_archive *zip)
+{
+	int i, size = 16;
+	while (size / 2 < zip->count)
+		size *= 2;
+	zip->index = Memento_label(fz_calloc(ctx, size, sizeof(int)), "zip_index");
+	zip->index_size = size;
+	for (i = 0; i < zip->count; i++)
+	{
+		unsigned int slot = hash_zip_name(zip->entries[i].name) & (size - 1);
+		while (zip->index[slot])
+		{
+			/* keep the first of duplicate names, like a linear scan would */
+			if (!fz_strcasecmp(zip->entries[i].name, zip->entries[zip->index[slot] - 1].name))
+				break;
+			slot = (slot + 1) & (size - 1);
+		}
+		if (!zip->index[slot])
+			zip->index[slot] = i + 1;
+	}
+}
+
 static zip_entry *lookup_zip_entry(fz_context *ctx, fz_zip_archive *zip, const char *name)
 {
+	unsigned int slot;
 	int i;
 	if (name[0] == '/')
 		++name;
-	for (i = 0; i < zip->count; i++)
-		if (!fz_strcasecmp(name, zip->entries[i].name))
-			return &zip->entries[i];
+	slot = hash_zip_name(name) & (zip->index_size - 1);
+	while ((i = zip->index[slot]) != 0)
+	{
+		if (!fz_strcasecmp(name, zip->entries[i - 1].name))
+			return &zip->entries[i - 1];
+		slot = (slot + 1) & (zip->index_size - 1);
+	}
 	return NULL;
 }
 
@@ -673,6 +722,7 @@ fz_open_zip_archive_with_stream(fz_context *ctx, fz_stream *file)
 	fz_try(ctx)
 	{
 		ensure_zip_entries(ctx, zip);
+		build_zip_index(ctx, zip);
 	}
 	fz_catch(ctx)
 	{
@@ -111,7 +111,7 @@ static uint32_t
 mobi_read_data(fz_context *ctx, fz_buffer *out, fz_stream *stm, uint32_t *offset, uint32_t total_count, int format)
 {
 	// https://wiki.mobileread.com/wiki/MOBI
-	uint32_t compression, text_length, record_count, text_encoding, i;
+	uint32_t compression, text_length, record_count, text_encoding, encryption, i;
 	unsigned char buf[4];
 	fz_range range = { 0 };
 	fz_stream *rec = NULL;
@@ -131,7 +131,7 @@ mobi_read_data(fz_context *ctx, fz_buffer *out, fz_stream *stm, uint32_t *offset
 		text_length = fz_read_uint32(ctx, rec);
 		record_count = fz_read_uint16(ctx, rec);
 		skip_bytes(ctx, rec, 2);
-		skip_bytes(ctx, rec, 2); // encryption
+		encryption = fz_read_uint16(ctx, rec);
 		skip_bytes(ctx, rec, 2);
 
 		// Optional MOBI header
@@ -149,6 +149,10 @@ mobi_read_data(fz_context *ctx, fz_buffer *out, fz_stream *stm, uint32_t *offset
 	fz_catch(ctx)
 		fz_rethrow(ctx);
 
+	/* SumatraPDF: the text of DRM protected books would be garbage. only BOOKMOBI
+	 * has an encryption field, in PalmDoc it's the high word of the reading position */
+	if (format == FORMAT_HTML && encryption != 0)
+		fz_throw(ctx, FZ_ERROR_FORMAT, "encrypted mobi documents are not supported");
 	if (compression != COMPRESSION_NONE && compression != COMPRESSION_PALMDOC)
 		fz_throw(ctx, FZ_ERROR_FORMAT, "unknown compression method");
 	if (text_encoding != TEXT_ENCODING_LATIN_1 &&
@@ -3066,30 +3066,34 @@ pdf_new_run_processor(fz_context *ctx, pdf_document *doc, fz_device *dev, fz_mat
 		proc->super.op_Q = pdf_run_Q;
 		proc->super.op_cm = pdf_run_cm;
 
-		/* path construction */
-		proc->super.op_m = pdf_run_m;
-		proc->super.op_l = pdf_run_l;
-		proc->super.op_c = pdf_run_c;
-		proc->super.op_v = pdf_run_v;
-		proc->super.op_y = pdf_run_y;
-		proc->super.op_h = pdf_run_h;
-		proc->super.op_re = pdf_run_re;
-
-		/* path painting */
-		proc->super.op_S = pdf_run_S;
-		proc->super.op_s = pdf_run_s;
-		proc->super.op_F = pdf_run_F;
-		proc->super.op_f = pdf_run_f;
-		proc->super.op_fstar = pdf_run_fstar;
-		proc->super.op_B = pdf_run_B;
-		proc->super.op_Bstar = pdf_run_Bstar;
-		proc->super.op_b = pdf_run_b;
-		proc->super.op_bstar = pdf_run_bstar;
-		proc->super.op_n = pdf_run_n;
-
-		/* clipping paths */
-		proc->super.op_W = pdf_run_W;
-		proc->super.op_Wstar = pdf_run_Wstar;
+		/* SumatraPDF: don't construct paths for devices that ignore them (e.g. text extraction) */
+		if (dev->fill_path || dev->stroke_path || dev->clip_path || dev->clip_stroke_path)
+		{
+			/* path construction */
+			proc->super.op_m = pdf_run_m;
+			proc->super.op_l = pdf_run_l;
+			proc->super.op_c = pdf_run_c;
+			proc->super.op_v = pdf_run_v;
+			proc->super.op_y = pdf_run_y;
+			proc->super.op_h = pdf_run_h;
+			proc->super.op_re = pdf_run_re;
+
+			/* path painting */
+			proc->super.op_S = pdf_run_S;
+			proc->super.op_s = pdf_run_s;
+			proc->super.op_F = pdf_run_F;
+			proc->super.op_f = pdf_run_f;
+			proc->super.op_fstar = pdf_run_fstar;
+			proc->super.op_B = pdf_run_B;
+			proc->super.op_Bstar = pdf_run_Bstar;
+			proc->super.op_b = pdf_run_b;
+			proc->super.op_bstar = pdf_run_bstar;
+			proc->super.op_n = pdf_run_n;
+
+			/* clipping paths */
+			proc->super.op_W = pdf_run_W;
+			proc->super.op_Wstar = pdf_run_Wstar;
+		}
 
 		/* text objects */
 		proc->super.op_BT = pdf_run_BT;
@@ -3138,7 +3142,9 @@ pdf_new_run_processor(fz_context *ctx, pdf_document *doc, fz_device *dev, fz_mat
 		proc->super.op_k = pdf_run_k;
 
 		/* shadings, images, xobjects */
-		proc->super.op_sh = pdf_run_sh;
+		/* SumatraPDF: don't load shadings for devices that ignore them */
+		if (dev->fill_shade)
+			proc->super.op_sh = pdf_run_sh;
 		if (dev->fill_image || dev->fill_image_mask || dev->clip_image_mask)
 		{
 			proc->super.op_BI = pdf_run_BI;
@@ -366,7 +366,7 @@ pdf_load_shading_dict(fz_context *ctx, pdf_document *doc, pdf_obj *dict, fz_matr
 	fz_try(ctx)
 	{
 		shade = fz_malloc_struct(ctx, fz_shade);
-		FZ_INIT_STORABLE(shade, 1, fz_drop_shade_imp);
+		FZ_INIT_KEY_STORABLE(shade, 1, fz_drop_shade_imp);
 		shade->type = FZ_MESH_TYPE4;
 		shade->use_background = 0;
 		shade->function_stride = 0;
@@ -396,16 +396,165 @@ xps_count_pages(fz_context *ctx, fz_document *doc_, int chapter)
 	return doc->page_count;
 }
 
+/* SumatraPDF: parsed FixedPage trees are kept in the store, so that
+reloading a page (e.g. when paging back and forth) doesn't parse it again.
+The trees are not modified after loading and are shared between pages. */
+typedef struct
+{
+	fz_storable storable;
+	fz_xml_doc *xml;
+} xps_stored_page;
+
+typedef struct
+{
+	int refs;
+	void *doc;
+	int number;
+} xps_page_key;
+
+static void
+xps_drop_stored_page_imp(fz_context *ctx, fz_storable *stored_)
+{
+	xps_stored_page *stored = (xps_stored_page *)stored_;
+	fz_drop_xml(ctx, stored->xml);
+	fz_free(ctx, stored);
+}
+
+static int
+xps_make_hash_page_key(fz_context *ctx, fz_store_hash *hash, void *key_)
+{
+	xps_page_key *key = (xps_page_key *)key_;
+	hash->u.pi.ptr = key->doc;
+	hash->u.pi.i = key->number;
+	return 1;
+}
+
+static void *
+xps_keep_page_key(fz_context *ctx, void *key_)
+{
+	xps_page_key *key = (xps_page_key *)key_;
+	return fz_keep_imp(ctx, key, &key->refs);
+}
+
+static void
+xps_drop_page_key(fz_context *ctx, void *key_)
+{
+	xps_page_key *key = (xps_page_key *)key_;
+	if (fz_drop_imp(ctx, key, &key->refs))
+		fz_free(ctx, key);
+}
+
+static int
+xps_cmp_page_key(fz_context *ctx, void *k0_, void *k1_)
+{
+	xps_page_key *k0 = (xps_page_key *)k0_;
+	xps_page_key *k1 = (xps_page_key *)k1_;
+	return k0->doc == k1->doc && k0->number == k1->number;
+}
+
+static void
+xps_format_page_key(fz_context *ctx, char *s, size_t n, void *key_)
+{
+	xps_page_key *key = (xps_page_key *)key_;
+	fz_snprintf(s, n, "(xps page doc=%p, page=%d)", key->doc, key->number);
+}
+
+static const fz_store_type xps_page_store_type =
+{
+	"xps_fixed_page",
+	xps_make_hash_page_key,
+	xps_keep_page_key,
+	xps_drop_page_key,
+	xps_cmp_page_key,
+	xps_format_page_key,
+	NULL
+};
+
+static fz_xml_doc *
+xps_find_stored_page(fz_context *ctx, xps_document *doc, int number)
+{
+	xps_page_key key;
+	xps_stored_page *stored;
+	fz_xml_doc *xml;
+
+	key.refs = 1;
+	key.doc = doc;
+	key.number = number;
+	stored = fz_find_item(ctx, xps_drop_stored_page_imp, &key, &xps_page_store_type);
+	if (!stored)
+		return NULL;
+	xml = fz_keep_xml(ctx, stored->xml);
+	fz_drop_storable(ctx, (fz_storable *)stored);
+	return xml;
+}
+
+static void
+xps_store_page(fz_context *ctx, xps_document *doc, int number, fz_xml_doc *xml, size_t size)
+{
+	xps_page_key *key = NULL;
+	xps_stored_page *stored = NULL;
+	void *existing;
+
+	fz_var(key);
+	fz_var(stored);
+
+	fz_try(ctx)
+	{
+		stored = fz_malloc_struct(ctx, xps_stored_page);
+		FZ_INIT_STORABLE(stored, 1, xps_drop_stored_page_imp);
+		stored->xml = fz_keep_xml(ctx, xml);
+		key = fz_malloc_struct(ctx, xps_page_key);
+		key->refs = 1;
+		key->doc = doc;
+		key->number = number;
+		existing = fz_store_item(ctx, key, stored, size, &xps_page_store_type);
+		if (existing)
+			fz_drop_storable(ctx, existing);
+	}
+	fz_always(ctx)
+	{
+		xps_drop_page_key(ctx, key);
+		fz_drop_storable(ctx, (fz_storable *)stored);
+	}
+	fz_catch(ctx)
+	{
+		/* Not caching the page is not an error */
+		fz_report_error(ctx);
+	}
+}
+
+static int
+xps_filter_stored_page(fz_context *ctx, void *doc, void *key_)
+{
+	xps_page_key *key = (xps_page_key *)key_;
+	return doc == key->doc;
+}
+
+void
+xps_purge_stored_pages(fz_context *ctx, xps_document *doc)
+{
+	fz_filter_store(ctx, xps_filter_stored_page, doc, &xps_page_store_type);
+}
+
 static fz_xml_doc *
-xps_load_fixed_page(fz_context *ctx, xps_document *doc, xps_fixpage *page)
+xps_load_fixed_page(fz_context *ctx, xps_document *doc, xps_fixpage *page, int number)
 {
 	xps_part *part;
 	fz_xml_doc *xml = NULL;
 	fz_xml *root;
 	char *width_att;
 	char *height_att;
+	size_t size;
+
+	xml = xps_find_stored_page(ctx, doc, number);
+	if (xml)
+	{
+		/* width and height were set when the page was first loaded */
+		return xml;
+	}
 
 	part = xps_read_part(ctx, doc, page->name);
+	size = fz_buffer_storage(ctx, part->data, NULL);
 	fz_try(ctx)
 	{
 		xml = fz_parse_xml(ctx, part->data, 0);
@@ -445,6 +594,9 @@ xps_load_fixed_page(fz_context *ctx, xps_document *doc, xps_fixpage *page)
 		fz_rethrow(ctx);
 	}
 
+	/* the parsed tree takes roughly twice the size of the XML */
+	xps_store_page(ctx, doc, number, xml, size * 2);
+
 	return xml;
 }
 
@@ -481,7 +633,7 @@ xps_load_page(fz_context *ctx, fz_document *doc_, int chapter, int number)
 	{
 		if (n == number)
 		{
-			xml = xps_load_fixed_page(ctx, doc, fix);
+			xml = xps_load_fixed_page(ctx, doc, fix, number);
 			fz_try(ctx)
 			{
 				page = fz_new_derived_page(ctx, xps_page, doc_);
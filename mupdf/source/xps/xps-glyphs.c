@@ -96,20 +96,45 @@ xps_measure_font_glyph(fz_context *ctx, xps_document *doc, fz_font *font, int gi
 	mtx->vorg = (float) face->ascender / face->units_per_EM;
 }
 
+/* SumatraPDF: the font table is hashed by part name, see XPS_FONT_TABLE_SIZE */
+static unsigned int
+xps_hash_font_part(char *partname)
+{
+	unsigned int h = 0;
+	while (*partname)
+		h = h * 31 + fz_tolower((unsigned char) *partname++);
+	return h % XPS_FONT_TABLE_SIZE;
+}
+
 static fz_font *
-xps_lookup_font_imp(fz_context *ctx, xps_document *doc, char *name)
+xps_lookup_font_imp(fz_context *ctx, xps_document *doc, char *partname, char *name)
 {
 	xps_font_cache *cache;
-	for (cache = doc->font_table; cache; cache = cache->next)
+	for (cache = doc->font_table[xps_hash_font_part(partname)]; cache; cache = cache->next)
 		if (!xps_strcasecmp(cache->name, name))
 			return fz_keep_font(ctx, cache->font);
 	return NULL;
 }
 
+/* SumatraPDF: a font part already loaded with another style simulation
+has been read (and deobfuscated) before, so share its buffer */
+static fz_buffer *
+xps_lookup_font_buffer(fz_context *ctx, xps_document *doc, char *partname)
+{
+	xps_font_cache *cache;
+	size_t n = strlen(partname);
+	for (cache = doc->font_table[xps_hash_font_part(partname)]; cache; cache = cache->next)
+		if (!fz_strncasecmp(cache->name, partname, n) && (cache->name[n] == 0 || cache->name[n] == '#'))
+			if (cache->font->buffer)
+				return fz_keep_buffer(ctx, cache->font->buffer);
+	return NULL;
+}
+
 static void
-xps_insert_font(fz_context *ctx, xps_document *doc, char *name, fz_font *font)
+xps_insert_font(fz_context *ctx, xps_document *doc, char *partname, char *name, fz_font *font)
 {
 	xps_font_cache *cache = fz_malloc_struct(ctx, xps_font_cache);
+	unsigned int h = xps_hash_font_part(partname);
 	cache->font = NULL;
 	cache->name = NULL;
 
@@ -117,7 +142,7 @@ xps_insert_font(fz_context *ctx, xps_document *doc, char *name, fz_font *font)
 	{
 		cache->font = fz_keep_font(ctx, font);
 		cache->name = fz_strdup(ctx, name);
-		cache->next = doc->font_table;
+		cache->next = doc->font_table[h];
 	}
 	fz_catch(ctx)
 	{
@@ -127,7 +152,7 @@ xps_insert_font(fz_context *ctx, xps_document *doc, char *name, fz_font *font)
 		fz_rethrow(ctx);
 	}
 
-	doc->font_table = cache;
+	doc->font_table[h] = cache;
 }
 
 /*
@@ -213,6 +238,21 @@ xps_select_best_font_encoding(fz_context *ctx, xps_document *doc, fz_font *font)
 	fz_warn(ctx, "cannot find a suitable cmap");
 }
 
+static void
+xps_apply_style_simulation(fz_context *ctx, fz_font *font, char *style_att)
+{
+	if (style_att)
+	{
+		fz_font_flags_t *flags = fz_font_flags(font);
+		int bold = !!strstr(style_att, "Bold");
+		int italic = !!strstr(style_att, "Italic");
+		flags->fake_bold = bold;
+		flags->is_bold = bold;
+		flags->fake_italic = italic;
+		flags->is_italic = italic;
+	}
+}
+
 fz_font *
 xps_lookup_font(fz_context *ctx, xps_document *doc, char *base_uri, char *font_uri, char *style_att)
 {
@@ -243,12 +283,36 @@ xps_lookup_font(fz_context *ctx, xps_document *doc, char *base_uri, char *font_u
 			fz_strlcat(fakename, "#BoldItalic", sizeof fakename);
 	}
 
-	font = xps_lookup_font_imp(ctx, doc, fakename);
+	font = xps_lookup_font_imp(ctx, doc, partname, fakename);
 	if (!font)
 	{
 		fz_buffer *buf = NULL;
 		fz_var(buf);
 
+		buf = xps_lookup_font_buffer(ctx, doc, partname);
+		if (buf)
+		{
+			fz_var(font);
+			fz_try(ctx)
+			{
+				font = fz_new_font_from_buffer(ctx, NULL, buf, subfontid, 1);
+				xps_select_best_font_encoding(ctx, doc, font);
+				xps_insert_font(ctx, doc, partname, fakename, font);
+			}
+			fz_always(ctx)
+			{
+				fz_drop_buffer(ctx, buf);
+			}
+			fz_catch(ctx)
+			{
+				fz_drop_font(ctx, font);
+				fz_warn(ctx, "cannot load font resource '%s'", partname);
+				return NULL;
+			}
+			xps_apply_style_simulation(ctx, font, style_att);
+			return font;
+		}
+
 		fz_try(ctx)
 		{
 			part = xps_read_part(ctx, doc, partname);
@@ -285,7 +349,7 @@ xps_lookup_font(fz_context *ctx, xps_document *doc, char *base_uri, char *font_u
 		{
 			font = fz_new_font_from_buffer(ctx, NULL, part->data, subfontid, 1);
 			xps_select_best_font_encoding(ctx, doc, font);
-			xps_insert_font(ctx, doc, fakename, font);
+			xps_insert_font(ctx, doc, partname, fakename, font);
 		}
 		fz_always(ctx)
 		{
@@ -298,16 +362,7 @@ xps_lookup_font(fz_context *ctx, xps_document *doc, char *base_uri, char *font_u
 			return NULL;
 		}
 
-		if (style_att)
-		{
-			fz_font_flags_t *flags = fz_font_flags(font);
-			int bold = !!strstr(style_att, "Bold");
-			int italic = !!strstr(style_att, "Italic");
-			flags->fake_bold = bold;
-			flags->is_bold = bold;
-			flags->fake_italic = italic;
-			flags->is_italic = italic;
-		}
+		xps_apply_style_simulation(ctx, font, style_att);
 	}
 	return font;
 }
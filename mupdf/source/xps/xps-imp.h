@@ -103,6 +103,20 @@ struct xps_font_cache_s
 	xps_font_cache *next;
 };
 
+/* SumatraPDF: fonts are hashed by part name (without style simulation),
+so all variants of a font part share a bucket and its font buffer */
+#define XPS_FONT_TABLE_SIZE 64
+
+typedef struct xps_remote_dict_s xps_remote_dict;
+
+/* SumatraPDF: parsed remote ResourceDictionary parts, shared by all pages */
+struct xps_remote_dict_s
+{
+	char *name;
+	fz_xml_doc *xml;
+	xps_remote_dict *next;
+};
+
 typedef struct xps_glyph_metrics_s xps_glyph_metrics;
 
 struct xps_glyph_metrics_s
@@ -139,6 +153,10 @@ void xps_drop_resource_dictionary(fz_context *ctx, xps_document *doc, xps_resour
 void xps_resolve_resource_reference(fz_context *ctx, xps_document *doc, xps_resource *dict, char **attp, fz_xml **tagp, char **urip);
 
 void xps_print_resource_dictionary(fz_context *ctx, xps_document *doc, xps_resource *dict);
+void xps_drop_remote_dictionaries(fz_context *ctx, xps_document *doc);
+
+/* SumatraPDF: parsed FixedPage trees are kept in the store */
+void xps_purge_stored_pages(fz_context *ctx, xps_document *doc);
 
 void xps_parse_fixed_page(fz_context *ctx, xps_document *doc, fz_matrix ctm, xps_page *page);
 void xps_parse_canvas(fz_context *ctx, xps_document *doc, fz_matrix ctm, fz_rect area, char *base_uri, xps_resource *dict, fz_xml *node);
@@ -208,7 +226,10 @@ struct xps_document_s
 	char *part_uri; /* part uri for parsing metadata relations */
 
 	/* We cache font resources */
-	xps_font_cache *font_table;
+	xps_font_cache *font_table[XPS_FONT_TABLE_SIZE];
+
+	/* SumatraPDF: and remote resource dictionaries */
+	xps_remote_dict *remote_dicts;
 
 	/* Opacity attribute stack */
 	float opacity[64];
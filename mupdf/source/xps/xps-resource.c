@@ -76,14 +76,74 @@ xps_resolve_resource_reference(fz_context *ctx, xps_document *doc, xps_resource
 	}
 }
 
+/* SumatraPDF: remote dictionaries are typically shared by every page of
+a document, so parse each part once and keep it for the document's lifetime */
+static fz_xml_doc *
+xps_load_remote_dictionary_xml(fz_context *ctx, xps_document *doc, char *part_name)
+{
+	xps_remote_dict *remote;
+	xps_part *part;
+	fz_xml_doc *xml = NULL;
+
+	fz_var(xml);
+
+	for (remote = doc->remote_dicts; remote; remote = remote->next)
+		if (!strcmp(remote->name, part_name))
+			return fz_keep_xml(ctx, remote->xml);
+
+	part = xps_read_part(ctx, doc, part_name);
+	fz_try(ctx)
+	{
+		xml = fz_parse_xml(ctx, part->data, 0);
+		if (!fz_xml_is_tag(fz_xml_root(xml), "ResourceDictionary"))
+			fz_throw(ctx, FZ_ERROR_FORMAT, "expected ResourceDictionary element");
+
+		remote = fz_malloc_struct(ctx, xps_remote_dict);
+		fz_try(ctx)
+			remote->name = fz_strdup(ctx, part_name);
+		fz_catch(ctx)
+		{
+			fz_free(ctx, remote);
+			fz_rethrow(ctx);
+		}
+		remote->xml = fz_keep_xml(ctx, xml);
+		remote->next = doc->remote_dicts;
+		doc->remote_dicts = remote;
+	}
+	fz_always(ctx)
+	{
+		xps_drop_part(ctx, doc, part);
+	}
+	fz_catch(ctx)
+	{
+		fz_drop_xml(ctx, xml);
+		fz_rethrow(ctx);
+	}
+
+	return xml;
+}
+
+void
+xps_drop_remote_dictionaries(fz_context *ctx, xps_document *doc)
+{
+	xps_remote_dict *remote, *next;
+	for (remote = doc->remote_dicts; remote; remote = next)
+	{
+		next = remote->next;
+		fz_drop_xml(ctx, remote->xml);
+		fz_free(ctx, remote->name);
+		fz_free(ctx, remote);
+	}
+	doc->remote_dicts = NULL;
+}
+
 static xps_resource *
 xps_parse_remote_resource_dictionary(fz_context *ctx, xps_document *doc, char *base_uri, char *source_att)
 {
 	char part_name[1024];
 	char part_uri[1024];
-	xps_part *part;
 	xps_resource *dict = NULL;
-	fz_xml_doc *xml = NULL;
+	fz_xml_doc *xml;
 	char *s;
 
 	fz_var(xml);
@@ -91,13 +151,9 @@ xps_parse_remote_resource_dictionary(fz_context *ctx, xps_document *doc, char *b
 	/* External resource dictionaries MUST NOT reference other resource dictionaries */
 	xps_resolve_url(ctx, doc, part_name, base_uri, source_att, sizeof part_name);
 
-	part = xps_read_part(ctx, doc, part_name);
+	xml = xps_load_remote_dictionary_xml(ctx, doc, part_name);
 	fz_try(ctx)
 	{
-		xml = fz_parse_xml(ctx, part->data, 0);
-		if (!fz_xml_is_tag(fz_xml_root(xml), "ResourceDictionary"))
-			fz_throw(ctx, FZ_ERROR_FORMAT, "expected ResourceDictionary element");
-
 		fz_strlcpy(part_uri, part_name, sizeof part_uri);
 		s = strrchr(part_uri, '/');
 		if (s)
@@ -112,7 +168,6 @@ xps_parse_remote_resource_dictionary(fz_context *ctx, xps_document *doc, char *b
 	}
 	fz_always(ctx)
 	{
-		xps_drop_part(ctx, doc, part);
 		fz_drop_xml(ctx, xml);
 	}
 	fz_catch(ctx)
@@ -225,20 +225,28 @@ xps_drop_document(fz_context *ctx, fz_document *doc_)
 {
 	xps_document *doc = (xps_document*)doc_;
 	xps_font_cache *font, *next;
+	int i;
+
+	xps_purge_stored_pages(ctx, doc);
 
 	if (doc->zip)
 		fz_drop_archive(ctx, doc->zip);
 
-	font = doc->font_table;
-	while (font)
+	for (i = 0; i < XPS_FONT_TABLE_SIZE; i++)
 	{
-		next = font->next;
-		fz_drop_font(ctx, font->font);
-		fz_free(ctx, font->name);
-		fz_free(ctx, font);
-		font = next;
+		font = doc->font_table[i];
+		while (font)
+		{
+			next = font->next;
+			fz_drop_font(ctx, font->font);
+			fz_free(ctx, font->name);
+			fz_free(ctx, font);
+			font = next;
+		}
 	}
 
+	xps_drop_remote_dictionaries(ctx, doc);
+
 	xps_drop_page_list(ctx, doc);
 
 	fz_free(ctx, doc->start_part);
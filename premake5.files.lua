@@ -648,6 +648,7 @@ function sumatrapdf_files()
     "Menu.*",
     "Notifications.*",
     "PdfSync.*",
+    "PdfToImage.*",
     "Print.*",
     "ProgressUpdateUI.*",
     "RenderCache.*",
@@ -669,12 +670,14 @@ function sumatrapdf_files()
     "SumatraProperties.*",
     "StressTesting.*",
     "SvgIcons.*",
+    "SymbolDetection.*",
     "TableOfContents.*",
     "Tabs.*",
     "Tester.*",
     "TextSearch.*",
     "TextSelection.*",
     "Theme.*",
+    "TileCache.*",
     "Toolbar.*",
     "Translations.*",
     "TranslationLangs.cpp",
@@ -751,6 +754,7 @@ function utils_files()
     "JsonParser.*",
     "Log.*",
     "LzmaSimpleArchive.*",
+    "PatternMatcher.*",
     "RegistryPaths.*",
     "Scoped.h",
     "ScopedWin.h",
@@ -807,6 +811,7 @@ function engines_files()
     "EngineImages.*",
     "EngineMupdf.*",
     "EngineMupdfImpl.*",
+    "EnginePlainText.*",
     "EnginePs.*",
     "EngineAll.h",
     "EbookDoc.*",
@@ -1162,6 +1167,7 @@ function test_util_files()
     "HtmlPrettyPrint.*",
     "HtmlPullParser.*",
     "JsonParser.*",
+    "PatternMatcher.*",
     "Scoped.*",
     "SettingsUtil.*",
     "Log.*",
@@ -3,6 +3,7 @@
 
 #include "utils/BaseUtil.h"
 #include "utils/StrFormat.h"
+#include "utils/ByteWriter.h"
 #include "utils/WinDynCalls.h"
 #include "utils/CmdLineArgsIter.h"
 #include "utils/DbgHelpDyn.h"
@@ -153,6 +154,30 @@ TempStr GetPathInAppDataDirTemp(const char* name) {
     return path::JoinTemp(dir, name);
 }
 
+// a fingerprint of the file's content, used for naming cache files. hashing
+// the whole file would be too expensive for big files on slow drives, so we
+// hash the size, modification time and the beginning of the file
+TempStr GetFileFingerprintTemp(const char* filePath) {
+    if (!filePath || !file::Exists(filePath)) {
+        return nullptr;
+    }
+    constexpr int kHashedPrefixSize = 64 * 1024;
+    ByteWriterLE w(kHashedPrefixSize + 16);
+    w.Write64((u64)file::GetSize(filePath));
+    FILETIME modTime = file::GetModificationTime(filePath);
+    w.Write32(modTime.dwLowDateTime);
+    w.Write32(modTime.dwHighDateTime);
+    char* buf = AllocArrayTemp<char>(kHashedPrefixSize);
+    int n = file::ReadN(filePath, buf, kHashedPrefixSize);
+    if (n > 0) {
+        w.d.Append(buf, (size_t)n);
+    }
+    u8 digest[16]{};
+    CalcMD5Digest(w.d.Get(), (int)w.Size(), digest);
+    AutoFreeStr hex = str::MemToHex(digest, dimof(digest));
+    return str::DupTemp(hex.Get());
+}
+
 // List of rules used to detect TeX editors.
 
 #define kRegCurrentVer "Software\\Microsoft\\Windows\\CurrentVersion"
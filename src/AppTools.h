@@ -32,6 +32,7 @@ bool IsDllBuild();
 void SetAppDataDir(const char* path);
 TempStr GetAppDataDirTemp();
 TempStr GetPathInAppDataDirTemp(const char* fileName);
+TempStr GetFileFingerprintTemp(const char* filePath);
 
 void DetectTextEditors(Vec<TextEditor*>&);
 char* BuildOpenFileCmd(const char* pattern, const char* path, int line, int col);
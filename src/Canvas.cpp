@@ -51,6 +51,7 @@
 #include "Tabs.h"
 #include "Toolbar.h"
 #include "Translations.h"
+#include "SymbolDetection.h"
 
 #include "utils/Log.h"
 
@@ -1025,6 +1026,12 @@ static bool DrawDocument(MainWindow* win, HDC hdc, RECT* rcArea) {
                     DrawCenteredText(hdc, bounds, _TRA("Please wait - rendering..."), isRtl);
                 }
                 rendering = true;
+            } else if (dm->GetEngine()->IsPartiallyLoaded()) {
+                // the page's data hasn't been read yet, the render is retried on the next paint
+                auto prevCol = SetTextColor(hdc, colDocTxt);
+                DrawCenteredText(hdc, bounds, _TRA("Please wait - loading..."), isRtl);
+                SetTextColor(hdc, prevCol);
+                ScheduleRepaint(win, REPAINT_MESSAGE_DELAY_IN_MS / 2);
             } else {
 #if 0
                 AutoDeletePen pen(CreatePen(PS_SOLID, 2, RGB(0xff, 0, 0)));
@@ -1063,6 +1070,7 @@ static bool DrawDocument(MainWindow* win, HDC hdc, RECT* rcArea) {
 
     WindowTab* tab = win->CurrentTab();
     PaintCurrentEditAnnotationMark(tab, hdc, dm);
+    PaintSymbolDetections(tab, hdc, dm);
 
     if (win->showSelection) {
         PaintSelection(win, hdc);
@@ -336,3 +336,4 @@ constexpr const char* kCmdArgCommandLine = "cmdline";
 constexpr const char* kCmdArgToolbarText = "toolbartext";
 #define CmdConvertPdfToImages 2024
 #define CmdMLModel 2025
+#define CmdDetectSymbolsInDocument 2026
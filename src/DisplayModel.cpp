@@ -306,7 +306,7 @@ DisplayModel::DisplayModel(EngineBase* engine, DocControllerCallback* cb) : DocC
     pageSpacing.dy += 4;
 #endif
 
-    textCache = new DocumentTextCache(engine);
+    textCache = AcquireDocumentTextCache(engine);
     textSelection = new TextSelection(engine, textCache);
     textSearch = new TextSearch(engine, textCache);
 }
@@ -318,7 +318,7 @@ DisplayModel::~DisplayModel() {
     delete pdfSync;
     delete textSearch;
     delete textSelection;
-    delete textCache;
+    ReleaseDocumentTextCache(textCache);
     SafeEngineRelease(&engine);
     free(pagesInfo);
 }
@@ -411,6 +411,23 @@ void DisplayModel::BuildPagesInfo() {
     }
 }
 
+// re-reads page sizes that might have changed after the document has been read
+// completely (see EngineBase::WaitForFullLoad) while keeping the scroll position
+void DisplayModel::UpdatePageSizes() {
+    ScrollState ss = GetScrollState();
+    for (int pageNo = 1; pageNo <= PageCount(); pageNo++) {
+        PageInfo* pageInfo = GetPageInfo(pageNo);
+        RectF page = engine->PageMediabox(pageNo);
+        if (!page.IsEmpty()) {
+            pageInfo->page = page;
+        }
+        pageInfo->contentBox = RectF();
+    }
+    Relayout(zoomVirtual, rotation);
+    SetScrollState(ss);
+    RepaintDisplay();
+}
+
 // TODO: a better name e.g. ShouldShow() to better distinguish between
 // before-layout info and after-layout visibility checks
 bool DisplayModel::PageShown(int pageNo) const {
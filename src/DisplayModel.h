@@ -131,6 +131,9 @@ struct DisplayModel : DocController {
     TextSelection* textSelection = nullptr;
     // access only from Search thread
     TextSearch* textSearch = nullptr;
+    // fingerprint of the document for the on-disk tile cache, empty if
+    // its tiles must not be cached. access only from the render thread
+    AutoFreeStr tileCacheId;
 
     PageInfo* GetPageInfo(int pageNo) const;
 
@@ -199,6 +202,7 @@ struct DisplayModel : DocController {
     bool InPresentation() const;
 
     void BuildPagesInfo();
+    void UpdatePageSizes();
     float ZoomRealFromVirtualForPage(float zoomVirtual, int pageNo) const;
     SizeF PageSizeAfterRotation(int pageNo, bool fitToContent = false) const;
     void ChangeStartPage(int startPage);
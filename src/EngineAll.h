@@ -58,6 +58,15 @@ bool EngineMupdfSupportsAnnotations(EngineBase*);
 bool EngineMupdfSaveUpdated(EngineBase* engine, const char* path, const ShowErrorCb& showErrorFunc);
 Annotation* EngineMupdfGetAnnotationAtPos(EngineBase*, int pageNo, PointF pos, Annotation*);
 ByteSlice EngineMupdfLoadAttachment(EngineBase*, int attachmentNo);
+// show linearized PDFs from network and removable drives before they're read completely
+// throttleKbps > 0 also does it for local files, reading at most that many KB per second
+void EnableEngineMupdfProgressiveLoading(int throttleKbps);
+
+/* EnginePlainText.cpp */
+
+// only used for big text files
+bool IsEnginePlainTextSupportedFile(Kind kind, const char* path);
+EngineBase* CreateEnginePlainTextFromFile(const char* path);
 
 /* EnginePs.cpp */
 
@@ -3,6 +3,7 @@
    License: GPLv3 */
 
 #include "utils/BaseUtil.h"
+#include "utils/FileUtil.h"
 #include "utils/WinUtil.h"
 
 #include "wingui/UIModels.h"
@@ -319,17 +320,108 @@ RenderPageArgs::RenderPageArgs(int pageNo, float zoom, int rotation, RectF* page
     this->cookie_out = cookie_out;
 }
 
+struct SharedEngine {
+    EngineBase* engine = nullptr;
+    char* path = nullptr;
+    // the file must not have changed since the engine was created
+    i64 fileSize = 0;
+    FILETIME modTime{};
+};
+
+struct SharedEngines {
+    CRITICAL_SECTION access;
+    Vec<SharedEngine> engines;
+
+    SharedEngines() {
+        InitializeCriticalSection(&access);
+    }
+};
+
+static SharedEngines& GetSharedEngines() {
+    static SharedEngines sharedEngines;
+    return sharedEngines;
+}
+
+EngineBase* FindSharedEngine(const char* path) {
+    if (!path) {
+        return nullptr;
+    }
+    i64 fileSize = file::GetSize(path);
+    FILETIME modTime = file::GetModificationTime(path);
+
+    SharedEngines& shared = GetSharedEngines();
+    ScopedCritSec scope(&shared.access);
+    for (SharedEngine& e : shared.engines) {
+        if (!path::IsSame(e.path, path)) {
+            continue;
+        }
+        if (e.fileSize != fileSize || CompareFileTime(&e.modTime, &modTime) != 0) {
+            continue;
+        }
+        e.engine->AddRef();
+        return e.engine;
+    }
+    return nullptr;
+}
+
+void RegisterSharedEngine(EngineBase* engine, const char* path) {
+    ReportIf(!engine || engine->isShared);
+    if (!engine || !path || engine->isShared) {
+        return;
+    }
+    SharedEngine e;
+    e.engine = engine;
+    e.path = str::Dup(path);
+    e.fileSize = file::GetSize(path);
+    e.modTime = file::GetModificationTime(path);
+
+    SharedEngines& shared = GetSharedEngines();
+    ScopedCritSec scope(&shared.access);
+    // new views should use the more recent engine (e.g. after a reload)
+    for (size_t i = shared.engines.size(); i > 0; i--) {
+        SharedEngine& prev = shared.engines[i - 1];
+        if (path::IsSame(prev.path, path)) {
+            str::Free(prev.path);
+            shared.engines.RemoveAt(i - 1);
+        }
+    }
+    shared.engines.Append(e);
+    engine->isShared = true;
+}
+
 int EngineBase::AddRef() {
     return refCount.Add();
 }
 
 bool EngineBase::Release() {
-    int rc = refCount.Dec();
-    if (rc == 0) {
-        delete this;
-        return true;
+    if (!isShared) {
+        int rc = refCount.Dec();
+        if (rc == 0) {
+            delete this;
+            return true;
+        }
+        return false;
     }
-    return false;
+
+    // FindSharedEngine() must not return an engine that is being deleted
+    SharedEngines& shared = GetSharedEngines();
+    {
+        ScopedCritSec scope(&shared.access);
+        int rc = refCount.Dec();
+        if (rc > 0) {
+            return false;
+        }
+        for (size_t i = 0; i < shared.engines.size(); i++) {
+            SharedEngine& e = shared.engines[i];
+            if (e.engine == this) {
+                str::Free(e.path);
+                shared.engines.RemoveAt(i);
+                break;
+            }
+        }
+    }
+    delete this;
+    return true;
 }
 
 EngineBase::~EngineBase() {
@@ -432,3 +524,19 @@ bool EngineBase::HandleLink(IPageDestination*, ILinkHandler*) {
     // if not implemented in derived classes
     return false;
 }
+
+PageText EngineBase::ExtractPageTextForIndex(int pageNo) {
+    return ExtractPageText(pageNo);
+}
+
+bool EngineBase::PageMightContainText(int, const WCHAR*, bool) {
+    return true;
+}
+
+bool EngineBase::IsPartiallyLoaded() {
+    return false;
+}
+
+bool EngineBase::WaitForFullLoad() {
+    return false;
+}
@@ -17,6 +17,7 @@ extern Kind kindEnginePdb;
 extern Kind kindEngineChm;
 extern Kind kindEngineHtml;
 extern Kind kindEngineTxt;
+extern Kind kindEnginePlainText;
 
 bool IsExternalUrl(const WCHAR* url);
 bool IsExternalUrl(const char* url);
@@ -391,6 +392,12 @@ struct RenderPageArgs {
     RectF* pageRect = nullptr;
     RenderTarget target = RenderTarget::View;
     AbortCookie** cookie_out = nullptr;
+    // set by callers that render the page again when isPreview is set
+    bool allowPreview = false;
+    // set by engines that rendered from an incompletely decoded page
+    // (only for RenderTarget::View and allowPreview). rendering again
+    // gives the final result
+    bool isPreview = false;
 
     RenderPageArgs(int pageNo, float zoom, int rotation, RectF* pageRect = nullptr,
                    RenderTarget target = RenderTarget::View, AbortCookie** cookie_out = nullptr);
@@ -409,9 +416,13 @@ class EngineBase {
     bool allowsPrinting = true;
     bool allowsCopyingText = true;
     bool isPasswordProtected = false;
+    // if true, page content depends on layout settings (e.g. font size for ebooks)
+    bool isReflowable = false;
     char* decryptionKey = nullptr;
     bool hasPageLabels = false;
     int pageCount = -1;
+    // set by RegisterSharedEngine()
+    bool isShared = false;
 
     // TODO: migrate other engines to use this
     AutoFreeStr fileNameBase;
@@ -453,6 +464,13 @@ class EngineBase {
     // coordinates of the individual glyphs)
     // caller needs to free() the result and *coordsOut (if coordsOut is non-nullptr)
     virtual PageText ExtractPageText(int pageNo) = 0;
+    // cheaper variant for search and indexing: the characters are the same but
+    // whitespace may differ, right-to-left text isn't reordered and coords are
+    // only approximate
+    virtual PageText ExtractPageTextForIndex(int pageNo);
+    // returns false if the text of the page can't contain s (which has no whitespace)
+    // without extracting it. used for skipping pages when searching
+    virtual bool PageMightContainText(int pageNo, const WCHAR* s, bool caseSensitive);
     // pages where clipping doesn't help are rendered in larger tiles
     virtual bool HasClipOptimizations(int pageNo) = 0;
 
@@ -521,6 +539,14 @@ class EngineBase {
     // without also measuring rendering times
     virtual bool BenchLoadPage(int pageNo) = 0;
 
+    // true while the document is still being read in the background. pages
+    // whose data hasn't arrived yet fail to render and should be retried later
+    virtual bool IsPartiallyLoaded();
+
+    // blocks until the document has been read completely. returns true if
+    // page sizes or the Table of Contents have changed as a result
+    virtual bool WaitForFullLoad();
+
     // the name of the file this engine handles
     const char* FilePath() const;
 
@@ -542,6 +568,13 @@ struct PasswordUI {
     virtual ~PasswordUI() = default;
 };
 
+// all views (tabs and windows) of the same file share a single engine.
+// the registry doesn't own a reference, engines are removed when they're deleted
+// returns an engine with an added reference or nullptr if the file isn't open or
+// has changed since
+EngineBase* FindSharedEngine(const char* path);
+void RegisterSharedEngine(EngineBase* engine, const char* path);
+
 template <typename T>
 void SafeEngineRelease(T** enginePtr) {
     T* engine = *enginePtr;
@@ -100,6 +100,12 @@ static EngineBase* CreateEngineForKind(Kind kind, const char* path, PasswordUI*
         engine = CreateEngineChmFromFile(path);
         return engine;
     }
+    if (IsEnginePlainTextSupportedFile(kind, path)) {
+        engine = CreateEnginePlainTextFromFile(path);
+        if (engine) {
+            return engine;
+        }
+    }
     if (gEnableEpubWithPdfEngine && IsEngineMupdfSupportedFileType(kind)) {
         engine = CreateEngineMupdfFromFile(path, kind, dpi, pwdUI);
         // https://github.com/sumatrapdfreader/sumatrapdf/issues/2212
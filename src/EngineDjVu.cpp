@@ -123,6 +123,20 @@ static TocItem* NewDjVuTocItem(TocItem* parent, const char* title, const char* l
     return res;
 }
 
+// decoded pages are kept around because decoding a page takes much longer than
+// rendering it, and a page is usually rendered as several tiles and at several zoom levels
+constexpr int kMaxDecodedDjVuPages = 6;
+// pages rendered at most at this fraction of their resolution don't need more than
+// the first chunk of their IW44 background (later chunks only add finer detail)
+constexpr float kDjVuPreviewScale = 0.25f;
+
+struct DjVuDecodedPage {
+    int pageNo = 0;
+    ddjvu_page_t* page = nullptr;
+    // number of BG44 chunks decoded so far (counted in DjVuContext::SpinMessageLoop)
+    int nBgChunks = 0;
+};
+
 struct DjVuContext {
     ddjvu_context_t* ctx = nullptr;
     int refCount = 1;
@@ -174,6 +188,12 @@ struct DjVuContext {
                     BOOL stop = FALSE;
                     ddjvu_stream_close(msg->m_any.document, streamId, stop);
                 }
+            } else if (DDJVU_CHUNK == tag && msg->m_any.page) {
+                // user data is cleared when a page is released
+                auto dp = (DjVuDecodedPage*)ddjvu_page_get_user_data(msg->m_any.page);
+                if (dp && str::Eq(msg->m_chunk.chunkid, "BG44")) {
+                    dp->nBgChunks++;
+                }
             }
             ddjvu_message_pop(ctx);
         }
@@ -233,6 +253,8 @@ struct DjVuPageInfo {
     Vec<IPageElement*> allElements;
     miniexp_t annos{miniexp_dummy};
     bool gotAllElements = false;
+    // only a single preview is rendered, even if the decoded page is released in between
+    bool renderedPreview = false;
 };
 
 class EngineDjVu : public EngineBase {
@@ -283,6 +305,11 @@ class EngineDjVu : public EngineBase {
 
     Vec<ddjvu_fileinfo_t> fileInfos;
 
+    // ordered from least to most recently used
+    Vec<DjVuDecodedPage*> decodedPages;
+
+    DjVuDecodedPage* GetDecodedPage(int pageNo);
+    void ReleaseDecodedPage(DjVuDecodedPage* dp);
     RenderedBitmap* CreateRenderedBitmap(const char* bmpData, Size size, bool grayscale) const;
     bool ExtractPageText(miniexp_t item, str::WStr& extracted, Vec<Rect>& coords);
     TempStr ResolveNamedDestTemp(const char* name);
@@ -312,6 +339,10 @@ EngineDjVu::~EngineDjVu() {
     }
     DeleteVecMembers(pages);
 
+    while (decodedPages.size() > 0) {
+        ReleaseDecodedPage(decodedPages[0]);
+    }
+
     if (outline != miniexp_nil) {
         ddjvu_miniexp_release(doc, outline);
     }
@@ -557,6 +588,51 @@ RenderedBitmap* EngineDjVu::CreateRenderedBitmap(const char* bmpData, Size size,
     return new RenderedBitmap(hbmp, size, hMap);
 }
 
+// returns a page that is being (or has been) decoded
+// must be called with gDjVuContext->lock held
+DjVuDecodedPage* EngineDjVu::GetDecodedPage(int pageNo) {
+    for (int i = 0; i < decodedPages.Size(); i++) {
+        DjVuDecodedPage* dp = decodedPages[i];
+        if (dp->pageNo == pageNo) {
+            decodedPages.RemoveAt(i);
+            decodedPages.Append(dp);
+            return dp;
+        }
+    }
+    ddjvu_page_t* page = ddjvu_page_create_by_pageno(doc, pageNo - 1);
+    if (!page) {
+        return nullptr;
+    }
+    if (decodedPages.Size() >= kMaxDecodedDjVuPages) {
+        ReleaseDecodedPage(decodedPages[0]);
+    }
+    auto dp = new DjVuDecodedPage();
+    dp->pageNo = pageNo;
+    dp->page = page;
+    ddjvu_page_set_user_data(page, dp);
+    decodedPages.Append(dp);
+    return dp;
+}
+
+// must be called with gDjVuContext->lock held
+void EngineDjVu::ReleaseDecodedPage(DjVuDecodedPage* dp) {
+    decodedPages.Remove(dp);
+    // also clears the user data and drops pending messages for the page
+    ddjvu_page_release(dp->page);
+    delete dp;
+}
+
+static bool IsPreviewSize(ddjvu_page_t* page, Rect full) {
+    float dx = (float)ddjvu_page_get_width(page);
+    float dy = (float)ddjvu_page_get_height(page);
+    if (dx <= 0 || dy <= 0) {
+        return false;
+    }
+    // independent of the rotation
+    float scale = sqrtf((float)full.dx * (float)full.dy / (dx * dy));
+    return scale <= kDjVuPreviewScale;
+}
+
 RenderedBitmap* EngineDjVu::RenderPage(RenderPageArgs& args) {
     ScopedCritSec scope(&gDjVuContext->lock);
     auto pageRect = args.pageRect;
@@ -568,16 +644,31 @@ RenderedBitmap* EngineDjVu::RenderPage(RenderPageArgs& args) {
     Rect full = Transform(PageMediabox(pageNo), pageNo, zoom, rotation).Round();
     screen = full.Intersect(screen);
 
-    ddjvu_page_t* page = ddjvu_page_create_by_pageno(doc, pageNo - 1);
-    if (!page) {
+    DjVuDecodedPage* dp = GetDecodedPage(pageNo);
+    if (!dp) {
         return nullptr;
     }
+    ddjvu_page_t* page = dp->page;
+    // at low zoom, render a preview as soon as the first chunk of the background
+    // has been decoded. the page is rendered again once it's been fully decoded
+    DjVuPageInfo* pi = pages[pageNo - 1];
+    bool allowPreview = args.allowPreview && args.target == RenderTarget::View && !pi->renderedPreview;
+    bool isPreview = false;
     while (!ddjvu_page_decoding_done(page)) {
+        if (allowPreview && dp->nBgChunks > 0 && IsPreviewSize(page, full)) {
+            isPreview = true;
+            break;
+        }
         gDjVuContext->SpinMessageLoop();
     }
     if (ddjvu_page_decoding_error(page)) {
+        ReleaseDecodedPage(dp);
         return nullptr;
     }
+    if (isPreview) {
+        pi->renderedPreview = true;
+        args.isPreview = true;
+    }
 
     ddjvu_page_rotation_t rot = DDJVU_ROTATE_0;
     switch (rotation) {
@@ -607,7 +698,6 @@ RenderedBitmap* EngineDjVu::RenderPage(RenderPageArgs& args) {
 
     defer {
         ddjvu_format_release(fmt);
-        ddjvu_page_release(page);
     };
 
     int topToBottom = TRUE;
@@ -642,15 +732,17 @@ RectF EngineDjVu::PageContentBox(int pageNo, RenderTarget) {
     ScopedCritSec scope(&gDjVuContext->lock);
 
     RectF pageRc = PageMediabox(pageNo);
-    ddjvu_page_t* page = ddjvu_page_create_by_pageno(doc, pageNo - 1);
-    if (!page) {
+    DjVuDecodedPage* dp = GetDecodedPage(pageNo);
+    if (!dp) {
         return pageRc;
     }
+    ddjvu_page_t* page = dp->page;
 
     while (!ddjvu_page_decoding_done(page)) {
         gDjVuContext->SpinMessageLoop();
     }
     if (ddjvu_page_decoding_error(page)) {
+        ReleaseDecodedPage(dp);
         return pageRc;
     }
     ddjvu_page_set_rotation(page, DDJVU_ROTATE_0);
@@ -660,7 +752,6 @@ RectF EngineDjVu::PageContentBox(int pageNo, RenderTarget) {
 
     defer {
         ddjvu_format_release(fmt);
-        ddjvu_page_release(page);
     };
 
     ddjvu_format_set_row_order(fmt, /* top_to_bottom */ TRUE);
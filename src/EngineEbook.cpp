@@ -139,6 +139,8 @@ class EngineEbook : public EngineBase {
     PoolAllocator allocator;
     // TODO: still needed?
     CRITICAL_SECTION pagesAccess;
+    // shared by all pages so that images aren't decoded on every render
+    HtmlImageCache* imageCache = nullptr;
     // page dimensions can vary between filetypes
     RectF pageRect;
     float pageBorder;
@@ -195,11 +197,13 @@ static TocItem* newEbookTocItem(TocItem* parent, const char* title, IPageDestina
 
 EngineEbook::EngineEbook() {
     pageCount = 0;
+    isReflowable = true;
     // "B Format" paperback
     pageRect = RectF(0, 0, 5.12f * GetFileDPI(), 7.8f * GetFileDPI());
     pageBorder = 0.4f * GetFileDPI();
     preferredLayout = preferredLayout = PageLayout(PageLayout::Type::Single);
     InitializeCriticalSection(&pagesAccess);
+    imageCache = new HtmlImageCache();
 }
 
 EngineEbook::~EngineEbook() {
@@ -212,6 +216,7 @@ EngineEbook::~EngineEbook() {
         DeleteVecMembers(*pages);
     }
     delete pages;
+    delete imageCache;
 
     LeaveCriticalSection(&pagesAccess);
     DeleteCriticalSection(&pagesAccess);
@@ -353,7 +358,7 @@ RenderedBitmap* EngineEbook::RenderPage(RenderPageArgs& args) {
 
     mui::ITextRender* textDraw = mui::TextRenderGdiplus::Create(&g);
     DrawHtmlPage(&g, textDraw, GetHtmlPage(pageNo), pageBorder, pageBorder, false, Color((ARGB)Color::Black),
-                 cookie ? &cookie->abort : nullptr);
+                 cookie ? &cookie->abort : nullptr, imageCache);
     delete textDraw;
     DeleteDC(hDC);
 
@@ -11,6 +11,7 @@ extern "C" {
 #include "utils/BaseUtil.h"
 #include "utils/Archive.h"
 #include "utils/ScopedWin.h"
+#include "utils/Dict.h"
 #include "utils/FileUtil.h"
 #include "utils/GdiPlusUtil.h"
 #include "utils/GuessFileType.h"
@@ -19,6 +20,7 @@ extern "C" {
 #include "utils/TrivialHtmlParser.h"
 #include "utils/WinUtil.h"
 #include "utils/ZipUtil.h"
+#include "utils/ThreadUtil.h"
 #include "utils/Timer.h"
 
 #include "wingui/UIModels.h"
@@ -458,6 +460,190 @@ static fz_stream* FzReadFileIfSmall(fz_context* ctx, const char* path) {
     return stm;
 }
 
+// see EnableEngineMupdfProgressiveLoading()
+static bool gProgressiveLoading = false;
+static int gProgressiveLoadKbps = 0;
+
+void EnableEngineMupdfProgressiveLoading(int throttleKbps) {
+    gProgressiveLoading = true;
+    gProgressiveLoadKbps = throttleKbps;
+}
+
+constexpr int kProgressiveChunkSize = 64 * 1024;
+
+// a file that is read into memory on a background thread while mupdf already
+// parses it. reading data that hasn't arrived yet throws FZ_ERROR_TRYLATER,
+// which makes mupdf load linearized PDFs one page at a time
+// (see pdf_progressive_advance())
+struct FzProgressiveFile {
+    char* path = nullptr;
+    // allocated with fz_malloc() because it's freed in drop_progressive()
+    u8* data = nullptr;
+    int size = 0;
+    // number of bytes at the start of data that have been read
+    AtomicInt nRead;
+    AtomicBool failed;
+    AtomicBool abort;
+    // if > 0, limits reading to that many KB per second (for testing)
+    int throttleKbps = 0;
+    HANDLE hThread = nullptr;
+    // manual-reset, signaled once the whole file has been read (or reading failed)
+    HANDLE evtDone = nullptr;
+};
+
+static bool IsProgressiveFileDone(FzProgressiveFile* pf) {
+    return WaitForSingleObject(pf->evtDone, 0) == WAIT_OBJECT_0;
+}
+
+static void ProgressiveFileReadThread(FzProgressiveFile* pf) {
+    AutoCloseHandle h = file::OpenReadOnly(pf->path);
+    int chunkSize = kProgressiveChunkSize;
+    DWORD sleepMs = 0;
+    if (pf->throttleKbps > 0) {
+        // 10 chunks per second
+        chunkSize = std::max(pf->throttleKbps * 1024 / 10, 1024);
+        sleepMs = 100;
+    }
+    int nRead = 0;
+    bool ok = h.IsValid();
+    while (ok && nRead < pf->size && !pf->abort.Get()) {
+        DWORD toRead = (DWORD)std::min(chunkSize, pf->size - nRead);
+        DWORD n = 0;
+        ok = ReadFile(h, pf->data + nRead, toRead, &n, nullptr) && n > 0;
+        if (ok) {
+            nRead += (int)n;
+            pf->nRead.Set(nRead);
+        }
+        if (sleepMs > 0) {
+            ::Sleep(sleepMs);
+        }
+    }
+    if (nRead < pf->size) {
+        if (!pf->abort.Get()) {
+            logf("ProgressiveFileReadThread: failed to read '%s'\n", pf->path);
+        }
+        pf->failed.Set(true);
+    }
+    SetEvent(pf->evtDone);
+}
+
+extern "C" int next_progressive(fz_context* ctx, fz_stream* stm, size_t) {
+    FzProgressiveFile* pf = (FzProgressiveFile*)stm->state;
+    if (stm->pos >= pf->size) {
+        return EOF;
+    }
+    // check failed before nRead: once it's set, nRead no longer changes
+    bool failed = pf->failed.Get();
+    int nRead = pf->nRead.Get();
+    if (stm->pos >= nRead) {
+        if (failed) {
+            fz_throw(ctx, FZ_ERROR_GENERIC, "failed to read '%s'", pf->path);
+        }
+        fz_throw(ctx, FZ_ERROR_TRYLATER, "data not read yet");
+    }
+    stm->rp = pf->data + stm->pos;
+    stm->wp = pf->data + nRead;
+    stm->pos = nRead;
+    return *stm->rp++;
+}
+
+extern "C" void seek_progressive(fz_context*, fz_stream* stm, i64 offset, int whence) {
+    FzProgressiveFile* pf = (FzProgressiveFile*)stm->state;
+    // fz_seek() has already converted SEEK_CUR to SEEK_SET
+    if (whence == SEEK_END) {
+        offset += pf->size;
+    }
+    stm->pos = std::clamp(offset, (i64)0, (i64)pf->size);
+    stm->rp = stm->wp = pf->data;
+}
+
+extern "C" void drop_progressive(fz_context* ctx, void* state) {
+    FzProgressiveFile* pf = (FzProgressiveFile*)state;
+    pf->abort.Set(true);
+    WaitForSingleObject(pf->hThread, INFINITE);
+    CloseHandle(pf->hThread);
+    CloseHandle(pf->evtDone);
+    fz_free(ctx, pf->data);
+    str::Free(pf->path);
+    delete pf;
+}
+
+// returns nullptr if the file should be read with FzOpenOrReadFile() instead
+static fz_stream* FzOpenProgressiveFile(fz_context* ctx, const char* path, FzProgressiveFile** pfOut) {
+    if (!gProgressiveLoading) {
+        return nullptr;
+    }
+    // bigger files aren't read into memory in the first place
+    i64 fileSize = file::GetSize(path);
+    if (fileSize <= 0 || fileSize >= kMaxMemoryFileSize) {
+        return nullptr;
+    }
+    // local drives are fast enough to read the whole file before showing it
+    bool throttled = gProgressiveLoadKbps > 0;
+    if (!throttled && path::IsOnFixedDrive(path)) {
+        return nullptr;
+    }
+    // only linearized files can be displayed before all data is available and
+    // their linearization dictionary must be the first object in the file
+    char buf[1024];
+    int n = file::ReadN(path, buf, sizeof(buf));
+    if (n <= 0 || str::BufFind(buf, n, "/Linearized") < 0) {
+        return nullptr;
+    }
+
+    u8* data = (u8*)fz_malloc_no_throw(ctx, (size_t)fileSize);
+    if (!data) {
+        return nullptr;
+    }
+    auto pf = new FzProgressiveFile();
+    pf->path = str::Dup(path);
+    pf->data = data;
+    pf->size = (int)fileSize;
+    pf->throttleKbps = gProgressiveLoadKbps;
+    pf->evtDone = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    auto fn = MkFunc0<FzProgressiveFile>(ProgressiveFileReadThread, pf);
+    pf->hThread = StartThread(fn, "ProgressiveFileReadThread");
+
+    fz_stream* stm = nullptr;
+    fz_try(ctx) {
+        // on failure, fz_new_stream() calls drop_progressive()
+        stm = fz_new_stream(ctx, pf, next_progressive, drop_progressive);
+        stm->seek = seek_progressive;
+        stm->progressive = 1;
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+        return nullptr;
+    }
+    logf("FzOpenProgressiveFile: '%s', %d bytes, throttle: %d kbps\n", path, pf->size, pf->throttleKbps);
+    *pfOut = pf;
+    return stm;
+}
+
+// while a progressively read file is opened, FZ_ERROR_TRYLATER is thrown
+// until the data needed to show the first page has been read
+static fz_document* FzOpenDocumentWhenAvailable(fz_context* ctx, const char* nameHint, fz_stream* stm,
+                                                FzProgressiveFile* pf) {
+    if (!pf) {
+        return fz_open_document_with_stream(ctx, nameHint, stm);
+    }
+    fz_document* doc = nullptr;
+    while (!doc) {
+        fz_try(ctx) {
+            doc = fz_open_document_with_stream(ctx, nameHint, stm);
+        }
+        fz_catch(ctx) {
+            fz_rethrow_unless(ctx, FZ_ERROR_TRYLATER);
+            fz_ignore_error(ctx);
+        }
+        if (!doc) {
+            // can't be TRYLATER anymore after the whole file has been read
+            WaitForSingleObject(pf->evtDone, 50);
+        }
+    }
+    return doc;
+}
+
 /*
 https://github.com/sumatrapdfreader/sumatrapdf/issues/4514
 Some PDF files have garbage at the beginning, before the %PDF- marker
@@ -563,21 +749,18 @@ static inline int WcharsPerRune(int rune) {
     return 1;
 }
 
-static void AddChar(fz_stext_line* line, fz_stext_char* c, str::WStr& s, Vec<Rect>& rects) {
-    fz_rect bbox = fz_rect_from_quad(c->quad);
-    Rect r = ToRectF(bbox).Round();
-
-    int n = WcharsPerRune(c->c);
+static void AppendRune(int rune, Rect r, str::WStr& s, Vec<Rect>& rects) {
+    int n = WcharsPerRune(rune);
     if (n == 2) {
         WCHAR tmp[2];
-        tmp[0] = 0xD800 | ((c->c - 0x10000) >> 10) & 0x3FF;
-        tmp[1] = 0xDC00 | (c->c - 0x10000) & 0x3FF;
+        tmp[0] = 0xD800 | ((rune - 0x10000) >> 10) & 0x3FF;
+        tmp[1] = 0xDC00 | (rune - 0x10000) & 0x3FF;
         s.Append(tmp, 2);
         rects.Append(r);
         rects.Append(r);
         return;
     }
-    WCHAR wc = c->c;
+    WCHAR wc = rune;
     bool isNonPrintable = (wc <= 32) || str::IsNonCharacter(wc);
     if (!isNonPrintable) {
         s.AppendChar(wc);
@@ -600,6 +783,12 @@ static void AddChar(fz_stext_line* line, fz_stext_char* c, str::WStr& s, Vec<Rec
     }
 }
 
+static void AddChar(fz_stext_line* line, fz_stext_char* c, str::WStr& s, Vec<Rect>& rects) {
+    fz_rect bbox = fz_rect_from_quad(c->quad);
+    Rect r = ToRectF(bbox).Round();
+    AppendRune(c->c, r, s, rects);
+}
+
 static void AddLineSep(str::WStr& s, Vec<Rect>& rects, const WCHAR* lineSep, size_t lineSepLen) {
     if (lineSepLen == 0) {
         return;
@@ -654,6 +843,215 @@ static WCHAR* FzTextPageToStr(fz_stext_page* text, Rect** coordsOut) {
     return content.StealData();
 }
 
+// lightweight alternative to fz_stext_device for ExtractPageTextForIndex():
+// characters are appended in content stream order with line breaks and spaces
+// guessed from the pen position and with approximate coordinates (the font's
+// advance and a fixed ascent/descent instead of glyph bounds). there's no
+// block/line layout and no image retention and since the device has no path,
+// image or shading callbacks, the pdf interpreter doesn't even load those
+struct FzIndexTextDevice {
+    fz_device super;
+
+    str::WStr* text;
+    Vec<Rect>* coords;
+
+    bool hasPen;
+    // end of the previous character and its (normalized) direction
+    fz_point pen;
+    fz_point dir;
+    int lastChar;
+
+    int metatextDepth;
+    // while inside an ActualText, its text replaces the glyphs (as in fz_stext_device)
+    int actualTextDepth;
+};
+
+// same thresholds as stext-device.c, relative to the font size
+constexpr float kIndexSpaceDist = 0.15f;
+constexpr float kIndexBaseMaxDist = 0.8f;
+constexpr float kIndexColumnDist = 3.f;
+
+static void IndexAddLineSep(FzIndexTextDevice* dev) {
+    if (dev->text->size() > 0 && dev->text->LastChar() != L'\n') {
+        AddLineSep(*dev->text, *dev->coords, L"\n", 1);
+    }
+}
+
+static void IndexAddRune(FzIndexTextDevice* dev, int c, Rect r) {
+    // expand ligatures and normalize spaces like fz_stext_device does by default
+    switch (c) {
+        case 0xFB00: // ff
+            AppendRune('f', r, *dev->text, *dev->coords);
+            c = 'f';
+            break;
+        case 0xFB01: // fi
+            AppendRune('f', r, *dev->text, *dev->coords);
+            c = 'i';
+            break;
+        case 0xFB02: // fl
+            AppendRune('f', r, *dev->text, *dev->coords);
+            c = 'l';
+            break;
+        case 0xFB03: // ffi
+            AppendRune('f', r, *dev->text, *dev->coords);
+            AppendRune('f', r, *dev->text, *dev->coords);
+            c = 'i';
+            break;
+        case 0xFB04: // ffl
+            AppendRune('f', r, *dev->text, *dev->coords);
+            AppendRune('f', r, *dev->text, *dev->coords);
+            c = 'l';
+            break;
+        case 0xFB05: // long st
+        case 0xFB06: // st
+            AppendRune('s', r, *dev->text, *dev->coords);
+            c = 't';
+            break;
+        case 0x00A0:
+        case 0x1680:
+        case 0x180E:
+        case 0x202F:
+        case 0x205F:
+        case 0x3000:
+            c = ' ';
+            break;
+        default:
+            if (c >= 0x2000 && c <= 0x200A) {
+                c = ' ';
+            }
+    }
+    AppendRune(c, r, *dev->text, *dev->coords);
+}
+
+static void IndexExtractSpan(fz_context* ctx, FzIndexTextDevice* dev, fz_text_span* span, fz_matrix ctm) {
+    if (dev->actualTextDepth > 0) {
+        return;
+    }
+    int wmode = span->wmode;
+    fz_matrix tm = span->trm;
+    for (int i = 0; i < span->len; i++) {
+        fz_text_item* item = &span->items[i];
+        // one unicode character mapped to multiple glyphs
+        if (item->ucs == -1) {
+            continue;
+        }
+        tm.e = item->x;
+        tm.f = item->y;
+        fz_matrix trm = fz_concat(tm, ctm);
+        fz_point dir = fz_transform_vector(wmode == 0 ? fz_make_point(1, 0) : fz_make_point(0, -1), trm);
+        float size = fz_matrix_expansion(trm);
+        float adv = item->gid < 0 ? 0 : fz_advance_glyph(ctx, span->font, item->gid, wmode);
+
+        // p is where the glyph starts and q where it ends, along the baseline
+        fz_point p = fz_make_point(trm.e, trm.f);
+        fz_point q = fz_make_point(trm.e + adv * dir.x, trm.f + adv * dir.y);
+        fz_rect box = fz_make_rect(0, -0.2f, adv, 0.8f);
+        if (wmode != 0) {
+            p = fz_make_point(trm.e - adv * dir.x, trm.f - adv * dir.y);
+            q = fz_make_point(trm.e, trm.f);
+            box = fz_make_rect(-0.5f, 0, 0.5f, adv);
+        }
+        Rect r = ToRectF(fz_transform_rect(box, trm)).Round();
+        fz_point ndir = fz_normalize_vector(dir);
+
+        // characters in a cluster don't move the pen
+        if (dev->hasPen && item->gid >= 0 && size > 0) {
+            fz_point d = fz_make_point(p.x - dev->pen.x, p.y - dev->pen.y);
+            // fake bold: the same character printed twice at the same position
+            if (item->ucs == dev->lastChar && fabsf(q.x - dev->pen.x) < FLT_EPSILON &&
+                fabsf(q.y - dev->pen.y) < FLT_EPSILON) {
+                continue;
+            }
+            float spacing = (ndir.x * d.x + ndir.y * d.y) / size;
+            float baseOffset = (-ndir.y * d.x + ndir.x * d.y) / size;
+            bool sameDir = ndir.x * dev->dir.x + ndir.y * dev->dir.y >= 0.999f;
+            if (!sameDir || fabsf(baseOffset) >= kIndexBaseMaxDist || fabsf(spacing) >= kIndexColumnDist) {
+                IndexAddLineSep(dev);
+            } else if (spacing > kIndexSpaceDist && !str::IsWs(dev->text->LastChar())) {
+                dev->text->AppendChar(L' ');
+                dev->coords->Append(Rect());
+            }
+        }
+        IndexAddRune(dev, item->ucs, r);
+
+        if (item->gid >= 0) {
+            dev->hasPen = true;
+            dev->pen = q;
+            dev->dir = ndir;
+        }
+        dev->lastChar = item->ucs;
+    }
+}
+
+static void IndexExtractText(fz_context* ctx, fz_device* dev, const fz_text* text, fz_matrix ctm) {
+    for (fz_text_span* span = text->head; span; span = span->next) {
+        IndexExtractSpan(ctx, (FzIndexTextDevice*)dev, span, ctm);
+    }
+}
+
+static void IndexFillText(fz_context* ctx, fz_device* dev, const fz_text* text, fz_matrix ctm, fz_colorspace*,
+                          const float*, float, fz_color_params) {
+    IndexExtractText(ctx, dev, text, ctm);
+}
+
+static void IndexStrokeText(fz_context* ctx, fz_device* dev, const fz_text* text, const fz_stroke_state*,
+                            fz_matrix ctm, fz_colorspace*, const float*, float, fz_color_params) {
+    IndexExtractText(ctx, dev, text, ctm);
+}
+
+static void IndexClipText(fz_context* ctx, fz_device* dev, const fz_text* text, fz_matrix ctm, fz_rect) {
+    IndexExtractText(ctx, dev, text, ctm);
+}
+
+static void IndexClipStrokeText(fz_context* ctx, fz_device* dev, const fz_text* text, const fz_stroke_state*,
+                                fz_matrix ctm, fz_rect) {
+    IndexExtractText(ctx, dev, text, ctm);
+}
+
+static void IndexIgnoreText(fz_context* ctx, fz_device* dev, const fz_text* text, fz_matrix ctm) {
+    IndexExtractText(ctx, dev, text, ctm);
+}
+
+static void IndexBeginMetatext(fz_context*, fz_device* dev_, fz_metatext meta, const char* text) {
+    auto dev = (FzIndexTextDevice*)dev_;
+    dev->metatextDepth++;
+    if (meta != FZ_METATEXT_ACTUALTEXT || dev->actualTextDepth > 0) {
+        return;
+    }
+    dev->actualTextDepth = dev->metatextDepth;
+    for (const char* s = text; s && *s;) {
+        int c;
+        s += fz_chartorune(&c, s);
+        IndexAddRune(dev, c, Rect());
+    }
+}
+
+static void IndexEndMetatext(fz_context*, fz_device* dev_) {
+    auto dev = (FzIndexTextDevice*)dev_;
+    if (dev->metatextDepth == 0) {
+        return;
+    }
+    if (dev->actualTextDepth == dev->metatextDepth) {
+        dev->actualTextDepth = 0;
+    }
+    dev->metatextDepth--;
+}
+
+static fz_device* NewFzIndexTextDevice(fz_context* ctx, str::WStr* text, Vec<Rect>* coords) {
+    auto dev = (FzIndexTextDevice*)fz_new_device_of_size(ctx, sizeof(FzIndexTextDevice));
+    dev->super.fill_text = IndexFillText;
+    dev->super.stroke_text = IndexStrokeText;
+    dev->super.clip_text = IndexClipText;
+    dev->super.clip_stroke_text = IndexClipStrokeText;
+    dev->super.ignore_text = IndexIgnoreText;
+    dev->super.begin_metatext = IndexBeginMetatext;
+    dev->super.end_metatext = IndexEndMetatext;
+    dev->super.hints |= FZ_DONT_DECODE_IMAGES;
+    dev->text = text;
+    dev->coords = coords;
+    return (fz_device*)dev;
+}
+
 static bool LinkifyCheckMultiline(const WCHAR* pageText, const WCHAR* pos, Rect* coords) {
     // multiline links end in a non-alphanumeric character and continue on a line
     // that starts left and only slightly below where the current line ended
@@ -1067,36 +1465,139 @@ Encore:
     return els[0];
 }
 
-// don't delete the result
-NO_INLINE static IPageElement* FzGetElementAtPos(FzPageInfo* pageInfo, PointF pt) {
-    if (!pageInfo) {
-        return nullptr;
+static void InvalidatePageElements(FzPageInfo* pageInfo) {
+    pageInfo->elementsNeedRebuilding = true;
+    pageInfo->elementIndex.needsRebuilding = true;
+}
+
+// more cells don't speed up hit-testing much but use more memory
+constexpr int kMaxElementIndexCells = 64;
+
+static int ElementIndexCell(float v, float start, float size, int nCells) {
+    int cell = (int)((v - start) * nCells / size);
+    return std::clamp(cell, 0, nCells - 1);
+}
+
+static void BuildElementIndex(FzPageInfo* pageInfo) {
+    FzPageElementIndex& idx = pageInfo->elementIndex;
+    if (!idx.needsRebuilding) {
+        return;
     }
-    Vec<IPageElement*> res;
+    idx.needsRebuilding = false;
 
+    Vec<IPageElement*>& els = idx.els;
+    els.Reset();
     for (auto pel : pageInfo->links) {
-        if (pel->GetRect().Contains(pt)) {
-            res.Append(pel);
-        }
+        els.Append(pel);
+    }
+    for (auto pel : pageInfo->autoLinks) {
+        els.Append(pel);
+    }
+    for (auto pel : pageInfo->comments) {
+        els.Append(pel);
+    }
+    for (auto& img : pageInfo->images) {
+        els.Append(img->imageElement);
     }
 
-    for (auto* pel : pageInfo->autoLinks) {
-        if (pel->GetRect().Contains(pt)) {
-            res.Append(pel);
+    // elements with empty rects can't be hit so they don't need to be in any cell
+    float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    int nValid = 0;
+    for (auto el : els) {
+        RectF r = el->GetRect();
+        if (r.dx <= 0 || r.dy <= 0) {
+            continue;
+        }
+        if (nValid == 0) {
+            x0 = r.x;
+            y0 = r.y;
+            x1 = r.x + r.dx;
+            y1 = r.y + r.dy;
+        } else {
+            x0 = std::min(x0, r.x);
+            y0 = std::min(y0, r.y);
+            x1 = std::max(x1, r.x + r.dx);
+            y1 = std::max(y1, r.y + r.dy);
+        }
+        nValid++;
+    }
+    idx.bounds = RectF(x0, y0, x1 - x0, y1 - y0);
+
+    // aim for about 2 elements per cell
+    int n = (int)sqrtf((float)nValid / 2.f);
+    idx.nCellsX = std::clamp(n, 1, kMaxElementIndexCells);
+    idx.nCellsY = idx.nCellsX;
+    int nCells = idx.nCellsX * idx.nCellsY;
+
+    // counting sort of (cell, element) pairs by cell
+    idx.cellStart.Reset();
+    idx.cellStart.AppendBlanks(nCells + 1);
+    idx.cellEls.Reset();
+    for (int pass = 0; pass < 2; pass++) {
+        int* pos = idx.cellStart.LendData();
+        if (pass == 1) {
+            int total = 0;
+            for (int i = 0; i <= nCells; i++) {
+                int count = pos[i];
+                pos[i] = total;
+                total += count;
+            }
+            idx.cellEls.AppendBlanks(total);
         }
+        int i = 0;
+        for (auto el : els) {
+            RectF r = el->GetRect();
+            if (r.dx > 0 && r.dy > 0) {
+                RectF& b = idx.bounds;
+                int cx0 = ElementIndexCell(r.x, b.x, b.dx, idx.nCellsX);
+                int cx1 = ElementIndexCell(r.x + r.dx, b.x, b.dx, idx.nCellsX);
+                int cy0 = ElementIndexCell(r.y, b.y, b.dy, idx.nCellsY);
+                int cy1 = ElementIndexCell(r.y + r.dy, b.y, b.dy, idx.nCellsY);
+                for (int cy = cy0; cy <= cy1; cy++) {
+                    for (int cx = cx0; cx <= cx1; cx++) {
+                        int cell = cy * idx.nCellsX + cx;
+                        if (pass == 0) {
+                            pos[cell]++;
+                        } else {
+                            idx.cellEls[pos[cell]++] = i;
+                        }
+                    }
+                }
+            }
+            i++;
+        }
+    }
+    // after filling, cellStart[i] is where cell i + 1 starts so shift it back
+    int* pos = idx.cellStart.LendData();
+    for (int i = nCells; i > 0; i--) {
+        pos[i] = pos[i - 1];
     }
+    pos[0] = 0;
+}
 
-    for (auto* pel : pageInfo->comments) {
-        if (pel->GetRect().Contains(pt)) {
-            res.Append(pel);
-        }
+// don't delete the result
+NO_INLINE static IPageElement* FzGetElementAtPos(FzPageInfo* pageInfo, PointF pt) {
+    if (!pageInfo) {
+        return nullptr;
+    }
+    BuildElementIndex(pageInfo);
+    FzPageElementIndex& idx = pageInfo->elementIndex;
+    if (!idx.bounds.Contains(pt)) {
+        return nullptr;
     }
 
-    fz_point p = {(float)pt.x, (float)pt.y};
-    for (auto& img : pageInfo->images) {
-        fz_rect ir = img->rect;
-        if (IsPointInRect(ir, p)) {
-            res.Append(img->imageElement);
+    RectF& b = idx.bounds;
+    int cx = ElementIndexCell(pt.x, b.x, b.dx, idx.nCellsX);
+    int cy = ElementIndexCell(pt.y, b.y, b.dy, idx.nCellsY);
+    int cell = cy * idx.nCellsX + cx;
+
+    // cells list elements in the order in which they were tested before there was an index
+    // (links, auto-links, comments, images) which matters for PickBestElement()
+    Vec<IPageElement*> res;
+    for (int i = idx.cellStart[cell]; i < idx.cellStart[cell + 1]; i++) {
+        IPageElement* pel = idx.els[idx.cellEls[i]];
+        if (pel->GetRect().Contains(pt)) {
+            res.Append(pel);
         }
     }
 
@@ -1161,6 +1662,9 @@ static void FzLinkifyPageText(FzPageInfo* pageInfo, fz_stext_page* stext) {
         bool overlaps = false;
         for (auto pel : pageInfo->links) {
             overlaps = FzRectOverlap(bbox, pel->GetRect()) >= 0.25f;
+            if (overlaps) {
+                break;
+            }
         }
         if (overlaps) {
             continue;
@@ -1181,6 +1685,35 @@ static void FzLinkifyPageText(FzPageInfo* pageInfo, fz_stext_page* stext) {
     free(coords);
 }
 
+// number of pages that keep their text around for FzLinkifyPage()
+constexpr int kMaxLinkifyQueue = 16;
+
+// detects links in the page's text the first time they're needed
+// caller must hold pagesAccess and ctxAccess
+static void FzLinkifyPage(EngineMupdf* e, FzPageInfo* pageInfo) {
+    if (!pageInfo || !pageInfo->needsLinkify) {
+        return;
+    }
+    pageInfo->needsLinkify = false;
+    e->linkifyQueue.Remove(pageInfo);
+
+    auto ctx = e->Ctx();
+    fz_stext_page* stext = pageInfo->linkifyText;
+    pageInfo->linkifyText = nullptr;
+    fz_var(stext);
+    if (!stext && pageInfo->page) {
+        fz_try(ctx) {
+            stext = fz_new_stext_page_from_page(ctx, pageInfo->page, nullptr);
+        }
+        fz_catch(ctx) {
+            fz_report_error(ctx);
+        }
+    }
+    FzLinkifyPageText(pageInfo, stext);
+    fz_drop_stext_page(ctx, stext);
+    InvalidatePageElements(pageInfo);
+}
+
 static void FzFindImagePositions(fz_context* ctx, int pageNo, Vec<FitzPageImageInfo*>& images, fz_stext_page* stext) {
     if (!stext) {
         return;
@@ -1580,13 +2113,21 @@ void InitializeEngineMupdf() {
 
 fz_context* GetOrClonePerThreadContext(EngineMupdf* engine, fz_context* ctx) {
     DWORD threadID = GetCurrentThreadId();
-    ScopedCritSec cs(&gPerThreadContextsCs);
-    for (auto& el : *gPerThreadContexts) {
-        if (el.engine == engine && el.threadID == threadID) {
-            return el.ctx;
+    {
+        ScopedCritSec cs(&gPerThreadContextsCs);
+        for (auto& el : *gPerThreadContexts) {
+            if (el.engine == engine && el.threadID == threadID) {
+                return el.ctx;
+            }
         }
     }
-    auto newCtx = fz_clone_context(ctx);
+    // ctx might be used by another thread at the same time
+    fz_context* newCtx;
+    {
+        ScopedCritSec ctxScope(engine->ctxAccess);
+        newCtx = fz_clone_context(ctx);
+    }
+    ScopedCritSec cs(&gPerThreadContextsCs);
     ContextThreadID el{engine, newCtx, threadID};
     gPerThreadContexts->Append(el);
     return newCtx;
@@ -1616,7 +2157,9 @@ EngineMupdf::EngineMupdf() {
         InitializeCriticalSection(&mutexes[i]);
     }
     InitializeCriticalSection(&pagesAccess);
-    ctxAccess = &mutexes[FZ_LOCK_ALLOC];
+    InitializeCriticalSection(&engineAccess);
+    InitializeCriticalSection(&mediaboxAccess);
+    ctxAccess = &engineAccess;
 
     fz_locks_ctx.user = this;
     fz_locks_ctx.lock = fz_lock_context_cs;
@@ -1636,9 +2179,13 @@ EngineMupdf::~EngineMupdf() {
     EnterCriticalSection(&pagesAccess);
 
     auto ctx = Ctx();
+    for (FzCachedDisplayList& dl : tileDisplayLists) {
+        fz_drop_display_list(ctx, dl.list);
+    }
     for (FzPageInfo* pi : pages) {
         DeleteVecMembers(pi->links);
         DeleteVecMembers(pi->autoLinks);
+        fz_drop_stext_page(ctx, pi->linkifyText);
         DeleteVecMembers(pi->comments);
         DeleteVecMembers(pi->images);
         if (pi->retainedLinks) {
@@ -1670,6 +2217,8 @@ EngineMupdf::~EngineMupdf() {
     for (size_t i = 0; i < dimof(mutexes); i++) {
         DeleteCriticalSection(&mutexes[i]);
     }
+    DeleteCriticalSection(&engineAccess);
+    DeleteCriticalSection(&mediaboxAccess);
     LeaveCriticalSection(&pagesAccess);
     DeleteCriticalSection(&pagesAccess);
 }
@@ -1705,6 +2254,7 @@ EngineBase* EngineMupdf::Clone() {
     }
 
     EngineMupdf* clone = new EngineMupdf();
+    clone->disableProgressiveLoad = true;
     bool ok = clone->Load(FilePath(), pwdUI);
     if (!ok) {
         delete clone;
@@ -1897,9 +2447,16 @@ bool EngineMupdf::Load(const char* path, PasswordUI* pwdUI) {
         return FinishLoading();
     }
 
-    fz_stream* file = FzOpenOrReadFile(ctx, fnCopy);
+    fz_stream* file = nullptr;
+    if (streamNo < 0 && !disableProgressiveLoad) {
+        file = FzOpenProgressiveFile(ctx, fnCopy, &progressiveFile);
+    }
+    if (!file) {
+        file = FzOpenOrReadFile(ctx, fnCopy);
+    }
     ok = LoadFromStream(file, FilePath(), pwdUI);
     if (!ok) {
+        progressiveFile = nullptr;
         return false;
     }
 
@@ -1910,6 +2467,7 @@ bool EngineMupdf::Load(const char* path, PasswordUI* pwdUI) {
         }
         fz_drop_document(ctx, _doc);
         _doc = nullptr;
+        progressiveFile = nullptr;
         file = FzReadMaybeFixPDF(ctx, FilePath());
         if (!file) {
             return false;
@@ -2033,7 +2591,7 @@ bool EngineMupdf::LoadFromStream(fz_stream* stm, const char* nameHint, PasswordU
     fz_var(dy);
     fz_var(fontDy);
     fz_try(ctx) {
-        _doc = fz_open_document_with_stream(ctx, nameHint, stm);
+        _doc = FzOpenDocumentWhenAvailable(ctx, nameHint, stm, progressiveFile);
         pdfdoc = pdf_specifics(ctx, _doc);
         dx = DpiScale(ldx, displayDPI);
         dy = DpiScale(ldy, displayDPI);
@@ -2063,6 +2621,10 @@ bool EngineMupdf::LoadFromStream(fz_stream* stm, const char* nameHint, PasswordU
     // TODO: make this work for non-PDF formats?
     u8 digest[16 + 32]{};
     if (pdfdoc) {
+        // the fingerprint is calculated over the whole file
+        if (progressiveFile) {
+            WaitForSingleObject(progressiveFile->evtDone, INFINITE);
+        }
         FzStreamFingerprint(ctx, pdfdoc->file, digest);
     }
 
@@ -2231,6 +2793,7 @@ static void FinishNonPDFLoading(EngineMupdf* e) {
 bool EngineMupdf::FinishLoading() {
     auto ctx = Ctx();
     pdfdoc = pdf_specifics(ctx, _doc);
+    isReflowable = fz_is_document_reflowable(ctx, _doc);
 
     pageCount = 0;
     fz_var(pageCount);
@@ -2262,22 +2825,52 @@ bool EngineMupdf::FinishLoading() {
 
     ScopedCritSec scope(ctxAccess);
 
+    // while the file is read progressively, only the pages read so far can be
+    // looked up. pages are stored in order so the first that fails ends it
+    bool isPartial = IsPartiallyLoaded();
+    int nPagesAvailable = pageCount;
     for (int pageNo = 0; pageNo < pageCount; pageNo++) {
+        FzPageInfo* pageInfo = pages[pageNo];
+        pageInfo->pageNo = pageNo + 1;
+        if (pageNo >= nPagesAvailable) {
+            // assume that the page has the same size as the first one
+            pageInfo->mediabox = pages[0]->mediabox;
+            pageInfo->isMediaboxGuessed = true;
+            continue;
+        }
         pdf_obj* pageref = nullptr;
         fz_rect mbox{};
         fz_matrix page_ctm{};
+        bool tryLater = false;
         fz_var(pageref);
         fz_var(mbox);
+        fz_var(tryLater);
         fz_try(ctx) {
             // note: don't pdf_drop_obj() this
-            pageref = pdf_lookup_page_obj(ctx, pdfdoc, pageNo);
+            if (progressiveFile) {
+                // also loads the regular xref once the end of the file is reached
+                pageref = pdf_progressive_advance(ctx, pdfdoc, pageNo);
+            } else {
+                pageref = pdf_lookup_page_obj(ctx, pdfdoc, pageNo);
+            }
             pdf_page_obj_transform(ctx, pageref, &mbox, &page_ctm);
             mbox = fz_transform_rect(mbox, page_ctm);
         }
         fz_catch(ctx) {
-            fz_report_error(ctx);
+            tryLater = fz_caught(ctx) == FZ_ERROR_TRYLATER && pageNo > 0;
+            if (tryLater) {
+                fz_ignore_error(ctx);
+            } else {
+                fz_report_error(ctx);
+            }
             mbox = {};
         }
+        if (tryLater) {
+            nPagesAvailable = pageNo;
+            pageInfo->mediabox = pages[0]->mediabox;
+            pageInfo->isMediaboxGuessed = true;
+            continue;
+        }
         if (fz_is_empty_rect(mbox)) {
             logfa("cannot find page size for page %d", pageNo);
             mbox.x0 = 0;
@@ -2285,11 +2878,27 @@ bool EngineMupdf::FinishLoading() {
             mbox.x1 = 612;
             mbox.y1 = 792;
         }
-        FzPageInfo* pageInfo = pages[pageNo];
         pageInfo->mediabox = ToRectF(mbox);
-        pageInfo->pageNo = pageNo + 1;
+    }
+    if (nPagesAvailable < pageCount) {
+        logf("FinishLoading: %d of %d pages available\n", nPagesAvailable, pageCount);
     }
 
+    // outline, properties etc. are usually stored after the pages
+    if (!isPartial) {
+        LoadPdfMetadata();
+    }
+
+    // TODO: support javascript
+    ReportIf(pdf_js_supported(ctx, pdfdoc));
+
+    return true;
+}
+
+// must be called within ctxAccess
+void EngineMupdf::LoadPdfMetadata() {
+    auto ctx = Ctx();
+
     fz_try(ctx) {
         outline = fz_load_outline(ctx, _doc);
     }
@@ -2370,11 +2979,64 @@ bool EngineMupdf::FinishLoading() {
     if (pageLabels) {
         hasPageLabels = true;
     }
+}
 
-    // TODO: support javascript
-    ReportIf(pdf_js_supported(ctx, pdfdoc));
+bool EngineMupdf::IsPartiallyLoaded() {
+    return progressiveFile && !IsProgressiveFileDone(progressiveFile);
+}
 
-    return true;
+bool EngineMupdf::WaitForFullLoad() {
+    if (!progressiveFile || !pdfdoc) {
+        return false;
+    }
+    WaitForSingleObject(progressiveFile->evtDone, INFINITE);
+
+    auto ctx = Ctx();
+    ScopedCritSec scope(ctxAccess);
+    if (pdfInfo) {
+        // LoadPdfMetadata() has already been called
+        return false;
+    }
+    // reading to the end also loads the document's regular xref
+    fz_try(ctx) {
+        pdf_progressive_advance(ctx, pdfdoc, pageCount - 1);
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+    }
+
+    bool changed = false;
+    for (FzPageInfo* pageInfo : pages) {
+        if (!pageInfo->isMediaboxGuessed) {
+            continue;
+        }
+        pageInfo->isMediaboxGuessed = false;
+        fz_rect mbox{};
+        fz_matrix page_ctm{};
+        fz_var(mbox);
+        fz_try(ctx) {
+            pdf_obj* pageref = pdf_lookup_page_obj(ctx, pdfdoc, pageInfo->pageNo - 1);
+            pdf_page_obj_transform(ctx, pageref, &mbox, &page_ctm);
+            mbox = fz_transform_rect(mbox, page_ctm);
+        }
+        fz_catch(ctx) {
+            fz_report_error(ctx);
+            mbox = {};
+        }
+        if (fz_is_empty_rect(mbox)) {
+            continue;
+        }
+        RectF mediabox = ToRectF(mbox);
+        ScopedCritSec mediaboxScope(&mediaboxAccess);
+        if (mediabox != pageInfo->mediabox) {
+            pageInfo->mediabox = mediabox;
+            changed = true;
+        }
+    }
+
+    LoadPdfMetadata();
+    changed |= (outline || attachments || hasPageLabels);
+    return changed;
 }
 
 static NO_INLINE IPageDestination* DestFromAttachment(EngineMupdf* engine, fz_outline* outline) {
@@ -2660,6 +3322,11 @@ static void RebuildCommentsFromAnnotationsInner(fz_context* ctx, pdf_annot* anno
 }
 
 static void RebuildCommentsFromAnnotations(fz_context* ctx, FzPageInfo* pageInfo) {
+    // this is called on every GetFzPageInfo() for pages without annotations
+    // so don't throw away the element index when nothing changes
+    if (pageInfo->comments.Size() > 0) {
+        InvalidatePageElements(pageInfo);
+    }
     DeleteVecMembers(pageInfo->comments);
 
     // TODO: can use pageInof->annotations
@@ -2684,6 +3351,9 @@ static void RebuildCommentsFromAnnotations(fz_context* ctx, FzPageInfo* pageInfo
 
     // re-order list into top-to-bottom order (i.e. last-to-first)
     comments.Reverse();
+    if (comments.Size() > 0) {
+        InvalidatePageElements(pageInfo);
+    }
 }
 
 // like GetFzPageInfo() but fails if we can't acquire locks
@@ -2736,8 +3406,7 @@ fz_stext_page* fz_new_stext_page_from_page2(fz_context* ctx, fz_page* page, cons
     return text;
 }
 
-// Maybe: handle FZ_ERROR_TRYLATER, which can happen when parsing from network.
-// (I don't think we read from network now).
+// returns nullptr for pages that haven't been read yet (see FzProgressiveFile)
 // Maybe: when loading fully, cache extracted text in FzPageInfo
 // so that we don't have to re-do fz_new_stext_page_from_page() when doing search
 FzPageInfo* EngineMupdf::GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* cookie) {
@@ -2755,7 +3424,18 @@ FzPageInfo* EngineMupdf::GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* co
             pageInfo->page = fz_load_page(ctx, _doc, pageIdx);
         }
         fz_catch(ctx) {
-            fz_report_error(ctx);
+            if (fz_caught(ctx) == FZ_ERROR_TRYLATER) {
+                fz_ignore_error(ctx);
+            } else {
+                fz_report_error(ctx);
+            }
+        }
+        // mupdf returns pages that hit data that hasn't been read yet (FZ_ERROR_TRYLATER)
+        // with page->incomplete set. every run of such a page stays incomplete and its
+        // annotations are partial, so load it again once more of the file has been read
+        if (pageInfo->page && pageInfo->page->incomplete) {
+            fz_drop_page(ctx, pageInfo->page);
+            pageInfo->page = nullptr;
         }
     }
 
@@ -2786,6 +3466,10 @@ FzPageInfo* EngineMupdf::GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* co
     if (loadQuick || pageInfo->fullyLoaded) {
         return pageInfo;
     }
+    // text and links might be incomplete until the whole file has been read
+    if (IsPartiallyLoaded()) {
+        return pageInfo;
+    }
 
     ReportIf(pageInfo->pageNo != pageNo);
 
@@ -2810,19 +3494,31 @@ FzPageInfo* EngineMupdf::GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* co
         pageInfo->links.Append(pel);
         link = link->next;
     }
+    InvalidatePageElements(pageInfo);
 
     if (!stext) {
         return pageInfo;
     }
 
-    FzLinkifyPageText(pageInfo, stext);
     FzFindImagePositions(ctx, pageNo, pageInfo->images, stext);
-    fz_drop_stext_page(ctx, stext);
+
+    // detecting links in text is only done if the user interacts with the page
+    // so keep the text for FzLinkifyPage() instead of extracting it again
+    pageInfo->needsLinkify = true;
+    pageInfo->linkifyText = stext;
+    linkifyQueue.Append(pageInfo);
+    if (linkifyQueue.Size() > kMaxLinkifyQueue) {
+        FzPageInfo* oldest = linkifyQueue[0];
+        linkifyQueue.RemoveAt(0);
+        fz_drop_stext_page(ctx, oldest->linkifyText);
+        oldest->linkifyText = nullptr;
+    }
     return pageInfo;
 }
 
 RectF EngineMupdf::PageMediabox(int pageNo) {
     FzPageInfo* pi = pages[pageNo - 1];
+    ScopedCritSec scope(&mediaboxAccess);
     return pi->mediabox;
 }
 
@@ -2849,7 +3545,7 @@ RectF EngineMupdf::PageContentBox(int pageNo, RenderTarget target) {
     fz_var(dev);
     fz_var(list);
 
-    RectF mediabox = pageInfo->mediabox;
+    RectF mediabox = PageMediabox(pageNo);
 
     fz_try(ctx) {
         list = fz_new_display_list_from_page(ctx, pageInfo->page);
@@ -2914,6 +3610,12 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
         *args.cookie_out = cookie;
         fzcookie = (fz_cookie*)cookie->GetData();
     }
+    // while the file is read progressively, a page's content might not be
+    // complete yet. the cookie tells and such renders fail so that they're retried
+    fz_cookie incompleteCookie{};
+    if (!fzcookie && IsPartiallyLoaded()) {
+        fzcookie = &incompleteCookie;
+    }
 
     FzPageInfo* pageInfo = GetFzPageInfo(pageNo, false, fzcookie);
     if (!pageInfo || !pageInfo->page) {
@@ -2921,6 +3623,19 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
     }
     fz_page* page = pageInfo->page;
 
+    // when only a part of the page is rendered (i.e. a tile of a big page), the page is
+    // recorded into a display list once and the list is replayed for each tile. that way
+    // the tile only pays for the part of the page it shows (see fz_list_chunk in list-device.c)
+    fz_display_list* list = nullptr;
+    if (args.pageRect) {
+        RectF mediabox = PageMediabox(pageNo);
+        RectF visible = args.pageRect->Intersect(mediabox);
+        bool isTile = visible.dx * visible.dy < mediabox.dx * mediabox.dy * 0.9f;
+        if (isTile) {
+            list = GetTileDisplayList(pageNo, args.target, fzcookie);
+        }
+    }
+
     ScopedCritSec cs(ctxAccess);
 
     auto pageRect = args.pageRect;
@@ -2954,6 +3669,32 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
             break;
     }
 
+    if (list) {
+        fz_try(ctx) {
+            pix = fz_new_pixmap_with_bbox(ctx, csRgb, ibounds, nullptr, 1);
+            fz_clear_pixmap_with_value(ctx, pix, 0xff);
+            dev = fz_new_draw_device(ctx, ctm, pix);
+            fz_run_display_list(ctx, list, dev, fz_identity, pRect, fzcookie);
+            fz_close_device(ctx, dev);
+            bitmap = NewRenderedFzPixmap(ctx, pix);
+        }
+        fz_always(ctx) {
+            fz_drop_device(ctx, dev);
+            fz_drop_pixmap(ctx, pix);
+            fz_drop_display_list(ctx, list);
+        }
+        fz_catch(ctx) {
+            fz_report_error(ctx);
+            delete bitmap;
+            return nullptr;
+        }
+        if (fzcookie && fzcookie->incomplete) {
+            delete bitmap;
+            return nullptr;
+        }
+        return bitmap;
+    }
+
     pdf_page* pdfpage = nullptr;
     fz_var(pdfpage);
     if (pdfdoc) {
@@ -3002,14 +3743,129 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
             return nullptr;
         }
     }
+    if (fzcookie && fzcookie->incomplete) {
+        delete bitmap;
+        return nullptr;
+    }
 
     return bitmap;
 }
 
+fz_display_list* EngineMupdf::NewDisplayList(int pageNo, RenderTarget target, fz_cookie* cookie) {
+    FzPageInfo* pageInfo = GetFzPageInfo(pageNo, true, cookie);
+    if (!pageInfo || !pageInfo->page) {
+        return nullptr;
+    }
+    fz_page* page = pageInfo->page;
+
+    auto ctx = Ctx();
+    ScopedCritSec cs(ctxAccess);
+
+    const char* usage = "View";
+    switch (target) {
+        case RenderTarget::Print:
+            usage = "Print";
+            break;
+    }
+
+    fz_display_list* list = nullptr;
+    fz_device* dev = nullptr;
+    fz_var(list);
+    fz_var(dev);
+    fz_try(ctx) {
+        list = fz_new_display_list(ctx, fz_bound_page(ctx, page));
+        dev = fz_new_list_device(ctx, list);
+        if (pdfdoc) {
+            pdf_page* pdfpage = pdf_page_from_fz_page(ctx, page);
+            pdf_run_page_with_usage(ctx, pdfpage, dev, fz_identity, usage, cookie);
+        } else {
+            fz_run_page_contents(ctx, page, dev, fz_identity, cookie);
+        }
+        fz_close_device(ctx, dev);
+    }
+    fz_always(ctx) {
+        fz_drop_device(ctx, dev);
+    }
+    fz_catch(ctx) {
+        fz_drop_display_list(ctx, list);
+        list = nullptr;
+        fz_report_error(ctx);
+    }
+    return list;
+}
+
+// caller must fz_drop_display_list() the result
+fz_display_list* EngineMupdf::GetTileDisplayList(int pageNo, RenderTarget target, fz_cookie* cookie) {
+    auto ctx = Ctx();
+    {
+        ScopedCritSec scope(ctxAccess);
+        int n = tileDisplayLists.Size();
+        for (int i = 0; i < n; i++) {
+            FzCachedDisplayList dl = tileDisplayLists[i];
+            if (dl.pageNo == pageNo && dl.target == target) {
+                // move to the end so that it's evicted last
+                tileDisplayLists.RemoveAt(i);
+                tileDisplayLists.Append(dl);
+                return fz_keep_display_list(ctx, dl.list);
+            }
+        }
+    }
+
+    fz_display_list* list = NewDisplayList(pageNo, target, cookie);
+    if (!list) {
+        return nullptr;
+    }
+    if (cookie && (cookie->abort || cookie->incomplete)) {
+        // the list is incomplete
+        ScopedCritSec scope(ctxAccess);
+        fz_drop_display_list(ctx, list);
+        return nullptr;
+    }
+
+    ScopedCritSec scope(ctxAccess);
+    // lists of huge pages can take a lot of memory so only keep a few
+    constexpr int kMaxTileDisplayLists = 2;
+    while (tileDisplayLists.Size() >= kMaxTileDisplayLists) {
+        FzCachedDisplayList dl = tileDisplayLists.PopAt(0);
+        fz_drop_display_list(ctx, dl.list);
+    }
+    FzCachedDisplayList dl;
+    dl.pageNo = pageNo;
+    dl.target = target;
+    dl.list = fz_keep_display_list(ctx, list);
+    tileDisplayLists.Append(dl);
+    return list;
+}
+
+// must be called when the content of the page changes (e.g. annotations are modified)
+void EngineMupdf::DropTileDisplayLists(int pageNo) {
+    auto ctx = Ctx();
+    ScopedCritSec scope(ctxAccess);
+    for (int i = tileDisplayLists.Size() - 1; i >= 0; i--) {
+        FzCachedDisplayList dl = tileDisplayLists[i];
+        if (dl.pageNo == pageNo) {
+            tileDisplayLists.RemoveAt(i);
+            fz_drop_display_list(ctx, dl.list);
+        }
+    }
+}
+
 // don't delete the result
 IPageElement* EngineMupdf::GetElementAtPos(int pageNo, PointF pt) {
-    FzPageInfo* pageInfo = GetFzPageInfoCanFail(pageNo);
-    return FzGetElementAtPos(pageInfo, pt);
+    // like GetFzPageInfoCanFail() but keeps the locks while detecting links
+    // and using the element index
+    IPageElement* res = nullptr;
+    if (!TryEnterCriticalSection(&pagesAccess)) {
+        return nullptr;
+    }
+    if (TryEnterCriticalSection(ctxAccess)) {
+        FzPageInfo* pageInfo = GetFzPageInfo(pageNo, true);
+        FzLinkifyPage(this, pageInfo);
+        res = FzGetElementAtPos(pageInfo, pt);
+        LeaveCriticalSection(ctxAccess);
+    }
+    LeaveCriticalSection(&pagesAccess);
+    return res;
 }
 
 // TOOD: optimize by returning reference or pointer so that
@@ -3020,6 +3876,9 @@ Vec<IPageElement*> EngineMupdf::GetElements(int pageNo) {
         return Vec<IPageElement*>();
     }
 
+    ScopedCritSec scope(&pagesAccess);
+    ScopedCritSec ctxScope(ctxAccess);
+    FzLinkifyPage(this, pageInfo);
     BuildElementsInfo(pageInfo);
     return pageInfo->allElements;
 }
@@ -3168,6 +4027,10 @@ RenderedBitmap* EngineMupdf::GetPageImage(int pageNo, RectF rect, int imageIdx)
 
 PageText EngineMupdf::ExtractPageText(int pageNo) {
     auto ctx = Ctx();
+    // DocumentTextCache keeps the result so it must not be missing anything
+    if (progressiveFile) {
+        WaitForSingleObject(progressiveFile->evtDone, INFINITE);
+    }
 
     FzPageInfo* pageInfo = GetFzPageInfo(pageNo, true);
     if (!pageInfo) {
@@ -3197,165 +4060,246 @@ PageText EngineMupdf::ExtractPageText(int pageNo) {
     return res;
 }
 
-static void pdf_extract_fonts(fz_context* ctx, pdf_obj* res, Vec<pdf_obj*>& fontList, Vec<pdf_obj*>& resList) {
-    if (!res || pdf_mark_obj(ctx, res)) {
-        return;
+PageText EngineMupdf::ExtractPageTextForIndex(int pageNo) {
+    auto ctx = Ctx();
+    if (progressiveFile) {
+        WaitForSingleObject(progressiveFile->evtDone, INFINITE);
     }
-    resList.Append(res);
 
-    pdf_obj* fonts = pdf_dict_gets(ctx, res, "Font");
-    for (int k = 0; k < pdf_dict_len(ctx, fonts); k++) {
-        pdf_obj* font = pdf_resolve_indirect(ctx, pdf_dict_get_val(ctx, fonts, k));
-        if (font && !fontList.Contains(font)) {
-            fontList.Append(font);
-        }
+    FzPageInfo* pageInfo = GetFzPageInfo(pageNo, true);
+    if (!pageInfo) {
+        return {};
     }
-    // also extract fonts for all XObjects (recursively)
-    pdf_obj* xobjs = pdf_dict_gets(ctx, res, "XObject");
-    for (int k = 0; k < pdf_dict_len(ctx, xobjs); k++) {
-        pdf_obj* xobj = pdf_dict_get_val(ctx, xobjs, k);
-        pdf_obj* xres = pdf_dict_gets(ctx, xobj, "Resources");
-        pdf_extract_fonts(ctx, xres, fontList, resList);
+
+    ScopedCritSec scope(ctxAccess);
+
+    str::WStr text;
+    Vec<Rect> coords;
+    fz_device* dev = nullptr;
+    fz_var(dev);
+    fz_try(ctx) {
+        dev = NewFzIndexTextDevice(ctx, &text, &coords);
+        fz_run_page_contents(ctx, pageInfo->page, dev, fz_identity, nullptr);
+        fz_close_device(ctx, dev);
     }
+    fz_always(ctx) {
+        fz_drop_device(ctx, dev);
+    }
+    fz_catch(ctx) {
+        // keep whatever text was extracted before the error
+        fz_report_error(ctx);
+    }
+
+    ReportIf(text.size() != coords.size());
+    PageText res;
+    res.len = (int)text.size();
+    res.text = text.StealData();
+    res.coords = coords.StealData();
+    return res;
 }
 
-TempStr EngineMupdf::ExtractFontListTemp() {
-    Vec<pdf_obj*> fontList;
-    Vec<pdf_obj*> resList;
+DocInventory::DocInventory() {
+    seenObjects = new dict::MapPtrToInt(1024);
+    seenFonts = new dict::MapStrToInt(256);
+    seenPageSizes = new dict::MapStrToInt(64);
+}
 
-    auto ctx = Ctx();
+DocInventory::~DocInventory() {
+    delete seenObjects;
+    delete seenFonts;
+    delete seenPageSizes;
+}
 
-    // collect all fonts from all page objects
-    int nPages = PageCount();
-    for (int i = 1; i <= nPages; i++) {
-        auto pageInfo = GetFzPageInfo(i, false);
-        if (!pageInfo) {
-            continue;
+static void InventoryAddFont(fz_context* ctx, DocInventory* inv, pdf_obj* font) {
+    const char *name = nullptr, *type = nullptr, *encoding = nullptr;
+    bool embedded = false;
+    bool subset = false;
+    fz_var(name);
+    fz_var(type);
+    fz_var(encoding);
+    fz_var(embedded);
+    fz_var(subset);
+    fz_try(ctx) {
+        pdf_obj* font2 = pdf_array_get(ctx, pdf_dict_gets(ctx, font, "DescendantFonts"), 0);
+        if (!font2) {
+            font2 = font;
+        }
+
+        name = pdf_to_name(ctx, pdf_dict_getsa(ctx, font2, "BaseFont", "Name"));
+        bool needAnonName = str::IsEmpty(name);
+        if (needAnonName && font2 != font) {
+            name = pdf_to_name(ctx, pdf_dict_getsa(ctx, font, "BaseFont", "Name"));
+            needAnonName = str::IsEmpty(name);
+        }
+        if (needAnonName) {
+            name = str::FormatTemp("<#%d>", pdf_obj_parent_num(ctx, font2));
+        }
+        embedded = false;
+        pdf_obj* desc = pdf_dict_gets(ctx, font2, "FontDescriptor");
+        if (desc && (pdf_dict_gets(ctx, desc, "FontFile") || pdf_dict_getsa(ctx, desc, "FontFile2", "FontFile3"))) {
+            embedded = true;
+        }
+        // subset fonts have names like "ABCDEF+Arial"
+        if (embedded && str::Len(name) > 7 && name[6] == '+') {
+            name += 7;
+            subset = true;
+        }
+
+        type = pdf_to_name(ctx, pdf_dict_gets(ctx, font, "Subtype"));
+        if (font2 != font) {
+            const char* type2 = pdf_to_name(ctx, pdf_dict_gets(ctx, font2, "Subtype"));
+            if (str::Eq(type2, "CIDFontType0")) {
+                type = "Type1 (CID)";
+            } else if (str::Eq(type2, "CIDFontType2")) {
+                type = "TrueType (CID)";
+            }
         }
-        fz_page* fzpage = pageInfo->page;
-        if (!fzpage) {
-            continue;
+        if (str::Eq(type, "Type3")) {
+            embedded = pdf_dict_gets(ctx, font2, "CharProcs") != nullptr;
         }
 
-        ScopedCritSec scope(ctxAccess);
-        pdf_page* page = pdf_page_from_fz_page(ctx, fzpage);
-        fz_try(ctx) {
-            pdf_obj* resources = pdf_page_resources(ctx, page);
-            pdf_extract_fonts(ctx, resources, fontList, resList);
-            pdf_annot* annot;
-            for (annot = pdf_first_annot(ctx, page); annot; annot = pdf_next_annot(ctx, annot)) {
-                pdf_obj* o = pdf_annot_ap(ctx, annot);
-                if (o) {
-                    // TODO(port): not sure this is the right thing
-                    resources = pdf_xobject_resources(ctx, o);
-                    pdf_extract_fonts(ctx, resources, fontList, resList);
-                }
-            }
-        }
-        fz_catch(ctx) {
-            fz_report_error(ctx);
+        encoding = pdf_to_name(ctx, pdf_dict_gets(ctx, font, "Encoding"));
+        if (str::Eq(encoding, "WinAnsiEncoding")) {
+            encoding = "Ansi";
+        } else if (str::Eq(encoding, "MacRomanEncoding")) {
+            encoding = "Roman";
+        } else if (str::Eq(encoding, "MacExpertEncoding")) {
+            encoding = "Expert";
         }
     }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+        return;
+    }
+    ReportIf(!name || !type || !encoding);
 
-    // start ctxAccess scope here so that we don't also have to
-    // ask for pagesAccess (as is required for GetFzPage)
-    ScopedCritSec scope(ctxAccess);
-
-    for (pdf_obj* res : resList) {
-        pdf_unmark_obj(ctx, res);
+    str::Str info;
+    if (name[0] < 0 && MultiByteToWideChar(936, MB_ERR_INVALID_CHARS, name, -1, nullptr, 0)) {
+        TempStr s = strconv::ToMultiByteTemp(name, 936, CP_UTF8);
+        info.Append(s);
+    } else {
+        info.Append(name);
+    }
+    if (!str::IsEmpty(encoding) || !str::IsEmpty(type) || embedded) {
+        info.Append(" (");
+        if (!str::IsEmpty(type)) {
+            info.AppendFmt("%s; ", type);
+        }
+        if (!str::IsEmpty(encoding)) {
+            info.AppendFmt("%s; ", encoding);
+        }
+        if (embedded) {
+            info.Append("embedded; ");
+        }
+        info.RemoveAt(info.size() - 2, 2);
+        info.Append(")");
     }
 
-    StrVec fonts;
-    for (size_t i = 0; i < fontList.size(); i++) {
-        const char *name = nullptr, *type = nullptr, *encoding = nullptr;
-        bool embedded = false;
-        fz_try(ctx) {
-            pdf_obj* font = fontList.at(i);
-            pdf_obj* font2 = pdf_array_get(ctx, pdf_dict_gets(ctx, font, "DescendantFonts"), 0);
-            if (!font2) {
-                font2 = font;
-            }
+    if (info.IsEmpty()) {
+        return;
+    }
+    // different font objects often describe the same font
+    if (!inv->seenFonts->Insert(info.Get(), 0)) {
+        return;
+    }
+    inv->fonts.Append(info.Get());
+    if (embedded) {
+        inv->nEmbeddedFonts++;
+    }
+    if (subset) {
+        inv->nSubsetFonts++;
+    }
+}
 
-            name = pdf_to_name(ctx, pdf_dict_getsa(ctx, font2, "BaseFont", "Name"));
-            bool needAnonName = str::IsEmpty(name);
-            if (needAnonName && font2 != font) {
-                name = pdf_to_name(ctx, pdf_dict_getsa(ctx, font, "BaseFont", "Name"));
-                needAnonName = str::IsEmpty(name);
-            }
-            if (needAnonName) {
-                name = str::FormatTemp("<#%d>", pdf_obj_parent_num(ctx, font2));
-            }
-            embedded = false;
-            pdf_obj* desc = pdf_dict_gets(ctx, font2, "FontDescriptor");
-            if (desc && (pdf_dict_gets(ctx, desc, "FontFile") || pdf_dict_getsa(ctx, desc, "FontFile2", "FontFile3"))) {
-                embedded = true;
-            }
-            if (embedded && str::Len(name) > 7 && name[6] == '+') {
-                name += 7;
-            }
+// collects fonts and images from res and, recursively, from form XObjects and patterns
+// resource dictionaries are visited only once which also protects against cycles
+static void InventoryAddResources(fz_context* ctx, DocInventory* inv, pdf_obj* res) {
+    res = pdf_resolve_indirect(ctx, res);
+    if (!res || !inv->seenObjects->Insert(res, 0)) {
+        return;
+    }
 
-            type = pdf_to_name(ctx, pdf_dict_gets(ctx, font, "Subtype"));
-            if (font2 != font) {
-                const char* type2 = pdf_to_name(ctx, pdf_dict_gets(ctx, font2, "Subtype"));
-                if (str::Eq(type2, "CIDFontType0")) {
-                    type = "Type1 (CID)";
-                } else if (str::Eq(type2, "CIDFontType2")) {
-                    type = "TrueType (CID)";
-                }
-            }
-            if (str::Eq(type, "Type3")) {
-                embedded = pdf_dict_gets(ctx, font2, "CharProcs") != nullptr;
-            }
+    pdf_obj* fonts = pdf_dict_gets(ctx, res, "Font");
+    for (int k = 0; k < pdf_dict_len(ctx, fonts); k++) {
+        pdf_obj* font = pdf_resolve_indirect(ctx, pdf_dict_get_val(ctx, fonts, k));
+        if (font && inv->seenObjects->Insert(font, 0)) {
+            InventoryAddFont(ctx, inv, font);
+        }
+    }
 
-            encoding = pdf_to_name(ctx, pdf_dict_gets(ctx, font, "Encoding"));
-            if (str::Eq(encoding, "WinAnsiEncoding")) {
-                encoding = "Ansi";
-            } else if (str::Eq(encoding, "MacRomanEncoding")) {
-                encoding = "Roman";
-            } else if (str::Eq(encoding, "MacExpertEncoding")) {
-                encoding = "Expert";
-            }
+    pdf_obj* xobjs = pdf_dict_gets(ctx, res, "XObject");
+    for (int k = 0; k < pdf_dict_len(ctx, xobjs); k++) {
+        pdf_obj* xobj = pdf_resolve_indirect(ctx, pdf_dict_get_val(ctx, xobjs, k));
+        if (!xobj || !inv->seenObjects->Insert(xobj, 0)) {
+            continue;
         }
-        fz_catch(ctx) {
-            fz_report_error(ctx);
+        if (pdf_name_eq(ctx, pdf_dict_get(ctx, xobj, PDF_NAME(Subtype)), PDF_NAME(Image))) {
+            inv->nImages++;
             continue;
         }
-        ReportIf(!name || !type || !encoding);
+        InventoryAddResources(ctx, inv, pdf_dict_gets(ctx, xobj, "Resources"));
+    }
 
-        str::Str info;
-        if (name[0] < 0 && MultiByteToWideChar(936, MB_ERR_INVALID_CHARS, name, -1, nullptr, 0)) {
-            TempStr s = strconv::ToMultiByteTemp(name, 936, CP_UTF8);
-            info.Append(s);
-        } else {
-            info.Append(name);
+    pdf_obj* patterns = pdf_dict_gets(ctx, res, "Pattern");
+    for (int k = 0; k < pdf_dict_len(ctx, patterns); k++) {
+        pdf_obj* pattern = pdf_resolve_indirect(ctx, pdf_dict_get_val(ctx, patterns, k));
+        if (pattern && inv->seenObjects->Insert(pattern, 0)) {
+            InventoryAddResources(ctx, inv, pdf_dict_gets(ctx, pattern, "Resources"));
         }
-        if (!str::IsEmpty(encoding) || !str::IsEmpty(type) || embedded) {
-            info.Append(" (");
-            if (!str::IsEmpty(type)) {
-                info.AppendFmt("%s; ", type);
-            }
-            if (!str::IsEmpty(encoding)) {
-                info.AppendFmt("%s; ", encoding);
-            }
-            if (embedded) {
-                info.Append("embedded; ");
+    }
+}
+
+void EngineMupdf::ScanPageInventory(DocInventory* inv, int pageNo) {
+    inv->nPagesScanned++;
+
+    // page sizes are rounded to whole points so that tiny differences don't matter
+    SizeF size = PageMediabox(pageNo).Size();
+    size = SizeF(roundf(size.dx), roundf(size.dy));
+    TempStr key = str::FormatTemp("%dx%d", (int)size.dx, (int)size.dy);
+    int idx = inv->pageSizes.Size();
+    if (inv->seenPageSizes->Insert(key, idx, &idx)) {
+        inv->pageSizes.Append(size);
+        inv->pageSizeCounts.Append(0);
+    }
+    inv->pageSizeCounts[idx]++;
+
+    if (!pdfdoc) {
+        return;
+    }
+    FzPageInfo* pageInfo = GetFzPageInfo(pageNo, false);
+    if (!pageInfo || !pageInfo->page) {
+        return;
+    }
+
+    auto ctx = Ctx();
+    ScopedCritSec scope(ctxAccess);
+    pdf_page* page = pdf_page_from_fz_page(ctx, pageInfo->page);
+    fz_try(ctx) {
+        InventoryAddResources(ctx, inv, pdf_page_resources(ctx, page));
+        for (pdf_annot* annot = pdf_first_annot(ctx, page); annot; annot = pdf_next_annot(ctx, annot)) {
+            pdf_obj* ap = pdf_annot_ap(ctx, annot);
+            if (ap) {
+                InventoryAddResources(ctx, inv, pdf_xobject_resources(ctx, ap));
             }
-            info.RemoveAt(info.size() - 2, 2);
-            info.Append(")");
         }
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+    }
+}
 
-        if (info.IsEmpty()) {
-            continue;
-        }
-        char* fontName = info.LendData();
-        AppendIfNotExists(&fonts, fontName);
+TempStr EngineMupdf::ExtractFontListTemp() {
+    DocInventory inv;
+    int nPages = PageCount();
+    for (int i = 1; i <= nPages; i++) {
+        ScanPageInventory(&inv, i);
     }
-    if (fonts.Size() == 0) {
+    if (inv.fonts.Size() == 0) {
         return nullptr;
     }
 
-    SortNatural(&fonts);
-    return JoinTemp(&fonts, "\n");
+    SortNatural(&inv.fonts);
+    return JoinTemp(&inv.fonts, "\n");
 }
 
 // clang-format off
@@ -3667,6 +4611,11 @@ bool IsEngineMupdfSupportedFileType(Kind kind) {
     if (kind == kindFilePalmDoc) {
         return true;
     }
+    // .mobi and .prc. HUFF/CDIC compressed books can't be opened by mupdf
+    // and fall back to EngineEbook
+    if (kind == kindFileMobi) {
+        return true;
+    }
     return false;
 }
 
@@ -3877,6 +4826,7 @@ NO_INLINE void MarkNotificationAsModified(EngineMupdf* e, Annotation* annot, Ann
     }
     int pageNo = annot->pageNo;
     ReportIf(pageNo < 1 || pageNo > e->pageCount);
+    e->DropTileDisplayLists(pageNo);
     int pageIdx = pageNo - 1;
 
     // EngineMupdf is the ultimate source of truth for Annotation* list
@@ -3909,7 +4859,7 @@ NO_INLINE void MarkNotificationAsModified(EngineMupdf* e, Annotation* annot, Ann
     }
     auto ctx = e->Ctx();
     RebuildCommentsFromAnnotations(ctx, pageInfo);
-    pageInfo->elementsNeedRebuilding = true;
+    InvalidatePageElements(pageInfo);
 }
 
 // creates Annotation wrapper around pdf_annot
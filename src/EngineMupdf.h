@@ -2,6 +2,12 @@
    License: GPLv3 */
 
 struct Annotation;
+struct FzProgressiveFile;
+
+namespace dict {
+class MapPtrToInt;
+class MapStrToInt;
+} // namespace dict
 
 struct FitzPageImageInfo {
     fz_rect rect = fz_unit_rect;
@@ -12,6 +18,20 @@ struct FitzPageImageInfo {
     }
 };
 
+// grid of cells over a page's elements. each cell lists elements that overlap it
+// so that FzGetElementAtPos() only tests a few elements on pages with many links
+struct FzPageElementIndex {
+    RectF bounds;
+    int nCellsX = 0;
+    int nCellsY = 0;
+    // in hit-testing order: links, auto-detected links, comments, images
+    Vec<IPageElement*> els;
+    // elements overlapping cell i are els[cellEls[cellStart[i]]] ... els[cellEls[cellStart[i + 1] - 1]]
+    Vec<int> cellStart;
+    Vec<int> cellEls;
+    bool needsRebuilding = true;
+};
+
 struct FzPageInfo {
     int pageNo = 0; // 1-based
     fz_page* page = nullptr;
@@ -22,15 +42,24 @@ struct FzPageInfo {
     fz_link* retainedLinks = nullptr;
 
     Vec<Annotation*> annotations;
-    // auto-detected links
+    // auto-detected links. detecting them is expensive so it's only done
+    // when they're first needed (see FzLinkifyPage())
     Vec<IPageElement*> autoLinks;
+    bool needsLinkify = false;
+    // text of the page kept for FzLinkifyPage(). dropped for pages that were
+    // loaded long ago (see EngineMupdf::linkifyQueue) and extracted again if needed
+    fz_stext_page* linkifyText = nullptr;
     // comments are made out of annotations
     Vec<IPageElement*> comments;
 
     Vec<IPageElement*> allElements;
     bool elementsNeedRebuilding = true;
+    FzPageElementIndex elementIndex;
 
     RectF mediabox{};
+    // the page's data hadn't been read yet when the document was opened
+    // (see FzProgressiveFile) so mediabox is a guess until WaitForFullLoad()
+    bool isMediaboxGuessed = false;
     Vec<FitzPageImageInfo*> images;
 
     // if false, only loaded page (fast)
@@ -38,6 +67,39 @@ struct FzPageInfo {
     bool fullyLoaded = false;
 };
 
+// display list of a page that is rendered in tiles. the list is recorded once and
+// replayed for every tile so that the page content is only interpreted once
+struct FzCachedDisplayList {
+    int pageNo = 0;
+    RenderTarget target = RenderTarget::View;
+    fz_display_list* list = nullptr;
+};
+
+// fonts, images and page sizes used by a document
+// built one page at a time with EngineMupdf::ScanPageInventory() so that
+// partial results can be shown while a big document is still being scanned
+struct DocInventory {
+    DocInventory();
+    ~DocInventory();
+
+    // e.g. "Arial (TrueType; Ansi; embedded)", in the order they were found
+    StrVec fonts;
+    int nEmbeddedFonts = 0;
+    int nSubsetFonts = 0;
+    int nImages = 0;
+    // distinct page sizes (in points) and the number of pages of that size
+    Vec<SizeF> pageSizes;
+    Vec<int> pageSizeCounts;
+    int nPagesScanned = 0;
+
+    // resource dictionaries, fonts and images already visited. they're
+    // usually shared between pages, so each is only looked at once
+    dict::MapPtrToInt* seenObjects = nullptr;
+    // for de-duplicating fonts and page sizes
+    dict::MapStrToInt* seenFonts = nullptr;
+    dict::MapStrToInt* seenPageSizes = nullptr;
+};
+
 class EngineMupdf : public EngineBase {
   public:
     EngineMupdf();
@@ -54,6 +116,7 @@ class EngineMupdf : public EngineBase {
     ByteSlice GetFileData() override;
     bool SaveFileAs(const char* copyFileName) override;
     PageText ExtractPageText(int pageNo) override;
+    PageText ExtractPageTextForIndex(int pageNo) override;
 
     bool HasClipOptimizations(int pageNo) override;
     TempStr GetPropertyTemp(const char* name) override;
@@ -68,6 +131,8 @@ class EngineMupdf : public EngineBase {
 
     IPageDestination* GetNamedDest(const char* name) override;
     TocTree* GetToc() override;
+    bool IsPartiallyLoaded() override;
+    bool WaitForFullLoad() override;
 
     TempStr GetPageLabeTemp(int pageNo) const override;
     int GetPageByLabel(const char* label) const override;
@@ -76,8 +141,11 @@ class EngineMupdf : public EngineBase {
 
     // make sure to never ask for pagesAccess in an ctxAccess
     // protected critical section in order to avoid deadlocks
+    // points to engineAccess, which is separate from mutexes[FZ_LOCK_ALLOC] so that
+    // mupdf allocations on other threads don't wait while the engine is busy
     CRITICAL_SECTION* ctxAccess;
     CRITICAL_SECTION pagesAccess;
+    CRITICAL_SECTION engineAccess;
 
     CRITICAL_SECTION mutexes[FZ_LOCK_MAX];
 
@@ -94,6 +162,19 @@ class EngineMupdf : public EngineBase {
 
     TocTree* tocTree = nullptr;
 
+    // most recently used is last. protected by ctxAccess
+    Vec<FzCachedDisplayList> tileDisplayLists;
+    // pages that keep FzPageInfo::linkifyText, most recently loaded is last. protected by pagesAccess
+    Vec<FzPageInfo*> linkifyQueue;
+
+    // set if the file is being read on a background thread (linearized PDFs
+    // on slow drives). owned by the document's fz_stream
+    FzProgressiveFile* progressiveFile = nullptr;
+    // FzPageInfo::mediabox is updated by WaitForFullLoad() while the ui reads it
+    CRITICAL_SECTION mediaboxAccess;
+    // e.g. a clone used for printing must be fully loaded
+    bool disableProgressiveLoad = false;
+
     // used to track "dirty" state of annotations. not perfect because if we add and delete
     // the same annotation, we should be back to 0
     bool modifiedAnnotations = false;
@@ -104,6 +185,7 @@ class EngineMupdf : public EngineBase {
     // bool Load(fz_stream* stm, PasswordUI* pwdUI = nullptr);
     bool LoadFromStream(fz_stream* stm, const char* nameHing, PasswordUI* pwdUI = nullptr);
     bool FinishLoading();
+    void LoadPdfMetadata();
     RenderedBitmap* GetPageImage(int pageNo, RectF rect, int imageIdx);
 
     FzPageInfo* GetFzPageInfoCanFail(int pageNo);
@@ -111,8 +193,17 @@ class EngineMupdf : public EngineBase {
     FzPageInfo* GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* cookie = nullptr);
     fz_matrix viewctm(int pageNo, float zoom, int rotation);
     fz_matrix viewctm(fz_page* page, float zoom, int rotation) const;
+    // records page content into a display list that can be replayed
+    // without holding ctxAccess e.g. on another thread with its own fz_context
+    // caller must fz_drop_display_list() the result
+    fz_display_list* NewDisplayList(int pageNo, RenderTarget target, fz_cookie* cookie = nullptr);
+    // like NewDisplayList() but re-uses lists of recently rendered pages
+    fz_display_list* GetTileDisplayList(int pageNo, RenderTarget target, fz_cookie* cookie);
+    void DropTileDisplayLists(int pageNo);
     TocItem* BuildTocTree(TocItem* parent, fz_outline* outline, int& idCounter, bool isAttachment);
     TempStr ExtractFontListTemp();
+    // only holds ctxAccess while scanning the page, safe to call on a background thread
+    void ScanPageInventory(DocInventory* inv, int pageNo);
 
     ByteSlice LoadStreamFromPDFFile(const char* filePath);
 };
@@ -126,3 +217,5 @@ void MarkNotificationAsModified(EngineMupdf*, Annotation*, AnnotationChange = An
 Annotation* MakeAnnotationWrapper(EngineMupdf* engine, pdf_annot* annot, int pageNo);
 
 void InitializeEngineMupdf();
+fz_context* GetOrClonePerThreadContext(EngineMupdf* engine, fz_context* ctx);
+void ReleasePerThreadContext(EngineMupdf* engine);
@@ -0,0 +1,685 @@
+/* Copyright 2024 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+#include "utils/BaseUtil.h"
+#include "utils/ScopedWin.h"
+#include "utils/FileUtil.h"
+#include "utils/GdiPlusUtil.h"
+#include "utils/GuessFileType.h"
+#include "utils/ThreadUtil.h"
+#include "utils/WinUtil.h"
+
+#include "wingui/UIModels.h"
+
+#include "DocController.h"
+#include "EngineBase.h"
+#include "EngineAll.h"
+
+#include "utils/Log.h"
+
+using Gdiplus::Matrix;
+using Gdiplus::MatrixOrderAppend;
+using Gdiplus::MatrixOrderPrepend;
+
+Kind kindEnginePlainText = "enginePlainText";
+
+// Shows big text files (e.g. logs) without reading them into memory. The file is
+// memory-mapped and split into pages of about the same number of bytes, so the
+// number of pages is known right away: a page starts with the first line that
+// starts within its byte range (or in the middle of a line that is longer than
+// a whole page). Lines are wrapped at the page width, so the height of a page
+// depends on its content. It's only known for the first few pages when the file
+// is opened, the others are measured by a background thread.
+
+// smaller files are converted to html and shown with EngineMupdf (which also
+// detects links). that's slower but looks the same as before
+constexpr i64 kMinPlainTextFileSize = 4 * 1024 * 1024;
+
+// bytes from the start of the file used for guessing the code page
+// and the average number of bytes per row
+constexpr int kPlainTextSampleSize = 64 * 1024;
+// pages measured when the file is opened
+constexpr int kPlainTextSyncPages = 16;
+constexpr i64 kMinPlainTextPageBytes = 512;
+constexpr i64 kMaxPlainTextPages = 1 << 20;
+
+constexpr int kPlainTextTabSize = 8;
+// font size and page border in page units (1/96 inch)
+constexpr float kPlainTextFontSize = 13.f;
+constexpr float kPlainTextPageBorder = 48.f;
+// text is drawn with fonts and character positions this many times bigger than
+// in page units to keep the rounding of GDI's integer coordinates invisible
+constexpr float kPlainTextScale = 16.f;
+
+// a row of laid out text of a page
+struct PlainTextRow {
+    // index into laid out text
+    int start = 0;
+    int len = 0;
+    // false if the line continues in the next row
+    bool endsLine = false;
+};
+
+static bool IsUtf8Continuation(char c) {
+    return ((u8)c & 0xC0) == 0x80;
+}
+
+static bool IsLowSurrogate(WCHAR c) {
+    return c >= 0xDC00 && c <= 0xDFFF;
+}
+
+// lays out s in rows of at most nColumns characters: tabs are expanded and
+// control characters are replaced with spaces, line ends are not included
+// the text and rows are only built if text and rows are not nullptr
+// returns the number of rows
+static int LayoutPlainText(const WCHAR* s, int len, int nColumns, str::WStr* text, Vec<PlainTextRow>* rows) {
+    int nRows = 0;
+    int col = 0;
+    int rowStart = 0;
+    auto endRow = [&](bool endsLine) {
+        if (rows) {
+            PlainTextRow row;
+            row.start = rowStart;
+            row.len = text->isize() - rowStart;
+            row.endsLine = endsLine;
+            rows->Append(row);
+            rowStart = text->isize();
+        }
+        nRows++;
+        col = 0;
+    };
+    for (int i = 0; i < len; i++) {
+        WCHAR c = s[i];
+        if (c == '\n') {
+            endRow(true);
+            continue;
+        }
+        if (c == '\r' && (i + 1 == len || s[i + 1] == '\n')) {
+            continue;
+        }
+        // the second half of a surrogate pair doesn't take a column
+        if (IsLowSurrogate(c)) {
+            if (text) {
+                text->AppendChar(c);
+            }
+            continue;
+        }
+        if (col == nColumns) {
+            endRow(false);
+        }
+        if (c == '\t') {
+            int n = std::min(kPlainTextTabSize - col % kPlainTextTabSize, nColumns - col);
+            for (int j = 0; text && j < n; j++) {
+                text->AppendChar(' ');
+            }
+            col += n;
+            continue;
+        }
+        if (c < 0x20 || c == 0x7F) {
+            c = ' ';
+        }
+        if (text) {
+            text->AppendChar(c);
+        }
+        col++;
+    }
+    if (col > 0) {
+        endRow(false);
+    }
+    return nRows;
+}
+
+class EnginePlainText : public EngineBase {
+  public:
+    EnginePlainText();
+    ~EnginePlainText() override;
+    EngineBase* Clone() override;
+
+    RectF PageMediabox(int pageNo) override;
+    RectF PageContentBox(int pageNo, RenderTarget target = RenderTarget::View) override;
+
+    RenderedBitmap* RenderPage(RenderPageArgs& args) override;
+
+    RectF Transform(const RectF& rect, int pageNo, float zoom, int rotation, bool inverse = false) override;
+
+    ByteSlice GetFileData() override;
+    bool SaveFileAs(const char* copyFileName) override;
+    PageText ExtractPageText(int pageNo) override;
+    bool HasClipOptimizations(int) override {
+        return false;
+    }
+    TempStr GetPropertyTemp(const char*) override {
+        return nullptr;
+    }
+
+    Vec<IPageElement*> GetElements(int) override {
+        return {};
+    }
+    IPageElement* GetElementAtPos(int, PointF) override {
+        return nullptr;
+    }
+
+    bool BenchLoadPage(int) override {
+        return true;
+    }
+
+    bool IsPartiallyLoaded() override;
+    bool WaitForFullLoad() override;
+    bool PageMightContainText(int pageNo, const WCHAR* s, bool caseSensitive) override;
+
+    static EngineBase* CreateFromFile(const char* path);
+
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMap = nullptr;
+    const char* mapped = nullptr;
+    // file content without byte order mark
+    const char* data = nullptr;
+    i64 dataLen = 0;
+    uint codePage = CP_UTF8;
+
+    // in page units
+    float charDx = 0;
+    float lineDy = 0;
+    float ascent = 0;
+    int nColumns = 0;
+    int rowsPerPage = 0;
+    i64 pageBytes = 0;
+
+    // number of rows of each page. the first kPlainTextSyncPages are set
+    // in Load(), the others by PlainTextIndexThread
+    int* pageRows = nullptr;
+    // set if a page measured by PlainTextIndexThread doesn't have rowsPerPage rows
+    bool pageSizesChanged = false;
+    AtomicBool abortIndex;
+    HANDLE hIndexThread = nullptr;
+    // manual-reset, signaled once all pages have been measured
+    HANDLE evtIndexed = nullptr;
+
+    bool Load(const char* path);
+    bool IsIndexed();
+    i64 PageStart(int pageNo);
+    WCHAR* DecodePage(int pageNo, int* lenOut);
+    int CountPageRows(int pageNo);
+    int LayoutPage(int pageNo, str::WStr& text, Vec<PlainTextRow>& rows);
+    void GetTransform(Matrix& m, int pageNo, float zoom, int rotation);
+};
+
+static void PlainTextIndexThread(EnginePlainText* engine) {
+    int nPages = engine->PageCount();
+    for (int pageNo = kPlainTextSyncPages + 1; pageNo <= nPages && !engine->abortIndex.Get(); pageNo++) {
+        int nRows = engine->CountPageRows(pageNo);
+        engine->pageRows[pageNo - 1] = nRows;
+        if (nRows != engine->rowsPerPage) {
+            engine->pageSizesChanged = true;
+        }
+    }
+    SetEvent(engine->evtIndexed);
+}
+
+EnginePlainText::EnginePlainText() {
+    kind = kindEnginePlainText;
+    str::ReplaceWithCopy(&defaultExt, ".txt");
+}
+
+EnginePlainText::~EnginePlainText() {
+    if (hIndexThread) {
+        abortIndex.Set(true);
+        WaitForSingleObject(hIndexThread, INFINITE);
+        CloseHandle(hIndexThread);
+    }
+    if (evtIndexed) {
+        CloseHandle(evtIndexed);
+    }
+    free(pageRows);
+    if (mapped) {
+        UnmapViewOfFile(mapped);
+    }
+    if (hMap) {
+        CloseHandle(hMap);
+    }
+    if (hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(hFile);
+    }
+}
+
+EngineBase* EnginePlainText::Clone() {
+    const char* path = FilePath();
+    if (!path) {
+        return nullptr;
+    }
+    return CreateFromFile(path);
+}
+
+bool EnginePlainText::IsIndexed() {
+    return WaitForSingleObject(evtIndexed, 0) == WAIT_OBJECT_0;
+}
+
+bool EnginePlainText::IsPartiallyLoaded() {
+    return !IsIndexed();
+}
+
+bool EnginePlainText::WaitForFullLoad() {
+    WaitForSingleObject(evtIndexed, INFINITE);
+    return pageSizesChanged;
+}
+
+// offset into data of the first byte of a page (or dataLen for pageNo > pageCount)
+i64 EnginePlainText::PageStart(int pageNo) {
+    if (pageNo <= 1) {
+        return 0;
+    }
+    if (pageNo > pageCount) {
+        return dataLen;
+    }
+    i64 start = (i64)(pageNo - 1) * pageBytes;
+    i64 end = std::min(start + pageBytes, dataLen);
+    // a newline right before start also counts
+    const char* nl = (const char*)memchr(data + start - 1, '\n', (size_t)(end - start));
+    if (nl) {
+        return nl - data + 1;
+    }
+    // a line longer than a page is split. for double-byte code pages
+    // this might split a character
+    if (codePage == CP_UTF8) {
+        while (start < end && IsUtf8Continuation(data[start])) {
+            start++;
+        }
+    }
+    return start;
+}
+
+// caller has to free() the result
+WCHAR* EnginePlainText::DecodePage(int pageNo, int* lenOut) {
+    i64 start = PageStart(pageNo);
+    int cb = (int)(PageStart(pageNo + 1) - start);
+    *lenOut = 0;
+    if (cb <= 0) {
+        return AllocArray<WCHAR>(1);
+    }
+    int cch = MultiByteToWideChar(codePage, 0, data + start, cb, nullptr, 0);
+    WCHAR* s = AllocArray<WCHAR>((size_t)std::max(cch, 0) + 1);
+    if (s && cch > 0) {
+        *lenOut = MultiByteToWideChar(codePage, 0, data + start, cb, s, cch);
+    }
+    return s;
+}
+
+int EnginePlainText::CountPageRows(int pageNo) {
+    int len;
+    AutoFreeWStr s(DecodePage(pageNo, &len));
+    return LayoutPlainText(s, len, nColumns, nullptr, nullptr);
+}
+
+int EnginePlainText::LayoutPage(int pageNo, str::WStr& text, Vec<PlainTextRow>& rows) {
+    int len;
+    AutoFreeWStr s(DecodePage(pageNo, &len));
+    return LayoutPlainText(s, len, nColumns, &text, &rows);
+}
+
+RectF EnginePlainText::PageMediabox(int pageNo) {
+    ReportIf(pageNo < 1 || pageNo > pageCount);
+    // until all pages have been measured, pages show as many rows as fit
+    // on a page so that the size of a page changes at most once
+    int nRows = rowsPerPage;
+    if (pageNo <= kPlainTextSyncPages || IsIndexed()) {
+        nRows = std::max(pageRows[pageNo - 1], 1);
+    }
+    float dx = 2 * kPlainTextPageBorder + nColumns * charDx;
+    float dy = 2 * kPlainTextPageBorder + nRows * lineDy;
+    return RectF(0, 0, dx, dy);
+}
+
+RectF EnginePlainText::PageContentBox(int pageNo, RenderTarget) {
+    RectF mbox = PageMediabox(pageNo);
+    mbox.Inflate(-kPlainTextPageBorder, -kPlainTextPageBorder);
+    return mbox;
+}
+
+void EnginePlainText::GetTransform(Matrix& m, int pageNo, float zoom, int rotation) {
+    GetBaseTransform(m, ToGdipRectF(PageMediabox(pageNo)), zoom, rotation);
+}
+
+RectF EnginePlainText::Transform(const RectF& rect, int pageNo, float zoom, int rotation, bool inverse) {
+    Gdiplus::PointF pts[2] = {Gdiplus::PointF((float)rect.x, (float)rect.y),
+                              Gdiplus::PointF((float)(rect.x + rect.dx), (float)(rect.y + rect.dy))};
+    Matrix m;
+    GetTransform(m, pageNo, zoom, rotation);
+    if (inverse) {
+        m.Invert();
+    }
+    m.TransformPoints(pts, 2);
+    return RectF::FromXY(pts[0].X, pts[0].Y, pts[1].X, pts[1].Y);
+}
+
+static HFONT CreatePlainTextFont(int size) {
+    return CreateFontW(-size, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_TT_PRECIS,
+                       CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, FIXED_PITCH | FF_MODERN, L"Consolas");
+}
+
+RenderedBitmap* EnginePlainText::RenderPage(RenderPageArgs& args) {
+    int pageNo = args.pageNo;
+    RectF pageRc = args.pageRect ? *args.pageRect : PageMediabox(pageNo);
+    Rect screen = Transform(pageRc, pageNo, args.zoom, args.rotation).Round();
+    Point screenTL = screen.TL();
+    screen.Offset(-screen.x, -screen.y);
+
+    HANDLE hMap = nullptr;
+    HBITMAP hbmp = CreateMemoryBitmap(screen.Size(), &hMap);
+    if (!hbmp) {
+        return nullptr;
+    }
+    HDC hdc = CreateCompatibleDC(nullptr);
+    DeleteObject(SelectObject(hdc, hbmp));
+    RECT rc = ToRECT(screen);
+    FillRect(hdc, &rc, (HBRUSH)GetStockObject(WHITE_BRUSH));
+
+    Matrix m;
+    GetTransform(m, pageNo, args.zoom, args.rotation);
+    m.Translate((float)-screenTL.x, (float)-screenTL.y, MatrixOrderAppend);
+    m.Scale(1.f / kPlainTextScale, 1.f / kPlainTextScale, MatrixOrderPrepend);
+    float el[6];
+    m.GetElements(el);
+    XFORM xf = {el[0], el[1], el[2], el[3], el[4], el[5]};
+    SetGraphicsMode(hdc, GM_ADVANCED);
+    SetWorldTransform(hdc, &xf);
+
+    HFONT font = CreatePlainTextFont((int)(kPlainTextFontSize * kPlainTextScale + 0.5f));
+    HGDIOBJ prevFont = SelectObject(hdc, font);
+    SetTextAlign(hdc, TA_BASELINE | TA_LEFT | TA_NOUPDATECP);
+    SetTextColor(hdc, RGB(0, 0, 0));
+    SetBkMode(hdc, TRANSPARENT);
+
+    str::WStr text;
+    Vec<PlainTextRow> rows;
+    LayoutPage(pageNo, text, rows);
+    Vec<int> dx;
+    int x = (int)(kPlainTextPageBorder * kPlainTextScale);
+    for (int i = 0; i < rows.Size(); i++) {
+        float y = kPlainTextPageBorder + i * lineDy;
+        PlainTextRow& row = rows[i];
+        if (row.len == 0 || y >= pageRc.y + pageRc.dy || y + lineDy <= pageRc.y) {
+            continue;
+        }
+        // characters are placed on a grid instead of using the font's advances
+        // so that rendering matches ExtractPageText
+        const WCHAR* s = text.Get() + row.start;
+        dx.Reset();
+        float pos = 0;
+        int prevX = 0;
+        for (int j = 0; j < row.len; j++) {
+            if (IsLowSurrogate(s[j])) {
+                dx.Append(0);
+                continue;
+            }
+            pos += charDx;
+            int nextX = (int)(pos * kPlainTextScale + 0.5f);
+            dx.Append(nextX - prevX);
+            prevX = nextX;
+        }
+        int baseline = (int)((y + ascent) * kPlainTextScale + 0.5f);
+        ExtTextOutW(hdc, x, baseline, 0, nullptr, s, (UINT)row.len, dx.LendData());
+    }
+
+    SelectObject(hdc, prevFont);
+    DeleteObject(font);
+    DeleteDC(hdc);
+    return new RenderedBitmap(hbmp, screen.Size(), hMap);
+}
+
+PageText EnginePlainText::ExtractPageText(int pageNo) {
+    str::WStr text;
+    Vec<PlainTextRow> rows;
+    LayoutPage(pageNo, text, rows);
+
+    str::WStr content;
+    Vec<Rect> coords;
+    int dy = (int)lineDy;
+    for (int i = 0; i < rows.Size(); i++) {
+        PlainTextRow& row = rows[i];
+        int y = (int)(kPlainTextPageBorder + i * lineDy);
+        const WCHAR* s = text.Get() + row.start;
+        content.Append(s, row.len);
+        int col = 0;
+        for (int j = 0; j < row.len; j++) {
+            // both halves of a surrogate pair get the same box
+            if (j > 0 && IsLowSurrogate(s[j])) {
+                Rect prev = coords.Last();
+                coords.Append(prev);
+                continue;
+            }
+            int x1 = (int)(kPlainTextPageBorder + col * charDx);
+            int x2 = (int)(kPlainTextPageBorder + (col + 1) * charDx);
+            coords.Append(Rect(x1, y, x2 - x1, dy));
+            col++;
+        }
+        // wrapped lines are continued without a separator
+        if (row.endsLine || i == rows.Size() - 1) {
+            content.AppendChar('\n');
+            coords.AppendBlanks(1);
+        }
+    }
+    ReportIf(coords.size() != content.size());
+
+    PageText res;
+    res.len = content.isize();
+    res.text = content.StealData();
+    res.coords = coords.StealData();
+    return res;
+}
+
+static bool MatchesAsciiI(const char* s, const char* needle, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (tolower((u8)s[i]) != (u8)needle[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// searches the raw bytes of a page instead of extracting its text. only returns
+// false if the text of the page can't contain s (which never contains whitespace)
+bool EnginePlainText::PageMightContainText(int pageNo, const WCHAR* s, bool caseSensitive) {
+    for (const WCHAR* c = s; *c; c++) {
+        // invalid bytes are decoded as U+FFFD, control characters are replaced
+        // and case-insensitive search is only done for ascii
+        if (*c == 0xFFFD || *c < 0x20 || (!caseSensitive && *c >= 0x80)) {
+            return true;
+        }
+    }
+    BOOL usedDefaultChar = FALSE;
+    BOOL* usedDefaultCharPtr = codePage == CP_UTF8 ? nullptr : &usedDefaultChar;
+    int cb = WideCharToMultiByte(codePage, 0, s, -1, nullptr, 0, nullptr, usedDefaultCharPtr);
+    if (cb <= 1 || usedDefaultChar) {
+        return true;
+    }
+    AutoFree needle = AllocArray<char>(cb);
+    WideCharToMultiByte(codePage, 0, s, -1, needle, cb, nullptr, nullptr);
+    size_t needleLen = (size_t)cb - 1;
+    if (!caseSensitive) {
+        str::ToLowerInPlace(needle);
+    }
+
+    i64 start = PageStart(pageNo);
+    i64 end = PageStart(pageNo + 1);
+    if (end - start < (i64)needleLen) {
+        return false;
+    }
+    const char* last = data + end - needleLen;
+    if (caseSensitive) {
+        for (const char* p = data + start; p <= last; p++) {
+            p = (const char*)memchr(p, needle[0], (size_t)(last - p) + 1);
+            if (!p) {
+                return false;
+            }
+            if (memeq(p, needle, needleLen)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    for (const char* p = data + start; p <= last; p++) {
+        if (MatchesAsciiI(p, needle, needleLen)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ByteSlice EnginePlainText::GetFileData() {
+    // the mapping stays valid even if the file has been deleted in the meantime
+    ByteSlice d((const u8*)mapped, (size_t)(data - mapped + dataLen));
+    return d.Clone();
+}
+
+bool EnginePlainText::SaveFileAs(const char* dstPath) {
+    const char* srcPath = FilePath();
+    if (!srcPath) {
+        return false;
+    }
+    return file::Copy(dstPath, srcPath, false);
+}
+
+// UTF-16 text is left to the other engines
+static bool IsUtf16(const char* s, i64 len) {
+    if (len < 2) {
+        return false;
+    }
+    return memeq(s, "\xFF\xFE", 2) || memeq(s, "\xFE\xFF", 2);
+}
+
+// big logs are often still being written to, so don't lock out
+// other processes that append to (or replace) the file
+static HANDLE OpenPlainTextFile(const char* path) {
+    WCHAR* pathW = ToWStrTemp(path);
+    DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+    return CreateFileW(pathW, GENERIC_READ, share, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+}
+
+bool EnginePlainText::Load(const char* path) {
+    SetFilePath(path);
+    const char* ext = path::GetExtTemp(path);
+    if (!str::IsEmpty(ext)) {
+        str::ReplaceWithCopy(&defaultExt, ext);
+    }
+
+    hFile = OpenPlainTextFile(path);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(hFile, &size) || size.QuadPart <= 0 || (u64)size.QuadPart > (u64)(SIZE_T)-1) {
+        return false;
+    }
+    // only the size seen now is mapped (and shown), data appended
+    // by other processes is picked up when the document is reloaded
+    hMap = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, (DWORD)size.HighPart, size.LowPart, nullptr);
+    if (!hMap) {
+        return false;
+    }
+    // on 32-bit this fails for files bigger than the available address space
+    mapped = (const char*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, (SIZE_T)size.QuadPart);
+    if (!mapped) {
+        logf("EnginePlainText::Load: failed to map '%s'\n", path);
+        return false;
+    }
+    data = mapped;
+    dataLen = size.QuadPart;
+    if (IsUtf16(data, dataLen)) {
+        return false;
+    }
+    if (dataLen >= 3 && memeq(data, UTF8_BOM, 3)) {
+        data += 3;
+        dataLen -= 3;
+    }
+
+    // the sample ends after an ascii character so that it doesn't end within a character
+    int sampleLen = (int)std::min(dataLen, (i64)kPlainTextSampleSize);
+    while (sampleLen > 0 && (u8)data[sampleLen - 1] >= 0x80) {
+        sampleLen--;
+    }
+    if (MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, data, sampleLen, nullptr, 0) == 0 && sampleLen > 0) {
+        codePage = GuessTextCodepage(data, (size_t)sampleLen, CP_ACP);
+    }
+
+    // measure the font in a big size for precision
+    HDC hdc = CreateCompatibleDC(nullptr);
+    HFONT font = CreatePlainTextFont(1000);
+    HGDIOBJ prevFont = SelectObject(hdc, font);
+    TEXTMETRICW tm{};
+    GetTextMetricsW(hdc, &tm);
+    SIZE charSize{};
+    GetTextExtentPoint32W(hdc, L"M", 1, &charSize);
+    SelectObject(hdc, prevFont);
+    DeleteObject(font);
+    DeleteDC(hdc);
+    float scale = kPlainTextFontSize / 1000.f;
+    charDx = charSize.cx * scale;
+    lineDy = (tm.tmHeight + tm.tmExternalLeading) * scale;
+    ascent = tm.tmAscent * scale;
+    if (charDx <= 0 || lineDy <= 0) {
+        return false;
+    }
+
+    // ISO 216 A4 (210mm x 297mm)
+    float pageDx = 8.27f * GetFileDPI() - 2 * kPlainTextPageBorder;
+    float pageDy = 11.693f * GetFileDPI() - 2 * kPlainTextPageBorder;
+    nColumns = std::max((int)(pageDx / charDx), 1);
+    rowsPerPage = std::max((int)(pageDy / lineDy), 1);
+
+    int sampleRows = 0;
+    {
+        int len = 0;
+        AutoFreeWStr s(strconv::StrCPToWStr(data, codePage, sampleLen));
+        if (s) {
+            len = str::Leni(s);
+        }
+        sampleRows = LayoutPlainText(s, len, nColumns, nullptr, nullptr);
+    }
+    double bytesPerRow = (double)sampleLen / std::max(sampleRows, 1);
+    pageBytes = std::max((i64)(bytesPerRow * rowsPerPage), kMinPlainTextPageBytes);
+    pageBytes = std::max(pageBytes, (dataLen + kMaxPlainTextPages - 1) / kMaxPlainTextPages);
+    pageCount = std::max((int)((dataLen + pageBytes - 1) / pageBytes), 1);
+
+    pageRows = AllocArray<int>(pageCount);
+    if (!pageRows) {
+        return false;
+    }
+    for (int pageNo = 1; pageNo <= std::min(pageCount, kPlainTextSyncPages); pageNo++) {
+        pageRows[pageNo - 1] = CountPageRows(pageNo);
+    }
+    evtIndexed = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (pageCount <= kPlainTextSyncPages) {
+        SetEvent(evtIndexed);
+    } else {
+        auto fn = MkFunc0<EnginePlainText>(PlainTextIndexThread, this);
+        hIndexThread = StartThread(fn, "PlainTextIndexThread");
+    }
+    logf("EnginePlainText::Load: '%s', %d pages, code page %d\n", path, pageCount, (int)codePage);
+    return true;
+}
+
+EngineBase* EnginePlainText::CreateFromFile(const char* path) {
+    EnginePlainText* engine = new EnginePlainText();
+    if (engine->Load(path)) {
+        return engine;
+    }
+    SafeEngineRelease(&engine);
+    return nullptr;
+}
+
+bool IsEnginePlainTextSupportedFile(Kind kind, const char* path) {
+    if (kind != kindFileTxt) {
+        return false;
+    }
+    // file::GetSize() fails for files that are open for writing
+    AutoCloseHandle h = OpenPlainTextFile(path);
+    LARGE_INTEGER size{};
+    if (!h.IsValid() || !GetFileSizeEx(h, &size)) {
+        return false;
+    }
+    return size.QuadPart >= kMinPlainTextFileSize;
+}
+
+EngineBase* CreateEnginePlainTextFromFile(const char* path) {
+    return EnginePlainText::CreateFromFile(path);
+}
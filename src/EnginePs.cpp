@@ -305,6 +305,10 @@ class EnginePs : public EngineBase {
         return pdfEngine->ExtractPageText(pageNo);
     }
 
+    PageText ExtractPageTextForIndex(int pageNo) override {
+        return pdfEngine->ExtractPageTextForIndex(pageNo);
+    }
+
     bool HasClipOptimizations(int pageNo) override {
         return pdfEngine->HasClipOptimizations(pageNo);
     }
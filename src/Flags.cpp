@@ -68,6 +68,7 @@
     V(Render, "render")                          \
     V(ExtractText, "extract-text")               \
     V(Bench, "bench")                            \
+    V(BenchMode, "bench-mode")                   \
     V(Dir, "d")                                  \
     V(InstallDir, "install-dir")                 \
     V(Lang, "lang")                              \
@@ -87,6 +88,7 @@
     V(Adobe, "a")                                \
     V(DDE, "dde")                                \
     V(EngineDump, "engine-dump")                 \
+    V(ProgressiveKbps, "progressive-kbps")       \
     V(SetColorRange, "set-color-range")
 
 #define MAKE_ARG(__arg, __name) __arg,
@@ -531,6 +533,11 @@ void ParseFlags(const WCHAR* cmdLine, Flags& i) {
             continue;
         }
 
+        if (arg == Arg::ProgressiveKbps) {
+            i.progressiveKbps = paramInt;
+            continue;
+        }
+
         if (arg == Arg::PrintTo) {
             i.printerName = str::Dup(param);
             i.exitWhenDone = true;
@@ -653,6 +660,10 @@ void ParseFlags(const WCHAR* cmdLine, Flags& i) {
             i.exitImmediately = true;
             continue;
         }
+        if (arg == Arg::BenchMode) {
+            i.benchMode = str::Dup(param);
+            continue;
+        }
         if (arg == Arg::Dir || arg == Arg::InstallDir) {
             i.installDir = str::Dup(param);
             continue;
@@ -740,4 +751,5 @@ Flags::~Flags() {
     str::Free(deleteFile);
     str::Free(search);
     str::Free(dde);
+    str::Free(benchMode);
 }
@@ -37,6 +37,10 @@ struct Flags {
     //   to benchmark. It can also be a string "loadonly" which means we'll
     //   only benchmark loading of the catalog
     StrVec pathsToBenchmark;
+    // -bench-mode <mode>: what -bench measures. nullptr means page load
+    // and render times. "export" times saving pages as images,
+    // "detect" times symbol detection
+    char* benchMode = nullptr;
     bool exitWhenDone = false;
     bool printDialog = false;
     char* printerName = nullptr;
@@ -87,6 +91,9 @@ struct Flags {
     bool testApp = false;
     char* dde = nullptr;
     bool engineDump = false; // -engine-dump
+    // -progressive-kbps <n>: show linearized PDFs from local drives while they're
+    // still being read and read them at n KB per second
+    int progressiveKbps = 0;
 
     bool crashOnOpen = false;
 
@@ -1387,12 +1387,176 @@ Vec<HtmlPage*>* HtmlFormatter::FormatAllPages(bool skipEmptyPages) {
     return pages;
 }
 
+static size_t BitmapBytes(Bitmap* bmp) {
+    return bmp ? (size_t)bmp->GetWidth() * (size_t)bmp->GetHeight() * 4 : 0;
+}
+
+// returns nullptr on failure
+static Bitmap* ScaleBitmap(Bitmap* bmp, int bmpDx, int bmpDy, int dx, int dy) {
+    Bitmap* scaled = new Bitmap(dx, dy, PixelFormat32bppPARGB);
+    Status status;
+    {
+        Graphics gScaled(scaled);
+        gScaled.SetInterpolationMode(Gdiplus::InterpolationModeHighQualityBicubic);
+        gScaled.SetPixelOffsetMode(Gdiplus::PixelOffsetModeHighQuality);
+        Gdiplus::ImageAttributes attrs;
+        attrs.SetWrapMode(Gdiplus::WrapModeTileFlipXY);
+        Gdiplus::Rect dst(0, 0, dx, dy);
+        status = gScaled.DrawImage(bmp, dst, 0, 0, bmpDx, bmpDy, UnitPixel, &attrs);
+    }
+    if (status != Ok) {
+        delete scaled;
+        return nullptr;
+    }
+    return scaled;
+}
+
+HtmlImageCache::Entry::Entry() {
+    InitializeCriticalSection(&bmpAccess);
+}
+
+HtmlImageCache::Entry::~Entry() {
+    delete bmp;
+    DeleteCriticalSection(&bmpAccess);
+}
+
+HtmlImageCache::HtmlImageCache(size_t maxBytes) : maxBytes(maxBytes) {
+    InitializeCriticalSection(&access);
+}
+
+HtmlImageCache::~HtmlImageCache() {
+    EnterCriticalSection(&access);
+    DeleteVecMembers(entries);
+    LeaveCriticalSection(&access);
+    DeleteCriticalSection(&access);
+}
+
+// returns the entry for img at size dx x dy with an added reference or nullptr if there's none
+HtmlImageCache::Entry* HtmlImageCache::Acquire(const ByteSlice& img, int dx, int dy) {
+    ScopedCritSec scope(&access);
+    for (Entry* e : entries) {
+        if (e->data == img.data() && e->len == img.size() && e->dx == dx && e->dy == dy) {
+            e->lastUsed = ++useCount;
+            e->refs++;
+            return e;
+        }
+    }
+    return nullptr;
+}
+
+// takes ownership of bmp. if another thread has added the same entry in the
+// meantime, bmp is deleted and that entry is returned
+HtmlImageCache::Entry* HtmlImageCache::AddAndAcquire(const ByteSlice& img, int dx, int dy, Bitmap* bmp) {
+    Entry* e = Acquire(img, dx, dy);
+    if (e) {
+        delete bmp;
+        return e;
+    }
+    ScopedCritSec scope(&access);
+    e = new Entry();
+    e->data = img.data();
+    e->len = img.size();
+    e->dx = dx;
+    e->dy = dy;
+    e->bmp = bmp;
+    if (bmp) {
+        e->bmpDx = (int)bmp->GetWidth();
+        e->bmpDy = (int)bmp->GetHeight();
+    }
+    e->nBytes = BitmapBytes(bmp);
+    e->lastUsed = ++useCount;
+    e->refs = 1;
+    nBytes += e->nBytes;
+    entries.Append(e);
+    return e;
+}
+
+void HtmlImageCache::Release(Entry* e) {
+    ScopedCritSec scope(&access);
+    e->refs--;
+    FreeSpace();
+}
+
+// drops the least recently drawn images that aren't in use until we're within the budget
+// caller must hold access
+void HtmlImageCache::FreeSpace() {
+    while (nBytes > maxBytes) {
+        int lru = -1;
+        for (int i = 0; i < entries.Size(); i++) {
+            if (entries[i]->refs > 0) {
+                continue;
+            }
+            if (lru < 0 || entries[i]->lastUsed < entries[lru]->lastUsed) {
+                lru = i;
+            }
+        }
+        if (lru < 0) {
+            break;
+        }
+        Entry* e = entries[lru];
+        nBytes -= e->nBytes;
+        entries.RemoveAt(lru);
+        delete e;
+    }
+}
+
+Status HtmlImageCache::Draw(Graphics* g, const ByteSlice& img, RectF bbox) {
+    Entry* e = Acquire(img, 0, 0);
+    if (!e) {
+        // decoding takes long, other threads can draw in the meantime
+        e = AddAndAcquire(img, 0, 0, BitmapFromData(img));
+    }
+    if (!e->bmp) {
+        Release(e);
+        return Ok;
+    }
+
+    // size of the image on the target, taking the zoom into account
+    Matrix m;
+    g->GetTransform(&m);
+    float el[6];
+    m.GetElements(el);
+    int dx = (int)ceilf(bbox.dx * hypotf(el[0], el[1]));
+    int dy = (int)ceilf(bbox.dy * hypotf(el[2], el[3]));
+
+    // downscale only once per size with high quality instead of on every draw.
+    // e.g. the view and thumbnails each get their own copy
+    int bmpDx = e->bmpDx;
+    int bmpDy = e->bmpDy;
+    if (dx > 0 && dy > 0 && dx <= bmpDx && dy <= bmpDy && (dx < bmpDx || dy < bmpDy)) {
+        Entry* scaledEntry = Acquire(img, dx, dy);
+        if (!scaledEntry) {
+            Bitmap* scaled;
+            {
+                ScopedCritSec bmpScope(&e->bmpAccess);
+                scaled = ScaleBitmap(e->bmp, bmpDx, bmpDy, dx, dy);
+            }
+            // remembers failures, too
+            scaledEntry = AddAndAcquire(img, dx, dy, scaled);
+        }
+        if (scaledEntry->bmp) {
+            Release(e);
+            e = scaledEntry;
+        } else {
+            Release(scaledEntry);
+        }
+    }
+
+    Status status;
+    {
+        ScopedCritSec bmpScope(&e->bmpAccess);
+        status = g->DrawImage(e->bmp, ToGdipRectF(bbox), 0, 0, (float)e->bmpDx, (float)e->bmpDy, UnitPixel);
+    }
+    Release(e);
+    return status;
+}
+
 // TODO: draw link in the appropriate format (blue text, underlined, should show hand cursor when
 // mouse is over a link. There's a slight complication here: we only get explicit information about
 // strings, not about the whitespace and we should underline the whitespace as well. Also the text
 // should be underlined at a baseline
 void DrawHtmlPage(Graphics* g, mui::ITextRender* textDraw, Vec<DrawInstr>* drawInstructions, float offX, float offY,
-                  bool showBbox, Color textColor, bool* abortCookie) {
+                  bool showBbox, Color textColor, bool* abortCookie, HtmlImageCache* imageCache) {
     Pen debugPen(Color(255, 0, 0), 1);
     // Pen linePen(Color(0, 0, 0), 2.f);
     Pen linePen(Color(0x5F, 0x4B, 0x32), 2.f);
@@ -1443,8 +1607,11 @@ void DrawHtmlPage(Graphics* g, mui::ITextRender* textDraw, Vec<DrawInstr>* drawI
             }
             status = g->DrawLine(&linePen, p1, p2);
             ReportIf(status != Ok);
+        } else if (DrawInstrType::Image == i.type && imageCache) {
+            status = imageCache->Draw(g, i.GetImage(), bbox);
+            // GDI+ sometimes seems to succeed in loading an image because it lazily decodes it
+            ReportIf(status != Ok && status != Win32Error);
         } else if (DrawInstrType::Image == i.type) {
-            // TODO: cache the bitmap somewhere (?)
             Bitmap* bmp = BitmapFromData(i.GetImage());
             if (bmp) {
                 status = g->DrawImage(bmp, ToGdipRectF(bbox), 0, 0, (float)bmp->GetWidth(), (float)bmp->GetHeight(),
@@ -292,8 +292,58 @@ class HtmlFormatter {
     Vec<HtmlPage*>* FormatAllPages(bool skipEmptyPages = true);
 };
 
+// decoding images is much slower than laying out and drawing text, so the decoded
+// images (and copies downscaled to the sizes they're drawn at) are kept across
+// pages and renderings. images are identified by the address of their data
+// which is owned by the document and must outlive the cache
+constexpr size_t kHtmlImageCacheMaxBytes = 64 * 1024 * 1024;
+
+struct HtmlImageCache {
+    struct Entry {
+        const u8* data = nullptr;
+        size_t len = 0;
+        // size the image has been scaled to, 0 x 0 for the decoded image
+        int dx = 0;
+        int dy = 0;
+        // nullptr if the image couldn't be decoded or scaled
+        Bitmap* bmp = nullptr;
+        // size of bmp, so that it doesn't have to be asked while another thread uses it
+        int bmpDx = 0;
+        int bmpDy = 0;
+        size_t nBytes = 0;
+        u64 lastUsed = 0;
+        // number of threads using the entry, it's not freed while in use
+        int refs = 0;
+        // a GDI+ bitmap can't be used by several threads at once
+        CRITICAL_SECTION bmpAccess;
+
+        Entry();
+        ~Entry();
+    };
+
+    // decoding and scaling happen outside of access, which only protects entries
+    Vec<Entry*> entries;
+    size_t nBytes = 0;
+    size_t maxBytes = 0;
+    u64 useCount = 0;
+    CRITICAL_SECTION access;
+
+    explicit HtmlImageCache(size_t maxBytes = kHtmlImageCacheMaxBytes);
+    HtmlImageCache(HtmlImageCache const&) = delete;
+    HtmlImageCache& operator=(HtmlImageCache const&) = delete;
+    ~HtmlImageCache();
+
+    Status Draw(Graphics* g, const ByteSlice& img, RectF bbox);
+
+  private:
+    Entry* Acquire(const ByteSlice& img, int dx, int dy);
+    Entry* AddAndAcquire(const ByteSlice& img, int dx, int dy, Bitmap* bmp);
+    void Release(Entry* e);
+    void FreeSpace();
+};
+
 void DrawHtmlPage(Graphics* g, mui::ITextRender* textDraw, Vec<DrawInstr>* drawInstructions, float offX, float offY,
-                  bool showBbox, Color textColor, bool* abortCookie = nullptr);
+                  bool showBbox, Color textColor, bool* abortCookie = nullptr, HtmlImageCache* imageCache = nullptr);
 
 mui::TextRenderMethod GetTextRenderMethod();
 void SetTextRenderMethod(mui::TextRenderMethod method);
@@ -91,9 +91,13 @@ static_assert(CmdZoomLast - CmdZoomFirst == 17, "zoom ids are not in a continuou
 //[ ACCESSKEY_GROUP File Menu
 static MenuDef menuDefFile[] = {
     {
-        _TRN("Open the ML_Model"),
+        _TRN("&Detect Symbols on Current Page"),
         CmdMLModel,
     },
+    {
+        _TRN("Detect Symbols in All Pages"),
+        CmdDetectSymbolsInDocument,
+    },
     {
         _TRN("Convert to &Images..."),
         CmdConvertPdfToImages,
@@ -907,6 +911,8 @@ static UINT_PTR disableIfNoDocument[] = {
     CmdOpenNextFileInFolder,
     CmdOpenPrevFileInFolder,
     CmdInvokeInverseSearch,
+    CmdMLModel,
+    CmdDetectSymbolsInDocument,
     // IDM_VIEW_WITH_XPS_VIEWER and IDM_VIEW_WITH_HTML_HELP
     // are removed instead of disabled (and can remain enabled
     // for broken XPS/CHM documents)
@@ -1,165 +1,501 @@
-#include <windows.h>
-#include <string>
-#include <sstream>
-#include <filesystem>
-#include <commdlg.h> // For OPENFILENAME
-
-LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
-
-HWND hwndResolutionField, hwndStartPageField, hwndEndPageField; // Handles for the text fields
-const WCHAR* g_pdfPath;                                         // Global variable to hold pdfPath
-
-// Helper function to convert std::wstring to std::string
-std::string ConvertWideToNarrow(const std::wstring& wideStr) {
-    return std::string(wideStr.begin(), wideStr.end());
-}
-
-// Helper function to extract the directory from a file path
-std::wstring GetDirectoryPath(const std::wstring& filePath) {
-    return std::filesystem::path(filePath).parent_path().wstring();
-}
-
-// Helper function to get the path to mutool.exe in the same directory as the executable
-std::wstring GetMutoolPath() {
-    wchar_t exePath[MAX_PATH];
-    GetModuleFileName(NULL, exePath, MAX_PATH);
-    std::filesystem::path exeDirectory = std::filesystem::path(exePath).parent_path();
-
-    // Check if mutool.exe is in the same directory as the executable
-    std::filesystem::path mutoolPath = exeDirectory / L"mutool.exe";
-    if (std::filesystem::exists(mutoolPath)) {
-        return mutoolPath.wstring();
-    }
-
-    // If not found, prompt the user to locate mutool.exe
-    MessageBox(NULL, L"mutool.exe not found. Please locate mutool.exe.", L"Error", MB_ICONERROR);
-    OPENFILENAME ofn = {0};
-    wchar_t szFile[MAX_PATH] = {0};
-    ofn.lStructSize = sizeof(ofn);
-    ofn.lpstrFilter = L"Executable Files\0*.exe\0All Files\0*.*\0";
-    ofn.lpstrFile = szFile;
-    ofn.nMaxFile = MAX_PATH;
-    ofn.lpstrTitle = L"Select mutool.exe";
-    ofn.Flags = OFN_FILEMUSTEXIST;
-
-    if (GetOpenFileName(&ofn)) {
-        std::filesystem::path selectedPath = szFile;
-        if (selectedPath.filename().wstring() == L"mutool.exe") {
-            return selectedPath.wstring();
+/* Copyright 2024 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+extern "C" {
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+}
+
+#include "utils/BaseUtil.h"
+#include "utils/ScopedWin.h"
+#include "utils/FileUtil.h"
+#include "utils/UITask.h"
+#include "utils/ThreadUtil.h"
+#include "utils/Timer.h"
+#include "utils/WinUtil.h"
+
+#include "wingui/UIModels.h"
+
+#include "Settings.h"
+#include "DocController.h"
+#include "EngineBase.h"
+#include "EngineMupdf.h"
+#include "DisplayModel.h"
+#include "ProgressUpdateUI.h"
+#include "Notifications.h"
+#include "SumatraPDF.h"
+#include "MainWindow.h"
+#include "WindowTab.h"
+#include "Translations.h"
+#include "PdfToImage.h"
+
+#include "utils/Log.h"
+
+// Pages are exported by a small pipeline:
+// - each worker thread takes the next page number, records the page into a
+//   display list (needs EngineMupdf::ctxAccess, but is cheap), then renders
+//   and encodes it with its own fz_context (doesn't need ctxAccess)
+// - the thread calling ExportPagesAsImages() writes encoded images in page
+//   order, reports progress and checks for cancellation
+// - workers never run more than maxPending pages ahead of the writer which
+//   bounds the memory used by encoded images that wait to be written
+
+struct ExportWorker;
+
+struct ExportPipeline {
+    PageImageExportArgs* args = nullptr;
+    EngineMupdf* engine = nullptr;
+    float zoom = 1.f;
+    int maxPending = 0;
+
+    CRITICAL_SECTION cs;
+    // signaled when a page has been encoded or has been written
+    CONDITION_VARIABLE cv;
+    // protected by cs
+    int nextPage = 0;
+    int nextToWrite = 0;
+    bool canceled = false;
+    // indexed by pageNo - args->startPage
+    Vec<fz_buffer*> encoded;
+    Vec<bool> isDone;
+
+    Vec<ExportWorker*> workers;
+
+    ExportPipeline() {
+        InitializeCriticalSection(&cs);
+        InitializeConditionVariable(&cv);
+    }
+    ~ExportPipeline() {
+        DeleteCriticalSection(&cs);
+    }
+};
+
+struct ExportWorker {
+    ExportPipeline* pipeline = nullptr;
+    HANDLE thread = nullptr;
+    fz_cookie cookie{};
+};
+
+static int GetExportThreadsCount(int nPages) {
+    SYSTEM_INFO si{};
+    GetSystemInfo(&si);
+    int n = (int)si.dwNumberOfProcessors;
+    n = limitValue(n, 1, 16);
+    return std::min(n, nPages);
+}
+
+// returns nullptr on failure or when aborted
+static fz_buffer* RenderAndEncodePage(fz_context* ctx, ExportPipeline* p, int pageNo, fz_cookie* cookie) {
+    fz_display_list* list = p->engine->NewDisplayList(pageNo, RenderTarget::Export, cookie);
+    if (!list) {
+        return nullptr;
+    }
+    PageImageExportArgs* args = p->args;
+
+    fz_buffer* res = nullptr;
+    fz_pixmap* pix = nullptr;
+    fz_device* dev = nullptr;
+    fz_var(res);
+    fz_var(pix);
+    fz_var(dev);
+    fz_try(ctx) {
+        fz_matrix ctm = fz_scale(p->zoom, p->zoom);
+        fz_rect bounds = fz_transform_rect(fz_bound_display_list(ctx, list), ctm);
+        fz_irect ibounds = fz_round_rect(bounds);
+        pix = fz_new_pixmap_with_bbox(ctx, fz_device_rgb(ctx), ibounds, nullptr, 0);
+        fz_clear_pixmap_with_value(ctx, pix, 0xff);
+        dev = fz_new_draw_device(ctx, fz_identity, pix);
+        fz_run_display_list(ctx, list, dev, ctm, bounds, cookie);
+        fz_close_device(ctx, dev);
+        if (!cookie->abort) {
+            if (args->format == PageImageFormat::Jpeg) {
+                res = fz_new_buffer_from_pixmap_as_jpeg(ctx, pix, fz_default_color_params, args->jpegQuality, 0);
+            } else {
+                res = fz_new_buffer_from_pixmap_as_png(ctx, pix, fz_default_color_params);
+            }
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_device(ctx, dev);
+        fz_drop_pixmap(ctx, pix);
+        fz_drop_display_list(ctx, list);
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+        res = nullptr;
+    }
+    return res;
+}
+
+static void ExportWorkerThread(ExportWorker* w) {
+    ExportPipeline* p = w->pipeline;
+    EngineMupdf* engine = p->engine;
+    fz_context* ctx = GetOrClonePerThreadContext(engine, engine->Ctx());
+    int endPage = p->args->endPage;
+    int startPage = p->args->startPage;
+    while (true) {
+        int pageNo;
+        {
+            ScopedCritSec cs(&p->cs);
+            while (!p->canceled && p->nextPage <= endPage && p->nextPage - p->nextToWrite >= p->maxPending) {
+                SleepConditionVariableCS(&p->cv, &p->cs, INFINITE);
+            }
+            if (p->canceled || p->nextPage > endPage) {
+                break;
+            }
+            pageNo = p->nextPage++;
+        }
+
+        fz_buffer* buf = RenderAndEncodePage(ctx, p, pageNo, &w->cookie);
+
+        {
+            ScopedCritSec cs(&p->cs);
+            int idx = pageNo - startPage;
+            p->encoded[idx] = buf;
+            p->isDone[idx] = true;
+        }
+        WakeAllConditionVariable(&p->cv);
+    }
+    ReleasePerThreadContext(engine);
+    DestroyTempAllocator();
+}
+
+static void CancelExport(ExportPipeline* p) {
+    {
+        ScopedCritSec cs(&p->cs);
+        p->canceled = true;
+        for (ExportWorker* w : p->workers) {
+            w->cookie.abort = 1;
+        }
+    }
+    WakeAllConditionVariable(&p->cv);
+}
+
+// waits until pageNo has been encoded. returns false if export was canceled
+static bool WaitForEncodedPage(ExportPipeline* p, int pageNo, fz_buffer** bufOut) {
+    int idx = pageNo - p->args->startPage;
+    while (true) {
+        if (WasCanceled(p->args->progressCb)) {
+            CancelExport(p);
+            return false;
+        }
+        ScopedCritSec cs(&p->cs);
+        if (!p->isDone[idx]) {
+            // wake up periodically to check for cancellation
+            SleepConditionVariableCS(&p->cv, &p->cs, 200);
+        }
+        if (p->isDone[idx]) {
+            *bufOut = p->encoded[idx];
+            p->encoded[idx] = nullptr;
+            return true;
+        }
+    }
+}
+
+static bool WriteEncodedPage(fz_context* ctx, PageImageExportArgs& args, int pageNo, fz_buffer* buf) {
+    u8* data = nullptr;
+    size_t size = fz_buffer_storage(ctx, buf, &data);
+    const char* ext = args.format == PageImageFormat::Jpeg ? "jpg" : "png";
+    TempStr fileName = str::FormatTemp("%s-%d.%s", args.fileNameBase, pageNo, ext);
+    TempStr path = path::JoinTemp(args.dstDir, fileName);
+    bool ok = file::WriteFile(path, {data, size});
+    if (!ok) {
+        logf("ExportPagesAsImages: failed to write '%s'\n", path);
+    }
+    return ok;
+}
+
+bool ExportPagesAsImages(PageImageExportArgs& args) {
+    args.nWritten = 0;
+    EngineMupdf* engine = AsEngineMupdf(args.engine);
+    if (!engine || !args.dstDir || !args.fileNameBase) {
+        return false;
+    }
+    int nPages = engine->PageCount();
+    args.startPage = limitValue(args.startPage, 1, nPages);
+    args.endPage = limitValue(args.endPage, args.startPage, nPages);
+    int total = args.endPage - args.startPage + 1;
+
+    auto timeStart = TimeGet();
+
+    ExportPipeline p;
+    p.args = &args;
+    p.engine = engine;
+    p.zoom = args.dpi / engine->GetFileDPI();
+    int nThreads = args.nThreads > 0 ? std::min(args.nThreads, total) : GetExportThreadsCount(total);
+    p.maxPending = args.maxPending > 0 ? args.maxPending : 2 * nThreads;
+    p.nextPage = args.startPage;
+    p.nextToWrite = args.startPage;
+    for (int i = 0; i < total; i++) {
+        p.encoded.Append(nullptr);
+        p.isDone.Append(false);
+    }
+
+    for (int i = 0; i < nThreads; i++) {
+        auto w = new ExportWorker();
+        w->pipeline = &p;
+        p.workers.Append(w);
+    }
+    for (ExportWorker* w : p.workers) {
+        auto fn = MkFunc0(ExportWorkerThread, w);
+        w->thread = StartThread(fn, "ExportImagesWorker");
+    }
+
+    fz_context* ctx = GetOrClonePerThreadContext(engine, engine->Ctx());
+    bool ok = true;
+    for (int pageNo = args.startPage; pageNo <= args.endPage; pageNo++) {
+        fz_buffer* buf = nullptr;
+        if (!WaitForEncodedPage(&p, pageNo, &buf)) {
+            ok = false;
+            break;
+        }
+        if (buf) {
+            if (WriteEncodedPage(ctx, args, pageNo, buf)) {
+                args.nWritten++;
+            }
+            fz_drop_buffer(ctx, buf);
         } else {
-            MessageBox(NULL, L"The selected file is not mutool.exe.", L"Error", MB_ICONERROR);
+            logf("ExportPagesAsImages: failed to render page %d\n", pageNo);
         }
+        {
+            ScopedCritSec cs(&p.cs);
+            p.nextToWrite = pageNo + 1;
+        }
+        WakeAllConditionVariable(&p.cv);
+        UpdateProgress(args.progressCb, pageNo - args.startPage + 1, total);
+    }
+
+    for (ExportWorker* w : p.workers) {
+        WaitForSingleObject(w->thread, INFINITE);
+        CloseHandle(w->thread);
+    }
+    DeleteVecMembers(p.workers);
+    // left-overs after cancellation
+    for (fz_buffer* buf : p.encoded) {
+        fz_drop_buffer(ctx, buf);
     }
-    return L"";
+    ReleasePerThreadContext(engine);
+
+    double dur = TimeSinceInMs(timeStart);
+    logf("ExportPagesAsImages: wrote %d of %d pages with %d threads in %.2f ms (%.2f pages/sec)\n", args.nWritten,
+         total, nThreads, dur, dur > 0 ? (double)args.nWritten * 1000.0 / dur : 0.0);
+    return ok && args.nWritten == total;
 }
 
-// GUI function to show the conversion window with input fields and button
-void ShowConversionGUI(const WCHAR* pdfPath) {
-    g_pdfPath = pdfPath;
+// --- UI
+
+static Kind kNotifExportImages = "exportImages";
 
-    const wchar_t CLASS_NAME[] = L"ConversionWindowClass";
-    WNDCLASS wc = {};
-    wc.lpfnWndProc = WindowProc;
-    wc.hInstance = GetModuleHandle(NULL);
-    wc.lpszClassName = CLASS_NAME;
+struct ExportImagesThreadData {
+    MainWindow* win = nullptr;
+    PageImageExportArgs args;
+    AutoFreeStr dstDir;
+    AutoFreeStr fileNameBase;
+    AtomicBool canceled;
+    bool ok = false;
+};
 
-    RegisterClass(&wc);
+struct UpdateExportStatusData {
+    ExportImagesThreadData* d;
+    int current;
+    int total;
+};
 
-    HWND hwnd = CreateWindowEx(0, CLASS_NAME, L"PDF Conversion", WS_OVERLAPPEDWINDOW, CW_USEDEFAULT, CW_USEDEFAULT, 400,
-                               300, NULL, NULL, wc.hInstance, NULL);
-    if (hwnd == NULL) {
+static void UpdateExportStatus(UpdateExportStatusData* data) {
+    AutoDelete delData(data);
+
+    auto d = data->d;
+    auto win = d->win;
+    if (!IsMainWindowValid(win) || d->canceled.Get()) {
         return;
     }
-    ShowWindow(hwnd, SW_SHOW);
+    auto wnd = GetNotificationForGroup(win->hwndCanvas, kNotifExportImages);
+    if (!wnd) {
+        d->canceled.Set(true);
+        return;
+    }
+    TempStr msg = str::FormatTemp(_TRA("Saving page %d of %d..."), data->current, data->total);
+    int perc = CalcPerc(data->current, data->total);
+    if (!UpdateNotificationProgress(wnd, msg, perc)) {
+        // canceled by closing the notification
+        d->canceled.Set(true);
+    }
+}
 
-    MSG msg = {};
-    while (GetMessage(&msg, NULL, 0, 0)) {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
-    }
-}
-
-// Window Procedure to handle messages for the GUI
-LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-    static HWND hwndButton;
-
-    switch (uMsg) {
-        case WM_CREATE:
-            CreateWindow(L"STATIC", L"Resolution:", WS_CHILD | WS_VISIBLE, 50, 30, 100, 20, hwnd, NULL,
-                         (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL);
-            CreateWindow(L"STATIC", L"Start Page:", WS_CHILD | WS_VISIBLE, 50, 70, 100, 20, hwnd, NULL,
-                         (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL);
-            CreateWindow(L"STATIC", L"End Page:", WS_CHILD | WS_VISIBLE, 50, 110, 100, 20, hwnd, NULL,
-                         (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL);
-
-            hwndResolutionField =
-                CreateWindow(L"EDIT", L"", WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL, 150, 30, 200, 20, hwnd,
-                             NULL, (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL);
-            hwndStartPageField =
-                CreateWindow(L"EDIT", L"", WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL, 150, 70, 200, 20, hwnd,
-                             NULL, (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL);
-            hwndEndPageField =
-                CreateWindow(L"EDIT", L"", WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL, 150, 110, 200, 20, hwnd,
-                             NULL, (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL);
-
-            hwndButton =
-                CreateWindow(L"BUTTON", L"Convert", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON, 150, 150,
-                             100, 30, hwnd, (HMENU)1, (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL);
-            break;
+static void OnExportImagesProgress(ExportImagesThreadData* d, ProgressUpdateData* data) {
+    if (data->wasCancelled) {
+        *data->wasCancelled = d->canceled.Get() || !IsMainWindowValid(d->win);
+        return;
+    }
+    auto status = new UpdateExportStatusData{d, data->current, data->total};
+    auto fn = MkFunc0<UpdateExportStatusData>(UpdateExportStatus, status);
+    uitask::Post(fn, nullptr);
+}
+
+static void ExportImagesFinished(ExportImagesThreadData* d) {
+    AutoDelete delData(d);
+
+    SafeEngineRelease(&d->args.engine);
+    auto win = d->win;
+    if (!IsMainWindowValid(win)) {
+        return;
+    }
+    auto wnd = GetNotificationForGroup(win->hwndCanvas, kNotifExportImages);
+    if (!wnd) {
+        return;
+    }
+    if (d->canceled.Get()) {
+        RemoveNotification(wnd);
+        return;
+    }
+    TempStr msg = str::FormatTemp(_TRA("Saved %d images to %s"), d->args.nWritten, d->dstDir.Get());
+    if (!d->ok) {
+        msg = str::FormatTemp(_TRA("Failed to save some pages. Saved %d images to %s"), d->args.nWritten,
+                              d->dstDir.Get());
+    }
+    NotificationUpdateMessage(wnd, msg, kNotif5SecsTimeOut, !d->ok);
+}
+
+static void ExportImagesThread(ExportImagesThreadData* d) {
+    d->ok = ExportPagesAsImages(d->args);
+    auto fn = MkFunc0<ExportImagesThreadData>(ExportImagesFinished, d);
+    uitask::Post(fn, "ExportImagesFinished");
+    DestroyTempAllocator();
+}
+
+static void StartExportImages(MainWindow* win, float dpi, int startPage, int endPage, PageImageFormat format) {
+    EngineBase* engine = win->CurrentTab()->GetEngine();
+    if (!AsEngineMupdf(engine)) {
+        ShowTemporaryNotification(win->hwndCanvas, _TRA("Saving as images is not supported for this document"));
+        return;
+    }
+    const char* filePath = engine->FilePath();
+
+    auto d = new ExportImagesThreadData();
+    d->win = win;
+    d->dstDir.SetCopy(path::GetDirTemp(filePath));
+    d->fileNameBase.SetCopy(path::GetPathNoExtTemp(path::GetBaseNameTemp(filePath)));
+    engine->AddRef();
+    d->args.engine = engine;
+    d->args.dstDir = d->dstDir.Get();
+    d->args.fileNameBase = d->fileNameBase.Get();
+    d->args.dpi = dpi;
+    d->args.startPage = startPage;
+    d->args.endPage = endPage;
+    d->args.format = format;
+    d->args.progressCb = MkFunc1<ExportImagesThreadData, ProgressUpdateData*>(OnExportImagesProgress, d);
+
+    NotificationCreateArgs nargs;
+    nargs.hwndParent = win->hwndCanvas;
+    nargs.timeoutMs = 0;
+    nargs.groupId = kNotifExportImages;
+    nargs.onRemoved = MkFunc1Void(RemoveNotification);
+    ShowNotification(nargs);
+
+    auto fn = MkFunc0(ExportImagesThread, d);
+    RunAsync(fn, "ExportImagesThread");
+}
+
+#define IDC_EXPORT_CONVERT 1
+
+static MainWindow* gExportWin = nullptr;
+static HWND gHwndResolutionField = nullptr;
+static HWND gHwndStartPageField = nullptr;
+static HWND gHwndEndPageField = nullptr;
+static HWND gHwndJpegCheckbox = nullptr;
+
+static void OnExportConvertClicked(HWND hwnd) {
+    MainWindow* win = gExportWin;
+    if (!IsMainWindowValid(win) || !win->IsDocLoaded()) {
+        DestroyWindow(hwnd);
+        return;
+    }
+    int nPages = win->ctrl->PageCount();
+    int dpi = atoi(HwndGetTextTemp(gHwndResolutionField));
+    int startPage = atoi(HwndGetTextTemp(gHwndStartPageField));
+    int endPage = atoi(HwndGetTextTemp(gHwndEndPageField));
+    if (dpi < 10 || dpi > 2400 || startPage < 1 || endPage < startPage || endPage > nPages) {
+        MsgBox(hwnd, _TRA("Invalid resolution or page range"), _TRA("Error"), MB_OK | MB_ICONERROR);
+        return;
+    }
+    bool jpeg = Button_GetCheck(gHwndJpegCheckbox) == BST_CHECKED;
+    PageImageFormat format = jpeg ? PageImageFormat::Jpeg : PageImageFormat::Png;
+    DestroyWindow(hwnd);
+    StartExportImages(win, (float)dpi, startPage, endPage, format);
+}
+
+static LRESULT CALLBACK WndProcExportImages(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
+    HINSTANCE hinst = GetModuleHandle(nullptr);
+    switch (msg) {
+        case WM_CREATE: {
+            CreateWindowW(L"STATIC", L"Resolution (DPI):", WS_CHILD | WS_VISIBLE, 30, 30, 120, 20, hwnd, nullptr,
+                          hinst, nullptr);
+            CreateWindowW(L"STATIC", L"Start Page:", WS_CHILD | WS_VISIBLE, 30, 70, 120, 20, hwnd, nullptr, hinst,
+                          nullptr);
+            CreateWindowW(L"STATIC", L"End Page:", WS_CHILD | WS_VISIBLE, 30, 110, 120, 20, hwnd, nullptr, hinst,
+                          nullptr);
+            DWORD editStyle = WS_CHILD | WS_VISIBLE | WS_BORDER | WS_TABSTOP | ES_AUTOHSCROLL | ES_NUMBER;
+            gHwndResolutionField =
+                CreateWindowW(L"EDIT", L"150", editStyle, 160, 30, 180, 20, hwnd, nullptr, hinst, nullptr);
+            gHwndStartPageField =
+                CreateWindowW(L"EDIT", L"", editStyle, 160, 70, 180, 20, hwnd, nullptr, hinst, nullptr);
+            gHwndEndPageField =
+                CreateWindowW(L"EDIT", L"", editStyle, 160, 110, 180, 20, hwnd, nullptr, hinst, nullptr);
+            DWORD checkboxStyle = WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_AUTOCHECKBOX;
+            gHwndJpegCheckbox = CreateWindowW(L"BUTTON", L"Save as JPEG", checkboxStyle, 160, 140, 180, 20, hwnd,
+                                              nullptr, hinst, nullptr);
+            CreateWindowW(L"BUTTON", L"Convert", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON, 160, 175, 100,
+                          30, hwnd, (HMENU)IDC_EXPORT_CONVERT, hinst, nullptr);
+            if (IsMainWindowValid(gExportWin) && gExportWin->IsDocLoaded()) {
+                HwndSetText(gHwndStartPageField, "1");
+                TempStr s = str::FormatTemp("%d", gExportWin->ctrl->PageCount());
+                HwndSetText(gHwndEndPageField, s);
+            }
+            return 0;
+        }
 
         case WM_COMMAND:
-            if (LOWORD(wParam) == 1) {
-                wchar_t resolutionBuffer[256], startPageBuffer[256], endPageBuffer[256];
-                GetWindowText(hwndResolutionField, resolutionBuffer, 256);
-                GetWindowText(hwndStartPageField, startPageBuffer, 256);
-                GetWindowText(hwndEndPageField, endPageBuffer, 256);
-
-                std::string resolution = ConvertWideToNarrow(resolutionBuffer);
-                std::string startPage = ConvertWideToNarrow(startPageBuffer);
-                std::string endPage = ConvertWideToNarrow(endPageBuffer);
-                std::string pdfPathStr = ConvertWideToNarrow(g_pdfPath);
-                std::wstring outputDirectoryW = GetDirectoryPath(g_pdfPath);
-                std::string outputDirectory = ConvertWideToNarrow(outputDirectoryW);
-
-                std::wstring mutoolPathW = GetMutoolPath();
-                if (mutoolPathW.empty()) {
-                    MessageBox(hwnd, L"mutool.exe was not found.", L"Error", MB_ICONERROR);
-                    return 0;
-                }
-
-                std::string mutoolPath = ConvertWideToNarrow(mutoolPathW);
-                std::stringstream command;
-                command << "\"" << mutoolPath << "\" convert -o \"" << outputDirectory << "\\page%d.png\" -O "
-                        << "resolution=" << resolution << " \"" << pdfPathStr << "\" " << startPage << "-" << endPage;
-
-                std::string commandString = command.str();
-                MessageBoxA(hwnd, commandString.c_str(), "Command", MB_OK);
-
-                STARTUPINFOA si = {sizeof(si)};
-                PROCESS_INFORMATION pi;
-
-                if (!CreateProcessA(NULL, const_cast<char*>(commandString.c_str()), NULL, NULL, FALSE, 0, NULL, NULL,
-                                    &si, &pi)) {
-                    MessageBoxA(hwnd, "Failed to execute mutool.", "Error", MB_ICONERROR);
-                } else {
-                    WaitForSingleObject(pi.hProcess, INFINITE);
-                    CloseHandle(pi.hProcess);
-                    CloseHandle(pi.hThread);
-                }
-
-                DestroyWindow(hwnd);
-                PostQuitMessage(0);
+            if (LOWORD(wp) == IDC_EXPORT_CONVERT) {
+                OnExportConvertClicked(hwnd);
+                return 0;
             }
             break;
 
         case WM_DESTROY:
-            PostQuitMessage(0);
+            gExportWin = nullptr;
             return 0;
     }
-    return DefWindowProc(hwnd, uMsg, wParam, lParam);
+    return DefWindowProc(hwnd, msg, wp, lp);
 }
 
-// Usage example
-void ConvertPdfToImages(const WCHAR* pdfPath) {
-    ShowConversionGUI(pdfPath);
+#define kExportImagesWinClass L"SUMATRA_PDF_EXPORT_IMAGES"
+
+// shows a window for choosing resolution and page range
+// and then saves pages of the current document as images
+void ConvertPdfToImages(MainWindow* win) {
+    if (!win->IsDocLoaded()) {
+        return;
+    }
+
+    static bool didRegister = false;
+    if (!didRegister) {
+        WNDCLASSW wc = {};
+        wc.lpfnWndProc = WndProcExportImages;
+        wc.hInstance = GetModuleHandle(nullptr);
+        wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
+        wc.hbrBackground = (HBRUSH)(COLOR_BTNFACE + 1);
+        wc.lpszClassName = kExportImagesWinClass;
+        RegisterClassW(&wc);
+        didRegister = true;
+    }
+
+    gExportWin = win;
+    DWORD style = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU;
+    HWND hwnd = CreateWindowExW(0, kExportImagesWinClass, L"Convert to Images", style, CW_USEDEFAULT, CW_USEDEFAULT,
+                                400, 260, win->hwndFrame, nullptr, GetModuleHandle(nullptr), nullptr);
+    if (!hwnd) {
+        gExportWin = nullptr;
+        return;
+    }
+    ShowWindow(hwnd, SW_SHOW);
 }
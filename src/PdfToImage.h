@@ -1,5 +1,41 @@
-#pragma once
+/* Copyright 2024 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
 
-#include "utils/BaseUtil.h"
+struct MainWindow;
+class EngineBase;
 
-void ConvertPdfToImages(const WCHAR* pdfPath);
\ No newline at end of file
+enum class PageImageFormat {
+    Png,
+    Jpeg,
+};
+
+// describes a request to save a range of pages as image files
+// pages are rendered in parallel but written to disk in page order
+struct PageImageExportArgs {
+    // must be EngineMupdf. caller keeps a reference for the duration of the export
+    EngineBase* engine = nullptr;
+    // directory where images are saved
+    const char* dstDir = nullptr;
+    // images are saved as ${fileNameBase}-${pageNo}.png (or .jpg)
+    const char* fileNameBase = nullptr;
+    int startPage = 1;
+    int endPage = 1;
+    float dpi = 150.f;
+    PageImageFormat format = PageImageFormat::Png;
+    int jpegQuality = 90;
+    // 0 means: number of logical processors
+    int nThreads = 0;
+    // maximum number of encoded pages waiting to be written to disk
+    // (bounds memory use when encoding is faster than writing)
+    // 0 means: 2 * nThreads
+    int maxPending = 0;
+    // optional. called with number of pages written so far
+    // and used to check for cancellation
+    ProgressUpdateCb progressCb;
+
+    // number of images actually written
+    int nWritten = 0;
+};
+
+bool ExportPagesAsImages(PageImageExportArgs& args);
+void ConvertPdfToImages(MainWindow* win);
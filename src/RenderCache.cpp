@@ -9,6 +9,7 @@
 #include "wingui/UIModels.h"
 
 #include "Settings.h"
+#include "AppTools.h"
 #include "DocController.h"
 #include "EngineBase.h"
 #include "EngineAll.h"
@@ -16,6 +17,7 @@
 #include "GlobalPrefs.h"
 #include "RenderCache.h"
 #include "TextSelection.h"
+#include "TileCache.h"
 
 #define NO_LOG
 #include "utils/Log.h"
@@ -57,6 +59,15 @@ RenderCache::~RenderCache() {
              cacheCount);
         ReportIf(true);
     }
+    if (nCompressedTiles > 0) {
+        int inKb = (int)(compressedInSize / 1024);
+        int outKb = (int)(compressedOutSize / 1024);
+        logfa("RenderCache: compressed %d tiles, %d kB => %d kB, %d hits, %.2f ms decompressing, %.2f ms saved\n",
+              nCompressedTiles, inKb, outKb, nCompressedHits, decompressMs, savedRenderMs);
+    }
+    for (CompressedTile* ct : compressed) {
+        delete ct;
+    }
 
     LeaveCriticalSection(&cacheAccess);
     DeleteCriticalSection(&cacheAccess);
@@ -138,6 +149,7 @@ static bool FreeIfFull(RenderCache* rc, const PageRenderRequest& req) {
     for (int i = 0; i < n; i++) {
         auto entry = rc->cache[i];
         if (entry->dm == dm && !dm->PageVisibleNearby(entry->pageNo)) {
+            rc->KeepCompressed(entry);
             bool didDrop = rc->DropCacheEntry(entry);
             if (didDrop) {
                 return true;
@@ -155,6 +167,7 @@ static bool FreeIfFull(RenderCache* rc, const PageRenderRequest& req) {
             // in a different window, but it's harder to detect
             continue;
         }
+        rc->KeepCompressed(entry);
         bool didDrop = rc->DropCacheEntry(entry);
         if (didDrop) {
             return true;
@@ -163,7 +176,7 @@ static bool FreeIfFull(RenderCache* rc, const PageRenderRequest& req) {
     return false;
 }
 
-void RenderCache::Add(PageRenderRequest& req, RenderedBitmap* bmp) {
+void RenderCache::Add(PageRenderRequest& req, RenderedBitmap* bmp, float renderMs, bool outOfDate) {
     ScopedCritSec scope(&cacheAccess);
     ReportIf(!req.dm);
 
@@ -179,11 +192,224 @@ void RenderCache::Add(PageRenderRequest& req, RenderedBitmap* bmp) {
 
     // Copy the PageRenderRequest as it will be reused
     auto entry = new BitmapCacheEntry(req.dm, req.pageNo, req.rotation, req.zoom, req.tile, bmp);
+    entry->renderMs = renderMs;
+    if (outOfDate) {
+        // the bitmap is displayed until it has been rendered again
+        entry->zoom = kInvalidZoom;
+        entry->outOfDate = true;
+    }
     entry->cacheIdx = cacheCount;
     cache[cacheCount] = entry;
     cacheCount++;
 }
 
+// all views of a shared engine render the same bitmaps, so copying one
+// that another view has already rendered is much cheaper than rendering it again
+RenderedBitmap* RenderCache::CopyFromSharedEngine(const PageRenderRequest& req) {
+    EngineBase* engine = req.dm->GetEngine();
+    if (!engine->isShared) {
+        return nullptr;
+    }
+    ScopedCritSec scope(&cacheAccess);
+    int rotation = NormalizeRotation(req.rotation);
+    for (int i = 0; i < cacheCount; i++) {
+        BitmapCacheEntry* e = cache[i];
+        if (e->dm == req.dm || e->dm->GetEngine() != engine || e->outOfDate || !e->bitmap) {
+            continue;
+        }
+        if (e->pageNo == req.pageNo && e->rotation == rotation && e->zoom == req.zoom && e->tile == req.tile) {
+            return e->bitmap->Clone();
+        }
+    }
+    return nullptr;
+}
+
+// pixels are in the layout of CreateMemoryBitmap() i.e. top-down 32-bit BGRX
+static ByteSlice CompressBitmap(RenderedBitmap* bmp) {
+    Size size = bmp->GetSize();
+    if (size.dx <= 0 || size.dy <= 0) {
+        return {};
+    }
+    BITMAPINFO bmi{};
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = size.dx;
+    bmi.bmiHeader.biHeight = -size.dy;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    size_t nPixels = (size_t)size.dx * size.dy;
+    AutoFree pixels = (char*)AllocArray<u32>(nPixels);
+    if (!pixels) {
+        return {};
+    }
+    HDC hdc = GetDC(nullptr);
+    int nLines = GetDIBits(hdc, bmp->GetBitmap(), 0, size.dy, pixels, &bmi, DIB_RGB_COLORS);
+    ReleaseDC(nullptr, hdc);
+    if (nLines != size.dy) {
+        return {};
+    }
+    return RleEncodePixels((const u32*)pixels.Get(), nPixels);
+}
+
+static RenderedBitmap* DecompressBitmap(const ByteSlice& d, Size size) {
+    HBITMAP hbmp = CreateMemoryBitmap(size);
+    if (!hbmp) {
+        return nullptr;
+    }
+    DIBSECTION info{};
+    int n = GetObject(hbmp, sizeof(info), &info);
+    u32* pixels = (u32*)info.dsBm.bmBits;
+    if (n != sizeof(info) || !pixels || !RleDecodePixels(d, pixels, (size_t)size.dx * size.dy)) {
+        DeleteObject(hbmp);
+        return nullptr;
+    }
+    return new RenderedBitmap(hbmp, size);
+}
+
+// instead of deleting the bitmap of an entry that is about to be dropped,
+// keep it around until the rendering thread has had time to compress it
+void RenderCache::KeepCompressed(BitmapCacheEntry* entry) {
+    ScopedCritSec scope(&cacheAccess);
+    // only up-to-date bitmaps that aren't used elsewhere
+    if (entry->refs != 1 || entry->outOfDate || !entry->bitmap || entry->zoom == kInvalidZoom) {
+        return;
+    }
+    for (int i = 0; i < compressed.Size(); i++) {
+        CompressedTile* ct = compressed[i];
+        if (ct->dm == entry->dm && ct->pageNo == entry->pageNo && ct->tile == entry->tile) {
+            compressedSize -= ct->data.size();
+            delete compressed.PopAt(i);
+            break;
+        }
+    }
+
+    auto ct = new CompressedTile();
+    ct->dm = entry->dm;
+    ct->pageNo = entry->pageNo;
+    ct->rotation = entry->rotation;
+    ct->zoom = entry->zoom;
+    ct->tile = entry->tile;
+    ct->renderMs = entry->renderMs;
+    ct->size = entry->bitmap->GetSize();
+    ct->bitmap = entry->bitmap;
+    entry->bitmap = nullptr;
+    compressed.Append(ct);
+
+    // don't hold on to too many uncompressed bitmaps (GDI resources are limited)
+    int nToCompress = 0;
+    for (int i = compressed.Size() - 1; i >= 0; i--) {
+        if (compressed[i]->bitmap && ++nToCompress > MAX_TILES_TO_COMPRESS) {
+            delete compressed.PopAt(i);
+        }
+    }
+    SetEvent(startRendering);
+}
+
+// compresses the least recently dropped tile that isn't compressed yet
+// returns false if there's nothing left to compress
+bool RenderCache::CompressDroppedTile() {
+    CompressedTile* ct = nullptr;
+    int nRemoves;
+    {
+        ScopedCritSec scope(&cacheAccess);
+        for (int i = 0; i < compressed.Size(); i++) {
+            if (compressed[i]->bitmap) {
+                ct = compressed.PopAt(i);
+                break;
+            }
+        }
+        nRemoves = nCompressedRemoves;
+    }
+    if (!ct) {
+        return false;
+    }
+
+    // compressing takes a few ms, so it happens outside of cacheAccess
+    ct->data = CompressBitmap(ct->bitmap);
+    delete ct->bitmap;
+    ct->bitmap = nullptr;
+
+    ScopedCritSec scope(&cacheAccess);
+    size_t inSize = (size_t)ct->size.dx * ct->size.dy * 4;
+    // pages with photos don't compress well enough to be worth it
+    // and tiles removed in the meantime might be out-of-date
+    if (ct->data.empty() || ct->data.size() > inSize / 2 || nRemoves != nCompressedRemoves) {
+        delete ct;
+        return true;
+    }
+    nCompressedTiles++;
+    compressedInSize += inSize;
+    compressedOutSize += ct->data.size();
+
+    compressed.Append(ct);
+    compressedSize += ct->data.size();
+    // drop the least recently dropped tiles
+    for (int i = 0; i < compressed.Size() && compressedSize > MAX_COMPRESSED_TILES_SIZE;) {
+        if (compressed[i]->bitmap) {
+            i++;
+            continue;
+        }
+        compressedSize -= compressed[i]->data.size();
+        delete compressed.PopAt(i);
+    }
+    return true;
+}
+
+// returns the bitmap of a previously dropped tile matching req
+RenderedBitmap* RenderCache::Decompress(const PageRenderRequest& req, float* renderMsOut) {
+    CompressedTile* ct = nullptr;
+    {
+        ScopedCritSec scope(&cacheAccess);
+        int rotation = NormalizeRotation(req.rotation);
+        for (int i = 0; i < compressed.Size(); i++) {
+            CompressedTile* t = compressed[i];
+            if (t->dm == req.dm && t->pageNo == req.pageNo && t->rotation == rotation && t->zoom == req.zoom &&
+                t->tile == req.tile) {
+                ct = compressed.PopAt(i);
+                compressedSize -= ct->data.size();
+                break;
+            }
+        }
+    }
+    if (!ct) {
+        return nullptr;
+    }
+    *renderMsOut = ct->renderMs;
+    RenderedBitmap* bmp = ct->bitmap;
+    if (bmp) {
+        // hasn't been compressed yet
+        ct->bitmap = nullptr;
+    } else {
+        auto timeStart = TimeGet();
+        bmp = DecompressBitmap(ct->data, ct->size);
+        // only accessed from the rendering thread
+        if (bmp) {
+            nCompressedHits++;
+            decompressMs += TimeSinceInMs(timeStart);
+            savedRenderMs += ct->renderMs;
+        }
+    }
+    delete ct;
+    return bmp;
+}
+
+// removes the dropped tiles of dm (or of all DisplayModels using its engine)
+// and optionally only for a given page. removes all tiles if dm is nullptr
+void RenderCache::RemoveCompressed(DisplayModel* dm, int pageNo, bool sameEngine) {
+    ScopedCritSec scope(&cacheAccess);
+    EngineBase* engine = dm ? dm->GetEngine() : nullptr;
+    for (int i = compressed.Size() - 1; i >= 0; i--) {
+        CompressedTile* ct = compressed[i];
+        bool shouldRemove = !dm || ct->dm == dm || sameEngine && ct->dm->GetEngine() == engine;
+        if (shouldRemove && (pageNo == kInvalidPageNo || ct->pageNo == pageNo)) {
+            compressedSize -= ct->data.size();
+            delete compressed.PopAt(i);
+        }
+    }
+    nCompressedRemoves++;
+}
+
 static RectF GetTileRect(RectF pagerect, TilePosition tile) {
     ReportIf(tile.res > 30);
     RectF rect;
@@ -270,6 +496,10 @@ void RenderCache::FreePage(DisplayModel* dm, int pageNo, TilePosition* tile) {
             }
         }
         if (shouldFree) {
+            // the DisplayModel is about to go away when freeing all its pages
+            if (!dm || pageNo != kInvalidPageNo) {
+                KeepCompressed(entry);
+            }
             DropCacheEntry(entry);
         }
     }
@@ -277,6 +507,7 @@ void RenderCache::FreePage(DisplayModel* dm, int pageNo, TilePosition* tile) {
 
 void RenderCache::FreeForDisplayModel(DisplayModel* dm) {
     FreePage(dm);
+    RemoveCompressed(dm);
 }
 
 void RenderCache::FreeNotVisible() {
@@ -287,9 +518,16 @@ void RenderCache::FreeNotVisible() {
 // mark invisible pages as out-of-date to prevent inconsistencies
 void RenderCache::KeepForDisplayModel(DisplayModel* oldDm, DisplayModel* newDm) {
     ScopedCritSec scope(&cacheAccess);
+    RemoveCompressed(oldDm, kInvalidPageNo, oldDm == newDm);
     for (int i = 0; i < cacheCount; i++) {
         BitmapCacheEntry* entry = cache[i];
         if (entry->dm != oldDm) {
+            // other views of a shared engine show the same content which
+            // (e.g. after editing annotations) must not be copied anymore
+            if (oldDm == newDm && entry->dm->GetEngine() == oldDm->GetEngine()) {
+                entry->zoom = kInvalidZoom;
+                entry->outOfDate = true;
+            }
             continue;
         }
         if (oldDm->PageVisible(entry->pageNo)) {
@@ -312,10 +550,14 @@ void RenderCache::Invalidate(DisplayModel* dm, int pageNo, RectF rect) {
 
     ScopedCritSec scopeCache(&cacheAccess);
 
-    RectF mediabox = dm->GetEngine()->PageMediabox(pageNo);
+    RemoveCompressed(dm, pageNo, true);
+    EngineBase* engine = dm->GetEngine();
+    RectF mediabox = engine->PageMediabox(pageNo);
     for (int i = 0; i < cacheCount; i++) {
         auto e = cache[i];
-        if (e->dm == dm && e->pageNo == pageNo && !GetTileRect(mediabox, e->tile).Intersect(rect).IsEmpty()) {
+        // also invalidate other views of a shared engine
+        bool sameEngine = e->dm == dm || e->dm->GetEngine() == engine;
+        if (sameEngine && e->pageNo == pageNo && !GetTileRect(mediabox, e->tile).Intersect(rect).IsEmpty()) {
             e->zoom = kInvalidZoom;
             e->outOfDate = true;
         }
@@ -388,6 +630,7 @@ bool RenderCache::ReduceTileSize() {
     while (cacheCount > 0) {
         FreeForDisplayModel(cache[0]->dm);
     }
+    RemoveCompressed();
     while (requestCount > 0) {
         ClearQueueForDisplayModel(requests[0].dm);
     }
@@ -633,6 +876,57 @@ void RenderCache::AbortCurrentRequest() {
     curReq->abort = true;
 }
 
+// tiles are also cached on disk (if enabled) so that re-opened documents don't
+// have to be rendered again. returns false if req's tile can't be cached
+static bool GetTileCacheKey(RenderCache* cache, const PageRenderRequest& req, TileCacheKey& key) {
+    if (gGlobalPrefs->fixedPageUI.tileCacheSize <= 0 || req.renderCb) {
+        return false;
+    }
+    DisplayModel* dm = req.dm;
+    EngineBase* engine = dm->GetEngine();
+    // reflowed pages depend on layout settings and decrypted pages shouldn't be
+    // written to disk. tiles with unsaved annotations don't match the file and saving
+    // them doesn't update the fingerprint, so this sticks until the document is reloaded
+    if (engine->isReflowable || engine->isPasswordProtected || EngineHasUnsavedAnnotations(engine)) {
+        dm->tileCacheId.SetCopy("");
+    }
+    if (!dm->tileCacheId) {
+        TempStr id = GetFileFingerprintTemp(engine->FilePath());
+        dm->tileCacheId.SetCopy(id ? id : "");
+    }
+    if (dm->tileCacheId.empty()) {
+        return false;
+    }
+    key.docId = dm->tileCacheId;
+    key.engineKind = engine->kind;
+    key.pageNo = req.pageNo;
+    key.rotation = NormalizeRotation(req.rotation);
+    key.zoom = req.zoom;
+    key.tileRes = req.tile.res;
+    key.tileRow = req.tile.row;
+    key.tileCol = req.tile.col;
+    // colors aren't replaced for individual images
+    bool keepColors = engine->IsImageCollection();
+    key.textColor = keepColors ? WIN_COL_BLACK : cache->textColor;
+    key.backgroundColor = keepColors ? WIN_COL_WHITE : cache->backgroundColor;
+    return true;
+}
+
+static RenderedBitmap* LoadTileFromDisk(const PageRenderRequest& req, const TileCacheKey& key) {
+    RenderedBitmap* bmp = LoadCachedTile(key);
+    if (!bmp) {
+        return nullptr;
+    }
+    // zoom is rounded in the key, so the size might be off by a pixel
+    Rect r = GetTileRectDevice(req.dm->GetEngine(), req.pageNo, req.rotation, req.zoom, req.tile);
+    Size size = bmp->GetSize();
+    if (abs(size.dx - r.dx) > 1 || abs(size.dy - r.dy) > 1) {
+        delete bmp;
+        return nullptr;
+    }
+    return bmp;
+}
+
 DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
     RenderCache* cache = (RenderCache*)data;
     PageRenderRequest req;
@@ -640,6 +934,10 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
 
     for (;;) {
         if (cache->ClearCurrentRequest()) {
+            // use the idle time for compressing tiles dropped from the cache
+            while (cache->requestCount == 0 && cache->CompressDroppedTile()) {
+                ResetTempAllocator();
+            }
             DWORD waitResult = WaitForSingleObject(cache->startRendering, INFINITE);
             // Is it not a page render request?
             if (WAIT_OBJECT_0 != waitResult) {
@@ -671,7 +969,36 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
 
         ReportIf(req.abortCookie != nullptr);
         EngineBase* engine = req.dm->GetEngine();
+        if (!req.renderCb) {
+            // colors have already been updated in the copy
+            bmp = cache->CopyFromSharedEngine(req);
+            if (bmp) {
+                cache->Add(req, bmp);
+                req.dm->RepaintDisplay();
+                continue;
+            }
+            float renderMs = 0.f;
+            bmp = cache->Decompress(req, &renderMs);
+            if (bmp) {
+                cache->Add(req, bmp, renderMs);
+                req.dm->RepaintDisplay();
+                continue;
+            }
+        }
+        TileCacheKey tileKey;
+        bool useTileCache = GetTileCacheKey(cache, req, tileKey);
+        if (useTileCache) {
+            bmp = LoadTileFromDisk(req, tileKey);
+            if (bmp) {
+                cache->Add(req, bmp);
+                req.dm->RepaintDisplay();
+                ResetTempAllocator();
+                continue;
+            }
+        }
         RenderPageArgs args(req.pageNo, req.zoom, req.rotation, &req.pageRect, RenderTarget::View, &req.abortCookie);
+        // callbacks (e.g. for thumbnails) only get a single bitmap so it must be final
+        args.allowPreview = !req.renderCb;
         auto timeStart = TimeGet();
         bmp = engine->RenderPage(args);
         if (req.abort) {
@@ -696,8 +1023,17 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
             if (bmp && !engine->IsImageCollection()) {
                 UpdateBitmapColors(bmp->GetBitmap(), cache->textColor, cache->backgroundColor);
             }
-            cache->Add(req, bmp);
+            cache->Add(req, bmp, (float)durMs, args.isPreview);
             req.dm->RepaintDisplay();
+            if (bmp && useTileCache && !args.isPreview) {
+                // the bitmap is now owned by the cache which might already have dropped it
+                BitmapCacheEntry* entry = cache->Find(req.dm, req.pageNo, req.rotation, req.zoom, &req.tile);
+                if (entry) {
+                    i64 maxSize = (i64)gGlobalPrefs->fixedPageUI.tileCacheSize * 1024 * 1024;
+                    SaveCachedTile(tileKey, entry->bitmap, maxSize);
+                    cache->DropCacheEntry(entry);
+                }
+            }
         }
         ResetTempAllocator();
     }
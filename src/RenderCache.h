@@ -14,6 +14,10 @@ constexpr int RENDER_DELAY_FAILED = std::numeric_limits<int>::max() - 2;
 // TODO: this should be based on amount of memory taken by rendered pages
 // i.e. one big page can use as much memory as lots of small pages
 #define MAX_BITMAPS_CACHED 64
+// memory used for tiles dropped from the cache (see CompressedTile)
+#define MAX_COMPRESSED_TILES_SIZE (64 * 1024 * 1024)
+// dropped tiles waiting to be compressed by the rendering thread
+#define MAX_TILES_TO_COMPRESS 8
 
 struct PageInfo;
 
@@ -50,6 +54,8 @@ struct BitmapCacheEntry {
     RenderedBitmap* bitmap = nullptr;
     bool outOfDate = false;
     int refs = 1;
+    // how long it took to render the bitmap
+    float renderMs = 0.f;
 
     BitmapCacheEntry(DisplayModel* dm, int pageNo, int rotation, float zoom, TilePosition tile,
                      RenderedBitmap* bitmap) {
@@ -65,6 +71,29 @@ struct BitmapCacheEntry {
     }
 };
 
+/* Tiles dropped from the cache (e.g. when scrolled out of view) are kept
+   run-length encoded, so that scrolling back only has to decompress them
+   instead of rendering them again. They're compressed by the rendering
+   thread when it's idle, until then bitmap is set instead of data. */
+struct CompressedTile {
+    DisplayModel* dm = nullptr;
+    int pageNo = 0;
+    int rotation = 0;
+    float zoom = 0.f;
+    TilePosition tile;
+    float renderMs = 0.f;
+
+    Size size;
+    // both owned by the CompressedTile
+    ByteSlice data;
+    RenderedBitmap* bitmap = nullptr;
+
+    ~CompressedTile() {
+        data.Free();
+        delete bitmap;
+    }
+};
+
 /* Even though this looks a lot like a BitmapCacheEntry, we keep it
    separate for clarity in the code (PageRenderRequests are reused,
    while BitmapCacheEntries are ref-counted) */
@@ -97,6 +126,20 @@ struct RenderCache {
     CRITICAL_SECTION requestAccess;
     HANDLE renderThread = nullptr;
 
+    // protected by cacheAccess, ordered from least to most recently dropped
+    Vec<CompressedTile*> compressed;
+    size_t compressedSize = 0;
+    // incremented whenever compressed tiles are removed (they might be
+    // out-of-date) so that a tile compressed outside cacheAccess isn't added
+    int nCompressedRemoves = 0;
+    // statistics for the compressed tiles, logged on exit
+    int nCompressedHits = 0;
+    int nCompressedTiles = 0;
+    size_t compressedInSize = 0;
+    size_t compressedOutSize = 0;
+    double decompressMs = 0;
+    double savedRenderMs = 0;
+
     Size maxTileSize{};
     bool isRemoteSession = false;
 
@@ -126,7 +169,12 @@ struct RenderCache {
 
     bool ClearCurrentRequest();
     bool GetNextRequest(PageRenderRequest* req);
-    void Add(PageRenderRequest& req, RenderedBitmap* bmp);
+    void Add(PageRenderRequest& req, RenderedBitmap* bmp, float renderMs = 0.f, bool outOfDate = false);
+    RenderedBitmap* CopyFromSharedEngine(const PageRenderRequest& req);
+    void KeepCompressed(BitmapCacheEntry* entry);
+    bool CompressDroppedTile();
+    RenderedBitmap* Decompress(const PageRenderRequest& req, float* renderMsOut);
+    void RemoveCompressed(DisplayModel* dm = nullptr, int pageNo = kInvalidPageNo, bool sameEngine = false);
 
     USHORT GetTileRes(DisplayModel* dm, int pageNo) const;
     USHORT GetMaxTileRes(DisplayModel* dm, int pageNo, int rotation);
@@ -197,6 +197,8 @@ struct UpdateFindStatusData {
     MainWindow* win;
     int current;
     int total;
+    // hits per term so far, when searching for several terms
+    AutoFreeStr hits;
 };
 
 static void UpdateFindStatus(UpdateFindStatusData* d) {
@@ -213,6 +215,9 @@ static void UpdateFindStatus(UpdateFindStatusData* d) {
         return;
     }
     TempStr msg = str::FormatTemp(_TRA("Searching %d of %d..."), d->current, d->total);
+    if (d->hits) {
+        msg = str::FormatTemp("%s %s", msg, d->hits.Get());
+    }
     int perc = CalcPerc(d->current, d->total);
     if (!UpdateNotificationProgress(wnd, msg, perc)) {
         // the search has been canceled by closing the notification
@@ -225,6 +230,8 @@ struct FindThreadData {
     MainWindow* win = nullptr;
     TextSearch::Direction direction = TextSearch::Direction::Forward;
     bool wasModified = false;
+    // set while counting the hits of a pattern search
+    bool countingHits = false;
     AutoFreeWStr text;
     HANDLE thread = nullptr;
 
@@ -281,6 +288,10 @@ struct FindThreadData {
                 buf = str::FormatTemp(_TRA("Found text at page %s (again)"), label);
                 MessageBeep(MB_ICONINFORMATION);
             }
+            TempStr hits = win->AsFixed()->textSearch->FormatTermHitsTemp();
+            if (hits) {
+                buf = str::FormatTemp("%s (%s)", buf, hits);
+            }
             NotificationUpdateMessage(wnd, buf, 0, loopedAround);
         }
     }
@@ -300,17 +311,38 @@ struct FindThreadData {
         data->win = this->win;
         data->current = current;
         data->total = total;
+        if (countingHits) {
+            data->hits = str::Dup(win->AsFixed()->textSearch->FormatTermHitsTemp());
+        }
         auto fn = MkFunc0<UpdateFindStatusData>(UpdateFindStatus, data);
         uitask::Post(fn, nullptr);
     }
 };
 
+struct FindShowHitTaskData {
+    MainWindow* win = nullptr;
+    FindThreadData* ftd = nullptr;
+    TextSel* textSel = nullptr;
+};
+
+// shows the first hit of a pattern search while the find thread counts all hits
+static void FindShowHitTask(FindShowHitTaskData* d) {
+    AutoDelete delData(d);
+    auto win = d->win;
+    if (!IsMainWindowValid(win) || win->findThread != d->ftd->thread || !win->IsDocLoaded()) {
+        return;
+    }
+    ShowSearchResult(win, d->textSel, true);
+}
+
 struct FindEndTaskData {
     MainWindow* win = nullptr;
     FindThreadData* ftd = nullptr;
     TextSel* textSel = nullptr;
     bool wasModifiedCanceled = false;
     bool loopedAround = false;
+    // set if FindShowHitTask() has already shown textSel
+    bool hitShown = false;
     FindEndTaskData() = default;
     ~FindEndTaskData() {
         delete ftd;
@@ -324,6 +356,7 @@ static void FindEndTask(FindEndTaskData* d) {
     auto textSel = d->textSel;
     auto wasModifiedCanceled = d->wasModifiedCanceled;
     auto loopedAround = d->loopedAround;
+    auto hitShown = d->hitShown;
 
     AutoDelete delData(d);
     if (!IsMainWindowValid(win)) {
@@ -338,7 +371,9 @@ static void FindEndTask(FindEndTaskData* d) {
     if (!win->IsDocLoaded()) {
         // the UI has already been disabled and hidden
     } else if (textSel) {
-        ShowSearchResult(win, textSel, wasModifiedCanceled);
+        if (!hitShown) {
+            ShowSearchResult(win, textSel, wasModifiedCanceled);
+        }
         ftd->HideUI(true, loopedAround);
     } else {
         // nothing found or search canceled
@@ -374,6 +409,9 @@ static void FindThread(FindThreadData* ftd) {
     TextSel* rect;
     textSearch->progressCb = MkFunc1<FindThreadData, ProgressUpdateData*>(UpdateSearchProgress, ftd);
     textSearch->SetDirection(ftd->direction);
+    if (ftd->wasModified) {
+        textSearch->SetText(ftd->text);
+    }
     if (ftd->wasModified || !ctrl->ValidPageNo(textSearch->GetCurrentPageNo()) ||
         !dm->GetPageInfo(textSearch->GetCurrentPageNo())->visibleRatio) {
         rect = textSearch->FindFirst(ctrl->CurrentPageNo(), ftd->text);
@@ -398,16 +436,35 @@ static void FindThread(FindThreadData* ftd) {
         Sleep(1);
     }
 
+    // counting the hits of all terms takes a pass over the whole document,
+    // so the first hit is shown before that
+    bool hitShown = false;
+    if (ftd->wasModified && rect && !win->findCancelled && textSearch->IsPatternSearch()) {
+        auto hitData = new FindShowHitTaskData;
+        hitData->win = win;
+        hitData->ftd = ftd;
+        hitData->textSel = rect;
+        auto fn = MkFunc0<FindShowHitTaskData>(FindShowHitTask, hitData);
+        uitask::Post(fn, "TaskFindShowHit");
+        hitShown = true;
+
+        ftd->countingHits = true;
+        textSearch->CountPatternHits();
+        ftd->countingHits = false;
+    }
+
     auto data = new FindEndTaskData;
     data->win = win;
     data->ftd = ftd;
     data->textSel = nullptr;
     data->loopedAround = false;
 
-    if (!win->findCancelled && rect) {
+    // canceling the count keeps the hit that is already shown
+    if (rect && (hitShown || !win->findCancelled)) {
         data->textSel = rect;
         data->wasModifiedCanceled = ftd->wasModified;
         data->loopedAround = loopedAround;
+        data->hitShown = hitShown;
     } else {
         data->wasModifiedCanceled = win->findCancelled;
     }
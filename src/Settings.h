@@ -68,6 +68,10 @@ struct FixedPageUI {
     bool invertColors;
     // if true, hides the scrollbars but retains ability to scroll
     bool hideScrollbars;
+    // maximum size (in MB) of the on-disk cache of rendered pages which
+    // allows showing re-opened documents without rendering them again; 0
+    // disables the cache
+    int tileCacheSize;
 };
 
 // customization options for eBookUI
@@ -531,10 +535,11 @@ static const FieldInfo gFixedPageUIFields[] = {
     {offsetof(FixedPageUI, gradientColors), SettingType::ColorArray, 0},
     {offsetof(FixedPageUI, invertColors), SettingType::Bool, false},
     {offsetof(FixedPageUI, hideScrollbars), SettingType::Bool, false},
+    {offsetof(FixedPageUI, tileCacheSize), SettingType::Int, 0},
 };
-static const StructInfo gFixedPageUIInfo = {sizeof(FixedPageUI), 8, gFixedPageUIFields,
+static const StructInfo gFixedPageUIInfo = {sizeof(FixedPageUI), 9, gFixedPageUIFields,
                                             "TextColor\0BackgroundColor\0SelectionColor\0WindowMargin\0PageSpacing\0Gra"
-                                            "dientColors\0InvertColors\0HideScrollbars"};
+                                            "dientColors\0InvertColors\0HideScrollbars\0TileCacheSize"};
 
 static const FieldInfo gEBookUIFields[] = {
     {offsetof(EBookUI, fontSize), SettingType::Float, (intptr_t) "0"},
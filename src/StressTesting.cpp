@@ -31,6 +31,8 @@
 #include "Flags.h"
 #include "SearchAndDDE.h"
 #include "StressTesting.h"
+#include "PdfToImage.h"
+#include "SymbolDetection.h"
 
 #include "utils/Log.h"
 
@@ -106,7 +108,36 @@ static void BenchChmLoadOnly(const char* filePath) {
     logf("Finished (in %.2f ms): %s\n", TimeSinceInMs(total), filePath);
 }
 
-static void BenchFile(const char* path, const char* pagesSpec) {
+// times saving pages as images, first with a single thread
+// and then with as many threads as there are cores
+static void BenchExportImages(EngineBase* engine, int startPage, int endPage) {
+    if (engine->kind != kindEngineMupdf) {
+        logf("Error: export is only supported for EngineMupdf\n");
+        return;
+    }
+    TempStr dir = GetTempDirTemp();
+    int nThreads[2] = {1, 0};
+    for (int n : nThreads) {
+        PageImageExportArgs args;
+        args.engine = engine;
+        args.dstDir = dir;
+        args.fileNameBase = "sumatra-bench-export";
+        args.startPage = startPage;
+        args.endPage = endPage;
+        args.nThreads = n;
+        auto t = TimeGet();
+        bool ok = ExportPagesAsImages(args);
+        double timeMs = TimeSinceInMs(t);
+        logf("export (threads: %d) pages %d-%d: %.2f ms, %.2f pages/sec%s\n", n, args.startPage, args.endPage, timeMs,
+             timeMs > 0 ? args.nWritten * 1000.0 / timeMs : 0.0, ok ? "" : " (failed)");
+        for (int pageNo = args.startPage; pageNo <= args.endPage; pageNo++) {
+            TempStr fileName = str::FormatTemp("%s-%d.png", args.fileNameBase, pageNo);
+            file::Delete(path::JoinTemp(dir, fileName));
+        }
+    }
+}
+
+static void BenchFile(const char* path, const char* pagesSpec, const char* benchMode) {
     if (!file::Exists(path)) {
         return;
     }
@@ -140,6 +171,22 @@ static void BenchFile(const char* path, const char* pagesSpec) {
     int pages = engine->PageCount();
     logf("page count: %d\n", pages);
 
+    if (str::Eq(benchMode, "export") || str::Eq(benchMode, "detect")) {
+        Vec<PageRange> benchRanges;
+        PageRange range{1, pages};
+        if (ParsePageRanges(pagesSpec, benchRanges)) {
+            range = benchRanges[0];
+        }
+        if (str::Eq(benchMode, "export")) {
+            BenchExportImages(engine, range.start, std::min(range.end, pages));
+        } else {
+            BenchSymbolDetection(engine, range.start, std::min(range.end, pages));
+        }
+        SafeEngineRelease(&engine);
+        logf("Finished (in %.2f ms): %s\n", TimeSinceInMs(total), path);
+        return;
+    }
+
     if (!pagesSpec) {
         for (int i = 1; i <= pages; i++) {
             BenchLoadRender(engine, i);
@@ -185,22 +232,22 @@ static void CollectFilesToBench(char* dir, StrVec& files) {
     }
 }
 
-static void BenchDir(char* dir) {
+static void BenchDir(char* dir, const char* benchMode) {
     StrVec files;
     CollectFilesToBench(dir, files);
     for (int i = 0; i < files.Size(); i++) {
-        BenchFile(files.At(i), nullptr);
+        BenchFile(files.At(i), nullptr, benchMode);
     }
 }
 
-void BenchFileOrDir(StrVec& pathsToBench) {
+void BenchFileOrDir(StrVec& pathsToBench, const char* benchMode) {
     int n = pathsToBench.Size() / 2;
     for (int i = 0; i < n; i++) {
         char* path = pathsToBench.At(2 * i);
         if (file::Exists(path)) {
-            BenchFile(path, pathsToBench.At(2 * i + 1));
+            BenchFile(path, pathsToBench.At(2 * i + 1), benchMode);
         } else if (dir::Exists(path)) {
-            BenchDir(path);
+            BenchDir(path, benchMode);
         } else {
             logf("Error: file or dir %s doesn't exist", path);
         }
@@ -70,6 +70,7 @@
 #include "ExternalViewers.h"
 #include "Favorites.h"
 #include "FileThumbnails.h"
+#include "TileCache.h"
 #include "Menu.h"
 #include "Print.h"
 #include "SearchAndDDE.h"
@@ -89,134 +90,10 @@
 #include "CommandPalette.h"
 #include "Theme.h"
 #include "Caption.h"
- 
-#include "utils/Log.h"
 #include "PdfToImage.h"
-#include <filesystem>
-#include <stdlib.h>
- 
-#include <string>
-#include <vector>
-#include <sstream>
-#include <filesystem>
-#include <gdiplus.h>
- 
-std::wstring GetProcessedImagePath(const std::wstring& originalPath) {
-    std::filesystem::path path(originalPath);
-    std::wstring newFileName = path.stem().wstring() + L"_processed" + L".png";
-    return (path.parent_path() / newFileName).wstring();
-}
- 
-// Helper function to execute a command and capture its output
-std::wstring ExecuteCommandAndCaptureOutput(const std::wstring& command) {
-    SECURITY_ATTRIBUTES saAttr;
-    saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
-    saAttr.bInheritHandle = TRUE;
-    saAttr.lpSecurityDescriptor = NULL;
- 
-    HANDLE hReadPipe, hWritePipe;
-    if (!CreatePipe(&hReadPipe, &hWritePipe, &saAttr, 0)) {
-        return L"Error creating pipe";
-    }
- 
-    STARTUPINFO si;
-    PROCESS_INFORMATION pi;
-    ZeroMemory(&si, sizeof(si));
-    si.cb = sizeof(si);
-    si.hStdError = hWritePipe;
-    si.hStdOutput = hWritePipe;
-    si.dwFlags |= STARTF_USESTDHANDLES;
- 
-    if (!CreateProcess(NULL, const_cast<LPWSTR>(command.c_str()), NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi)) {
-        CloseHandle(hReadPipe);
-        CloseHandle(hWritePipe);
-        return L"Error creating process";
-    }
- 
-    CloseHandle(hWritePipe);
- 
-    std::wstring output;
-    char buffer[4096];
-    DWORD bytesRead;
-    while (ReadFile(hReadPipe, buffer, sizeof(buffer), &bytesRead, NULL) && bytesRead != 0) {
-        output += std::wstring(buffer, buffer + bytesRead);
-    }
- 
-    CloseHandle(hReadPipe);
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
- 
-    return output;
-}
- 
-// Helper function to parse the output for the image path
-std::wstring ParseOutputForImagePath(const std::wstring& output) {
-    std::wistringstream iss(output);
-    std::wstring line;
-    while (std::getline(iss, line)) {
-        if (line.find(L"Processed image saved at:") != std::wstring::npos) {
-            return line.substr(line.find(L":") + 2);
-        }
-    }
-    return L"";
-}
- 
-// Helper function to display the image in a new window
-void DisplayImageInNewWindow(const std::wstring& imagePath, HWND parentHwnd) {
-    // Initialize GDI+
-    Gdiplus::GdiplusStartupInput gdiplusStartupInput;
-    ULONG_PTR gdiplusToken;
-    Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
- 
-    // Create a new window
-    HWND hwnd = CreateWindowEx(
-        0,
-        L"STATIC",
-        L"Processed Image",
-        WS_OVERLAPPEDWINDOW,
-        CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT,
-        parentHwnd,
-        NULL,
-        GetModuleHandle(NULL),
-        NULL
-    );
- 
-    if (hwnd == NULL) {
-        MessageBox(parentHwnd, L"Failed to create window", L"Error", MB_ICONERROR);
-        return;
-    }
- 
-    // Load the image
-    Gdiplus::Image* image = Gdiplus::Image::FromFile(imagePath.c_str());
-    if (image == NULL) {
-        MessageBox(parentHwnd, L"Failed to load image", L"Error", MB_ICONERROR);
-        DestroyWindow(hwnd);
-        return;
-    }
- 
-    // Set window size based on image dimensions
-    SetWindowPos(hwnd, NULL, 0, 0, image->GetWidth(), image->GetHeight(), SWP_NOMOVE | SWP_NOZORDER);
+#include "SymbolDetection.h"
  
-    // Show the window
-    ShowWindow(hwnd, SW_SHOW);
- 
-    // Create a graphics object and draw the image
-    HDC hdc = GetDC(hwnd);
-    Gdiplus::Graphics graphics(hdc);
-    graphics.DrawImage(image, 0, 0, image->GetWidth(), image->GetHeight());
- 
-    // Message loop
-    MSG msg;
-    while (GetMessage(&msg, NULL, 0, 0)) {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
-    }
- 
-    // Clean up
-    delete image;
-    ReleaseDC(hwnd, hdc);
-    Gdiplus::GdiplusShutdown(gdiplusToken);
-}
+#include "utils/Log.h"
  
 constexpr const char* kRestrictionsFileName = "sumatrapdfrestrict.ini";
  
@@ -261,13 +138,6 @@ static void CloseDocumentInCurrentTab(MainWindow*, bool keepUIEnabled, bool dele
 static void OnSidebarSplitterMove(Splitter::MoveEvent*);
 static void OnFavSplitterMove(Splitter::MoveEvent*);
  
-// Function to get the directory of the current executable
-std::wstring GetExecutableDirectory() {
-    wchar_t exePath[MAX_PATH];
-    GetModuleFileName(NULL, exePath, MAX_PATH);
-    return std::filesystem::path(exePath).parent_path().wstring();
-}
- 
 EBookUI* GetEBookUI() {
     return &gGlobalPrefs->eBookUI;
 }
@@ -1133,8 +1003,9 @@ static DocController* CreateControllerForChm(const char* path, PasswordUI* pwdUI
 // https://github.com/sumatrapdfreader/sumatrapdf/issues/3903
 DocController* gMostRecentlyOpenedDoc = nullptr;
  
+// reuseEngine is false when reloading, so that the file is parsed again with current settings
 DocController* CreateControllerForEngineOrFile(EngineBase* engine, const char* path, PasswordUI* pwdUI,
-                                               MainWindow* win) {
+                                               MainWindow* win, bool reuseEngine) {
     // TODO: move this to MainWindow constructor
     if (!win->cbHandler) {
         win->cbHandler = new ControllerCallbackHandler(win);
@@ -1142,9 +1013,20 @@ DocController* CreateControllerForEngineOrFile(EngineBase* engine, const char* p
  
     auto timeStart = TimeGet();
     bool chmInFixedUI = gGlobalPrefs->chmUI.useFixedPageUI;
+    // another tab or window might already show this file
+    if (!engine && reuseEngine) {
+        engine = FindSharedEngine(path);
+        if (engine && EngineHasUnsavedAnnotations(engine)) {
+            // show the file as it is on disk
+            SafeEngineRelease(&engine);
+        }
+    }
     // TODO: sniff file content only once
     if (!engine) {
         engine = CreateEngineFromFile(path, pwdUI, chmInFixedUI);
+        if (engine) {
+            RegisterSharedEngine(engine, path);
+        }
     }
     if (!engine) {
         // as a last resort, try to open as chm file
@@ -1239,6 +1121,53 @@ static bool showTocByDefault(const char* path) {
     return showByDefault;
 }
  
+// waits on a background thread until a progressively loaded document has been read
+// completely (see EngineBase::IsPartiallyLoaded) and then updates its tab
+struct FullLoadJob {
+    WindowTab* tab = nullptr;
+    EngineBase* engine = nullptr;
+    bool changed = false;
+};
+ 
+static void FullLoadFinished(FullLoadJob* job) {
+    // the tab might have been closed or reloaded in the meantime
+    MainWindow* win = FindMainWindowByTab(job->tab);
+    DisplayModel* dm = win ? job->tab->AsFixed() : nullptr;
+    if (job->changed && dm && dm->GetEngine() == job->engine) {
+        logf("FullLoadFinished: '%s'\n", job->engine->FilePath());
+        dm->UpdatePageSizes();
+        // tiles rendered for the previous page sizes are outdated. the tab
+        // might be in the background, so this is not MainWindowRerender(win)
+        gRenderCache->CancelRendering(dm);
+        gRenderCache->KeepForDisplayModel(dm, dm);
+        if (job->tab == win->CurrentTab()) {
+            win->RedrawAll(true);
+        }
+        if (job->tab == win->CurrentTab() && !win->presentation && !win->tocVisible) {
+            // the Table of Contents might only be available now
+            ClearTocBox(win);
+            SetSidebarVisibility(win, showTocByDefault(job->tab->filePath), gGlobalPrefs->showFavorites);
+        }
+    }
+    SafeEngineRelease(&job->engine);
+    delete job;
+}
+ 
+static void FullLoadThread(FullLoadJob* job) {
+    job->changed = job->engine->WaitForFullLoad();
+    auto fn = MkFunc0<FullLoadJob>(FullLoadFinished, job);
+    uitask::Post(fn, "FullLoadFinished");
+}
+ 
+static void StartFullLoadJob(WindowTab* tab, EngineBase* engine) {
+    auto job = new FullLoadJob();
+    job->tab = tab;
+    engine->AddRef();
+    job->engine = engine;
+    auto fn = MkFunc0<FullLoadJob>(FullLoadThread, job);
+    RunAsync(fn, "FullLoadThread");
+}
+ 
 // Document is represented as DocController. Replace current DocController (if any) with ctrl
 // in current tab.
 // meaning of the internal values of LoadArgs:
@@ -1428,11 +1357,17 @@ static void ReplaceDocumentInCurrentTab(LoadArgs* args, DocController* ctrl, Fil
  
     win->RedrawAll(true);
     TabsOnChangedDoc(win);
+    LoadCachedSymbolDetections(tab);
  
     if (!win->IsDocLoaded()) {
         return;
     }
  
+    EngineBase* engine = win->AsFixed() ? win->AsFixed()->GetEngine() : nullptr;
+    if (engine && engine->IsPartiallyLoaded()) {
+        StartFullLoadJob(tab, engine);
+    }
+ 
     TempStr unsupported = win->ctrl->GetPropertyTemp(kPropUnsupportedFeatures);
     if (unsupported) {
         const char* s = _TRA("This document uses unsupported features (%s) and might not render properly");
@@ -1491,7 +1426,7 @@ void ReloadDocument(MainWindow* win, bool autoRefresh) {
     HwndPasswordUI pwdUI(win->hwndFrame);
     const char* path = tab->filePath;
     logfa("ReloadDocument: %s, auto refresh: %d\n", path, (int)autoRefresh);
-    DocController* ctrl = CreateControllerForEngineOrFile(nullptr, path, &pwdUI, win);
+    DocController* ctrl = CreateControllerForEngineOrFile(nullptr, path, &pwdUI, win, false);
     // We don't allow PDF-repair if it is an autorefresh because
     // a refresh event can occur before the file is finished being written,
     // in which case the repair could fail. Instead, if the file is broken,
@@ -2335,6 +2270,18 @@ void MainWindowRerender(MainWindow* win, bool includeNonClientArea) {
     } else {
         win->RedrawAll(true);
     }
+    // KeepForDisplayModel() has invalidated tiles of other views of a shared engine
+    // (e.g. after editing annotations) but they must be repainted to show the change
+    EngineBase* engine = dm->GetEngine();
+    if (!engine->isShared) {
+        return;
+    }
+    for (MainWindow* other : gWindows) {
+        DisplayModel* otherDm = other->AsFixed();
+        if (other != win && otherDm && otherDm->GetEngine() == engine) {
+            other->RedrawAll(true);
+        }
+    }
 }
  
 static void RerenderEverything() {
@@ -2958,7 +2905,7 @@ static bool AppendFileFilterForDoc(DocController* ctrl, str::Str& fileFilter) {
         fileFilter.Append(_TRA("FictionBook documents"));
     } else if (type == kindEnginePdb) {
         fileFilter.Append(_TRA("PalmDoc documents"));
-    } else if (type == kindEngineTxt) {
+    } else if (type == kindEngineTxt || type == kindEnginePlainText) {
         fileFilter.Append(_TRA("Text documents"));
     } else {
         fileFilter.Append(_TRA("PDF documents"));
@@ -3793,6 +3740,7 @@ static void ShowOptionsDialog(HWND hwnd) {
     if (!gGlobalPrefs->rememberOpenedFiles) {
         gFileHistory.Clear(true);
         DeleteThumbnailCacheDirectory();
+        DeleteTileCacheDirectory();
     }
     UpdateDocumentColors();
  
@@ -4986,6 +4934,7 @@ static void ClearHistoryFinish(ClearHistoryData* d) {
  
 static void ClearHistoryAsync(ClearHistoryData* d) {
     DeleteThumbnailCacheDirectory();
+    DeleteTileCacheDirectory();
     TempStr symDir = GetCrashInfoDirTemp();
     dir::RemoveAll(symDir);
     auto fn = MkFunc0<ClearHistoryData>(ClearHistoryFinish, d);
@@ -5397,77 +5346,21 @@ static LRESULT FrameOnCommand(MainWindow* win, HWND hwnd, UINT msg, WPARAM wp, L
         case CmdSaveAs:
             SaveCurrentFileAs(win);
             break;
-        #include <windows.h>
+        case CmdMLModel:
+            if (win->IsDocLoaded()) {
+                DetectSymbolsOnCurrentPage(win);
+            }
+            break;
+ 
+        case CmdDetectSymbolsInDocument:
+            if (win->IsDocLoaded()) {
+                DetectSymbolsInDocument(win);
+            }
+            break;
  
-        case CmdMLModel: {
-    // Open file dialog to select an image
-    OPENFILENAME ofn;
-    wchar_t szFile[260] = { 0 };
-    ZeroMemory(&ofn, sizeof(ofn));
-    ofn.lStructSize = sizeof(ofn);
-    ofn.hwndOwner = win->hwndFrame;
-    ofn.lpstrFile = szFile;
-    ofn.nMaxFile = sizeof(szFile);
-    ofn.lpstrFilter = L"Image Files\0*.jpg;*.jpeg;*.png;*.bmp\0All Files\0*.*\0";
-    ofn.nFilterIndex = 1;
-    ofn.lpstrFileTitle = NULL;
-    ofn.nMaxFileTitle = 0;
-    ofn.lpstrInitialDir = NULL;
-    ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
-
-    if (GetOpenFileName(&ofn) == TRUE) {
-        // Get the path to Final_app.py
-        std::wstring executableDirectory = GetExecutableDirectory();
-        std::filesystem::path finalAppPath = std::filesystem::path(executableDirectory) / L"Final_app.py";
-
-        if (!std::filesystem::exists(finalAppPath)) {
-            MessageBox(win->hwndFrame, L"Final_app.py not found", L"Error", MB_ICONERROR);
-            return 0;
-        }
-
-        // Construct the command to execute the Python script with the selected file path
-        std::wstring command = L"python \"" + finalAppPath.wstring() + L"\" \"" + ofn.lpstrFile + L"\"";
-
-        // Execute the command and capture the output
-        std::wstring output = ExecuteCommandAndCaptureOutput(command);
-
-        // Parse the output to get the path of the processed image
-        std::wstring processedImagePath = GetProcessedImagePath(ofn.lpstrFile);
-
-        if (!processedImagePath.empty()) {
-            // Open the processed image in a new tab using SumatraPDF's LoadDocument function
-            LoadArgs args(ToUtf8Temp(processedImagePath.c_str()), win);
-            LoadDocument(&args);
-        } else {
-            MessageBox(win->hwndFrame, L"Failed to process the image", L"Error", MB_ICONERROR);
-        }
-    }
-    break;
-}
         case CmdConvertPdfToImages:
             if (win->IsDocLoaded()) {
-                // Set up the OPENFILENAME structure
-                OPENFILENAME ofn;
-                WCHAR filePath[MAX_PATH] = L"";
-                ZeroMemory(&ofn, sizeof(ofn));
- 
-                ofn.lStructSize = sizeof(ofn);
-                ofn.hwndOwner = win->hwndFrame; // Parent window handle
-                ofn.lpstrFile = filePath;       // File path buffer
-                ofn.nMaxFile = MAX_PATH;
-                ofn.lpstrFilter = L"PDF Files\0*.pdf\0All Files\0*.*\0"; // Filter for PDF files
-                ofn.nFilterIndex = 1;
-                ofn.lpstrTitle = L"Select PDF to Convert";
-                ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST;
- 
-                // Show the Open dialog box
-                if (GetOpenFileName(&ofn) == TRUE) {
-                    // If user selects a file, filePath will contain the selected path
-                    ConvertPdfToImages(filePath);
-                } else {
-                    // Handle the case where the user cancels the dialog or an error occurs
-                    MessageBox(win->hwndFrame, L"No file selected or operation canceled.", L"Warning", MB_ICONWARNING);
-                }
+                ConvertPdfToImages(win);
             }
             break;
  
@@ -184,7 +184,7 @@ MainWindow* LoadDocumentFinish(LoadArgs* args);
 void StartLoadDocument(LoadArgs* args);
 MainWindow* CreateAndShowMainWindow(SessionData* data = nullptr);
 DocController* CreateControllerForEngineOrFile(EngineBase* engine, const char* path, PasswordUI* pwdUI,
-                                               MainWindow* win);
+                                               MainWindow* win, bool reuseEngine = true);
 
 uint MbRtlReadingMaybe();
 void MessageBoxWarning(HWND hwnd, const char* msg, const char* title = nullptr);
@@ -6,6 +6,9 @@
 #include "utils/ScopedWin.h"
 #include "utils/FileUtil.h"
 #include "utils/WinUtil.h"
+#include "utils/UITask.h"
+#include "utils/ThreadUtil.h"
+#include "utils/Timer.h"
 
 #include "wingui/UIModels.h"
 #include "wingui/Layout.h"
@@ -16,6 +19,7 @@
 #include "DocController.h"
 #include "EngineBase.h"
 #include "EngineAll.h"
+#include "EngineMupdf.h"
 #include "DisplayModel.h"
 #include "AppTools.h"
 #include "AppColors.h"
@@ -40,6 +44,8 @@ constexpr const WCHAR* kPropertiesWinClassName = L"SUMATRA_PDF_PROPERTIES";
 
 LRESULT CALLBACK WndProcProperties(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
 
+struct DocInventoryJob;
+
 struct PropertiesLayout {
     struct Pos {
         // overlong paths get the ellipsis in the middle instead of at the end
@@ -51,10 +57,7 @@ struct PropertiesLayout {
     };
 
     PropertiesLayout() = default;
-    ~PropertiesLayout() {
-        delete btnCopyToClipboard;
-        delete btnGetFonts;
-    }
+    ~PropertiesLayout();
 
     void AddProperty(const char* key, const char* value, bool isPath = false) {
         if (str::IsEmpty(value)) {
@@ -96,16 +99,68 @@ struct PropertiesLayout {
         return positions.At(i);
     }
 
+    // removes properties after the first n
+    void TruncateProperties(int n) {
+        while (PropCount() > n) {
+            strings.RemoveAt(strings.Size() - 1);
+            strings.RemoveAt(strings.Size() - 1);
+            positions.RemoveLast();
+        }
+    }
+
     HWND hwnd = nullptr;
     HWND hwndParent = nullptr;
     Button* btnCopyToClipboard = nullptr;
     Button* btnGetFonts = nullptr;
+    bool extended = false;
+
+    // properties after the first nBasicProps are filled in by inventoryJob
+    DocInventoryJob* inventoryJob = nullptr;
+    int nBasicProps = 0;
 
   private:
     StrVec strings;
     Vec<Pos> positions;
 };
 
+// collects DocInventory for extended properties on a background thread
+// so that the window shows up immediately and fills in as pages are scanned
+struct DocInventoryJob {
+    // nullptr once the properties window is closed
+    PropertiesLayout* pl = nullptr;
+    EngineMupdf* engine = nullptr;
+    AtomicBool canceled;
+};
+
+// a snapshot of DocInventory, sent from DocInventoryThread to the ui thread
+struct DocInventoryUpdate {
+    DocInventoryJob* job = nullptr;
+    AutoFreeStr fonts;
+    int nFonts = 0;
+    int nEmbeddedFonts = 0;
+    int nSubsetFonts = 0;
+    int nImages = 0;
+    // in inches
+    Vec<SizeF> pageSizes;
+    Vec<int> pageSizeCounts;
+    int nPagesScanned = 0;
+    int nPages = 0;
+    bool finished = false;
+};
+
+// how often partial results are sent to the ui
+constexpr double kInventoryUpdateIntervalMs = 250;
+
+PropertiesLayout::~PropertiesLayout() {
+    if (inventoryJob) {
+        // the job deletes itself when the thread finishes
+        inventoryJob->pl = nullptr;
+        inventoryJob->canceled.Set(true);
+    }
+    delete btnCopyToClipboard;
+    delete btnGetFonts;
+}
+
 static Vec<PropertiesLayout*> gPropertiesWindows;
 
 PropertiesLayout* FindPropertyWindowByHwnd(HWND hwnd) {
@@ -198,13 +253,13 @@ static TempStr ConvDateToDisplayTemp(const char* s, bool (*dateParseFn)(const ch
     return FormatSystemTimeTemp(date);
 }
 
-// format page size according to locale (e.g. "29.7 x 21.0 cm" or "11.69 x 8.27 in")
-// Caller needs to free the result
-static TempStr FormatPageSizeTemp(EngineBase* engine, int pageNo, int rotation) {
-    RectF mediabox = engine->PageMediabox(pageNo);
-    float zoom = 1.0f / engine->GetFileDPI();
-    SizeF size = engine->Transform(mediabox, pageNo, zoom, rotation).Size();
+// https://www.compart.com/en/unicode/U+202A
+constexpr const char* leftToRightEmbeding = "\xe2\x80\xaa";
+// https://www.compart.com/en/unicode/U+202c
+constexpr const char* popDirectionalFormatting = "\xe2\x80\xac";
 
+// format page size (in inches) according to locale (e.g. "29.7 x 21.0 cm" or "11.69 x 8.27 in")
+static TempStr FormatPageSizeTemp(SizeF size) {
     const char* formatName = "";
     switch (GetPaperFormatFromSizeApprox(size)) {
         case PaperFormat::A2:
@@ -252,7 +307,20 @@ static TempStr FormatPageSizeTemp(EngineBase* engine, int pageNo, int rotation)
     char* strWidth = str::FormatFloatWithThousandSepTemp(width);
     char* strHeight = str::FormatFloatWithThousandSepTemp(height);
 
-    return str::FormatTemp("%s x %s %s%s", strWidth, strHeight, unit, formatName);
+    TempStr res = str::FormatTemp("%s x %s %s%s", strWidth, strHeight, unit, formatName);
+    if (IsUIRtl() && IsWindowsVistaOrGreater()) {
+        // ensure that the size remains ungarbled left-to-right
+        // (note: XP doesn't know about \u202A...\u202C)
+        res = str::JoinTemp(leftToRightEmbeding, res, popDirectionalFormatting);
+    }
+    return res;
+}
+
+static TempStr FormatPageSizeTemp(EngineBase* engine, int pageNo, int rotation) {
+    RectF mediabox = engine->PageMediabox(pageNo);
+    float zoom = 1.0f / engine->GetFileDPI();
+    SizeF size = engine->Transform(mediabox, pageNo, zoom, rotation).Size();
+    return FormatPageSizeTemp(size);
 }
 
 // returns a list of permissions denied by this document
@@ -367,7 +435,7 @@ static Rect CalcPropertiesLayout(PropertiesLayout* layoutData, HDC hdc) {
 
 static void ShowExtendedProperties(PropertiesLayout* pl) {
     MainWindow* win = FindMainWindowByHwnd(pl ? pl->hwndParent : nullptr);
-    if (win && !pl->HasProperty(_TRA("Fonts:"))) {
+    if (win && !pl->extended) {
         DestroyWindow(pl->hwnd);
         ShowProperties(win->hwndFrame, win->ctrl, true);
     }
@@ -390,6 +458,18 @@ static void CopyPropertiesToClipboard(PropertiesLayout* layoutData) {
     CopyTextToClipboard(lines.LendData());
 }
 
+// resize the window to match the size of the content
+// (as long as it fits into the current monitor's work area)
+static void ResizePropertiesWindow(PropertiesLayout* pl, Rect rc) {
+    HWND hwnd = pl->hwnd;
+    Rect wRc = WindowRect(hwnd);
+    Rect cRc = ClientRect(hwnd);
+    Rect work = GetWorkAreaRect(WindowRect(pl->hwndParent), hwnd);
+    wRc.dx = std::min(rc.dx + wRc.dx - cRc.dx, work.dx);
+    wRc.dy = std::min(rc.dy + wRc.dy - cRc.dy, work.dy);
+    MoveWindow(hwnd, wRc.x, wRc.y, wRc.dx, wRc.dy, FALSE);
+}
+
 static bool gDidRegister = false;
 static bool CreatePropertiesWindow(HWND hParent, PropertiesLayout* layoutData, bool extended) {
     HMODULE h = GetModuleHandleW(nullptr);
@@ -419,6 +499,7 @@ static bool CreatePropertiesWindow(HWND hParent, PropertiesLayout* layoutData, b
 
     layoutData->hwnd = hwnd;
     layoutData->hwndParent = hParent;
+    layoutData->extended = extended;
     bool isRtl = IsUIRtl();
     HwndSetRtl(hwnd, isRtl);
     {
@@ -454,13 +535,7 @@ static bool CreatePropertiesWindow(HWND hParent, PropertiesLayout* layoutData, b
     EndPaint(hwnd, &ps);
 
     // resize the new window to just match these dimensions
-    // (as long as they fit into the current monitor's work area)
-    Rect wRc = WindowRect(hwnd);
-    Rect cRc = ClientRect(hwnd);
-    Rect work = GetWorkAreaRect(WindowRect(hParent), hwnd);
-    wRc.dx = std::min(rc.dx + wRc.dx - cRc.dx, work.dx);
-    wRc.dy = std::min(rc.dy + wRc.dy - cRc.dy, work.dy);
-    MoveWindow(hwnd, wRc.x, wRc.y, wRc.dx, wRc.dy, FALSE);
+    ResizePropertiesWindow(layoutData, rc);
     CenterDialog(hwnd, hParent);
 
     ShowWindow(hwnd, SW_SHOW);
@@ -529,10 +604,120 @@ static void AddPdfFileStructure(DocController* ctrl, PropertiesLayout* layoutDat
     layoutData->AddProperty(_TRA("PDF Optimizations:"), val);
 }
 
-// https://www.compart.com/en/unicode/U+202A
-constexpr const char* leftToRightEmbeding = "\xe2\x80\xaa";
-// https://www.compart.com/en/unicode/U+202c
-constexpr const char* popDirectionalFormatting = "\xe2\x80\xac";
+// documents for which fonts, images and page sizes are collected with DocInventoryJob
+static EngineMupdf* GetInventoryEngine(DocController* ctrl) {
+    DisplayModel* dm = ctrl->AsFixed();
+    return dm ? AsEngineMupdf(dm->GetEngine()) : nullptr;
+}
+
+static void AddInventoryProps(PropertiesLayout* pl, DocInventoryUpdate* u) {
+    pl->TruncateProperties(pl->nBasicProps);
+    // add a space between basic and extended file properties
+    pl->AddProperty(" ", " ");
+    if (!u->finished) {
+        TempStr s = str::FormatTemp(_TRA("page %d of %d"), u->nPagesScanned, u->nPages);
+        pl->AddProperty(_TRA("Scanning:"), s);
+    }
+    pl->AddProperty(_TRA("Fonts:"), u->fonts);
+    if (u->nFonts > 0) {
+        TempStr s = str::FormatTemp("%d / %d", u->nEmbeddedFonts, u->nFonts);
+        if (u->nSubsetFonts > 0) {
+            s = str::FormatTemp(_TRA("%s (%d subset)"), s, u->nSubsetFonts);
+        }
+        pl->AddProperty(_TRA("Embedded Fonts:"), s);
+    }
+    if (u->nImages > 0) {
+        pl->AddProperty(_TRA("Images:"), str::FormatTemp("%d", u->nImages));
+    }
+
+    StrVec sizes;
+    int n = u->pageSizes.Size();
+    for (int i = 0; i < n; i++) {
+        TempStr size = FormatPageSizeTemp(u->pageSizes[i]);
+        sizes.Append(str::FormatTemp("%s: %d", size, u->pageSizeCounts[i]));
+    }
+    pl->AddProperty(_TRA("Page Sizes:"), JoinTemp(&sizes, "\n"));
+}
+
+static void RelayoutProperties(PropertiesLayout* pl) {
+    HWND hwnd = pl->hwnd;
+    HDC hdc = GetDC(hwnd);
+    Rect rc = CalcPropertiesLayout(pl, hdc);
+    ReleaseDC(hwnd, hdc);
+    ResizePropertiesWindow(pl, rc);
+    InvalidateRect(hwnd, nullptr, TRUE);
+}
+
+static void DocInventoryUpdated(DocInventoryUpdate* u) {
+    AutoDelete delUpdate(u);
+
+    DocInventoryJob* job = u->job;
+    PropertiesLayout* pl = job->pl;
+    if (pl) {
+        AddInventoryProps(pl, u);
+        RelayoutProperties(pl);
+    }
+    if (!u->finished) {
+        return;
+    }
+    if (pl) {
+        pl->inventoryJob = nullptr;
+    }
+    SafeEngineRelease(&job->engine);
+    delete job;
+}
+
+static void PostDocInventoryUpdate(DocInventoryJob* job, DocInventory& inv, bool finished) {
+    auto u = new DocInventoryUpdate();
+    u->job = job;
+    StrVec fonts = inv.fonts;
+    if (fonts.Size() > 0) {
+        SortNatural(&fonts);
+        u->fonts.Set(Join(&fonts, "\n"));
+    }
+    u->nFonts = fonts.Size();
+    u->nEmbeddedFonts = inv.nEmbeddedFonts;
+    u->nSubsetFonts = inv.nSubsetFonts;
+    u->nImages = inv.nImages;
+    float dpi = job->engine->GetFileDPI();
+    for (SizeF size : inv.pageSizes) {
+        u->pageSizes.Append(SizeF(size.dx / dpi, size.dy / dpi));
+    }
+    u->pageSizeCounts = inv.pageSizeCounts;
+    u->nPagesScanned = inv.nPagesScanned;
+    u->nPages = job->engine->PageCount();
+    u->finished = finished;
+    auto fn = MkFunc0<DocInventoryUpdate>(DocInventoryUpdated, u);
+    uitask::Post(fn, "DocInventoryUpdated");
+}
+
+static void DocInventoryThread(DocInventoryJob* job) {
+    DocInventory inv;
+    int nPages = job->engine->PageCount();
+    auto lastUpdate = TimeGet();
+    for (int pageNo = 1; pageNo <= nPages && !job->canceled.Get(); pageNo++) {
+        job->engine->ScanPageInventory(&inv, pageNo);
+        // the first page is sent right away, the rest periodically
+        bool sendUpdate = (pageNo == 1) || (TimeSinceInMs(lastUpdate) > kInventoryUpdateIntervalMs);
+        if (sendUpdate && pageNo < nPages) {
+            PostDocInventoryUpdate(job, inv, false);
+            lastUpdate = TimeGet();
+        }
+        ResetTempAllocator();
+    }
+    PostDocInventoryUpdate(job, inv, true);
+    DestroyTempAllocator();
+}
+
+static void StartDocInventory(PropertiesLayout* pl, EngineMupdf* engine) {
+    auto job = new DocInventoryJob();
+    job->pl = pl;
+    engine->AddRef();
+    job->engine = engine;
+    pl->inventoryJob = job;
+    auto fn = MkFunc0(DocInventoryThread, job);
+    RunAsync(fn, "DocInventoryThread");
+}
 
 static void GetProps(DocController* ctrl, PropertiesLayout* layoutData, bool extended) {
     ReportIf(!ctrl);
@@ -588,19 +773,20 @@ static void GetProps(DocController* ctrl, PropertiesLayout* layoutData, bool ext
 
     if (dm) {
         strTemp = FormatPageSizeTemp(dm->GetEngine(), ctrl->CurrentPageNo(), dm->GetRotation());
-        if (IsUIRtl() && IsWindowsVistaOrGreater()) {
-            // ensure that the size remains ungarbled left-to-right
-            // (note: XP doesn't know about \u202A...\u202C)
-            strTemp = str::JoinTemp(leftToRightEmbeding, strTemp, popDirectionalFormatting);
-        }
         layoutData->AddProperty(_TRA("Page Size:"), strTemp);
     }
 
     strTemp = FormatPermissionsTemp(ctrl);
     layoutData->AddProperty(_TRA("Denied Permissions:"), strTemp);
 
-    if (extended) {
-        // Note: FontList extraction can take a while
+    if (extended && GetInventoryEngine(ctrl)) {
+        // scanning the whole document can take a while so it's done in
+        // the background by DocInventoryThread. until then show placeholders
+        layoutData->nBasicProps = layoutData->PropCount();
+        DocInventoryUpdate u;
+        u.nPages = ctrl->PageCount();
+        AddInventoryProps(layoutData, &u);
+    } else if (extended) {
         val = ctrl->GetPropertyTemp(kPropFontList);
         if (val) {
             // add a space between basic and extended file properties
@@ -625,7 +811,13 @@ void ShowProperties(HWND parent, DocController* ctrl, bool extended) {
     GetProps(ctrl, layoutData, extended);
 
     if (!CreatePropertiesWindow(parent, layoutData, extended)) {
+        gPropertiesWindows.Remove(layoutData);
         delete layoutData;
+        return;
+    }
+    EngineMupdf* engine = GetInventoryEngine(ctrl);
+    if (extended && engine) {
+        StartDocInventory(layoutData, engine);
     }
 }
 
@@ -978,6 +978,7 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int) {
     Flags flags;
     ParseFlags(GetCommandLineW(), flags);
     gCli = &flags;
+    EnableEngineMupdfProgressiveLoading(flags.progressiveKbps);
 
     CheckIsStoreBuild();
 
@@ -1154,7 +1155,7 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int) {
     }
 
     if (flags.pathsToBenchmark.Size() > 0) {
-        BenchFileOrDir(flags.pathsToBenchmark);
+        BenchFileOrDir(flags.pathsToBenchmark, flags.benchMode);
     }
 
     if (flags.exitImmediately) {
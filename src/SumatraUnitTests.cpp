@@ -18,6 +18,7 @@
 #include "GlobalPrefs.h"
 #include "Flags.h"
 #include "Commands.h"
+#include "SymbolDetection.h"
 
 #include <float.h>
 #include <math.h>
@@ -76,6 +77,15 @@ static void ParseCommandLineTest() {
         utassert(str::Eq("1,3,8-34", i.pathsToBenchmark.At(3)));
     }
 
+    {
+        Flags i;
+        ParseFlags(L"SumatraPDF.exe -bench foo.pdf 1-10 -bench-mode export", i);
+        utassert(2 == i.pathsToBenchmark.Size());
+        utassert(str::Eq("foo.pdf", i.pathsToBenchmark.At(0)));
+        utassert(str::Eq("1-10", i.pathsToBenchmark.At(1)));
+        utassert(str::Eq("export", i.benchMode));
+    }
+
     {
         Flags i;
         ParseFlags(L"SumatraPDF.exe -presentation -bgcolor 0xaa0c13 foo.pdf -invert-colors bar.pdf", i);
@@ -155,6 +165,28 @@ static void BenchRangeTest() {
     utassert(!IsBenchPagesInfo(nullptr));
 }
 
+static void SuppressOverlappingSymbolsTest() {
+    Vec<DetectedSymbol> symbols;
+    // the same fuse detected in two overlapping tiles
+    symbols.Append({11, 0.6f, RectF(100, 100, 20, 10)});
+    symbols.Append({11, 0.9f, RectF(101, 100, 20, 10)});
+    // partial box of a breaker cut by a tile's edge and the full box
+    symbols.Append({2, 0.7f, RectF(200, 200, 40, 40)});
+    symbols.Append({2, 0.5f, RectF(200, 200, 15, 40)});
+    // a different class at the same position is kept
+    symbols.Append({12, 0.4f, RectF(100, 100, 20, 10)});
+    // a neighboring fuse is kept
+    symbols.Append({11, 0.8f, RectF(130, 100, 20, 10)});
+
+    SuppressOverlappingSymbols(symbols);
+    utassert(symbols.Size() == 4);
+    // sorted by confidence
+    utassert(symbols[0].classIdx == 11 && symbols[0].confidence == 0.9f);
+    utassert(symbols[1].classIdx == 11 && symbols[1].rect.x == 130);
+    utassert(symbols[2].classIdx == 2 && symbols[2].rect.dx == 40);
+    utassert(symbols[3].classIdx == 12);
+}
+
 // TODO: disabled because they bring too many dependencies
 static void versioncheck_test() {
     utassert(IsValidProgramVersion("1"));
@@ -297,6 +329,7 @@ void SumatraPDF_UnitTests() {
     parseCommandsTest();
     colorTest();
     BenchRangeTest();
+    SuppressOverlappingSymbolsTest();
     ParseCommandLineTest();
     versioncheck_test();
     hexstrTest();
@@ -0,0 +1,1250 @@
+/* Copyright 2024 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+extern "C" {
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+}
+
+#include "utils/BaseUtil.h"
+#include "utils/ScopedWin.h"
+#include "utils/ByteReader.h"
+#include "utils/ByteWriter.h"
+#include "utils/CryptoUtil.h"
+#include "utils/FileUtil.h"
+#include "utils/UITask.h"
+#include "utils/ThreadUtil.h"
+#include "utils/Timer.h"
+#include "utils/WinUtil.h"
+
+#include "wingui/UIModels.h"
+
+#include "Settings.h"
+#include "DocController.h"
+#include "EngineBase.h"
+#include "EngineMupdf.h"
+#include "DisplayModel.h"
+#include "Notifications.h"
+#include "SumatraPDF.h"
+#include "MainWindow.h"
+#include "WindowTab.h"
+#include "Translations.h"
+#include "AppTools.h"
+#include "SymbolDetection.h"
+
+#include "utils/Log.h"
+
+// Symbols are detected by a YOLO model (src/ml_model/best.pt) driven by
+// Final_app.py. We render the page ourselves at the model's input size and
+// send raw pixels over a pipe:
+//   <- "ready\n" once the model is loaded
+//   -> "batch <n>\n" followed by n pages, each being
+//      "page <pageNo> <dx> <dy>\n" followed by dx * dy * 3 bytes of
+//      top-down BGR pixels (no row padding)
+//   for each page of the batch, in order:
+//   <- "box <classIdx> <confidence> <x0> <y0> <x1> <y1>\n" for each
+//      detected symbol, in pixels of the image we sent
+//   <- "done <pageNo>\n"
+// Other lines written by the script are logged and otherwise ignored.
+
+// must match class_names in Final_app.py
+static const char* gSymbolClassNames[] = {
+    "Panel",
+    "Transformer",
+    "C.Breaker",
+    "Breaker (Sub-Category)",
+    "Feeder",
+    "Dis.Switch",
+    "Motor",
+    "Inverter",
+    "ATS",
+    "STS",
+    "Key Transfer Block",
+    "Fuse",
+    "UPS",
+    "Surge Protective Device (SPD)",
+    "SwitchBoard",
+    "Arrow",
+    "Generator",
+    "Sub-Transformer (Tx)",
+    "Bus Terminal",
+    "Feeders Tag",
+    "Manual Transfer Switch",
+    "Variable Frequency Drive (VFD)",
+};
+
+const char* SymbolClassName(int classIdx) {
+    if (classIdx < 0 || classIdx >= (int)dimof(gSymbolClassNames)) {
+        return "Unknown";
+    }
+    return gSymbolClassNames[classIdx];
+}
+
+// a long-lived Final_app.py process with the model loaded
+// started on first use and kept running so that we only pay python and
+// model startup (seconds) once. it exits when we close its stdin which
+// also happens automatically when SumatraPDF exits
+// only used by one detection job (thread) at a time
+struct SymbolDetector {
+    HANDLE hProcess = nullptr;
+    // we write pages to child's stdin
+    HANDLE hWrite = nullptr;
+    // and read results from child's stdout
+    HANDLE hRead = nullptr;
+    // data read from hRead but not yet returned as a line
+    str::Str readBuf;
+    str::Str line;
+};
+
+static SymbolDetector gSymbolDetector;
+// only accessed on ui thread
+static bool gIsDetectingSymbols = false;
+
+static void StopSymbolDetector(SymbolDetector* det) {
+    // closing stdin tells the script to exit
+    SafeCloseHandle(&det->hWrite);
+    if (det->hProcess) {
+        if (WaitForSingleObject(det->hProcess, 5000) != WAIT_OBJECT_0) {
+            TerminateProcess(det->hProcess, 1);
+        }
+    }
+    SafeCloseHandle(&det->hProcess);
+    SafeCloseHandle(&det->hRead);
+    det->readBuf.Reset();
+}
+
+static bool WriteAllToPipe(HANDLE h, const void* data, size_t size) {
+    const u8* d = (const u8*)data;
+    while (size > 0) {
+        DWORD toWrite = (DWORD)std::min(size, (size_t)64 * 1024);
+        DWORD written = 0;
+        if (!WriteFile(h, d, toWrite, &written, nullptr) || written == 0) {
+            return false;
+        }
+        d += written;
+        size -= written;
+    }
+    return true;
+}
+
+// returns nullptr when the child exited (or closed stdout)
+// returned line is valid until the next call
+static const char* ReadLineFromDetector(SymbolDetector* det) {
+    for (;;) {
+        char* s = det->readBuf.Get();
+        const char* nl = str::FindChar(s, '\n');
+        if (nl) {
+            size_t n = nl - s;
+            det->line.Reset();
+            det->line.Append(s, n);
+            det->readBuf.RemoveAt(0, n + 1);
+            str::TrimWSInPlace(det->line.Get(), str::TrimOpt::Right);
+            return det->line.Get();
+        }
+        char buf[4096];
+        DWORD nRead = 0;
+        if (!ReadFile(det->hRead, buf, sizeof(buf), &nRead, nullptr) || nRead == 0) {
+            return nullptr;
+        }
+        det->readBuf.Append(buf, nRead);
+    }
+}
+
+static bool LaunchSymbolDetector(SymbolDetector* det) {
+    TempStr scriptPath = GetPathInExeDirTemp("Final_app.py");
+    if (!file::Exists(scriptPath)) {
+        logf("LaunchSymbolDetector: '%s' doesn't exist\n", scriptPath);
+        return false;
+    }
+
+    SECURITY_ATTRIBUTES sa{};
+    sa.nLength = sizeof(sa);
+    sa.bInheritHandle = TRUE;
+
+    HANDLE childStdin = nullptr;
+    HANDLE childStdout = nullptr;
+    if (!CreatePipe(&childStdin, &det->hWrite, &sa, 0)) {
+        return false;
+    }
+    if (!CreatePipe(&det->hRead, &childStdout, &sa, 0)) {
+        CloseHandle(childStdin);
+        SafeCloseHandle(&det->hWrite);
+        return false;
+    }
+    // only the child's ends of the pipes should be inherited
+    SetHandleInformation(det->hWrite, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(det->hRead, HANDLE_FLAG_INHERIT, 0);
+    // the script (and libraries it uses) can be chatty on stderr
+    // we don't read it so it must not go to a pipe that can fill up
+    HANDLE hNul = CreateFileW(L"NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0,
+                              nullptr);
+
+    STARTUPINFOW si{};
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = childStdin;
+    si.hStdOutput = childStdout;
+    si.hStdError = hNul;
+
+    // we run on machines without a (supported) gpu so force cpu
+    TempStr cmdLine = str::FormatTemp("python \"%s\" --stdin --device cpu", scriptPath);
+    WCHAR* cmdLineW = ToWStrTemp(cmdLine);
+    PROCESS_INFORMATION pi{};
+    BOOL ok = CreateProcessW(nullptr, cmdLineW, nullptr, nullptr, TRUE, CREATE_NO_WINDOW, nullptr, nullptr, &si, &pi);
+    CloseHandle(childStdin);
+    CloseHandle(childStdout);
+    if (hNul != INVALID_HANDLE_VALUE) {
+        CloseHandle(hNul);
+    }
+    if (!ok) {
+        logf("LaunchSymbolDetector: failed to launch '%s'\n", cmdLine);
+        StopSymbolDetector(det);
+        return false;
+    }
+    CloseHandle(pi.hThread);
+    det->hProcess = pi.hProcess;
+
+    // wait until the model is loaded
+    for (;;) {
+        const char* line = ReadLineFromDetector(det);
+        if (!line) {
+            logf("LaunchSymbolDetector: '%s' exited before loading the model\n", cmdLine);
+            StopSymbolDetector(det);
+            return false;
+        }
+        if (str::Eq(line, "ready")) {
+            return true;
+        }
+        logf("detector: %s\n", line);
+    }
+}
+
+static bool EnsureSymbolDetector(SymbolDetector* det) {
+    if (det->hProcess && WaitForSingleObject(det->hProcess, 0) == WAIT_TIMEOUT) {
+        return true;
+    }
+    // never started or died
+    StopSymbolDetector(det);
+    auto timeStart = TimeGet();
+    bool ok = LaunchSymbolDetector(det);
+    logf("EnsureSymbolDetector: started detector in %.2f ms, ok: %d\n", TimeSinceInMs(timeStart), (int)ok);
+    return ok;
+}
+
+// Large sheets (E-size, A0) don't fit the model's input at a resolution where
+// small symbols (fuses, breakers) are still recognizable. We render such pages
+// at kSymbolTileDpi in model-sized tiles that overlap by kSymbolTileOverlap
+// pixels so that every symbol is fully inside at least one tile, and merge
+// per-tile results with SuppressOverlappingSymbols().
+// Tiles without any content are not rendered nor sent to the model.
+
+// a page, or a tile of a page, to be rendered and sent to the model
+struct ModelInput {
+    int pageNo = 0;
+    // area of the page to render, in page (user) coordinates
+    RectF pageRect;
+    float zoom = 1.f;
+    // the last input for pageNo. its results complete the page
+    bool isLastOfPage = false;
+    // if true, nothing is rendered nor sent to the model
+    // (e.g. page without content or that failed to render)
+    bool skip = false;
+    // set together with skip when rendering failed, which might be temporary
+    bool renderFailed = false;
+    // set together with skip and isLastOfPage for pages whose symbols are already
+    // in the cache. they're reported in order with the other pages of their batch
+    PageSymbols* cached = nullptr;
+    // for EngineMupdf we render tiles in parallel from a display list
+    fz_display_list* list = nullptr;
+
+    // top-down, tightly packed BGR
+    u8* pixels = nullptr;
+    Size size;
+    // the rendered area in the same (zoomed) coordinates as
+    // EngineBase::Transform() so that boxes can be mapped back to the page
+    RectF bmpRect;
+
+    ~ModelInput() {
+        free(pixels);
+        delete cached;
+    }
+};
+
+// Detection results are cached on disk, one file per document, so that
+// re-opening a document or re-running detection doesn't need the model.
+// The file name is a fingerprint of the document's content. The file starts
+// with a header line identifying the model (hash of best.pt) and render
+// parameters; when they don't match, cached results are ignored and the file
+// is re-written. It's followed by a record per page:
+//   i32 pageNo, i32 nSymbols, nSymbols * (u16 classIdx, u16 confidence * 65535,
+//   f32 x, f32 y, f32 dx, f32 dy)
+// all little-endian. A page can be present more than once, the last one wins.
+
+constexpr int kSymbolCacheRecordSize = 2 + 2 + 4 * 4;
+
+static Mutex gSymbolCacheMutex;
+// protected by gSymbolCacheMutex
+static AutoFreeStr gModelHash;
+static FILETIME gModelModTime{};
+static i64 gModelSize = -1;
+
+static TempStr GetSymbolCacheDirTemp() {
+    return GetPathInAppDataDirTemp("symbolcache");
+}
+
+// must be called with gSymbolCacheMutex held
+static const char* GetModelHash() {
+    TempStr modelPath = GetPathInExeDirTemp("best.pt");
+    i64 size = file::GetSize(modelPath);
+    FILETIME modTime = file::GetModificationTime(modelPath);
+    if (gModelHash && size == gModelSize && FileTimeEq(modTime, gModelModTime)) {
+        return gModelHash;
+    }
+    gModelHash.Reset();
+    ByteSlice d = file::ReadFile(modelPath);
+    if (d.empty()) {
+        return nullptr;
+    }
+    u8 digest[16]{};
+    CalcMD5Digest(d.data(), (int)d.size(), digest);
+    d.Free();
+    gModelHash.Set(str::MemToHex(digest, dimof(digest)));
+    gModelModTime = modTime;
+    gModelSize = size;
+    return gModelHash;
+}
+
+// must be called with gSymbolCacheMutex held
+static TempStr GetSymbolCacheHeaderTemp() {
+    const char* modelHash = GetModelHash();
+    if (!modelHash) {
+        return nullptr;
+    }
+    return str::FormatTemp("SumatraSymbolCache 1 %s %dx%d %d %d\n", modelHash, kSymbolModelDx, kSymbolModelDy,
+                           (int)kSymbolTileDpi, kSymbolTileOverlap);
+}
+
+static float ReadFloatLE(ByteReader& r, size_t off) {
+    u32 v = r.DWordLE(off);
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+static void WriteFloatLE(ByteWriter& w, float f) {
+    u32 v;
+    memcpy(&v, &f, sizeof(v));
+    w.Write32(v);
+}
+
+// returns false if there's no (valid) cache for this document
+static bool LoadSymbolCache(const char* cachePath, Vec<PageSymbols*>& pages) {
+    ScopedCritSec cs(&gSymbolCacheMutex.cs);
+    TempStr header = GetSymbolCacheHeaderTemp();
+    if (!header || !file::Exists(cachePath)) {
+        return false;
+    }
+    ByteSlice d = file::ReadFile(cachePath);
+    if (d.empty()) {
+        return false;
+    }
+    size_t headerLen = str::Len(header);
+    if (d.size() < headerLen || !memeq(d.data(), header, headerLen)) {
+        logf("LoadSymbolCache: '%s' is for a different model or render parameters\n", cachePath);
+        d.Free();
+        return false;
+    }
+    ByteReader r(d);
+    size_t off = headerLen;
+    while (off + 8 <= r.len) {
+        int pageNo = (int)r.DWordLE(off);
+        int n = (int)r.DWordLE(off + 4);
+        off += 8;
+        if (n < 0 || off + (size_t)n * kSymbolCacheRecordSize > r.len) {
+            // truncated write
+            break;
+        }
+        auto ps = new PageSymbols();
+        ps->pageNo = pageNo;
+        for (int i = 0; i < n; i++) {
+            DetectedSymbol sym;
+            sym.classIdx = (int)r.WordLE(off);
+            sym.confidence = (float)r.WordLE(off + 2) / 65535.f;
+            sym.rect.x = ReadFloatLE(r, off + 4);
+            sym.rect.y = ReadFloatLE(r, off + 8);
+            sym.rect.dx = ReadFloatLE(r, off + 12);
+            sym.rect.dy = ReadFloatLE(r, off + 16);
+            ps->symbols.Append(sym);
+            off += kSymbolCacheRecordSize;
+        }
+        // last one wins
+        for (int i = 0; i < pages.Size(); i++) {
+            if (pages[i]->pageNo == pageNo) {
+                delete pages.PopAt(i);
+                break;
+            }
+        }
+        pages.Append(ps);
+    }
+    d.Free();
+    return true;
+}
+
+// if isValid is false, the file is (re)created
+static void AppendToSymbolCache(const char* cachePath, bool& isValid, PageSymbols* ps) {
+    ScopedCritSec cs(&gSymbolCacheMutex.cs);
+    TempStr header = GetSymbolCacheHeaderTemp();
+    if (!header) {
+        return;
+    }
+    ByteWriterLE w;
+    if (!isValid) {
+        w.d.Append(header);
+    }
+    w.Write32((u32)ps->pageNo);
+    w.Write32((u32)ps->symbols.Size());
+    for (DetectedSymbol& sym : ps->symbols) {
+        w.Write16((u16)sym.classIdx);
+        w.Write16((u16)(limitValue(sym.confidence, 0.f, 1.f) * 65535.f));
+        WriteFloatLE(w, sym.rect.x);
+        WriteFloatLE(w, sym.rect.y);
+        WriteFloatLE(w, sym.rect.dx);
+        WriteFloatLE(w, sym.rect.dy);
+    }
+    if (!isValid) {
+        dir::CreateAll(GetSymbolCacheDirTemp());
+        isValid = file::WriteFile(cachePath, w.AsByteSlice());
+        return;
+    }
+    WCHAR* pathW = ToWStrTemp(cachePath);
+    AutoCloseHandle h = CreateFileW(pathW, FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (!h.IsValid()) {
+        return;
+    }
+    DWORD written = 0;
+    WriteFile(h, w.d.Get(), (DWORD)w.Size(), &written, nullptr);
+}
+
+static TempStr GetSymbolCachePathTemp(const char* filePath) {
+    TempStr fingerprint = GetFileFingerprintTemp(filePath);
+    if (!fingerprint) {
+        return nullptr;
+    }
+    return path::JoinTemp(GetSymbolCacheDirTemp(), str::JoinTemp(fingerprint, ".dat"));
+}
+
+struct DetectSymbolsJob {
+    EngineBase* engine = nullptr;
+    Vec<int> pages;
+    int batchSize = kSymbolBatchSize;
+    // called on the detection thread for each page, in order
+    // takes ownership of PageSymbols
+    Func1<PageSymbols*> onPageDone;
+    // checked between batches
+    AtomicBool canceled;
+    // if false, always run the model (for benchmarking)
+    bool useCache = true;
+
+    int nPagesDone = 0;
+    int nSymbols = 0;
+
+    // internal state of RunDetectSymbolsJob()
+    EngineMupdf* engineMupdf = nullptr;
+    // context of detection thread, only if engineMupdf
+    fz_context* ctx = nullptr;
+    int nextPageIdx = 0;
+    // inputs planned but not yet rendered
+    Vec<ModelInput*> planned;
+    AutoFreeStr cachePath;
+    bool isCacheValid = false;
+    Vec<PageSymbols*> cached;
+};
+
+// takes ownership of res
+static void PageSymbolsDone(DetectSymbolsJob* job, PageSymbols* res) {
+    job->nPagesDone++;
+    job->nSymbols += res->symbols.Size();
+    if (job->onPageDone.IsValid()) {
+        job->onPageDone.Call(res);
+    } else {
+        delete res;
+    }
+}
+
+// plans a placeholder for a page whose symbols are already in the cache
+static bool PlanCachedPage(DetectSymbolsJob* job, int pageNo) {
+    for (int i = 0; i < job->cached.Size(); i++) {
+        if (job->cached[i]->pageNo == pageNo) {
+            auto in = new ModelInput();
+            in->pageNo = pageNo;
+            in->skip = true;
+            in->isLastOfPage = true;
+            in->cached = job->cached.PopAt(i);
+            job->planned.Append(in);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void DeleteModelInputs(DetectSymbolsJob* job, Vec<ModelInput*>& inputs) {
+    for (ModelInput* in : inputs) {
+        if (in->list) {
+            fz_drop_display_list(job->ctx, in->list);
+        }
+        delete in;
+    }
+    inputs.Reset();
+}
+
+// converts a rendered bitmap to top-down, tightly packed BGR
+static u8* GetBitmapBGR(RenderedBitmap* bmp) {
+    Size size = bmp->GetSize();
+    int dx = size.dx;
+    int dy = size.dy;
+    int stride = ((dx * 3 + 3) / 4) * 4;
+    u8* data = AllocArray<u8>((size_t)stride * dy);
+    if (!data) {
+        return nullptr;
+    }
+
+    BITMAPINFO bmi{};
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = dx;
+    bmi.bmiHeader.biHeight = -dy;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 24;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    HDC hdc = GetDC(nullptr);
+    int res = GetDIBits(hdc, bmp->GetBitmap(), 0, dy, data, &bmi, DIB_RGB_COLORS);
+    ReleaseDC(nullptr, hdc);
+    if (res == 0) {
+        free(data);
+        return nullptr;
+    }
+    // remove row padding
+    int rowSize = dx * 3;
+    if (rowSize != stride) {
+        for (int y = 1; y < dy; y++) {
+            memmove(data + y * rowSize, data + y * stride, rowSize);
+        }
+    }
+    return data;
+}
+
+static void RenderModelInputWithEngine(EngineBase* engine, ModelInput* in) {
+    RenderPageArgs args(in->pageNo, in->zoom, 0, &in->pageRect, RenderTarget::Export);
+    RenderedBitmap* bmp = engine->RenderPage(args);
+    if (!bmp) {
+        return;
+    }
+    in->pixels = GetBitmapBGR(bmp);
+    in->size = bmp->GetSize();
+    in->bmpRect = engine->Transform(in->pageRect, in->pageNo, in->zoom, 0);
+    delete bmp;
+}
+
+static void RenderModelInputMupdf(fz_context* ctx, ModelInput* in) {
+    fz_pixmap* pix = nullptr;
+    fz_device* dev = nullptr;
+    fz_var(pix);
+    fz_var(dev);
+    fz_try(ctx) {
+        // for rotation 0 EngineMupdf::Transform() is just scaling by zoom
+        fz_matrix ctm = fz_scale(in->zoom, in->zoom);
+        RectF& r = in->pageRect;
+        fz_rect area = fz_transform_rect(fz_make_rect(r.x, r.y, r.x + r.dx, r.y + r.dy), ctm);
+        fz_irect ibounds = fz_round_rect(area);
+        pix = fz_new_pixmap_with_bbox(ctx, fz_device_rgb(ctx), ibounds, nullptr, 0);
+        fz_clear_pixmap_with_value(ctx, pix, 0xff);
+        dev = fz_new_draw_device(ctx, fz_identity, pix);
+        fz_run_display_list(ctx, in->list, dev, ctm, fz_rect_from_irect(ibounds), nullptr);
+        fz_close_device(ctx, dev);
+
+        int dx = pix->w;
+        int dy = pix->h;
+        u8* data = AllocArray<u8>((size_t)dx * dy * 3);
+        if (data) {
+            // RGB => BGR
+            for (int y = 0; y < dy; y++) {
+                const u8* s = pix->samples + (size_t)y * pix->stride;
+                u8* d = data + (size_t)y * dx * 3;
+                for (int x = 0; x < dx; x++) {
+                    d[0] = s[2];
+                    d[1] = s[1];
+                    d[2] = s[0];
+                    s += 3;
+                    d += 3;
+                }
+            }
+            in->pixels = data;
+            in->size = Size(dx, dy);
+            in->bmpRect = RectF((float)ibounds.x0, (float)ibounds.y0, (float)dx, (float)dy);
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_device(ctx, dev);
+        fz_drop_pixmap(ctx, pix);
+        fz_drop_display_list(ctx, in->list);
+        in->list = nullptr;
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+    }
+}
+
+struct RenderModelInputData {
+    EngineMupdf* engine;
+    ModelInput* in;
+};
+
+static void RenderModelInputThread(RenderModelInputData* d) {
+    fz_context* ctx = GetOrClonePerThreadContext(d->engine, d->engine->Ctx());
+    RenderModelInputMupdf(ctx, d->in);
+    ReleasePerThreadContext(d->engine);
+    DestroyTempAllocator();
+}
+
+// renders inputs of a batch. EngineMupdf inputs are rendered in parallel
+static void RenderBatch(DetectSymbolsJob* job, Vec<ModelInput*>& batch) {
+    if (!job->engineMupdf) {
+        for (ModelInput* in : batch) {
+            if (!in->skip) {
+                RenderModelInputWithEngine(job->engine, in);
+            }
+        }
+    } else {
+        Vec<HANDLE> threads;
+        Vec<RenderModelInputData> data;
+        data.SetSize(batch.Size());
+        for (int i = 0; i < batch.Size(); i++) {
+            ModelInput* in = batch[i];
+            if (in->skip) {
+                continue;
+            }
+            if (!in->list) {
+                // failed to create display list
+                RenderModelInputWithEngine(job->engine, in);
+                continue;
+            }
+            data[i] = {job->engineMupdf, in};
+            auto fn = MkFunc0<RenderModelInputData>(RenderModelInputThread, &data[i]);
+            HANDLE h = StartThread(fn, "RenderModelInputThread");
+            if (h) {
+                threads.Append(h);
+            } else {
+                RenderModelInputMupdf(job->ctx, in);
+            }
+        }
+        if (threads.Size() > 0) {
+            WaitForMultipleObjects((DWORD)threads.Size(), threads.LendData(), TRUE, INFINITE);
+        }
+        for (HANDLE h : threads) {
+            CloseHandle(h);
+        }
+    }
+    for (ModelInput* in : batch) {
+        if (!in->skip && !in->pixels) {
+            logf("RenderBatch: failed to render page %d\n", in->pageNo);
+            in->skip = true;
+            in->renderFailed = true;
+        }
+    }
+}
+
+// sets hasContent[i] to false for tiles that definitely have no content
+static void GetTilesWithContent(DetectSymbolsJob* job, int pageNo, fz_display_list* list, Vec<RectF>& tiles,
+                                Vec<bool>& hasContent) {
+    hasContent.SetSize(tiles.Size());
+    if (!list) {
+        RectF content = job->engine->PageContentBox(pageNo, RenderTarget::Export);
+        for (int i = 0; i < tiles.Size(); i++) {
+            hasContent[i] = !content.Intersect(tiles[i]).IsEmpty();
+        }
+        return;
+    }
+    fz_context* ctx = job->ctx;
+    for (int i = 0; i < tiles.Size(); i++) {
+        RectF& r = tiles[i];
+        fz_rect tile = fz_make_rect(r.x, r.y, r.x + r.dx, r.y + r.dy);
+        fz_rect bbox = fz_empty_rect;
+        fz_device* dev = nullptr;
+        fz_var(dev);
+        // on error, assume there's content
+        hasContent[i] = true;
+        fz_try(ctx) {
+            // the display list only runs nodes that intersect the tile
+            dev = fz_new_bbox_device(ctx, &bbox);
+            fz_run_display_list(ctx, list, dev, fz_identity, tile, nullptr);
+            fz_close_device(ctx, dev);
+            hasContent[i] = !fz_is_empty_rect(fz_intersect_rect(bbox, tile));
+        }
+        fz_always(ctx) {
+            fz_drop_device(ctx, dev);
+        }
+        fz_catch(ctx) {
+            fz_report_error(ctx);
+        }
+    }
+}
+
+// decides how to render the page: whole, scaled to fit the model's input,
+// or as tiles at kSymbolTileDpi
+static void PlanPage(DetectSymbolsJob* job, int pageNo) {
+    EngineBase* engine = job->engine;
+    RectF mediabox = engine->PageMediabox(pageNo);
+    fz_display_list* list = nullptr;
+    if (job->engineMupdf && !mediabox.IsEmpty()) {
+        list = job->engineMupdf->NewDisplayList(pageNo, RenderTarget::Export);
+    }
+
+    // takes page's intrinsic rotation into account
+    RectF pageSize = engine->Transform(mediabox, pageNo, 1.f, 0);
+    float zoomFit = 0;
+    if (!pageSize.IsEmpty()) {
+        zoomFit = std::min((float)kSymbolModelDx / pageSize.dx, (float)kSymbolModelDy / pageSize.dy);
+    }
+    float zoomTile = kSymbolTileDpi / engine->GetFileDPI();
+
+    Vec<RectF> tiles;
+    float zoom = zoomFit;
+    if (zoomFit >= zoomTile) {
+        tiles.Append(mediabox);
+    } else if (zoomFit > 0) {
+        zoom = zoomTile;
+        // tiles are calculated in pixels so that they're exactly model-sized
+        int pageDx = (int)ceilf(pageSize.dx * zoom);
+        int pageDy = (int)ceilf(pageSize.dy * zoom);
+        int tileDx = std::min(kSymbolModelDx, pageDx);
+        int tileDy = std::min(kSymbolModelDy, pageDy);
+        int stepX = tileDx - kSymbolTileOverlap;
+        int stepY = tileDy - kSymbolTileOverlap;
+        for (int y = 0;; y += stepY) {
+            y = std::min(y, pageDy - tileDy);
+            for (int x = 0;; x += stepX) {
+                x = std::min(x, pageDx - tileDx);
+                RectF r((float)x, (float)y, (float)tileDx, (float)tileDy);
+                tiles.Append(engine->Transform(r, pageNo, zoom, 0, true));
+                if (x + tileDx >= pageDx) {
+                    break;
+                }
+            }
+            if (y + tileDy >= pageDy) {
+                break;
+            }
+        }
+    }
+
+    Vec<bool> hasContent;
+    GetTilesWithContent(job, pageNo, list, tiles, hasContent);
+    int nPlanned = 0;
+    for (int i = 0; i < tiles.Size(); i++) {
+        if (!hasContent[i]) {
+            continue;
+        }
+        auto in = new ModelInput();
+        in->pageNo = pageNo;
+        in->pageRect = tiles[i];
+        in->zoom = zoom;
+        if (list) {
+            in->list = fz_keep_display_list(job->ctx, list);
+        }
+        job->planned.Append(in);
+        nPlanned++;
+    }
+    if (nPlanned == 0) {
+        // blank or broken page. still needs to be reported
+        auto in = new ModelInput();
+        in->pageNo = pageNo;
+        in->skip = true;
+        job->planned.Append(in);
+    }
+    job->planned.Last()->isLastOfPage = true;
+    if (list) {
+        fz_drop_display_list(job->ctx, list);
+    }
+    logf("PlanPage: page %d, %d tiles, %d with content\n", pageNo, tiles.Size(), nPlanned);
+}
+
+static void RenderNextBatch(DetectSymbolsJob* job, Vec<ModelInput*>& batch) {
+    while (batch.Size() < job->batchSize) {
+        if (job->planned.IsEmpty()) {
+            if (job->nextPageIdx >= job->pages.Size()) {
+                break;
+            }
+            int pageNo = job->pages[job->nextPageIdx++];
+            if (!PlanCachedPage(job, pageNo)) {
+                PlanPage(job, pageNo);
+            }
+            continue;
+        }
+        batch.Append(job->planned.PopAt(0));
+    }
+    RenderBatch(job, batch);
+}
+
+static bool SendBatchToDetector(SymbolDetector* det, Vec<ModelInput*>& batch) {
+    int n = 0;
+    for (ModelInput* in : batch) {
+        n += in->skip ? 0 : 1;
+    }
+    if (n == 0) {
+        return true;
+    }
+    // only started when needed, all pages might be cached
+    if (!EnsureSymbolDetector(det)) {
+        return false;
+    }
+    TempStr header = str::FormatTemp("batch %d\n", n);
+    if (!WriteAllToPipe(det->hWrite, header, str::Len(header))) {
+        return false;
+    }
+    for (ModelInput* in : batch) {
+        if (in->skip) {
+            continue;
+        }
+        header = str::FormatTemp("page %d %d %d\n", in->pageNo, in->size.dx, in->size.dy);
+        if (!WriteAllToPipe(det->hWrite, header, str::Len(header))) {
+            return false;
+        }
+        size_t nBytes = (size_t)in->size.dx * in->size.dy * 3;
+        if (!WriteAllToPipe(det->hWrite, in->pixels, nBytes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// reads results for an input sent with SendBatchToDetector() and appends
+// them to res. returns false if the detector died or got out of sync
+static bool ReadDetectorResults(SymbolDetector* det, EngineBase* engine, ModelInput* in, PageSymbols* res) {
+    RectF& bmpRect = in->bmpRect;
+    for (;;) {
+        const char* line = ReadLineFromDetector(det);
+        if (!line) {
+            return false;
+        }
+        int donePageNo = 0;
+        if (str::Parse(line, "done %d%$", &donePageNo)) {
+            return donePageNo == in->pageNo;
+        }
+        DetectedSymbol sym;
+        float x0, y0, x1, y1;
+        if (!str::Parse(line, "box %d %f %f %f %f %f%$", &sym.classIdx, &sym.confidence, &x0, &y0, &x1, &y1)) {
+            logf("detector: %s\n", line);
+            continue;
+        }
+        // from pixels of the rendered image back to page coordinates
+        RectF r = RectF::FromXY(bmpRect.x + x0, bmpRect.y + y0, bmpRect.x + x1, bmpRect.y + y1);
+        sym.rect = engine->Transform(r, in->pageNo, in->zoom, 0, true);
+        res->symbols.Append(sym);
+    }
+}
+
+static float RectArea(const RectF& r) {
+    return r.dx * r.dy;
+}
+
+// non-maximum suppression across tiles: overlapping tiles detect the same
+// symbol more than once and a symbol cut by a tile's edge produces a partial
+// box that is mostly contained in the full box from the neighboring tile
+void SuppressOverlappingSymbols(Vec<DetectedSymbol>& symbols) {
+    std::sort(symbols.begin(), symbols.end(),
+              [](const DetectedSymbol& a, const DetectedSymbol& b) { return a.confidence > b.confidence; });
+    Vec<DetectedSymbol> res;
+    for (DetectedSymbol& sym : symbols) {
+        bool suppressed = false;
+        for (DetectedSymbol& kept : res) {
+            if (kept.classIdx != sym.classIdx) {
+                continue;
+            }
+            float inter = RectArea(kept.rect.Intersect(sym.rect));
+            if (inter <= 0) {
+                continue;
+            }
+            float a1 = RectArea(kept.rect);
+            float a2 = RectArea(sym.rect);
+            float iou = inter / (a1 + a2 - inter);
+            float ios = inter / std::min(a1, a2);
+            if (iou > 0.5f || ios > 0.8f) {
+                suppressed = true;
+                break;
+            }
+        }
+        if (!suppressed) {
+            res.Append(sym);
+        }
+    }
+    symbols = res;
+}
+
+// Inputs are processed in batches. While the detector runs inference on one
+// batch we render the next one so that rendering time is (mostly) hidden.
+// returns false if the detector couldn't be started or died
+static bool RunDetectSymbolsJob(SymbolDetector* det, DetectSymbolsJob* job) {
+    if (job->useCache) {
+        job->cachePath.SetCopy(GetSymbolCachePathTemp(job->engine->FilePath()));
+    }
+    if (job->cachePath) {
+        job->isCacheValid = LoadSymbolCache(job->cachePath, job->cached);
+    }
+    job->engineMupdf = AsEngineMupdf(job->engine);
+    if (job->engineMupdf) {
+        job->ctx = GetOrClonePerThreadContext(job->engineMupdf, job->engineMupdf->Ctx());
+    }
+    auto timeStart = TimeGet();
+    bool ok = true;
+    Vec<ModelInput*> batch;
+    Vec<ModelInput*> nextBatch;
+    // results of the page whose tiles we're currently reading
+    PageSymbols* curr = nullptr;
+    // if a part of curr failed to render, its results are incomplete
+    bool currRenderFailed = false;
+    RenderNextBatch(job, batch);
+    while (!batch.IsEmpty()) {
+        if (!SendBatchToDetector(det, batch)) {
+            ok = false;
+            break;
+        }
+        if (!job->canceled.Get()) {
+            RenderNextBatch(job, nextBatch);
+        }
+        // we always read all results of a batch we've sent so that
+        // the detector is ready for the next job
+        for (ModelInput* in : batch) {
+            if (in->cached) {
+                PageSymbolsDone(job, in->cached);
+                in->cached = nullptr;
+                continue;
+            }
+            if (!curr) {
+                curr = new PageSymbols();
+                curr->pageNo = in->pageNo;
+            }
+            if (!in->skip && !ReadDetectorResults(det, job->engine, in, curr)) {
+                ok = false;
+                break;
+            }
+            currRenderFailed |= in->renderFailed;
+            if (!in->isLastOfPage) {
+                continue;
+            }
+            SuppressOverlappingSymbols(curr->symbols);
+            // only cache complete results so that the page is detected again next time
+            if (job->cachePath && !currRenderFailed) {
+                AppendToSymbolCache(job->cachePath, job->isCacheValid, curr);
+            }
+            PageSymbolsDone(job, curr);
+            curr = nullptr;
+            currRenderFailed = false;
+        }
+        DeleteModelInputs(job, batch);
+        if (!ok || job->canceled.Get()) {
+            break;
+        }
+        batch = nextBatch;
+        nextBatch.Reset();
+    }
+    delete curr;
+    DeleteModelInputs(job, batch);
+    DeleteModelInputs(job, nextBatch);
+    DeleteModelInputs(job, job->planned);
+    DeleteVecMembers(job->cached);
+    if (job->engineMupdf) {
+        ReleasePerThreadContext(job->engineMupdf);
+        job->ctx = nullptr;
+    }
+    if (!ok) {
+        // don't know what state it's in, start a new one next time
+        StopSymbolDetector(det);
+    }
+    double dur = TimeSinceInMs(timeStart);
+    logf("RunDetectSymbolsJob: %d pages, %d symbols, batch size %d in %.2f ms (%.2f pages/sec)\n", job->nPagesDone,
+         job->nSymbols, job->batchSize, dur, dur > 0 ? (double)job->nPagesDone * 1000.0 / dur : 0.0);
+    return ok;
+}
+
+bool BenchSymbolDetection(EngineBase* engine, int startPage, int endPage) {
+    auto timeStart = TimeGet();
+    if (!EnsureSymbolDetector(&gSymbolDetector)) {
+        logf("Error: failed to start symbol detector\n");
+        return false;
+    }
+    logf("detect: detector startup %.2f ms\n", TimeSinceInMs(timeStart));
+    int batchSizes[2] = {1, kSymbolBatchSize};
+    bool ok = true;
+    for (int batchSize : batchSizes) {
+        DetectSymbolsJob job;
+        job.engine = engine;
+        job.batchSize = batchSize;
+        job.useCache = false;
+        for (int pageNo = startPage; pageNo <= endPage; pageNo++) {
+            job.pages.Append(pageNo);
+        }
+        auto t = TimeGet();
+        ok &= RunDetectSymbolsJob(&gSymbolDetector, &job);
+        double timeMs = TimeSinceInMs(t);
+        logf("detect (batch: %d) pages %d-%d: %.2f ms, %.2f pages/sec, %d symbols\n", batchSize, startPage, endPage,
+             timeMs, timeMs > 0 ? job.nPagesDone * 1000.0 / timeMs : 0.0, job.nSymbols);
+    }
+    StopSymbolDetector(&gSymbolDetector);
+    return ok;
+}
+
+// --- UI
+
+static Kind kNotifDetectSymbols = "detectSymbols";
+
+struct DetectSymbolsData {
+    MainWindow* win = nullptr;
+    WindowTab* tab = nullptr;
+    DetectSymbolsJob job;
+    bool showProgress = false;
+    bool ok = false;
+};
+
+struct PageSymbolsReadyData {
+    DetectSymbolsData* d;
+    PageSymbols* res;
+    int nPagesDone;
+};
+
+// the tab might have been closed or the document reloaded while we were working
+static bool IsDetectionTargetValid(MainWindow* win, WindowTab* tab, EngineBase* engine) {
+    if (!IsMainWindowValid(win) || FindMainWindowByTab(tab) != win) {
+        return false;
+    }
+    DisplayModel* dm = tab->AsFixed();
+    return dm && dm->GetEngine() == engine;
+}
+
+static void SetPageSymbols(WindowTab* tab, PageSymbols* res) {
+    for (int i = 0; i < tab->detectedSymbols.Size(); i++) {
+        PageSymbols* ps = tab->detectedSymbols[i];
+        if (ps->pageNo == res->pageNo) {
+            delete ps;
+            tab->detectedSymbols[i] = res;
+            return;
+        }
+    }
+    tab->detectedSymbols.Append(res);
+}
+
+static void PageSymbolsReady(PageSymbolsReadyData* data) {
+    AutoDelete delData(data);
+
+    auto d = data->d;
+    if (!IsDetectionTargetValid(d->win, d->tab, d->job.engine)) {
+        d->job.canceled.Set(true);
+        delete data->res;
+        return;
+    }
+    int pageNo = data->res->pageNo;
+    SetPageSymbols(d->tab, data->res);
+    if (d->tab == d->win->CurrentTab() && d->tab->AsFixed()->PageVisible(pageNo)) {
+        ScheduleRepaint(d->win, 0);
+    }
+    if (!d->showProgress || d->job.canceled.Get()) {
+        return;
+    }
+    auto wnd = GetNotificationForGroup(d->win->hwndCanvas, kNotifDetectSymbols);
+    if (!wnd) {
+        d->job.canceled.Set(true);
+        return;
+    }
+    int current = data->nPagesDone;
+    int total = d->job.pages.Size();
+    TempStr msg = str::FormatTemp(_TRA("Detecting symbols: page %d of %d..."), current, total);
+    if (!UpdateNotificationProgress(wnd, msg, CalcPerc(current, total))) {
+        // canceled by closing the notification
+        d->job.canceled.Set(true);
+    }
+}
+
+// called on detection thread
+static void OnPageSymbolsDone(DetectSymbolsData* d, PageSymbols* res) {
+    auto data = new PageSymbolsReadyData{d, res, d->job.nPagesDone};
+    auto fn = MkFunc0<PageSymbolsReadyData>(PageSymbolsReady, data);
+    uitask::Post(fn, nullptr);
+}
+
+static void DetectSymbolsFinished(DetectSymbolsData* d) {
+    AutoDelete delData(d);
+
+    gIsDetectingSymbols = false;
+    SafeEngineRelease(&d->job.engine);
+    MainWindow* win = d->win;
+    if (!IsMainWindowValid(win)) {
+        return;
+    }
+    RemoveNotificationsForGroup(win->hwndCanvas, kNotifDetectSymbols);
+    if (FindMainWindowByTab(d->tab) != win) {
+        return;
+    }
+    if (!d->ok) {
+        ShowTemporaryNotification(win->hwndCanvas, _TRA("Symbol detection failed"));
+        return;
+    }
+    if (d->job.canceled.Get()) {
+        // the totals are partial (and the user closed the progress notification
+        // or the document has changed)
+        return;
+    }
+    TempStr msg;
+    if (d->job.pages.Size() == 1) {
+        msg = str::FormatTemp(_TRA("Found %d symbols on page %d"), d->job.nSymbols, d->job.pages[0]);
+    } else {
+        msg = str::FormatTemp(_TRA("Found %d symbols on %d pages"), d->job.nSymbols, d->job.nPagesDone);
+    }
+    ShowTemporaryNotification(win->hwndCanvas, msg);
+}
+
+static void DetectSymbolsThread(DetectSymbolsData* d) {
+    d->ok = RunDetectSymbolsJob(&gSymbolDetector, &d->job);
+    auto fn = MkFunc0<DetectSymbolsData>(DetectSymbolsFinished, d);
+    uitask::Post(fn, "DetectSymbolsFinished");
+    DestroyTempAllocator();
+}
+
+static void StartDetectSymbols(MainWindow* win, int startPage, int endPage) {
+    WindowTab* tab = win->CurrentTab();
+    DisplayModel* dm = tab ? tab->AsFixed() : nullptr;
+    if (!dm) {
+        return;
+    }
+    if (gIsDetectingSymbols) {
+        ShowTemporaryNotification(win->hwndCanvas, _TRA("Symbol detection is already running"));
+        return;
+    }
+    gIsDetectingSymbols = true;
+    EngineBase* engine = dm->GetEngine();
+
+    auto d = new DetectSymbolsData();
+    d->win = win;
+    d->tab = tab;
+    engine->AddRef();
+    d->job.engine = engine;
+    for (int pageNo = startPage; pageNo <= endPage; pageNo++) {
+        d->job.pages.Append(pageNo);
+    }
+    d->job.onPageDone = MkFunc1<DetectSymbolsData, PageSymbols*>(OnPageSymbolsDone, d);
+    d->showProgress = startPage != endPage;
+
+    NotificationCreateArgs nargs;
+    nargs.hwndParent = win->hwndCanvas;
+    nargs.timeoutMs = 0;
+    nargs.groupId = kNotifDetectSymbols;
+    nargs.onRemoved = MkFunc1Void(RemoveNotification);
+    if (!d->showProgress) {
+        nargs.msg = str::FormatTemp(_TRA("Detecting symbols on page %d..."), startPage);
+    }
+    ShowNotification(nargs);
+
+    auto fn = MkFunc0(DetectSymbolsThread, d);
+    RunAsync(fn, "DetectSymbolsThread");
+}
+
+struct LoadCachedSymbolsData {
+    MainWindow* win = nullptr;
+    WindowTab* tab = nullptr;
+    EngineBase* engine = nullptr;
+    Vec<PageSymbols*> pages;
+};
+
+static void LoadCachedSymbolsFinished(LoadCachedSymbolsData* d) {
+    AutoDelete delData(d);
+
+    if (IsDetectionTargetValid(d->win, d->tab, d->engine)) {
+        for (PageSymbols* ps : d->pages) {
+            SetPageSymbols(d->tab, ps);
+        }
+        d->pages.Reset();
+        if (d->tab == d->win->CurrentTab()) {
+            ScheduleRepaint(d->win, 0);
+        }
+    }
+    DeleteVecMembers(d->pages);
+    SafeEngineRelease(&d->engine);
+}
+
+static void LoadCachedSymbolsThread(LoadCachedSymbolsData* d) {
+    TempStr cachePath = GetSymbolCachePathTemp(d->engine->FilePath());
+    if (cachePath) {
+        LoadSymbolCache(cachePath, d->pages);
+    }
+    auto fn = MkFunc0<LoadCachedSymbolsData>(LoadCachedSymbolsFinished, d);
+    uitask::Post(fn, "LoadCachedSymbolsFinished");
+    DestroyTempAllocator();
+}
+
+// called when a document is (re)loaded into a tab
+void LoadCachedSymbolDetections(WindowTab* tab) {
+    DeleteSymbolDetections(tab);
+    DisplayModel* dm = tab->AsFixed();
+    if (!dm || !tab->win) {
+        return;
+    }
+    // symbol detection is not used
+    if (!file::Exists(GetPathInExeDirTemp("best.pt"))) {
+        return;
+    }
+    auto d = new LoadCachedSymbolsData();
+    d->win = tab->win;
+    d->tab = tab;
+    d->engine = dm->GetEngine();
+    d->engine->AddRef();
+    auto fn = MkFunc0(LoadCachedSymbolsThread, d);
+    RunAsync(fn, "LoadCachedSymbolsThread");
+}
+
+void DetectSymbolsOnCurrentPage(MainWindow* win) {
+    DisplayModel* dm = win->AsFixed();
+    if (!dm) {
+        return;
+    }
+    int pageNo = dm->CurrentPageNo();
+    StartDetectSymbols(win, pageNo, pageNo);
+}
+
+void DetectSymbolsInDocument(MainWindow* win) {
+    DisplayModel* dm = win->AsFixed();
+    if (!dm) {
+        return;
+    }
+    StartDetectSymbols(win, 1, dm->PageCount());
+}
+
+void PaintSymbolDetections(WindowTab* tab, HDC hdc, DisplayModel* dm) {
+    if (!tab || tab->detectedSymbols.IsEmpty()) {
+        return;
+    }
+    COLORREF col = RGB(0xff, 0xcc, 0x00);
+    AutoDeletePen pen(CreatePen(PS_SOLID, 2, col));
+    ScopedSelectObject selPen(hdc, pen);
+    ScopedSelectObject selBrush(hdc, GetStockObject(NULL_BRUSH));
+    ScopedSelectFont selFont(hdc, GetDefaultGuiFont());
+    int prevBkMode = SetBkMode(hdc, TRANSPARENT);
+    COLORREF prevTextCol = SetTextColor(hdc, RGB(0xcc, 0x66, 0x00));
+
+    for (PageSymbols* ps : tab->detectedSymbols) {
+        if (!dm->PageVisible(ps->pageNo)) {
+            // CvtToScreen() might not work if page is not visible
+            continue;
+        }
+        for (DetectedSymbol& sym : ps->symbols) {
+            Rect r = dm->CvtToScreen(ps->pageNo, sym.rect);
+            Rectangle(hdc, r.x, r.y, r.x + r.dx, r.y + r.dy);
+            TempWStr label = ToWStrTemp(SymbolClassName(sym.classIdx));
+            TextOutW(hdc, r.x, r.y - GetSizeOfDefaultGuiFont() - 4, label, (int)str::Len(label));
+        }
+    }
+
+    SetTextColor(hdc, prevTextCol);
+    SetBkMode(hdc, prevBkMode);
+}
+
+void DeleteSymbolDetections(WindowTab* tab) {
+    DeleteVecMembers(tab->detectedSymbols);
+}
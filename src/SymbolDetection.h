@@ -0,0 +1,43 @@
+/* Copyright 2024 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+struct MainWindow;
+struct WindowTab;
+struct DisplayModel;
+class EngineBase;
+
+// size of the image the detection model (src/ml_model/best.pt) was trained on
+// pages are rendered to fit this size, there's no additional resampling
+constexpr int kSymbolModelDx = 2560;
+constexpr int kSymbolModelDy = 1728;
+// number of pages sent to the model at once when detecting in many pages
+constexpr int kSymbolBatchSize = 4;
+// pages that don't fit the model's input at this resolution are detected in tiles
+constexpr float kSymbolTileDpi = 150.f;
+// in pixels. should be bigger than the biggest symbol
+constexpr int kSymbolTileOverlap = 256;
+
+struct DetectedSymbol {
+    // index into the model's class table, see SymbolClassName()
+    int classIdx = -1;
+    float confidence = 0.f;
+    // in page (user) coordinates
+    RectF rect;
+};
+
+// symbols detected on a single page
+struct PageSymbols {
+    int pageNo = 0;
+    Vec<DetectedSymbol> symbols;
+};
+
+const char* SymbolClassName(int classIdx);
+void SuppressOverlappingSymbols(Vec<DetectedSymbol>& symbols);
+
+void DetectSymbolsOnCurrentPage(MainWindow* win);
+void DetectSymbolsInDocument(MainWindow* win);
+void PaintSymbolDetections(WindowTab* tab, HDC hdc, DisplayModel* dm);
+void DeleteSymbolDetections(WindowTab* tab);
+void LoadCachedSymbolDetections(WindowTab* tab);
+
+bool BenchSymbolDetection(EngineBase* engine, int startPage, int endPage);
@@ -3,6 +3,7 @@
 
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
+#include "utils/PatternMatcher.h"
 #include "utils/WinUtil.h"
 
 #include "wingui/UIModels.h"
@@ -14,6 +15,8 @@
 #include "TextSelection.h"
 #include "TextSearch.h"
 
+#include "utils/Log.h"
+
 #define SkipWhitespace(c) for (; str::IsWs(*(c)); (c)++)
 // ignore spaces between CJK glyphs but not between Latin, Greek, Cyrillic, etc. letters
 // cf. http://code.google.com/p/sumatrapdf/issues/detail?id=959
@@ -38,6 +41,13 @@ void TextSearch::Clear() {
     str::FreePtr(&findText);
     str::FreePtr(&anchor);
     str::FreePtr(&lastText);
+    str::FreePtr(&pattern);
+    delete matcher;
+    matcher = nullptr;
+    termHits.Reset();
+    pageHits.Reset();
+    hitsPage = 0;
+    lastHitLen = 0;
     Reset();
 }
 
@@ -60,8 +70,15 @@ void TextSearch::SetText(const WCHAR* text) {
     // and search text ending in a single space enables the 'Match word end' option
     // (that behavior already "kind of" exists without special treatment, but
     // usually is not quite what a user expects, so let's try to be cleverer)
-    this->matchWordStart = text[0] == ' ' && text[1] != ' ';
-    this->matchWordEnd = str::EndsWith(text, L" ") && !str::EndsWith(text, L"  ");
+    bool wordStart = text[0] == ' ' && text[1] != ' ';
+    bool wordEnd = str::EndsWith(text, L" ") && !str::EndsWith(text, L"  ");
+    if (wordStart != matchWordStart || wordEnd != matchWordEnd) {
+        // hits and skipped pages were found under the old rules
+        hitsPage = 0;
+        markAllPagesNonSkip(pagesToSkip);
+    }
+    this->matchWordStart = wordStart;
+    this->matchWordEnd = wordEnd;
 
     if (text[0] == ' ') {
         text++;
@@ -100,6 +117,19 @@ void TextSearch::SetText(const WCHAR* text) {
         this->findText[str::Len(this->findText) - 1] = '\0';
     }
 
+    // pattern searches must be asked for explicitly so that plain searches
+    // for text containing '|' or '/' keep working
+    if (str::StartsWith(this->findText, kRegexSearchPrefix)) {
+        this->pattern = str::Dup(this->findText + str::Len(kRegexSearchPrefix));
+        this->isRegex = true;
+    } else if (str::StartsWith(this->findText, kTermsSearchPrefix)) {
+        this->pattern = str::Dup(this->findText + str::Len(kTermsSearchPrefix));
+        this->isRegex = false;
+    }
+    if (this->pattern) {
+        str::FreePtr(&anchor);
+    }
+
     markAllPagesNonSkip(pagesToSkip);
 }
 
@@ -109,6 +139,12 @@ void TextSearch::SetSensitive(bool sensitive) {
     }
     this->caseSensitive = sensitive;
 
+    // the matcher depends on the case sensitivity
+    delete matcher;
+    matcher = nullptr;
+    termHits.Reset();
+    hitsPage = 0;
+
     markAllPagesNonSkip(pagesToSkip);
 }
 
@@ -118,7 +154,9 @@ void TextSearch::SetDirection(TextSearch::Direction direction) {
         return;
     }
     forward = fwd;
-    if (findText) {
+    if (pattern) {
+        findIndex += fwd ? lastHitLen : -lastHitLen;
+    } else if (findText) {
         int n = (int)str::Len(findText);
         if (fwd) {
             findIndex += n;
@@ -264,6 +302,9 @@ bool TextSearch::FindTextInPage(int pageNo, TextSearch::PageAndOffset* finalGlyp
     // get here with pageNo != 0 the findText has already been set so I didn't add
     // a findText = textCache->GetData(findPage) here.
     findPage = pageNo;
+    if (pattern) {
+        return FindPatternInPage(pageNo, finalGlyph);
+    }
 
     const WCHAR* found;
     PageAndOffset fg;
@@ -304,6 +345,232 @@ bool TextSearch::FindTextInPage(int pageNo, TextSearch::PageAndOffset* finalGlyp
     return true;
 }
 
+// normalizes text for pattern matching the way MatchEnd() tolerates differences:
+// dashes and typographic quotes become '-', '\'' and '"' and letters are lower-cased
+// unless caseSensitive is set. for term lists (but not regular expressions, where
+// \s, \t etc. must see the actual whitespace) runs of whitespace become a single
+// space and whitespace after non-word characters is dropped (except between two '?').
+// offsets receives the offset in text of every character of res
+static void NormalizeForPattern(const WCHAR* text, bool caseSensitive, bool isRegex, str::WStr& res,
+                                Vec<int>& offsets) {
+    res.Reset();
+    offsets.Reset();
+    for (const WCHAR* s = text; *s; s++) {
+        WCHAR c = *s;
+        if (!isRegex && str::IsWs(c)) {
+            WCHAR prev = res.isize() > 0 ? res.LastChar() : ' ';
+            if (prev == ' ') {
+                continue;
+            }
+            if (!isnoncjkwordchar(prev)) {
+                const WCHAR* next = s;
+                SkipWhitespace(next);
+                if (prev != '?' || *next != '?') {
+                    continue;
+                }
+            }
+            c = ' ';
+        } else if (0x2010 <= c && c <= 0x2014) {
+            c = '-';
+        } else if (0x2018 <= c && c <= 0x201b) {
+            c = '\'';
+        } else if (0x201c <= c && c <= 0x201f) {
+            c = '"';
+        } else if (!caseSensitive) {
+            c = CharToLower(c);
+        }
+        res.AppendChar(c);
+        offsets.Append((int)(s - text));
+    }
+}
+
+bool TextSearch::IsPatternSearch() const {
+    return pattern != nullptr;
+}
+
+// returns false for invalid regular expressions and empty term lists
+bool TextSearch::EnsureMatcher() {
+    if (matcher || !pattern) {
+        return matcher != nullptr;
+    }
+    if (isRegex) {
+        matcher = NewRegexMatcher(pattern, !caseSensitive);
+        if (!matcher) {
+            logf("TextSearch::EnsureMatcher: invalid regular expression '%s'\n", ToUtf8Temp(pattern));
+        }
+        return matcher != nullptr;
+    }
+
+    // terms are normalized just like the text they're matched against
+    Vec<WCHAR*> terms;
+    str::WStr part;
+    str::WStr term;
+    Vec<int> offsets;
+    const WCHAR* s = pattern;
+    while (*s) {
+        // terms are separated by '|', "\|" and "\\" are a literal '|' and '\'
+        part.Reset();
+        for (; *s && *s != '|'; s++) {
+            if (*s == '\\' && (s[1] == '|' || s[1] == '\\')) {
+                s++;
+            }
+            part.AppendChar(*s);
+        }
+        NormalizeForPattern(part.Get(), caseSensitive, false, term, offsets);
+        if (term.isize() > 0 && term.LastChar() == ' ') {
+            term.RemoveLast();
+        }
+        const WCHAR* t = term.Get();
+        if (*t == ' ') {
+            t++;
+        }
+        if (*t) {
+            terms.Append(str::Dup(t));
+        }
+        if (*s) {
+            s++;
+        }
+    }
+    matcher = NewTermsMatcher((const WCHAR**)terms.LendData(), terms.Size());
+    terms.FreeMembers();
+    return matcher != nullptr;
+}
+
+// appends the start and end offsets of all hits in text to hits
+// and, if counts is given, counts them per term
+void TextSearch::FindPatternHits(const WCHAR* text, Vec<int>& hits, Vec<int>* counts) {
+    if (!text || !EnsureMatcher()) {
+        return;
+    }
+    NormalizeForPattern(text, caseSensitive, isRegex, normText, normOffsets);
+    Vec<PatternMatch> matches;
+    matcher->FindAll(normText.Get(), normText.isize(), matches);
+    for (PatternMatch& m : matches) {
+        int start = normOffsets[m.start];
+        int end = normOffsets[m.end - 1] + 1;
+        if (matchWordStart && start > 0 && isWordChar(text[start - 1]) && isWordChar(text[start])) {
+            continue;
+        }
+        if (matchWordEnd && isWordChar(text[end - 1]) && isWordChar(text[end])) {
+            continue;
+        }
+        hits.Append(start);
+        hits.Append(end);
+        if (counts) {
+            counts->at(m.term)++;
+        }
+    }
+}
+
+bool TextSearch::FindPatternInPage(int pageNo, PageAndOffset* finalGlyph) {
+    if (hitsPage != pageNo) {
+        pageHits.Reset();
+        FindPatternHits(pageText, pageHits, nullptr);
+        hitsPage = pageNo;
+    }
+    int n = pageHits.Size() / 2;
+    for (int i = 0; i < n; i++) {
+        int idx = forward ? i : n - 1 - i;
+        int start = pageHits[2 * idx];
+        int end = pageHits[2 * idx + 1];
+        if (forward ? start < findIndex : start >= findIndex) {
+            continue;
+        }
+        StartAt(pageNo, start);
+        SelectUpTo(pageNo, end);
+        // skip hits that are completely outside the page's mediabox
+        if (result.len == 0) {
+            continue;
+        }
+        searchHitStartAt = pageNo;
+        findIndex = forward ? end : start;
+        lastHitLen = end - start;
+        if (finalGlyph) {
+            *finalGlyph = {pageNo, end};
+        }
+        return true;
+    }
+    return false;
+}
+
+// counts the hits of all terms in a single pass over the document and marks
+// the pages without hits so that going from hit to hit skips them.
+// returns the total number of hits (0 if canceled)
+int TextSearch::CountPatternHits() {
+    termHits.Reset();
+    hitsPage = 0;
+    if (!EnsureMatcher()) {
+        return 0;
+    }
+    termHits.AppendBlanks(matcher->TermCount());
+    Vec<int> hits;
+    int total = 0;
+    int pageNo;
+    for (pageNo = 1; pageNo <= nPages && !WasCanceled(progressCb); pageNo++) {
+        UpdateProgress(progressCb, pageNo, nPages);
+        hits.Reset();
+        if (textCache->HasTextForPage(pageNo)) {
+            FindPatternHits(textCache->GetTextForPage(pageNo), hits, &termHits);
+        } else {
+            // the text cache keeps a rect per character until the document is
+            // closed, so only pages with hits end up there (in FindPatternInPage)
+            PageText pageText = engine->ExtractPageText(pageNo);
+            FindPatternHits(pageText.text, hits, &termHits);
+            FreePageText(&pageText);
+        }
+        pagesToSkip[pageNo - 1] = hits.size() == 0;
+        total += hits.Size() / 2;
+    }
+    if (pageNo <= nPages) {
+        // partial counts would look like final ones
+        termHits.Reset();
+        return 0;
+    }
+    return total;
+}
+
+// e.g. "foo: 3, bar: 1" or nullptr if the hits haven't been counted
+TempStr TextSearch::FormatTermHitsTemp() const {
+    if (!matcher || termHits.Size() != matcher->TermCount()) {
+        return nullptr;
+    }
+    str::Str s;
+    for (int i = 0; i < termHits.Size(); i++) {
+        if (i > 0) {
+            s.Append(", ");
+        }
+        s.AppendFmt("%s: %d", ToUtf8Temp(matcher->Term(i)), termHits[i]);
+    }
+    return str::DupTemp(s.Get());
+}
+
+// mupdf reorders right-to-left text in the full text but not in the index text
+static bool HasRtlChars(const WCHAR* s) {
+    for (; *s; s++) {
+        if ((0x0590 <= *s && *s <= 0x08FF) || (0xFB1D <= *s && *s <= 0xFDFF) || (0xFE70 <= *s && *s <= 0xFEFF)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// extracting the full text (with exact glyph positions) is relatively expensive,
+// so for pages where we don't have it yet, first check the cheaper index text
+// for the anchor (which never contains whitespace)
+bool TextSearch::PageMightMatch(int pageNo) {
+    if (!anchor || textCache->HasTextForPage(pageNo) || HasRtlChars(anchor)) {
+        return true;
+    }
+    if (!engine->PageMightContainText(pageNo, anchor, caseSensitive)) {
+        return false;
+    }
+    const WCHAR* indexText = textCache->GetIndexTextForPage(pageNo);
+    if (caseSensitive) {
+        return StrStr(indexText, anchor) != nullptr;
+    }
+    return StrStrI(indexText, anchor) != nullptr;
+}
+
 bool TextSearch::FindStartingAtPage(int pageNo) {
     if (str::IsEmpty(findText)) {
         return false;
@@ -317,6 +584,11 @@ bool TextSearch::FindStartingAtPage(int pageNo) {
             pageNo += next;
             continue;
         }
+        if (!PageMightMatch(pageNo)) {
+            pagesToSkip[pageNo - 1] = true;
+            pageNo += next;
+            continue;
+        }
 
         Reset();
 
@@ -1,6 +1,13 @@
 /* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
    License: GPLv3 */
 
+struct PatternMatcher;
+
+// search text starting with these is a regular expression resp. a list of terms
+// separated by '|' instead of plain text (see TextSearch::pattern)
+constexpr const WCHAR* kRegexSearchPrefix = L"regex:";
+constexpr const WCHAR* kTermsSearchPrefix = L"terms:";
+
 struct TextSearch : public TextSelection {
     enum class Direction : bool { Backward = false, Forward = true };
 
@@ -36,8 +43,33 @@ struct TextSearch : public TextSelection {
     bool matchWordStart = false;
     bool matchWordEnd = false;
 
+    // set when the search text is a list of terms separated by '|' ("\|" for
+    // a literal '|') or a regular expression (see PatternMatcher.h), as marked by
+    // kTermsSearchPrefix resp. kRegexSearchPrefix. all terms are matched in a
+    // single pass over a page's text. unlike findText, such hits never span pages
+    WCHAR* pattern = nullptr;
+    bool isRegex = false;
+    PatternMatcher* matcher = nullptr;
+    // number of hits per term, set by CountPatternHits()
+    Vec<int> termHits;
+    // start and end offsets of the hits on page hitsPage
+    Vec<int> pageHits;
+    int hitsPage = 0;
+    int lastHitLen = 0;
+    // buffers for FindPatternHits()
+    str::WStr normText;
+    Vec<int> normOffsets;
+
+    bool IsPatternSearch() const;
+    int CountPatternHits();
+    TempStr FormatTermHitsTemp() const;
+    bool EnsureMatcher();
+    void FindPatternHits(const WCHAR* text, Vec<int>& hits, Vec<int>* counts);
+    bool FindPatternInPage(int pageNo, PageAndOffset* finalGlyph);
+
     void SetText(const WCHAR* text);
     bool FindTextInPage(int pageNo, PageAndOffset* finalGlyph);
+    bool PageMightMatch(int pageNo);
     bool FindStartingAtPage(int pageNo);
     PageAndOffset MatchEnd(const WCHAR* start) const;
 
@@ -22,7 +22,8 @@ bool isWordChar(WCHAR c) {
 DocumentTextCache::DocumentTextCache(EngineBase* engine) : engine(engine) {
     nPages = engine->PageCount();
     pagesText = AllocArray<PageText>(nPages);
-    debugSize = nPages * (sizeof(Rect*) + sizeof(WCHAR*) + sizeof(int));
+    pagesIndexText = AllocArray<WCHAR*>(nPages);
+    debugSize = nPages * (sizeof(Rect*) + sizeof(WCHAR*) * 2 + sizeof(int));
 
     InitializeCriticalSection(&access);
 }
@@ -35,8 +36,10 @@ DocumentTextCache::~DocumentTextCache() {
         PageText* pageText = &pagesText[i];
         free(pageText->coords);
         free(pageText->text);
+        free(pagesIndexText[i]);
     }
     free(pagesText);
+    free(pagesIndexText);
     LeaveCriticalSection(&access);
     DeleteCriticalSection(&access);
 }
@@ -71,6 +74,86 @@ const WCHAR* DocumentTextCache::GetTextForPage(int pageNo, int* lenOut, Rect** c
     return pageText->text;
 }
 
+// text from EngineBase::ExtractPageTextForIndex() with all whitespace removed.
+// it's cheaper to extract than the full text and good enough for ruling out
+// pages that can't contain a search term
+const WCHAR* DocumentTextCache::GetIndexTextForPage(int pageNo) {
+    ReportIf(pageNo < 1 || pageNo > nPages);
+
+    ScopedCritSec scope(&access);
+    WCHAR*& indexText = pagesIndexText[pageNo - 1];
+
+    if (!indexText) {
+        PageText pageText = engine->ExtractPageTextForIndex(pageNo);
+        str::WStr s(pageText.len);
+        for (int i = 0; i < pageText.len; i++) {
+            if (!str::IsWs(pageText.text[i])) {
+                s.AppendChar(pageText.text[i]);
+            }
+        }
+        FreePageText(&pageText);
+        indexText = s.StealData();
+        debugSize += ((int)str::Len(indexText) + 1) * (int)sizeof(WCHAR);
+    }
+    return indexText;
+}
+
+struct SharedTextCache {
+    DocumentTextCache* textCache = nullptr;
+    int nRefs = 0;
+};
+
+struct SharedTextCaches {
+    CRITICAL_SECTION access;
+    Vec<SharedTextCache> caches;
+
+    SharedTextCaches() {
+        InitializeCriticalSection(&access);
+    }
+};
+
+static SharedTextCaches& GetSharedTextCaches() {
+    static SharedTextCaches sharedTextCaches;
+    return sharedTextCaches;
+}
+
+DocumentTextCache* AcquireDocumentTextCache(EngineBase* engine) {
+    SharedTextCaches& shared = GetSharedTextCaches();
+    ScopedCritSec scope(&shared.access);
+    for (SharedTextCache& c : shared.caches) {
+        if (c.textCache->engine == engine) {
+            c.nRefs++;
+            return c.textCache;
+        }
+    }
+    SharedTextCache c;
+    c.textCache = new DocumentTextCache(engine);
+    c.nRefs = 1;
+    shared.caches.Append(c);
+    return c.textCache;
+}
+
+void ReleaseDocumentTextCache(DocumentTextCache* textCache) {
+    if (!textCache) {
+        return;
+    }
+    SharedTextCaches& shared = GetSharedTextCaches();
+    ScopedCritSec scope(&shared.access);
+    for (size_t i = 0; i < shared.caches.size(); i++) {
+        SharedTextCache& c = shared.caches[i];
+        if (c.textCache != textCache) {
+            continue;
+        }
+        c.nRefs--;
+        if (c.nRefs == 0) {
+            shared.caches.RemoveAt(i);
+            delete textCache;
+        }
+        return;
+    }
+    ReportIf(true);
+}
+
 TextSelection::TextSelection(EngineBase* engine, DocumentTextCache* textCache) : engine(engine), textCache(textCache) {
 }
 
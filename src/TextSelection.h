@@ -5,6 +5,8 @@ struct DocumentTextCache {
     EngineBase* engine = nullptr;
     int nPages = 0;
     PageText* pagesText = nullptr;
+    // see GetIndexTextForPage()
+    WCHAR** pagesIndexText = nullptr;
     int debugSize = 0;
 
     CRITICAL_SECTION access;
@@ -14,8 +16,13 @@ struct DocumentTextCache {
 
     bool HasTextForPage(int pageNo) const;
     const WCHAR* GetTextForPage(int pageNo, int* lenOut = nullptr, Rect** coordsOut = nullptr);
+    const WCHAR* GetIndexTextForPage(int pageNo);
 };
 
+// all DisplayModels of a (shared) engine also share its DocumentTextCache
+DocumentTextCache* AcquireDocumentTextCache(EngineBase* engine);
+void ReleaseDocumentTextCache(DocumentTextCache* textCache);
+
 // TODO: replace with Vec<TextSel>
 struct TextSel {
     int len = 0;
@@ -0,0 +1,430 @@
+/* Copyright 2024 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+extern "C" {
+#include <zlib.h>
+}
+
+#include "utils/BaseUtil.h"
+#include "utils/ByteReader.h"
+#include "utils/ByteWriter.h"
+#include "utils/CryptoUtil.h"
+#include "utils/Dict.h"
+#include "utils/DirIter.h"
+#include "utils/FileUtil.h"
+#include "utils/ThreadUtil.h"
+#include "utils/WinUtil.h"
+
+#include "AppTools.h"
+#include "TileCache.h"
+
+#include "utils/Log.h"
+
+// A tile is stored in its own file named <docId>-<hash of the rest of the key>.tile
+// so that documents can't collide and outdated documents are evicted without
+// having to know about them. The file starts with kTileCacheHeader followed by
+//   u32 dx, u32 dy, zlib compressed top-down 32-bit BGRX pixels
+// little-endian. Rendered pages are mostly flat areas which compress well
+// even at the fastest compression level.
+// The modification time of a file is the time it was last used.
+// Tiles are compressed and written on a background thread so that saving
+// them doesn't delay rendering.
+
+static const char* kTileCacheHeader = "SumatraTile 1\n";
+
+// tiles are at most screen-sized, bigger values come from corrupted files
+constexpr int kMaxCachedTileDx = 1 << 14;
+// tiles waiting to be written beyond that are not cached
+constexpr int kMaxPendingTileWrites = 32;
+
+struct TileCacheFile {
+    // file name within the cache directory
+    char* name = nullptr;
+    i64 size = 0;
+    // FILETIME of last use
+    u64 lastUsed = 0;
+};
+
+// a tile waiting to be written by TileCacheWriterThread
+struct TileCacheWrite {
+    // file name within the cache directory
+    char* name = nullptr;
+    Size size;
+    // top-down 32-bit BGRX
+    char* pixels = nullptr;
+    i64 maxCacheSize = 0;
+};
+
+static Mutex gTileCacheMutex;
+// protected by gTileCacheMutex. built on first use
+static Vec<TileCacheFile>* gTileCacheFiles = nullptr;
+// index into gTileCacheFiles by name
+static dict::MapStrToInt* gTileCacheIndex = nullptr;
+static i64 gTileCacheSize = 0;
+// protected by gTileCacheMutex
+static Vec<TileCacheWrite> gTileCacheWrites;
+static bool gTileCacheWriterRunning = false;
+
+static TempStr GetTileCacheDirTemp() {
+    return GetPathInAppDataDirTemp("tilecache");
+}
+
+static u64 FileTimeToU64(FILETIME ft) {
+    return ((u64)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+static TempStr GetTileCacheFileNameTemp(const TileCacheKey& key) {
+    u32 textColor = (u32)key.textColor & 0xFFFFFF;
+    u32 bgColor = (u32)key.backgroundColor & 0xFFFFFF;
+    TempStr s = str::FormatTemp("%s %d %d %.4f %d %d %d %06x %06x", key.engineKind, key.pageNo, key.rotation, key.zoom,
+                                key.tileRes, key.tileRow, key.tileCol, textColor, bgColor);
+    u8 digest[16]{};
+    CalcMD5Digest((u8*)s, str::Leni(s), digest);
+    AutoFreeStr hex = str::MemToHex(digest, dimof(digest));
+    return str::FormatTemp("%s-%s.tile", key.docId, hex.Get());
+}
+
+// must be called with gTileCacheMutex held
+static void RebuildTileCacheIndex() {
+    // removed keys aren't freed by the dict, so this also reclaims their memory
+    delete gTileCacheIndex;
+    gTileCacheIndex = new dict::MapStrToInt(1024);
+    int n = gTileCacheFiles->Size();
+    for (int i = 0; i < n; i++) {
+        gTileCacheIndex->Insert(gTileCacheFiles->at(i).name, i);
+    }
+}
+
+// must be called with gTileCacheMutex held
+static void EnsureTileCacheIndex() {
+    if (gTileCacheFiles) {
+        return;
+    }
+    gTileCacheFiles = new Vec<TileCacheFile>();
+    gTileCacheSize = 0;
+    DirIter di{GetTileCacheDirTemp()};
+    for (DirIterEntry* de : di) {
+        if (!path::Match(de->name, "*.tile")) {
+            continue;
+        }
+        TileCacheFile f;
+        f.name = str::Dup(de->name);
+        f.size = GetFileSize(de->fd);
+        f.lastUsed = FileTimeToU64(de->fd->ftLastWriteTime);
+        gTileCacheFiles->Append(f);
+        gTileCacheSize += f.size;
+    }
+    RebuildTileCacheIndex();
+    logf("EnsureTileCacheIndex: %d files, %d kB\n", gTileCacheFiles->Size(), (int)(gTileCacheSize / 1024));
+}
+
+// must be called with gTileCacheMutex held
+static int FindTileCacheFile(const char* name) {
+    int idx = -1;
+    if (!gTileCacheIndex->Get(name, &idx)) {
+        return -1;
+    }
+    return idx;
+}
+
+// must be called with gTileCacheMutex held
+static void RemoveTileCacheFile(int idx) {
+    Vec<TileCacheFile>& files = *gTileCacheFiles;
+    TileCacheFile& f = files[idx];
+    file::Delete(path::JoinTemp(GetTileCacheDirTemp(), f.name));
+    gTileCacheSize -= f.size;
+    gTileCacheIndex->Remove(f.name, nullptr);
+    str::Free(f.name);
+    // RemoveAtFast() moves the last file to idx
+    int last = files.Size() - 1;
+    if (idx != last) {
+        gTileCacheIndex->Remove(files[last].name, nullptr);
+        gTileCacheIndex->Insert(files[last].name, idx);
+    }
+    files.RemoveAtFast(idx);
+}
+
+static int CmpLastUsed(const void* a, const void* b) {
+    const TileCacheFile* f1 = (const TileCacheFile*)a;
+    const TileCacheFile* f2 = (const TileCacheFile*)b;
+    if (f1->lastUsed == f2->lastUsed) {
+        return 0;
+    }
+    return f1->lastUsed < f2->lastUsed ? -1 : 1;
+}
+
+// removes least recently used files until the cache takes at most maxSize bytes
+// must be called with gTileCacheMutex held
+static void FreeTileCacheSpace(i64 maxSize) {
+    if (gTileCacheSize <= maxSize) {
+        return;
+    }
+    Vec<TileCacheFile>& files = *gTileCacheFiles;
+    files.Sort(CmpLastUsed);
+    int nRemoved = 0;
+    i64 size = gTileCacheSize;
+    while (nRemoved < files.Size() && size > maxSize) {
+        TileCacheFile& f = files[nRemoved];
+        file::Delete(path::JoinTemp(GetTileCacheDirTemp(), f.name));
+        size -= f.size;
+        str::Free(f.name);
+        nRemoved++;
+    }
+    files.RemoveAt(0, nRemoved);
+    gTileCacheSize = size;
+    RebuildTileCacheIndex();
+    logf("FreeTileCacheSpace: removed %d files\n", nRemoved);
+}
+
+// returns top-down 32-bit BGRX pixels of bmp
+static char* GetCachedTilePixels(RenderedBitmap* bmp, Size size) {
+    BITMAPINFO bmi{};
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = size.dx;
+    bmi.bmiHeader.biHeight = -size.dy;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    AutoFree pixels = AllocArray<char>((size_t)size.dx * size.dy * 4);
+    if (!pixels) {
+        return nullptr;
+    }
+    HDC hdc = GetDC(nullptr);
+    int nLines = GetDIBits(hdc, bmp->GetBitmap(), 0, size.dy, pixels, &bmi, DIB_RGB_COLORS);
+    ReleaseDC(nullptr, hdc);
+    if (nLines != size.dy) {
+        return nullptr;
+    }
+    return pixels.Release();
+}
+
+static ByteSlice EncodeCachedTile(const char* pixels, Size size) {
+    uLong nPixelBytes = (uLong)size.dx * size.dy * 4;
+    uLongf compressedLen = compressBound(nPixelBytes);
+    AutoFree compressed = AllocArray<char>(compressedLen);
+    if (!compressed) {
+        return {};
+    }
+    const Bytef* src = (const Bytef*)pixels;
+    int res = compress2((Bytef*)compressed.Get(), &compressedLen, src, nPixelBytes, Z_BEST_SPEED);
+    if (res != Z_OK) {
+        return {};
+    }
+
+    size_t headerLen = str::Len(kTileCacheHeader);
+    ByteWriterLE w(headerLen + 8 + compressedLen);
+    w.d.Append(kTileCacheHeader, headerLen);
+    w.Write32((u32)size.dx);
+    w.Write32((u32)size.dy);
+    w.d.Append(compressed.Get(), compressedLen);
+    return w.d.StealAsByteSlice();
+}
+
+static RenderedBitmap* DecodeCachedTile(const ByteSlice& d) {
+    size_t headerLen = str::Len(kTileCacheHeader);
+    if (d.size() < headerLen + 8 || !memeq(d.data(), kTileCacheHeader, headerLen)) {
+        return nullptr;
+    }
+    ByteReader r(d);
+    Size size((int)r.DWordLE(headerLen), (int)r.DWordLE(headerLen + 4));
+    if (size.dx <= 0 || size.dy <= 0 || size.dx > kMaxCachedTileDx || size.dy > kMaxCachedTileDx) {
+        return nullptr;
+    }
+
+    uLongf nPixelBytes = (uLongf)size.dx * size.dy * 4;
+    AutoFree pixels = AllocArray<char>(nPixelBytes);
+    if (!pixels) {
+        return nullptr;
+    }
+    const Bytef* src = (const Bytef*)d.data() + headerLen + 8;
+    uLong srcLen = (uLong)(d.size() - headerLen - 8);
+    uLongf pixelsLen = nPixelBytes;
+    int res = uncompress((Bytef*)pixels.Get(), &pixelsLen, src, srcLen);
+    if (res != Z_OK || pixelsLen != nPixelBytes) {
+        return nullptr;
+    }
+
+    HBITMAP hbmp = CreateMemoryBitmap(size);
+    if (!hbmp) {
+        return nullptr;
+    }
+    BITMAPINFO bmi{};
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = size.dx;
+    bmi.bmiHeader.biHeight = -size.dy;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    HDC hdc = GetDC(nullptr);
+    int nLines = SetDIBits(hdc, hbmp, 0, size.dy, pixels, &bmi, DIB_RGB_COLORS);
+    ReleaseDC(nullptr, hdc);
+    if (nLines != size.dy) {
+        DeleteObject(hbmp);
+        return nullptr;
+    }
+    return new RenderedBitmap(hbmp, size);
+}
+
+// returns nullptr if the tile isn't cached
+RenderedBitmap* LoadCachedTile(const TileCacheKey& key) {
+    if (!key.docId) {
+        return nullptr;
+    }
+    TempStr name = GetTileCacheFileNameTemp(key);
+    TempStr path = path::JoinTemp(GetTileCacheDirTemp(), name);
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    {
+        ScopedCritSec cs(&gTileCacheMutex.cs);
+        EnsureTileCacheIndex();
+        int idx = FindTileCacheFile(name);
+        if (idx < 0) {
+            return nullptr;
+        }
+        gTileCacheFiles->at(idx).lastUsed = FileTimeToU64(now);
+    }
+
+    ByteSlice d = file::ReadFile(path);
+    RenderedBitmap* bmp = DecodeCachedTile(d);
+    d.Free();
+    if (!bmp) {
+        logf("LoadCachedTile: '%s' is invalid\n", path);
+        ScopedCritSec cs(&gTileCacheMutex.cs);
+        // DeleteTileCacheDirectory() might have been called in the meantime
+        EnsureTileCacheIndex();
+        int idx = FindTileCacheFile(name);
+        if (idx >= 0) {
+            RemoveTileCacheFile(idx);
+        }
+        return nullptr;
+    }
+    // so that the order of use survives a restart
+    file::SetModificationTime(path, now);
+    return bmp;
+}
+
+// compresses and writes a tile. called on TileCacheWriterThread
+static void WriteCachedTile(TileCacheWrite& w) {
+    ByteSlice d = EncodeCachedTile(w.pixels, w.size);
+    if (d.empty()) {
+        return;
+    }
+    i64 size = (i64)d.size();
+    if (size > w.maxCacheSize) {
+        d.Free();
+        return;
+    }
+
+    TempStr dir = GetTileCacheDirTemp();
+    {
+        ScopedCritSec cs(&gTileCacheMutex.cs);
+        EnsureTileCacheIndex();
+        int idx = FindTileCacheFile(w.name);
+        if (idx >= 0) {
+            RemoveTileCacheFile(idx);
+        }
+        FreeTileCacheSpace(w.maxCacheSize - size);
+        dir::CreateAll(dir);
+    }
+
+    // the file isn't in the index while it's being written so LoadCachedTile() doesn't read it
+    bool ok = file::WriteFile(path::JoinTemp(dir, w.name), d);
+    d.Free();
+    if (!ok) {
+        return;
+    }
+
+    ScopedCritSec cs(&gTileCacheMutex.cs);
+    // DeleteTileCacheDirectory() might have been called in the meantime,
+    // in which case the new index might already include the file
+    EnsureTileCacheIndex();
+    if (FindTileCacheFile(w.name) >= 0) {
+        return;
+    }
+    TileCacheFile f;
+    f.name = str::Dup(w.name);
+    f.size = size;
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    f.lastUsed = FileTimeToU64(now);
+    gTileCacheFiles->Append(f);
+    gTileCacheIndex->Insert(f.name, gTileCacheFiles->Size() - 1);
+    gTileCacheSize += size;
+}
+
+static void FreeTileCacheWrite(TileCacheWrite& w) {
+    str::Free(w.name);
+    free(w.pixels);
+}
+
+static void TileCacheWriterThread() {
+    for (;;) {
+        TileCacheWrite w;
+        {
+            ScopedCritSec cs(&gTileCacheMutex.cs);
+            if (gTileCacheWrites.IsEmpty()) {
+                gTileCacheWriterRunning = false;
+                break;
+            }
+            w = gTileCacheWrites.PopAt(0);
+        }
+        WriteCachedTile(w);
+        FreeTileCacheWrite(w);
+        ResetTempAllocator();
+    }
+    DestroyTempAllocator();
+}
+
+// bmp must have been rendered for the given key. doesn't take ownership of bmp.
+// the tile is written asynchronously
+void SaveCachedTile(const TileCacheKey& key, RenderedBitmap* bmp, i64 maxCacheSize) {
+    if (!key.docId || !bmp || maxCacheSize <= 0) {
+        return;
+    }
+    Size size = bmp->GetSize();
+    if (size.dx <= 0 || size.dy <= 0 || size.dx > kMaxCachedTileDx || size.dy > kMaxCachedTileDx) {
+        return;
+    }
+    {
+        ScopedCritSec cs(&gTileCacheMutex.cs);
+        if (gTileCacheWrites.Size() >= kMaxPendingTileWrites) {
+            return;
+        }
+    }
+    // the bitmap might be freed by the render cache before the tile is written
+    TileCacheWrite w;
+    w.pixels = GetCachedTilePixels(bmp, size);
+    if (!w.pixels) {
+        return;
+    }
+    w.name = str::Dup(GetTileCacheFileNameTemp(key));
+    w.size = size;
+    w.maxCacheSize = maxCacheSize;
+
+    ScopedCritSec cs(&gTileCacheMutex.cs);
+    gTileCacheWrites.Append(w);
+    if (!gTileCacheWriterRunning) {
+        gTileCacheWriterRunning = true;
+        RunAsync(MkFunc0Void(TileCacheWriterThread), "TileCacheWriterThread");
+    }
+}
+
+void DeleteTileCacheDirectory() {
+    ScopedCritSec cs(&gTileCacheMutex.cs);
+    for (TileCacheWrite& w : gTileCacheWrites) {
+        FreeTileCacheWrite(w);
+    }
+    gTileCacheWrites.Reset();
+    dir::RemoveAll(GetTileCacheDirTemp());
+    if (gTileCacheFiles) {
+        for (TileCacheFile& f : *gTileCacheFiles) {
+            str::Free(f.name);
+        }
+        delete gTileCacheFiles;
+        gTileCacheFiles = nullptr;
+    }
+    delete gTileCacheIndex;
+    gTileCacheIndex = nullptr;
+    gTileCacheSize = 0;
+}
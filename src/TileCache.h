@@ -0,0 +1,28 @@
+/* Copyright 2024 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+// On-disk cache of rendered page tiles, shared by all documents. Tiles are
+// evicted in least-recently-used order once the cache grows beyond the size
+// passed to SaveCachedTile() (see FixedPageUI.TileCacheSize).
+
+// identifies a rendered tile. zoom is rounded to 4 decimal places
+// which is the granularity at which tiles are re-used
+struct TileCacheKey {
+    // fingerprint of the document, see GetFileFingerprintTemp()
+    const char* docId = nullptr;
+    Kind engineKind = nullptr;
+    int pageNo = 0;
+    int rotation = 0;
+    float zoom = 0.f;
+    // see TilePosition
+    int tileRes = 0;
+    int tileRow = 0;
+    int tileCol = 0;
+    // colors black and white have been replaced with
+    COLORREF textColor = 0;
+    COLORREF backgroundColor = 0;
+};
+
+RenderedBitmap* LoadCachedTile(const TileCacheKey& key);
+void SaveCachedTile(const TileCacheKey& key, RenderedBitmap* bmp, i64 maxCacheSize);
+void DeleteTileCacheDirectory();
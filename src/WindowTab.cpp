@@ -22,6 +22,7 @@
 #include "Selection.h"
 #include "Translations.h"
 #include "EditAnnotations.h"
+#include "SymbolDetection.h"
 
 WindowTab::WindowTab(MainWindow* win) {
     this->win = win;
@@ -44,6 +45,7 @@ WindowTab::~WindowTab() {
         AsChm()->RemoveParentHwnd();
     }
     delete selectionOnPage;
+    DeleteSymbolDetections(this);
     // technically we only need to clear ctrl == gMostRecentlyOpenedDoc
     // but gMostRecentlyOpenedDoc is only for dde commands
     // so doesn't need to be kept for long
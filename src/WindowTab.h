@@ -2,6 +2,7 @@
    License: GPLv3 */
 
 struct SelectionOnPage;
+struct PageSymbols;
 struct WatchedFile;
 struct EditAnnotationsWindow;
 struct MainWindow;
@@ -35,6 +36,8 @@ struct WindowTab {
     // list of rectangles of the last rectangular, text or image selection
     // (split by page, in user coordinates)
     Vec<SelectionOnPage>* selectionOnPage = nullptr;
+    // results of symbol detection, one entry per processed page
+    Vec<PageSymbols*> detectedSymbols;
     // previous View settings, needed when unchecking the Fit Width/Page toolbar buttons
     float prevZoomVirtual{kInvalidZoom};
     DisplayMode prevDisplayMode{DisplayMode::Automatic};
@@ -140,7 +140,7 @@ HRESULT PdfFilter::GetNextChunkValue(ChunkValue& chunkValue) {
 
         case PdfFilterState::Content:
             while (++m_iPageNo <= m_pdfEngine->PageCount()) {
-                PageText pageText = m_pdfEngine->ExtractPageText(m_iPageNo);
+                PageText pageText = m_pdfEngine->ExtractPageTextForIndex(m_iPageNo);
                 if (str::IsEmpty(pageText.text)) {
                     FreePageText(&pageText);
                     continue;
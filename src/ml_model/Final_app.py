@@ -1,10 +1,10 @@
 import sys
 import os
-from PIL import Image, ImageDraw
 from ultralytics import YOLO
 import numpy as np
- 
+
 # Define class names
+# must match gSymbolClassNames in src/SymbolDetection.cpp
 class_names = {
     0: "Panel", 1: "Transformer", 2: "C.Breaker", 3: "Breaker (Sub-Category)",
     4: "Feeder", 5: "Dis.Switch", 6: "Motor", 7: "Inverter", 8: "ATS", 9: "STS",
@@ -13,51 +13,105 @@ class_names = {
     18: "Bus Terminal", 19: "Feeders Tag", 20: "Manual Transfer Switch",
     21: "Variable Frequency Drive (VFD)"
 }
- 
-def enhance_dpi(image, target_dpi=300):
-    scale_factor = target_dpi / 72.0
-    new_size = (int(image.width * scale_factor), int(image.height * scale_factor))
-    enhanced_image = image.resize(new_size, Image.LANCZOS)
-    return enhanced_image
- 
-def process_image(file_path, model):
-    # Load and enhance the image
-    img_original = Image.open(file_path)
-    img_original = enhance_dpi(img_original, target_dpi=300)
-    img_resized = img_original.resize((2560, 1728), Image.LANCZOS)
- 
-    # Perform object detection
-    results = model(img_resized, imgsz=(2560, 1728))
- 
-    # Extract bounding boxes
-    detected_boxes = []
-    if results is not None:
-        detected_classes = results[0].boxes.cls.cpu().numpy()
-        boxes = results[0].boxes.xyxy.cpu().numpy()
-        for idx, box in zip(detected_classes, boxes):
-            detected_boxes.append((box, int(idx)))
- 
-    # Draw bounding boxes on the image
-    img_with_boxes = img_resized.copy()
-    draw = ImageDraw.Draw(img_with_boxes)
-    for box, class_idx in detected_boxes:
-        draw.rectangle([box[0], box[1], box[2], box[3]], outline="yellow", width=3)
-        # label = class_names.get(class_idx, "Unknown")
-        # draw.text((box[0], box[1] - 10), label, fill="yellow")
- 
-    # Save the processed image
-    base_name = os.path.splitext(os.path.basename(file_path))[0]
-    output_path = f"{base_name}_processed.png"
-    img_with_boxes.save(output_path, format="PNG", compress_level=0, quality=100, optimize=True)
- 
-    return output_path, detected_boxes
- 
+
+# size of images the model was trained on (width, height)
+# SumatraPDF renders pages to fit this size so we don't resample
+model_size = (2560, 1728)
+
+def detect(model, imgs, device=None):
+    # imgs is a path, a numpy array of BGR pixels (height, width, 3)
+    # or a list of those which are then processed as a single batch
+    results = model(imgs, imgsz=(model_size[1], model_size[0]), device=device, verbose=False)
+    all_boxes = []
+    for res in results:
+        detected_boxes = []
+        boxes = res.boxes
+        classes = boxes.cls.cpu().numpy()
+        confs = boxes.conf.cpu().numpy()
+        xyxy = boxes.xyxy.cpu().numpy()
+        for cls, conf, box in zip(classes, confs, xyxy):
+            detected_boxes.append((int(cls), float(conf), box))
+        all_boxes.append(detected_boxes)
+    return all_boxes
+
+def write_boxes(out, detected_boxes):
+    for cls, conf, box in detected_boxes:
+        out.write(f"box {cls} {conf:.4f} {box[0]:.2f} {box[1]:.2f} {box[2]:.2f} {box[3]:.2f}\n")
+
+def read_exactly(f, n):
+    data = bytearray()
+    while len(data) < n:
+        chunk = f.read(n - len(data))
+        if not chunk:
+            return None
+        data.extend(chunk)
+    return data
+
+def read_line(inp):
+    line = inp.readline()
+    if not line:
+        return None
+    return line.decode("ascii", "replace").split()
+
+# reads "page <pageNo> <width> <height>\n" and the pixels
+def read_page(inp):
+    parts = read_line(inp)
+    if parts is None or len(parts) != 4 or parts[0] != "page":
+        return None
+    page_no, width, height = int(parts[1]), int(parts[2]), int(parts[3])
+    data = read_exactly(inp, width * height * 3)
+    if data is None:
+        return None
+    return page_no, np.frombuffer(data, dtype=np.uint8).reshape((height, width, 3))
+
+# protocol used by SumatraPDF (see src/SymbolDetection.cpp):
+# stdout: "ready\n" once the model is loaded
+# stdin: "batch <n>\n" followed by n pages, each being
+#        "page <pageNo> <width> <height>\n" followed by width * height * 3 bytes
+#        of top-down BGR pixels
+# stdout: for each page of the batch, in order:
+#         "box <class> <confidence> <x0> <y0> <x1> <y1>\n" for each detection
+#         "done <pageNo>\n"
+# exits when stdin is closed
+def serve_stdin(model, device):
+    out = sys.stdout
+    # libraries print progress to stdout which would corrupt the protocol
+    sys.stdout = sys.stderr
+    inp = sys.stdin.buffer
+    out.write("ready\n")
+    out.flush()
+    while True:
+        parts = read_line(inp)
+        if parts is None:
+            break
+        if len(parts) != 2 or parts[0] != "batch":
+            out.write(f"error: unexpected '{' '.join(parts)}'\n")
+            out.flush()
+            break
+        pages = []
+        for _ in range(int(parts[1])):
+            page = read_page(inp)
+            if page is None:
+                return
+            pages.append(page)
+        if not pages:
+            continue
+        results = detect(model, [img for _, img in pages], device)
+        for (page_no, _), detected_boxes in zip(pages, results):
+            write_boxes(out, detected_boxes)
+            out.write(f"done {page_no}\n")
+        out.flush()
+
 if __name__ == "__main__":
-    if len(sys.argv) != 2:
-        print("Usage: python Final_app.py <image_path>")
+    args = sys.argv[1:]
+    device = None
+    if len(args) >= 2 and args[-2] == "--device":
+        device = args[-1]
+        args = args[:-2]
+    if len(args) != 1:
+        print("Usage: python Final_app.py <image_path> | --stdin [--device cpu]")
         sys.exit(1)
- 
-    input_image_path = sys.argv[1]
+
     script_dir = os.path.dirname(os.path.abspath(__file__))
 
 # Construct the path to best.pt
@@ -65,16 +119,20 @@ if __name__ == "__main__":
 
 # Load the YOLO model
     model = YOLO(model_path)
- 
-    processed_image_path, detections = process_image(input_image_path, model)
-    print(f"Processed image saved at: {processed_image_path}")
- 
+
+    if args[0] == "--stdin":
+        serve_stdin(model, device)
+        sys.exit(0)
+
+    detections = detect(model, args[0], device)[0]
+    write_boxes(sys.stdout, detections)
+
     # Print detection results
     print("\nDetection Results:")
     detection_counts = {}
-    for _, class_idx in detections:
+    for class_idx, _, _ in detections:
         class_name = class_names.get(class_idx, "Unknown")
         detection_counts[class_name] = detection_counts.get(class_name, 0) + 1
- 
+
     for class_name, count in detection_counts.items():
-        print(f"Detected: {count} {class_name}(s)")
\ No newline at end of file
+        print(f"Detected: {count} {class_name}(s)")
@@ -24,6 +24,7 @@ To write new regression test:
 #include "utils/GuessFileType.h"
 #include "utils/GdiPlusUtil.h"
 #include "utils/HtmlParserLookup.h"
+#include "utils/Timer.h"
 #include "mui/Mui.h"
 #include "utils/WinUtil.h"
 
@@ -167,12 +168,14 @@ static void UninstallCrashHandler() {
 
 #include "Regress00.cpp"
 #include "Regress03.cpp"
+#include "Regress04.cpp"
 
 static void RunTests() {
     Regress00();
     Regress01();
     Regress02();
     Regress03();
+    Regress04();
 }
 
 int RegressMain() {
@@ -0,0 +1,100 @@
+/* Copyright 2024 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+// must be #included from Regress.cpp
+
+// tests that searching for several terms at once counts the hits of all of
+// them in a single pass over a big text document i.e. that N terms don't
+// cost N passes. the document is generated so that no external file is needed
+
+static const char* kFillerLine = "lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor\n";
+// about 8.5 MB so that it's opened with the memory-mapped plain text engine
+constexpr int kRegress04Lines = 110000;
+
+static char* CreateRegress04Fixture() {
+    str::Str s(kRegress04Lines * str::Len(kFillerLine));
+    for (int i = 0; i < kRegress04Lines; i++) {
+        if (i % 100 == 0) {
+            s.Append("Alpha Centauri is the closest star system\n");
+        } else if (i % 1000 == 7) {
+            s.Append("a beta\xE2\x80\x93version of the \xE2\x80\x9Cgamma ray\xE2\x80\x9D  burst\n");
+        } else {
+            s.Append(kFillerLine);
+        }
+    }
+    char* path = path::Join(GetTempDirTemp(), "sumatra-regress04.txt");
+    bool ok = file::WriteFile(path, s.AsByteSlice());
+    ReportIf(!ok);
+    return path;
+}
+
+static double TimeCountPatternHits(TextSearch* tsrch, const WCHAR* text, int* total) {
+    tsrch->SetText(text);
+    auto timeStart = TimeGet();
+    *total = tsrch->CountPatternHits();
+    return TimeSinceInMs(timeStart);
+}
+
+static void Regress04() {
+    AutoFreeStr filePath(CreateRegress04Fixture());
+    EngineBase* engine = CreateEngineFromFile(filePath, nullptr, true);
+    ReportIf(!engine || engine->kind != kindEnginePlainText);
+    if (!engine) {
+        return;
+    }
+    DocumentTextCache* textCache = new DocumentTextCache(engine);
+    TextSearch* tsrch = new TextSearch(engine, textCache);
+
+    // the first pass also extracts the text of all pages (without caching it)
+    int total = 0;
+    double msExtract = TimeCountPatternHits(tsrch, L"terms:alpha|beta-version|\"gamma ray\" burst", &total);
+    printf("Regress04: %d pages, extracting text and counting took %.2f ms\n", engine->PageCount(), msExtract);
+    ReportIf(total != 1100 + 2 * 110);
+    // counting must not keep the text (and glyph coordinates) of all pages around
+    printf("Regress04: text cache size after counting: %d kB\n", textCache->debugSize / 1024);
+    ReportIf(textCache->debugSize != 0);
+    ReportIf(tsrch->termHits[0] != 1100 || tsrch->termHits[1] != 110 || tsrch->termHits[2] != 110);
+
+    TimeCountPatternHits(tsrch, L"regex:alp+ha|b[aeiou]ta\\W\\w+", &total);
+    ReportIf(total != 1100 + 110);
+    // whitespace isn't collapsed for regular expressions
+    TimeCountPatternHits(tsrch, L"regex:system\\r?\\nlorem", &total);
+    ReportIf(total == 0);
+
+    // without a prefix, '|' is searched for like any other character
+    tsrch->SetText(L"alpha|beta");
+    ReportIf(tsrch->IsPatternSearch());
+    TimeCountPatternHits(tsrch, L"terms:alpha\\|beta|centauri", &total);
+    ReportIf(tsrch->termHits[0] != 0 || tsrch->termHits[1] != 1100);
+
+    tsrch->SetSensitive(true);
+    TimeCountPatternHits(tsrch, L"terms:alpha|Alpha", &total);
+    ReportIf(tsrch->termHits[0] != 0 || tsrch->termHits[1] != 1100);
+    tsrch->SetSensitive(false);
+
+    const WCHAR* terms[] = {L"centauri", L"closest", L"star", L"system", L"version", L"ray", L"burst", L"xyzzy"};
+    int nTerms = dimofi(terms);
+    double msOneTerm = TimeCountPatternHits(tsrch, L"terms:centauri", &total);
+    ReportIf(total != 1100);
+    double msSeparate = 0;
+    for (const WCHAR* term : terms) {
+        AutoFreeWStr text(str::Join(kTermsSearchPrefix, term));
+        msSeparate += TimeCountPatternHits(tsrch, text, &total);
+    }
+    str::WStr allTerms(kTermsSearchPrefix);
+    for (const WCHAR* term : terms) {
+        allTerms.Append(term);
+        allTerms.AppendChar('|');
+    }
+    double msAllTerms = TimeCountPatternHits(tsrch, allTerms.Get(), &total);
+    ReportIf(total != 4 * 1100 + 3 * 110);
+    printf("Regress04: 1 term: %.2f ms, %d terms: %.2f ms, %d separate passes: %.2f ms\n", msOneTerm, nTerms,
+           msAllTerms, nTerms, msSeparate);
+    // N terms should cost about one pass, not N passes (generous because of timing noise)
+    ReportIf(msAllTerms > 3 * msOneTerm + 50);
+
+    delete tsrch;
+    delete textCache;
+    SafeEngineRelease(&engine);
+    file::Delete(filePath);
+}
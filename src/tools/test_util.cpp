@@ -19,6 +19,7 @@ extern void FileUtilTest();
 extern void HtmlPrettyPrintTest();
 extern void HtmlPullParser_UnitTests();
 extern void JsonTest();
+extern void PatternMatcherTest();
 extern void SettingsUtilTest();
 extern void SimpleLogTest();
 extern void SquareTreeTest();
@@ -43,6 +44,7 @@ int main(int, char**) {
     HtmlPrettyPrintTest();
     HtmlPullParser_UnitTests();
     JsonTest();
+    PatternMatcherTest();
     SettingsUtilTest();
     SimpleLogTest();
     SquareTreeTest();
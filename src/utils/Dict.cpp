@@ -62,8 +62,18 @@ class WStrKeyHasherComparator : public HasherComparator {
     }
 };
 
+class PtrKeyHasherComparator : public HasherComparator {
+    size_t Hash(uintptr_t key) override {
+        return MurmurHash2(&key, sizeof(key));
+    }
+    bool Equal(uintptr_t k1, uintptr_t k2) override {
+        return k1 == k2;
+    }
+};
+
 static StrKeyHasherComparator gStrKeyHasherComparator;
 static WStrKeyHasherComparator gWStrKeyHasherComparator;
+static PtrKeyHasherComparator gPtrKeyHasherComparator;
 
 struct HashTableEntry {
     uintptr_t key;
@@ -268,4 +278,54 @@ bool MapStrToInt::Get(const char* key, int* valOut) const {
     return true;
 }
 
+MapPtrToInt::MapPtrToInt(size_t initialSize) {
+    // keys are stored as-is so the allocator is only used for HashTableEntry entries
+    h = NewHashTable(initialSize, &allocator);
+}
+
+MapPtrToInt::~MapPtrToInt() {
+    DeleteHashTable(h);
+}
+
+size_t MapPtrToInt::Count() const {
+    return h->nUsed;
+}
+
+// if a key exists, returns false and sets existingValOut to existing value
+// if a key doesn't exist, inserts it and returns true
+bool MapPtrToInt::Insert(const void* key, int val, int* existingValOut) {
+    bool newEntry;
+    HashTableEntry* e = GetOrCreateEntry(h, &gPtrKeyHasherComparator, (uintptr_t)key, &allocator, newEntry);
+    if (!newEntry) {
+        if (existingValOut) {
+            *existingValOut = (int)e->val;
+        }
+        return false;
+    }
+    e->key = (uintptr_t)key;
+    e->val = (intptr_t)val;
+
+    HashTableResizeIfNeeded(h, &gPtrKeyHasherComparator);
+    return true;
+}
+
+bool MapPtrToInt::Remove(const void* key, int* removedValOut) const {
+    uintptr_t removedVal;
+    bool removed = RemoveEntry(h, &gPtrKeyHasherComparator, (uintptr_t)key, &removedVal);
+    if (removed && removedValOut) {
+        *removedValOut = (int)removedVal;
+    }
+    return removed;
+}
+
+bool MapPtrToInt::Get(const void* key, int* valOut) const {
+    bool newEntry;
+    HashTableEntry* e = GetOrCreateEntry(h, &gPtrKeyHasherComparator, (uintptr_t)key, nullptr, newEntry);
+    if (!e) {
+        return false;
+    }
+    *valOut = (int)e->val;
+    return true;
+}
+
 } // namespace dict
@@ -32,4 +32,22 @@ class MapStrToInt {
     bool Get(const char* key, int* valOut) const;
 };
 
+// a dictionary whose keys are pointers and the values are integers
+// keys are only compared, never dereferenced, so they don't have to stay valid
+class MapPtrToInt {
+  public:
+    PoolAllocator allocator;
+    HashTable* h = nullptr;
+
+    explicit MapPtrToInt(size_t initialSize = DEFAULT_HASH_TABLE_INITIAL_SIZE);
+    ~MapPtrToInt();
+
+    size_t Count() const;
+
+    bool Insert(const void* key, int val, int* existingValOut = nullptr);
+
+    bool Remove(const void* key, int* removedValOut) const;
+    bool Get(const void* key, int* valOut) const;
+};
+
 } // namespace dict
@@ -0,0 +1,905 @@
+/* Copyright 2024 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+#include "utils/PatternMatcher.h"
+
+// the full range of WCHAR values
+constexpr int kCharCount = 0x10000;
+
+static int CmpPatternMatch(const void* a, const void* b) {
+    const PatternMatch* m1 = (const PatternMatch*)a;
+    const PatternMatch* m2 = (const PatternMatch*)b;
+    if (m1->start != m2->start) {
+        return m1->start - m2->start;
+    }
+    // longer matches first
+    if (m1->end != m2->end) {
+        return m2->end - m1->end;
+    }
+    return m1->term - m2->term;
+}
+
+// reduces all (possibly overlapping) candidates to leftmost-longest, non-overlapping matches
+static void AppendNonOverlapping(Vec<PatternMatch>& candidates, Vec<PatternMatch>& matches) {
+    candidates.Sort(CmpPatternMatch);
+    int pos = 0;
+    for (PatternMatch& m : candidates) {
+        if (m.start >= pos) {
+            matches.Append(m);
+            pos = m.end;
+        }
+    }
+}
+
+static WCHAR ToLowerChar(WCHAR c) {
+    if (c < 0x80) {
+        return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+    }
+    WCHAR buf[1] = {c};
+    CharLowerBuffW(buf, 1);
+    return buf[0];
+}
+
+///// Aho-Corasick automaton for literal terms /////
+
+struct TermsMatcher : PatternMatcher {
+    Vec<WCHAR*> terms;
+    Vec<int> termLens;
+    // maps characters that appear in terms to 1..nClasses-1, all others to 0
+    u16* charClass = nullptr;
+    int nClasses = 1;
+    // complete transition table (including failure transitions):
+    // the node following node n for character class c is next[n * nClasses + c]
+    Vec<int> next;
+    // term ending at a node or -1
+    Vec<int> nodeTerm;
+    // next node on the failure path at which a term ends (0 if none)
+    Vec<int> outLink;
+
+    ~TermsMatcher() override;
+    int TermCount() const override {
+        return terms.Size();
+    }
+    const WCHAR* Term(int idx) const override {
+        return terms[idx];
+    }
+    void FindAll(const WCHAR* s, int len, Vec<PatternMatch>& matches) override;
+
+    int AddNode();
+    bool Build(const WCHAR** terms, int nTerms);
+};
+
+TermsMatcher::~TermsMatcher() {
+    terms.FreeMembers();
+    free(charClass);
+}
+
+int TermsMatcher::AddNode() {
+    int node = nodeTerm.Size();
+    for (int i = 0; i < nClasses; i++) {
+        next.Append(-1);
+    }
+    nodeTerm.Append(-1);
+    outLink.Append(0);
+    return node;
+}
+
+bool TermsMatcher::Build(const WCHAR** src, int nTerms) {
+    charClass = AllocArray<u16>(kCharCount);
+    if (!charClass || nTerms <= 0) {
+        return false;
+    }
+    for (int i = 0; i < nTerms; i++) {
+        int len = str::Leni(src[i]);
+        if (len == 0) {
+            return false;
+        }
+        terms.Append(str::Dup(src[i]));
+        termLens.Append(len);
+        for (int j = 0; j < len; j++) {
+            WCHAR c = src[i][j];
+            if (charClass[c] == 0) {
+                charClass[c] = (u16)nClasses++;
+            }
+        }
+    }
+
+    // the trie
+    AddNode();
+    for (int i = 0; i < nTerms; i++) {
+        int node = 0;
+        for (int j = 0; j < termLens[i]; j++) {
+            int c = charClass[terms[i][j]];
+            if (next[node * nClasses + c] < 0) {
+                int child = AddNode();
+                next[node * nClasses + c] = child;
+            }
+            node = next[node * nClasses + c];
+        }
+        // for duplicates, the first term wins
+        if (nodeTerm[node] < 0) {
+            nodeTerm[node] = i;
+        }
+    }
+
+    // failure links in breadth-first order, turning the trie into a DFA
+    int nNodes = nodeTerm.Size();
+    Vec<int> fail;
+    fail.AppendBlanks(nNodes);
+    Vec<int> queue;
+    for (int c = 0; c < nClasses; c++) {
+        int child = next[c];
+        if (child < 0) {
+            next[c] = 0;
+        } else {
+            queue.Append(child);
+        }
+    }
+    for (int qi = 0; qi < queue.Size(); qi++) {
+        int node = queue[qi];
+        for (int c = 0; c < nClasses; c++) {
+            int child = next[node * nClasses + c];
+            int failNext = next[fail[node] * nClasses + c];
+            if (child < 0) {
+                next[node * nClasses + c] = failNext;
+                continue;
+            }
+            fail[child] = failNext;
+            outLink[child] = nodeTerm[failNext] >= 0 ? failNext : outLink[failNext];
+            queue.Append(child);
+        }
+    }
+    return true;
+}
+
+void TermsMatcher::FindAll(const WCHAR* s, int len, Vec<PatternMatch>& matches) {
+    Vec<PatternMatch> candidates;
+    int node = 0;
+    for (int i = 0; i < len; i++) {
+        node = next[node * nClasses + charClass[s[i]]];
+        int n = nodeTerm[node] >= 0 ? node : outLink[node];
+        for (; n > 0; n = outLink[n]) {
+            PatternMatch m;
+            m.term = nodeTerm[n];
+            m.start = i + 1 - termLens[m.term];
+            m.end = i + 1;
+            candidates.Append(m);
+        }
+    }
+    AppendNonOverlapping(candidates, matches);
+}
+
+PatternMatcher* NewTermsMatcher(const WCHAR** terms, int nTerms) {
+    TermsMatcher* m = new TermsMatcher();
+    if (!m->Build(terms, nTerms)) {
+        delete m;
+        return nullptr;
+    }
+    return m;
+}
+
+///// regular expressions /////
+
+// caps that keep pathological expressions from using too much memory
+constexpr int kMaxRegexRepeat = 1000;
+constexpr int kMaxNfaStates = 64 * 1024;
+constexpr int kMaxDfaStates = 4096;
+// size of the hash table for looking up dfa states, must be a power of 2
+constexpr int kDfaTableSize = 2 * kMaxDfaStates;
+
+// a range of characters (inclusive)
+struct CharRange {
+    int lo = 0;
+    int hi = 0;
+};
+
+// a set of characters is ranges[first..first+count)
+struct CharSet {
+    int first = 0;
+    int count = 0;
+};
+
+enum class ReKind : u8 {
+    Empty,
+    Set,
+    Concat,
+    Alt,
+    Repeat,
+};
+
+struct ReNode {
+    ReKind kind = ReKind::Empty;
+    int set = -1;
+    // children
+    int a = -1;
+    int b = -1;
+    // for Repeat, max is -1 if unbounded
+    int min = 0;
+    int max = 0;
+};
+
+enum class NfaKind : u8 {
+    Set,
+    Split,
+    Match,
+};
+
+struct NfaState {
+    NfaKind kind = NfaKind::Match;
+    int set = -1;
+    int out = -1;
+    int out1 = -1;
+    int term = -1;
+};
+
+struct DfaState {
+    // nfa states are dfaNfa[first..first+count)
+    int first = 0;
+    int count = 0;
+    u32 hash = 0;
+    // accepted term or -1
+    int term = -1;
+};
+
+struct RegexMatcher : PatternMatcher {
+    Vec<WCHAR*> terms;
+    bool lowerCase = false;
+
+    // parsing
+    const WCHAR* re = nullptr;
+    const WCHAR* s = nullptr;
+    Vec<ReNode> nodes;
+    Vec<CharRange> ranges;
+    Vec<CharSet> sets;
+
+    // characters that can't be told apart by the expression share a class
+    u16* charClass = nullptr;
+    int nClasses = 0;
+    // whether set i contains class c is setHas[i * nClasses + c]
+    Vec<bool> setHas;
+
+    Vec<NfaState> nfa;
+    int nfaStart = -1;
+
+    // state 0 is the dead state (no nfa states), state 1 the start state
+    Vec<DfaState> dfa;
+    Vec<int> dfaNfa;
+    // dfaNext[d * nClasses + c] or -1 if not computed yet
+    Vec<int> dfaNext;
+    // hash table of dfa states (index + 1, 0 for unused slots)
+    Vec<int> dfaTable;
+    // for ComputeClosure
+    Vec<int> closureMark;
+    int closureGen = 0;
+    Vec<int> stack;
+    Vec<int> tmpSet;
+
+    ~RegexMatcher() override;
+    int TermCount() const override {
+        return terms.Size();
+    }
+    const WCHAR* Term(int idx) const override {
+        return terms[idx];
+    }
+    void FindAll(const WCHAR* s, int len, Vec<PatternMatch>& matches) override;
+
+    // parser
+    int AddNode(ReKind kind, int a = -1, int b = -1);
+    int AddSet();
+    void AddRange(int lo, int hi);
+    bool ParseEscape(WCHAR c, bool inClass);
+    int ParseAlt();
+    int ParseConcat();
+    int ParseRepeat();
+    int ParseAtom();
+    bool ParseClass(int setIdx);
+    bool ParseInt(int* n);
+    void NormalizeSet(int setIdx, bool negate);
+
+    bool Compile(const WCHAR* re, bool lowerCase);
+    void BuildCharClasses();
+    int AddNfa(NfaKind kind, int out = -1, int out1 = -1);
+    int CompileNode(int node, int next);
+
+    void AddClosure(int st);
+    int FindOrAddDfaState();
+    void ResetDfa();
+    int Step(int d, int c);
+    int MatchAt(const WCHAR* s, int len, int start, int* termOut);
+};
+
+RegexMatcher::~RegexMatcher() {
+    terms.FreeMembers();
+    free(charClass);
+}
+
+int RegexMatcher::AddNode(ReKind kind, int a, int b) {
+    ReNode n;
+    n.kind = kind;
+    n.a = a;
+    n.b = b;
+    nodes.Append(n);
+    return nodes.Size() - 1;
+}
+
+int RegexMatcher::AddSet() {
+    CharSet cs;
+    cs.first = ranges.Size();
+    sets.Append(cs);
+    return sets.Size() - 1;
+}
+
+// ranges are always added to the last set
+void RegexMatcher::AddRange(int lo, int hi) {
+    CharRange r;
+    r.lo = lo;
+    r.hi = hi;
+    ranges.Append(r);
+    sets.Last().count++;
+    if (!lowerCase) {
+        return;
+    }
+    // the text is lower-cased, so e.g. [A-Z] has to match a-z
+    if (hi - lo > 0x400) {
+        return;
+    }
+    for (int c = lo; c <= hi; c++) {
+        int lower = ToLowerChar((WCHAR)c);
+        if (lower != c) {
+            r.lo = r.hi = lower;
+            ranges.Append(r);
+            sets.Last().count++;
+        }
+    }
+}
+
+static int CmpCharRange(const void* a, const void* b) {
+    return ((const CharRange*)a)->lo - ((const CharRange*)b)->lo;
+}
+
+// sorts and merges the ranges of a set, optionally inverting it
+void RegexMatcher::NormalizeSet(int setIdx, bool negate) {
+    CharSet& cs = sets[setIdx];
+    Vec<CharRange> sorted;
+    sorted.Append(ranges.LendData() + cs.first, cs.count);
+    sorted.Sort(CmpCharRange);
+    Vec<CharRange> merged;
+    for (CharRange& r : sorted) {
+        if (merged.Size() > 0 && r.lo <= merged.Last().hi + 1) {
+            merged.Last().hi = std::max(merged.Last().hi, r.hi);
+        } else {
+            merged.Append(r);
+        }
+    }
+    if (negate) {
+        Vec<CharRange> inverted;
+        int lo = 0;
+        for (CharRange& r : merged) {
+            if (r.lo > lo) {
+                inverted.Append(CharRange{lo, r.lo - 1});
+            }
+            lo = r.hi + 1;
+        }
+        if (lo < kCharCount) {
+            inverted.Append(CharRange{lo, kCharCount - 1});
+        }
+        merged = inverted;
+    }
+    // the set is the last one being built, so its ranges are at the end
+    ReportIf(cs.first + cs.count != ranges.Size());
+    ranges.RemoveAt(cs.first, cs.count);
+    ranges.Append(merged);
+    cs.count = merged.Size();
+}
+
+// adds the characters of an escape sequence to the last set
+bool RegexMatcher::ParseEscape(WCHAR c, bool inClass) {
+    switch (c) {
+        case 'd':
+            AddRange('0', '9');
+            return true;
+        case 'w':
+            AddRange('0', '9');
+            AddRange('A', 'Z');
+            AddRange('a', 'z');
+            AddRange('_', '_');
+            // letters of most scripts
+            AddRange(0xC0, 0xFFFF);
+            return true;
+        case 's':
+            AddRange('\t', '\r');
+            AddRange(' ', ' ');
+            AddRange(0xA0, 0xA0);
+            AddRange(0x2000, 0x200B);
+            AddRange(0x2028, 0x2029);
+            AddRange(0x3000, 0x3000);
+            return true;
+        case 't':
+            AddRange('\t', '\t');
+            return true;
+        case 'n':
+            AddRange('\n', '\n');
+            return true;
+        case 'r':
+            AddRange('\r', '\r');
+            return true;
+    }
+    if (!c || (c < 0x80 && isalnum(c) && !inClass)) {
+        // unknown escapes are reserved
+        return false;
+    }
+    AddRange(c, c);
+    return true;
+}
+
+bool RegexMatcher::ParseInt(int* n) {
+    if (!str::IsDigit(*s)) {
+        return false;
+    }
+    *n = 0;
+    for (; str::IsDigit(*s); s++) {
+        *n = *n * 10 + (*s - '0');
+        if (*n > kMaxRegexRepeat) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// parses the inside of [...] into the last set
+bool RegexMatcher::ParseClass(int setIdx) {
+    bool negate = *s == '^';
+    if (negate) {
+        s++;
+    }
+    bool first = true;
+    while (*s && (*s != ']' || first)) {
+        first = false;
+        int lo = *s++;
+        if (lo == '\\') {
+            WCHAR c = *s++;
+            if (c == 'd' || c == 'w' || c == 's') {
+                ParseEscape(c, true);
+                continue;
+            }
+            if (c == 'D' || c == 'W' || c == 'S') {
+                // negated classes inside classes would need set operations
+                return false;
+            }
+            if (c == 't' || c == 'n' || c == 'r') {
+                lo = c == 't' ? '\t' : c == 'n' ? '\n' : '\r';
+            } else if (!c) {
+                return false;
+            } else {
+                lo = c;
+            }
+        }
+        int hi = lo;
+        if (s[0] == '-' && s[1] && s[1] != ']') {
+            s++;
+            hi = *s++;
+            if (hi == '\\') {
+                hi = *s++;
+                if (!hi) {
+                    return false;
+                }
+            }
+            if (hi < lo) {
+                return false;
+            }
+        }
+        if (lowerCase && lo == hi) {
+            lo = hi = ToLowerChar((WCHAR)lo);
+        }
+        AddRange(lo, hi);
+    }
+    if (*s != ']') {
+        return false;
+    }
+    s++;
+    NormalizeSet(setIdx, negate);
+    return true;
+}
+
+// returns -1 on error
+int RegexMatcher::ParseAtom() {
+    WCHAR c = *s;
+    if (c == '(') {
+        s++;
+        if (s[0] == '?' && s[1] == ':') {
+            s += 2;
+        }
+        int node = ParseAlt();
+        if (node < 0 || *s != ')') {
+            return -1;
+        }
+        s++;
+        return node;
+    }
+    if (!c || c == ')' || c == '|' || c == '*' || c == '+' || c == '?' || c == '{') {
+        return -1;
+    }
+    int setIdx = AddSet();
+    int node = AddNode(ReKind::Set);
+    nodes[node].set = setIdx;
+    s++;
+    if (c == '[') {
+        return ParseClass(setIdx) ? node : -1;
+    }
+    if (c == '.') {
+        AddRange(0, kCharCount - 1);
+    } else if (c == '\\') {
+        WCHAR e = *s++;
+        bool negate = e == 'D' || e == 'W' || e == 'S';
+        if (negate) {
+            e = (WCHAR)(e - 'A' + 'a');
+        }
+        if (!ParseEscape(e, false)) {
+            return -1;
+        }
+        NormalizeSet(setIdx, negate);
+        return node;
+    } else {
+        if (lowerCase) {
+            c = ToLowerChar(c);
+        }
+        AddRange(c, c);
+    }
+    NormalizeSet(setIdx, false);
+    return node;
+}
+
+int RegexMatcher::ParseRepeat() {
+    int node = ParseAtom();
+    while (node >= 0) {
+        int min, max;
+        WCHAR c = *s;
+        if (c == '*') {
+            min = 0;
+            max = -1;
+        } else if (c == '+') {
+            min = 1;
+            max = -1;
+        } else if (c == '?') {
+            min = 0;
+            max = 1;
+        } else if (c == '{') {
+            s++;
+            if (!ParseInt(&min)) {
+                return -1;
+            }
+            max = min;
+            if (*s == ',') {
+                s++;
+                max = -1;
+                if (*s != '}' && (!ParseInt(&max) || max < min)) {
+                    return -1;
+                }
+            }
+            if (*s != '}') {
+                return -1;
+            }
+        } else {
+            break;
+        }
+        s++;
+        node = AddNode(ReKind::Repeat, node);
+        nodes[node].min = min;
+        nodes[node].max = max;
+    }
+    return node;
+}
+
+int RegexMatcher::ParseConcat() {
+    int node = AddNode(ReKind::Empty);
+    while (*s && *s != '|' && *s != ')') {
+        int next = ParseRepeat();
+        if (next < 0) {
+            return -1;
+        }
+        node = AddNode(ReKind::Concat, node, next);
+    }
+    return node;
+}
+
+int RegexMatcher::ParseAlt() {
+    int node = ParseConcat();
+    while (node >= 0 && *s == '|') {
+        s++;
+        int next = ParseConcat();
+        if (next < 0) {
+            return -1;
+        }
+        node = AddNode(ReKind::Alt, node, next);
+    }
+    return node;
+}
+
+void RegexMatcher::BuildCharClasses() {
+    // a class starts at every character where some set starts or ends
+    Vec<bool> isStart;
+    isStart.AppendBlanks(kCharCount);
+    isStart[0] = true;
+    for (CharRange& r : ranges) {
+        isStart[r.lo] = true;
+        if (r.hi + 1 < kCharCount) {
+            isStart[r.hi + 1] = true;
+        }
+    }
+    nClasses = 0;
+    for (int c = 0; c < kCharCount; c++) {
+        if (isStart[c]) {
+            nClasses++;
+        }
+        charClass[c] = (u16)(nClasses - 1);
+    }
+    setHas.AppendBlanks((size_t)sets.Size() * nClasses);
+    for (int i = 0; i < sets.Size(); i++) {
+        CharSet& cs = sets[i];
+        for (int j = 0; j < cs.count; j++) {
+            CharRange& r = ranges[cs.first + j];
+            for (int c = charClass[r.lo]; c <= charClass[r.hi]; c++) {
+                setHas[i * nClasses + c] = true;
+            }
+        }
+    }
+}
+
+int RegexMatcher::AddNfa(NfaKind kind, int out, int out1) {
+    NfaState st;
+    st.kind = kind;
+    st.out = out;
+    st.out1 = out1;
+    nfa.Append(st);
+    return nfa.Size() - 1;
+}
+
+// compiles node so that it continues with the nfa state next
+// returns the first state or -1 if the nfa got too big
+int RegexMatcher::CompileNode(int nodeIdx, int next) {
+    if (next < 0 || nfa.Size() > kMaxNfaStates) {
+        return -1;
+    }
+    ReNode n = nodes[nodeIdx];
+    switch (n.kind) {
+        case ReKind::Empty:
+            return next;
+        case ReKind::Set: {
+            int st = AddNfa(NfaKind::Set, next);
+            nfa[st].set = n.set;
+            return st;
+        }
+        case ReKind::Concat:
+            return CompileNode(n.a, CompileNode(n.b, next));
+        case ReKind::Alt: {
+            int a = CompileNode(n.a, next);
+            int b = CompileNode(n.b, next);
+            if (a < 0 || b < 0) {
+                return -1;
+            }
+            return AddNfa(NfaKind::Split, a, b);
+        }
+        case ReKind::Repeat: {
+            int st = next;
+            if (n.max < 0) {
+                int split = AddNfa(NfaKind::Split, -1, next);
+                int body = CompileNode(n.a, split);
+                nfa[split].out = body;
+                st = body < 0 ? -1 : split;
+            } else {
+                for (int i = n.min; i < n.max && st >= 0; i++) {
+                    int body = CompileNode(n.a, st);
+                    st = body < 0 ? -1 : AddNfa(NfaKind::Split, body, next);
+                }
+            }
+            for (int i = 0; i < n.min && st >= 0; i++) {
+                st = CompileNode(n.a, st);
+            }
+            return st;
+        }
+    }
+    return -1;
+}
+
+bool RegexMatcher::Compile(const WCHAR* src, bool lower) {
+    re = src;
+    s = src;
+    lowerCase = lower;
+    charClass = AllocArray<u16>(kCharCount);
+    if (!charClass) {
+        return false;
+    }
+
+    // top-level alternatives are separate terms
+    Vec<int> branches;
+    while (true) {
+        const WCHAR* start = s;
+        int node = ParseConcat();
+        if (node < 0) {
+            return false;
+        }
+        branches.Append(node);
+        terms.Append(str::Dup(start, s - start));
+        if (*s != '|') {
+            break;
+        }
+        s++;
+    }
+    if (*s) {
+        // unbalanced ')'
+        return false;
+    }
+    BuildCharClasses();
+
+    int nBranches = branches.Size();
+    Vec<int> starts;
+    for (int i = 0; i < nBranches; i++) {
+        int match = AddNfa(NfaKind::Match);
+        nfa[match].term = i;
+        int st = CompileNode(branches[i], match);
+        if (st < 0) {
+            return false;
+        }
+        starts.Append(st);
+    }
+    nfaStart = starts.Last();
+    for (int i = nBranches - 2; i >= 0; i--) {
+        nfaStart = AddNfa(NfaKind::Split, starts[i], nfaStart);
+    }
+    closureMark.AppendBlanks(nfa.Size());
+    ResetDfa();
+    return true;
+}
+
+// adds st and all states reachable from it without consuming a character to tmpSet
+void RegexMatcher::AddClosure(int st) {
+    stack.Append(st);
+    while (stack.Size() > 0) {
+        st = stack.Pop();
+        if (closureMark[st] == closureGen) {
+            continue;
+        }
+        closureMark[st] = closureGen;
+        NfaState& ns = nfa[st];
+        if (ns.kind == NfaKind::Split) {
+            stack.Append(ns.out1);
+            stack.Append(ns.out);
+        } else {
+            tmpSet.Append(st);
+        }
+    }
+}
+
+static int CmpInt(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+// returns the dfa state for the nfa states in tmpSet, -1 if there are too many
+int RegexMatcher::FindOrAddDfaState() {
+    tmpSet.Sort(CmpInt);
+    int n = tmpSet.Size();
+    u32 hash = 0;
+    for (int st : tmpSet) {
+        hash = hash * 31 + (u32)st;
+    }
+    int slot = (int)(hash & (kDfaTableSize - 1));
+    for (; dfaTable[slot] != 0; slot = (slot + 1) & (kDfaTableSize - 1)) {
+        int i = dfaTable[slot] - 1;
+        DfaState& d = dfa[i];
+        if (d.hash == hash && d.count == n && memeq(dfaNfa.LendData() + d.first, tmpSet.LendData(), n * sizeof(int))) {
+            return i;
+        }
+    }
+    if (dfa.Size() >= kMaxDfaStates) {
+        return -1;
+    }
+    dfaTable[slot] = dfa.Size() + 1;
+    DfaState d;
+    d.first = dfaNfa.Size();
+    d.count = n;
+    d.hash = hash;
+    for (int st : tmpSet) {
+        NfaState& ns = nfa[st];
+        if (ns.kind == NfaKind::Match && (d.term < 0 || ns.term < d.term)) {
+            d.term = ns.term;
+        }
+    }
+    dfaNfa.Append(tmpSet);
+    dfa.Append(d);
+    for (int c = 0; c < nClasses; c++) {
+        dfaNext.Append(-1);
+    }
+    return dfa.Size() - 1;
+}
+
+// throws away all dfa states except the dead and the start state
+void RegexMatcher::ResetDfa() {
+    dfa.Reset();
+    dfaNfa.Reset();
+    dfaNext.Reset();
+    dfaTable.Reset();
+    dfaTable.AppendBlanks(kDfaTableSize);
+    tmpSet.Reset();
+    FindOrAddDfaState();
+    closureGen++;
+    AddClosure(nfaStart);
+    FindOrAddDfaState();
+}
+
+// returns -1 if the state cache is full
+int RegexMatcher::Step(int d, int c) {
+    int next = dfaNext[d * nClasses + c];
+    if (next >= 0) {
+        return next;
+    }
+    tmpSet.Reset();
+    closureGen++;
+    DfaState ds = dfa[d];
+    for (int i = 0; i < ds.count; i++) {
+        NfaState& ns = nfa[dfaNfa[ds.first + i]];
+        if (ns.kind == NfaKind::Set && setHas[ns.set * nClasses + c]) {
+            AddClosure(ns.out);
+        }
+    }
+    next = FindOrAddDfaState();
+    if (next >= 0) {
+        dfaNext[d * nClasses + c] = next;
+    }
+    return next;
+}
+
+// returns the end of the longest non-empty match starting at start or -1
+int RegexMatcher::MatchAt(const WCHAR* text, int len, int start, int* termOut) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int end = -1;
+        int d = 1;
+        int i;
+        for (i = start; i < len; i++) {
+            d = Step(d, charClass[text[i]]);
+            if (d <= 0) {
+                break;
+            }
+            if (dfa[d].term >= 0) {
+                end = i + 1;
+                *termOut = dfa[d].term;
+            }
+        }
+        if (d >= 0) {
+            return end;
+        }
+        // out of dfa states, start over with an empty cache
+        ResetDfa();
+    }
+    return -1;
+}
+
+void RegexMatcher::FindAll(const WCHAR* text, int len, Vec<PatternMatch>& matches) {
+    int i = 0;
+    while (i < len) {
+        // quickly skip characters that can't start a match
+        if (Step(1, charClass[text[i]]) == 0) {
+            i++;
+            continue;
+        }
+        PatternMatch m;
+        int end = MatchAt(text, len, i, &m.term);
+        if (end <= i) {
+            i++;
+            continue;
+        }
+        m.start = i;
+        m.end = end;
+        matches.Append(m);
+        i = end;
+    }
+}
+
+PatternMatcher* NewRegexMatcher(const WCHAR* re, bool lowerCase) {
+    RegexMatcher* m = new RegexMatcher();
+    if (!m->Compile(re, lowerCase)) {
+        delete m;
+        return nullptr;
+    }
+    return m;
+}
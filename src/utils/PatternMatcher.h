@@ -0,0 +1,43 @@
+/* Copyright 2024 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+// Finds the occurrences of several search terms in a single pass over the text.
+// Literal terms are matched with an Aho-Corasick automaton, regular expressions
+// with a DFA that is built lazily from the expression's NFA.
+//
+// Supported regular expression syntax:
+//   c         literal character (including ^ and $)
+//   \c        escaped special character, \t, \n, \r
+//   \d \w \s  digit, word character, whitespace (\D \W \S for the opposite)
+//   .         any character
+//   [a-z]     character class, [^a-z] for a negated class
+//   xy x|y    concatenation, alternation
+//   (x) (?:x) grouping
+//   x* x+ x? x{n} x{n,} x{n,m}  repetition
+//
+// Matches are leftmost-longest and don't overlap. Each alternative at the top
+// level of a regular expression counts as a separate term.
+
+struct PatternMatch {
+    // index of the matched term
+    int term = 0;
+    // offsets into the text, end is exclusive
+    int start = 0;
+    int end = 0;
+};
+
+struct PatternMatcher {
+    virtual ~PatternMatcher() = default;
+    virtual int TermCount() const = 0;
+    // the term as given (or the source of a top-level alternative)
+    virtual const WCHAR* Term(int idx) const = 0;
+    // appends all matches in s (which doesn't have to be zero-terminated)
+    virtual void FindAll(const WCHAR* s, int len, Vec<PatternMatch>& matches) = 0;
+};
+
+// returns nullptr if there are no terms or a term is empty
+PatternMatcher* NewTermsMatcher(const WCHAR** terms, int nTerms);
+// returns nullptr for invalid expressions. if lowerCase is true, the text is
+// expected to be lower-cased and so letters in the expression match their
+// lower-case version
+PatternMatcher* NewRegexMatcher(const WCHAR* re, bool lowerCase);
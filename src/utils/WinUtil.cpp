@@ -2263,6 +2263,92 @@ ByteSlice SerializeBitmap(HBITMAP hbmp) {
     return {(u8*)bmpData, bmpBytes};
 }
 
+// Run-length encoding of 32-bit pixels which is fast enough to be used instead
+// of rendering again (rendered pages are mostly runs of the background color).
+// The data is a sequence of u32 counts n, each followed either by n pixels or,
+// if the high bit of n is set, by a single pixel repeated (n & 0x7FFFFFFF) times
+constexpr u32 kRleRunBit = 0x80000000;
+// shorter runs take less space as part of a literal
+constexpr size_t kRleMinRun = 3;
+
+ByteSlice RleEncodePixels(const u32* pixels, size_t nPixels) {
+    if (nPixels == 0 || nPixels >= kRleRunBit) {
+        return {};
+    }
+    // a run takes at most as many u32 (including the count of the preceding
+    // literal) as it has pixels, so the only overhead is the count of the last literal
+    u32* res = AllocArray<u32>(nPixels + 1);
+    if (!res) {
+        return {};
+    }
+    u32* dst = res;
+    size_t litStart = 0;
+    size_t i = 0;
+    while (i < nPixels) {
+        u32 c = pixels[i];
+        size_t end = i + 1;
+        while (end < nPixels && pixels[end] == c) {
+            end++;
+        }
+        if (end - i >= kRleMinRun) {
+            if (i > litStart) {
+                *dst++ = (u32)(i - litStart);
+                memcpy(dst, pixels + litStart, (i - litStart) * sizeof(u32));
+                dst += i - litStart;
+            }
+            *dst++ = kRleRunBit | (u32)(end - i);
+            *dst++ = c;
+            litStart = end;
+        }
+        i = end;
+    }
+    if (nPixels > litStart) {
+        *dst++ = (u32)(nPixels - litStart);
+        memcpy(dst, pixels + litStart, (nPixels - litStart) * sizeof(u32));
+        dst += nPixels - litStart;
+    }
+    size_t size = (dst - res) * sizeof(u32);
+    // free the unused part of the worst case allocation
+    u8* d = (u8*)realloc(res, size);
+    if (!d) {
+        d = (u8*)res;
+    }
+    return {d, size};
+}
+
+// returns false if d is corrupted or doesn't decode to exactly nPixels pixels
+bool RleDecodePixels(const ByteSlice& d, u32* pixels, size_t nPixels) {
+    const u32* src = (const u32*)d.data();
+    size_t srcLen = d.size() / sizeof(u32);
+    size_t i = 0;
+    size_t n = 0;
+    while (i < srcLen) {
+        u32 count = src[i++];
+        size_t len = count & ~kRleRunBit;
+        if (len > nPixels - n) {
+            return false;
+        }
+        if (count & kRleRunBit) {
+            if (i >= srcLen) {
+                return false;
+            }
+            u32 c = src[i++];
+            u32* dst = pixels + n;
+            for (size_t k = 0; k < len; k++) {
+                dst[k] = c;
+            }
+        } else {
+            if (len > srcLen - i) {
+                return false;
+            }
+            memcpy(pixels + n, src + i, len * sizeof(u32));
+            i += len;
+        }
+        n += len;
+    }
+    return n == nPixels;
+}
+
 HBITMAP CreateMemoryBitmap(Size size, HANDLE* hDataMapping) {
     BITMAPINFO bmi{};
     bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
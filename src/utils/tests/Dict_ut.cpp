@@ -77,6 +77,45 @@ void DictTestMapStrToInt() {
     toRemove.FreeMembers();
 }
 
+void DictTestMapPtrToInt() {
+    dict::MapPtrToInt d(4); // start small so that we can test resizing
+    bool ok;
+    int val;
+
+    utassert(0 == d.Count());
+    ok = d.Get(&val, &val);
+    utassert(!ok);
+    ok = d.Remove(&val, nullptr);
+    utassert(!ok);
+
+    ok = d.Insert(&val, 5);
+    utassert(ok);
+    utassert(1 == d.Count());
+    ok = d.Insert(&val, 8, &val);
+    utassert(!ok);
+    utassert(val == 5);
+    ok = d.Get(&ok, &val);
+    utassert(!ok);
+
+    // keys are never dereferenced so any value works
+    char* base = (char*)16;
+    for (int i = 0; i < 1024; i++) {
+        ok = d.Insert(base + i * 8, i);
+        utassert(ok);
+    }
+    utassert(1025 == d.Count());
+    for (int i = 0; i < 1024; i++) {
+        ok = d.Get(base + i * 8, &val);
+        utassert(ok);
+        utassert(i == val);
+        ok = d.Remove(base + i * 8, &val);
+        utassert(ok);
+        utassert(i == val);
+    }
+    utassert(1 == d.Count());
+}
+
 void DictTest() {
     DictTestMapStrToInt();
+    DictTestMapPtrToInt();
 }
@@ -0,0 +1,74 @@
+/* Copyright 2024 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+#include "utils/PatternMatcher.h"
+
+// must be last due to assert() over-write
+#include "utils/UtAssert.h"
+
+// expected is a list of "term:start-end" separated by spaces
+static void CheckMatches(PatternMatcher* m, const WCHAR* s, const char* expected) {
+    utassert(m != nullptr);
+    if (!m) {
+        return;
+    }
+    Vec<PatternMatch> matches;
+    m->FindAll(s, str::Leni(s), matches);
+    str::Str got;
+    for (PatternMatch& pm : matches) {
+        if (got.size() > 0) {
+            got.AppendChar(' ');
+        }
+        got.AppendFmt("%d:%d-%d", pm.term, pm.start, pm.end);
+    }
+    utassert(str::Eq(got.Get(), expected));
+    delete m;
+}
+
+static void TermsMatcherTest() {
+    const WCHAR* terms[] = {L"he", L"she", L"his", L"hers"};
+    CheckMatches(NewTermsMatcher(terms, dimofi(terms)), L"ushers and his hershe", "1:1-4 2:11-14 3:15-19 0:19-21");
+    CheckMatches(NewTermsMatcher(terms, dimofi(terms)), L"nothing", "");
+
+    // overlapping terms: the leftmost, then the longest one wins
+    const WCHAR* terms2[] = {L"ab", L"abc", L"bcd"};
+    CheckMatches(NewTermsMatcher(terms2, dimofi(terms2)), L"abcd bcd", "1:0-3 2:5-8");
+
+    PatternMatcher* m = NewTermsMatcher(terms2, dimofi(terms2));
+    utassert(m->TermCount() == 3);
+    utassert(str::Eq(m->Term(2), L"bcd"));
+    delete m;
+
+    const WCHAR* empty[] = {L"a", L""};
+    utassert(!NewTermsMatcher(empty, dimofi(empty)));
+    utassert(!NewTermsMatcher(terms, 0));
+}
+
+static void RegexMatcherTest() {
+    CheckMatches(NewRegexMatcher(L"\\d+|foo(bar)?", false), L"a 123 foobar foo 7x", "0:2-5 1:6-12 1:13-16 0:17-18");
+    CheckMatches(NewRegexMatcher(L"[A-C]x{2,3}", true), L"axx bxxxx cx dxx", "0:0-3 0:4-8");
+    CheckMatches(NewRegexMatcher(L"a.*b", false), L"xaxxbxxbyy", "0:1-8");
+    CheckMatches(NewRegexMatcher(L"[^a-z ]+", false), L"abc DEF1 g", "0:4-8");
+    CheckMatches(NewRegexMatcher(L"\\w+@\\w+\\.com", false), L"mail bob@ex.com now", "0:5-15");
+    CheckMatches(NewRegexMatcher(L"(?:a|b)*c?", false), L"abba d c", "0:0-4 0:7-8");
+    CheckMatches(NewRegexMatcher(L"colou?r", false), L"color colour colouur", "0:0-5 0:6-12");
+
+    // expressions with a large number of dfa states
+    CheckMatches(NewRegexMatcher(L"(a|b)*a(a|b){12}", false), L"bbbbbbbbbbbbbbbb", "");
+
+    PatternMatcher* m = NewRegexMatcher(L"one|t(wo|hree)", false);
+    utassert(m->TermCount() == 2);
+    utassert(str::Eq(m->Term(1), L"t(wo|hree)"));
+    delete m;
+
+    const WCHAR* invalid[] = {L"(ab", L"a)", L"*a", L"a{3,2}", L"[a-", L"\\q", L"x{2000}"};
+    for (const WCHAR* re : invalid) {
+        utassert(!NewRegexMatcher(re, false));
+    }
+}
+
+void PatternMatcherTest() {
+    TermsMatcherTest();
+    RegexMatcherTest();
+}
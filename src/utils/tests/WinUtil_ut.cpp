@@ -43,6 +43,34 @@ void WinUtilTest() {
         utassert(allScreens.Intersect(oneScreen) == oneScreen);
     }
 
+    {
+        u32 pixels[] = {1, 1, 1, 1, 2, 3, 3, 4, 4, 4, 5};
+        size_t n = dimof(pixels);
+        ByteSlice d = RleEncodePixels(pixels, n);
+        utassert(d.size() == 10 * sizeof(u32));
+        u32 decoded[dimof(pixels)]{};
+        utassert(RleDecodePixels(d, decoded, n));
+        utassert(memeq(pixels, decoded, sizeof(pixels)));
+        utassert(!RleDecodePixels(d, decoded, n - 1));
+        ByteSlice truncated = {d.data(), d.size() - sizeof(u32)};
+        utassert(!RleDecodePixels(truncated, decoded, n));
+        d.Free();
+    }
+
+    {
+        // no runs at all is the worst case
+        u32 pixels[100];
+        for (size_t i = 0; i < dimof(pixels); i++) {
+            pixels[i] = (u32)i;
+        }
+        ByteSlice d = RleEncodePixels(pixels, dimof(pixels));
+        utassert(d.size() == (dimof(pixels) + 1) * sizeof(u32));
+        u32 decoded[dimof(pixels)]{};
+        utassert(RleDecodePixels(d, decoded, dimof(pixels)));
+        utassert(memeq(pixels, decoded, sizeof(pixels)));
+        d.Free();
+    }
+
     // TODO: moved AdjustLigthness() to Colors.[h|cpp] which is outside of utils directory
 #if 0
     {